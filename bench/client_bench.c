@@ -0,0 +1,419 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud.h>
+#include <sensorcloud/engine.h>
+#include <sensorcloud/ingest.h>
+#include <sensorcloud/multi_buffer.h>
+#include <sensorcloud/retry.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Uploads through the whole client stack against the loopback driver.
+ * Virtual latency is deterministic for a given config, host time measures the cost of the client itself.
+ */
+
+#define BENCH_POINTS 100
+
+typedef struct
+{
+    const char* name;
+    size_t minRead;
+    size_t maxRead;
+    uint8_t chunked;
+} BenchScenario;
+
+typedef struct
+{
+    SensorCloud sensorCloud;
+    SensorCloudPointBuffer points;
+    char pointData[16 + 12 * BENCH_POINTS];
+    size_t uploadsLeft;
+    size_t failures;
+    uint64_t uploadStart;
+    uint64_t latencyTotal;
+    uint64_t latencyMax;
+} BenchState;
+
+static double bench_hostSeconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void bench_upload(BenchState* state);
+
+static void bench_uploadCallback(void* userData, SensorCloudError error)
+{
+    BenchState* state = (BenchState*)userData;
+    if(error != sensorCloud_ok)
+        ++state->failures;
+
+    uint64_t latency = loopback_now() - state->uploadStart;
+    state->latencyTotal += latency;
+    if(latency > state->latencyMax)
+        state->latencyMax = latency;
+
+    if(--state->uploadsLeft > 0)
+        bench_upload(state);
+}
+
+static void bench_upload(BenchState* state)
+{
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&state->points, state->pointData, sizeof(state->pointData), rate);
+    size_t i = 0;
+    for(; i < BENCH_POINTS; ++i)
+        sensorCloud_addPoint(&state->points, i, (float)i);
+
+    state->uploadStart = loopback_now();
+    sensorCloud_asyncUploadData(&state->sensorCloud, "sensor", "channel", &state->points, bench_uploadCallback);
+}
+
+static void bench_run(const BenchScenario* scenario, size_t uploads)
+{
+    static const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+    static const char createdChunked[] = "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n";
+
+    LoopbackConfig config;
+    loopback_defaultConfig(&config);
+    config.minRead = scenario->minRead;
+    config.maxRead = scenario->maxRead;
+    config.connectLatency = 30000;
+    config.writeLatency = 100;
+    config.responseLatency = 20000;
+    config.readLatency = 10;
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", scenario->chunked);
+    if(scenario->chunked)
+        loopback_setDefaultResponse(createdChunked, sizeof(createdChunked) - 1);
+    else
+        loopback_setDefaultResponse(created, sizeof(created) - 1);
+
+    BenchState* state = (BenchState*)calloc(1, sizeof(BenchState));
+    sensorCloud_init(&state->sensorCloud, "device", "key", state);
+    state->uploadsLeft = uploads;
+
+    double start = bench_hostSeconds();
+    bench_upload(state);
+    loopback_run();
+    double elapsed = bench_hostSeconds() - start;
+
+    LoopbackStats stats = loopback_stats();
+    printf("%-24s %8zu %10.0f %10.2f %12.1f %12llu %8u %6zu\n", scenario->name, uploads,
+        uploads / elapsed, stats.bytesOut / elapsed / 1e6, (double)state->latencyTotal / uploads,
+        (unsigned long long)state->latencyMax, stats.reads, state->failures);
+    free(state);
+}
+
+typedef struct
+{
+    SensorCloudSubmission submission;
+    SensorCloudPointBuffer points;
+    char pointData[16 + 12 * BENCH_POINTS];
+    uint64_t start;
+} BenchUpload;
+
+typedef struct
+{
+    SensorCloudEngine engine;
+    size_t uploadsLeft;
+    size_t failures;
+    uint64_t latencyTotal;
+    uint64_t latencyMax;
+} BenchEngineState;
+
+static void bench_engineSubmit(BenchEngineState* state, BenchUpload* upload)
+{
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&upload->points, upload->pointData, sizeof(upload->pointData), rate);
+    size_t i = 0;
+    for(; i < BENCH_POINTS; ++i)
+        sensorCloud_addPoint(&upload->points, i, (float)i);
+
+    --state->uploadsLeft;
+    upload->start = loopback_now();
+    sensorCloudEngine_initSubmission(&upload->submission, "sensor", "channel", &upload->points, upload);
+    sensorCloudEngine_submit(&state->engine, &upload->submission);
+}
+
+static void bench_engineCallback(void* userData, SensorCloudSubmission* submission)
+{
+    BenchEngineState* state = (BenchEngineState*)userData;
+    BenchUpload* upload = (BenchUpload*)submission->userData;
+    if(submission->error != sensorCloud_ok)
+        ++state->failures;
+
+    uint64_t latency = loopback_now() - upload->start;
+    state->latencyTotal += latency;
+    if(latency > state->latencyMax)
+        state->latencyMax = latency;
+
+    if(state->uploadsLeft > 0)
+        bench_engineSubmit(state, upload);
+}
+
+// hangupPercent of the uploads find the peer hanging up on them, retried if retry isn't NULL
+static void bench_runEngine(size_t slotCount, size_t uploads, uint8_t hangupPercent, SensorCloudRetry* retry)
+{
+    static const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+
+    LoopbackConfig config;
+    loopback_defaultConfig(&config);
+    config.connectLatency = 30000;
+    config.writeLatency = 100;
+    config.responseLatency = 20000;
+    config.readLatency = 10;
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", NULL);
+    BenchEngineState state;
+    memset(&state, 0, sizeof(state));
+    state.uploadsLeft = uploads;
+    SensorCloudEngineSlot* slots = (SensorCloudEngineSlot*)calloc(slotCount, sizeof(SensorCloudEngineSlot));
+    BenchUpload* inFlight = (BenchUpload*)calloc(slotCount, sizeof(BenchUpload));
+    sensorCloudEngine_init(&state.engine, &sensorCloud, slots, slotCount, bench_engineCallback, &state);
+    sensorCloudEngine_setRetry(&state.engine, retry);
+
+    // keep one upload per slot submitted, each completion submits the next
+    double start = bench_hostSeconds();
+    size_t i = 0;
+    for(; i < slotCount && state.uploadsLeft > 0; ++i)
+        bench_engineSubmit(&state, &inFlight[i]);
+    // the authentication request is already out, only uploads are hung up on
+    loopback_setHangupPercent(hangupPercent);
+    loopback_run();
+    double elapsed = bench_hostSeconds() - start;
+
+    char name[32];
+    if(hangupPercent)
+        sprintf(name, "engine/%zu %u%% %s", slotCount, hangupPercent, retry ? "retry" : "drop");
+    else
+        sprintf(name, "engine/%zu slots", slotCount);
+    LoopbackStats stats = loopback_stats();
+    printf("%-24s %8zu %10.0f %10.2f %12.1f %12llu %8u %6zu  virtual %.3fs\n", name, uploads,
+        uploads / elapsed, stats.bytesOut / elapsed / 1e6, (double)state.latencyTotal / uploads,
+        (unsigned long long)state.latencyMax, stats.reads, state.failures, loopback_now() / 1e6);
+    sensorCloudEngine_destroy(&state.engine);
+    free(inFlight);
+    free(slots);
+}
+
+#define BENCH_CHANNELS 12
+
+// encode the same samples of 12 channels a point buffer at a time and through a multi-channel buffer
+static void bench_runEncode(size_t rounds)
+{
+    static Timestamp times[BENCH_POINTS];
+    static float values[BENCH_CHANNELS * BENCH_POINTS];
+    static char pointData[BENCH_CHANNELS][16 + 12 * BENCH_POINTS];
+    SensorCloudPointBuffer points[BENCH_CHANNELS];
+    SensorCloudSampleRate rate = {100, sensorCloud_hertz};
+    SensorCloudMultiBuffer buffer;
+    sensorCloudMultiBuffer_init(&buffer, rate, BENCH_CHANNELS, times, values, BENCH_POINTS);
+    size_t i = 0;
+    size_t c;
+    for(; i < BENCH_POINTS; ++i)
+    {
+        float sample[BENCH_CHANNELS];
+        for(c = 0; c < BENCH_CHANNELS; ++c)
+            sample[c] = (float)(i * c);
+        sensorCloudMultiBuffer_append(&buffer, 1000000 + i, sample);
+    }
+
+    double start = bench_hostSeconds();
+    size_t round = 0;
+    for(; round < rounds; ++round)
+    {
+        for(c = 0; c < BENCH_CHANNELS; ++c)
+        {
+            sensorCloud_initPointBuffer(&points[c], pointData[c], sizeof(pointData[c]), rate);
+            for(i = 0; i < BENCH_POINTS; ++i)
+                sensorCloud_addPoint(&points[c], times[i], values[c * BENCH_POINTS + i]);
+            sensorCloud_finishPointBuffer(&points[c]);
+        }
+    }
+    double perChannel = bench_hostSeconds() - start;
+
+    start = bench_hostSeconds();
+    for(round = 0; round < rounds; ++round)
+        sensorCloudMultiBuffer_encode(&buffer, points);
+    double columnar = bench_hostSeconds() - start;
+
+    double samples = (double)rounds * BENCH_POINTS;
+    printf("%-24s %8zu %10.0f samples/s\n", "encode/per-channel", rounds, samples / perChannel);
+    printf("%-24s %8zu %10.0f samples/s\n", "encode/columnar", rounds, samples / columnar);
+}
+
+#define BENCH_PRODUCERS 32
+#define BENCH_INGEST_BATCHES 4
+// room for every point a drain can bring on top of what is left after the previous one
+#define BENCH_INGEST_POINTS (2 * BENCH_PRODUCERS * BENCH_INGEST_BATCHES * SENSORCLOUD_INGEST_BATCH)
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    SensorCloudPointBuffer points[BENCH_CHANNELS];
+    SensorCloudIngestQueue queue;
+    SensorCloudIngestProducer producers[BENCH_PRODUCERS];
+    SensorCloudIngestBatch batches[BENCH_PRODUCERS][BENCH_INGEST_BATCHES];
+    size_t pointsPerProducer;
+} BenchIngestState;
+
+typedef struct
+{
+    BenchIngestState* state;
+    size_t index;
+} BenchProducer;
+
+static char bench_ingestData[BENCH_CHANNELS][16 + 12 * BENCH_INGEST_POINTS];
+
+// start the point buffer over once it is half full, standing in for handing it to the engine
+static void bench_ingestRecycle(SensorCloudPointBuffer* points, size_t channel)
+{
+    if(buffer_bytesAvailable(&points->data) < sizeof(bench_ingestData[channel]) / 2)
+    {
+        SensorCloudSampleRate rate = {100, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(points, bench_ingestData[channel], sizeof(bench_ingestData[channel]), rate);
+    }
+}
+
+// what the producers do today, one mutex around every point
+static void* bench_mutexProducer(void* userData)
+{
+    BenchProducer* producer = (BenchProducer*)userData;
+    BenchIngestState* state = producer->state;
+    size_t channel = producer->index % BENCH_CHANNELS;
+    size_t i = 0;
+    for(; i < state->pointsPerProducer; ++i)
+    {
+        pthread_mutex_lock(&state->mutex);
+        bench_ingestRecycle(&state->points[channel], channel);
+        sensorCloud_addPoint(&state->points[channel], i, (float)i);
+        pthread_mutex_unlock(&state->mutex);
+    }
+    return NULL;
+}
+
+static void* bench_queueProducer(void* userData)
+{
+    BenchProducer* producer = (BenchProducer*)userData;
+    BenchIngestState* state = producer->state;
+    SensorCloudIngestProducer* ingest = &state->producers[producer->index];
+    uint32_t channel = producer->index % BENCH_CHANNELS;
+    size_t i = 0;
+    while(i < state->pointsPerProducer)
+    {
+        if(sensorCloudIngest_put(ingest, channel, i, (float)i) == 0)
+            ++i;
+        else
+            sched_yield();
+    }
+    sensorCloudIngest_publish(ingest);
+    return NULL;
+}
+
+// the same number of points from a growing number of producer threads, through a mutex and through the queue
+static void bench_runIngest(size_t producerCount, size_t points)
+{
+    static BenchIngestState state;
+    SensorCloudPointBuffer* channels[BENCH_CHANNELS];
+    pthread_t threads[BENCH_PRODUCERS];
+    BenchProducer producers[BENCH_PRODUCERS];
+    SensorCloudSampleRate rate = {100, sensorCloud_hertz};
+    size_t c;
+    for(c = 0; c < BENCH_CHANNELS; ++c)
+    {
+        sensorCloud_initPointBuffer(&state.points[c], bench_ingestData[c], sizeof(bench_ingestData[c]), rate);
+        channels[c] = &state.points[c];
+    }
+    pthread_mutex_init(&state.mutex, NULL);
+    state.pointsPerProducer = points / producerCount;
+    size_t total = state.pointsPerProducer * producerCount;
+    size_t i;
+    for(i = 0; i < producerCount; ++i)
+    {
+        producers[i].state = &state;
+        producers[i].index = i;
+    }
+
+    double start = bench_hostSeconds();
+    for(i = 0; i < producerCount; ++i)
+        pthread_create(&threads[i], NULL, bench_mutexProducer, &producers[i]);
+    for(i = 0; i < producerCount; ++i)
+        pthread_join(threads[i], NULL);
+    double mutex = bench_hostSeconds() - start;
+    pthread_mutex_destroy(&state.mutex);
+
+    sensorCloudIngest_init(&state.queue);
+    for(i = 0; i < producerCount; ++i)
+        sensorCloudIngest_initProducer(&state.producers[i], &state.queue, state.batches[i], BENCH_INGEST_BATCHES);
+    uint64_t refused = 0;
+    start = bench_hostSeconds();
+    for(i = 0; i < producerCount; ++i)
+        pthread_create(&threads[i], NULL, bench_queueProducer, &producers[i]);
+    // this thread is the uploader
+    while(state.queue.drained + state.queue.dropped < total)
+    {
+        if(!sensorCloudIngest_drain(&state.queue, channels, BENCH_CHANNELS))
+            sched_yield();
+        for(c = 0; c < BENCH_CHANNELS; ++c)
+            bench_ingestRecycle(&state.points[c], c);
+    }
+    double queue = bench_hostSeconds() - start;
+    for(i = 0; i < producerCount; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        refused += state.producers[i].refused;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "ingest/%zu/mutex", producerCount);
+    printf("%-24s %8zu %10.0f points/s\n", name, total, total / mutex);
+    snprintf(name, sizeof(name), "ingest/%zu/queue", producerCount);
+    printf("%-24s %8zu %10.0f points/s %10llu refused %6llu dropped\n", name, total, total / queue,
+        (unsigned long long)refused, (unsigned long long)state.queue.dropped);
+}
+
+int main(int argc, char** argv)
+{
+    static const BenchScenario scenarios[] =
+    {
+        {"whole/content-length", 0, 0, 0},
+        {"whole/chunked", 0, 0, 1},
+        {"1-16/content-length", 1, 16, 0},
+        {"1-16/chunked", 1, 16, 1},
+        {"1/content-length", 1, 1, 0},
+        {"1/chunked", 1, 1, 1}
+    };
+
+    size_t uploads = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+    if(uploads == 0)
+        uploads = 1;
+
+    printf("%-24s %8s %10s %10s %12s %12s %8s %6s\n", "scenario", "uploads", "uploads/s", "MB/s out",
+        "mean us", "max us", "reads", "fail");
+    size_t i = 0;
+    for(; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i)
+        bench_run(&scenarios[i], uploads);
+
+    static const size_t slotCounts[] = {1, 4, 16};
+    for(i = 0; i < sizeof(slotCounts) / sizeof(slotCounts[0]); ++i)
+        bench_runEngine(slotCounts[i], uploads, 0, NULL);
+    // a flaky link, failed uploads are lost without retries and cost a backoff with them
+    SensorCloudRetry retry;
+    sensorCloudRetry_init(&retry, 0, 0, 1);
+    bench_runEngine(4, uploads, 10, NULL);
+    bench_runEngine(4, uploads, 10, &retry);
+    bench_runEncode(uploads);
+    for(i = 1; i <= BENCH_PRODUCERS; i *= 2)
+        bench_runIngest(i, uploads * BENCH_POINTS);
+    return 0;
+}
@@ -54,7 +54,9 @@ int ICACHE_FLASH_ATTR bufferSequence_compare(BufferSequence a, BufferSequence b,
         s -= compareLength;
         if(s == 0)
             return 0;
+        a.data += compareLength;
         a.length -= compareLength;
+        b.data += compareLength;
         b.length -= compareLength;
         if((a.length == 0 && !a.next) || (b.length == 0 && !b.next))
             // termination condition
@@ -0,0 +1,20 @@
+#include "crc.h"
+
+// a nibble at a time, small enough to keep in flash
+static const uint32_t crc32_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t ICACHE_FLASH_ATTR crc32_update(uint32_t crc, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc = ~crc;
+    size_t i = 0;
+    for(; i < size; ++i)
+    {
+        crc = crc32_table[(crc ^ bytes[i]) & 0x0f] ^ (crc >> 4);
+        crc = crc32_table[(crc ^ (bytes[i] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+    return ~crc;
+}
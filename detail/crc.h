@@ -0,0 +1,24 @@
+#ifndef DETAIL_CRC
+#define DETAIL_CRC
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Update a CRC-32 (IEEE 802.3, as used by zlib) with more data.
+ * @param[in]   crc     CRC of the data so far, 0 to start.
+ * @param[in]   data    Data to add.
+ * @param[in]   size    Number of bytes to add.
+ * @return CRC of the data so far including data.
+ */
+uint32_t crc32_update(uint32_t crc, const void* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
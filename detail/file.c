@@ -0,0 +1,90 @@
+#include "file.h"
+
+#ifndef SENSORCLOUD_NO_STDIO
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// make a rename in the directory of path durable
+static int file_syncDirectory(const char* path)
+{
+    char directory[256];
+    const char* slash = strrchr(path, '/');
+    if(!slash)
+        strcpy(directory, ".");
+    else if(slash == path)
+        strcpy(directory, "/");
+    else if((size_t)(slash - path) < sizeof(directory))
+    {
+        memcpy(directory, path, slash - path);
+        directory[slash - path] = '\0';
+    }
+    else
+        return 1;
+
+    int fd = open(directory, O_RDONLY);
+    if(fd < 0)
+        return 1;
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+int file_load(const char* path, int (*parse)(void*, Buffer*), void* context)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file) // nothing saved yet
+        return 0;
+
+    int result = 1;
+    char* data = NULL;
+    long size;
+    if(fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0)
+    {
+        data = (char*)malloc(size ? size : 1);
+        if(data && fread(data, 1, size, file) == (size_t)size)
+        {
+            Buffer buffer;
+            buffer_init(&buffer, data, size);
+            buffer_commit(&buffer, size);
+            result = parse(context, &buffer);
+        }
+    }
+    free(data);
+    fclose(file);
+    return result;
+}
+
+int file_save(const char* path, size_t maxSize, int (*serialize)(const void*, Buffer*), const void* context)
+{
+    char* data = (char*)malloc(maxSize ? maxSize : 1);
+    if(!data)
+        return 1;
+    Buffer buffer;
+    buffer_init(&buffer, data, maxSize);
+    int result = serialize(context, &buffer);
+
+    if(result == 0)
+    { // write next to the file and rename over it
+        char tempPath[256];
+        snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+        FILE* file = fopen(tempPath, "wb");
+        result = 1;
+        if(file)
+        {
+            // the data has to be on disk before the rename is, or a crash can leave an empty file behind
+            size_t written = fwrite(data, 1, buffer_size(&buffer), file);
+            int synced = fflush(file) == 0 && fsync(fileno(file)) == 0;
+            if(fclose(file) == 0 && synced && written == buffer_size(&buffer) && rename(tempPath, path) == 0)
+                result = file_syncDirectory(path);
+            else
+                remove(tempPath);
+        }
+    }
+    free(data);
+    return result;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef DETAIL_FILE
+#define DETAIL_FILE
+
+#include <buffer/buffer.h>
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Persistence of small state files for hosts with a filesystem, not built when SENSORCLOUD_NO_STDIO is defined.
+ */
+#ifndef SENSORCLOUD_NO_STDIO
+
+/**
+ * Read a whole file and hand it to a parser.
+ * @param[in]   path    File to read.
+ * @param[in]   parse   Called with the contents of the file, returns 0 if they were understood.
+ * @param[in]   context Passed to parse.
+ * @return 0 if the file was parsed or doesn't exist, not 0 if it couldn't be read or parsed.
+ */
+int file_load(const char* path, int (*parse)(void*, Buffer*), void* context);
+
+/**
+ * Replace a file with what a serializer writes, a crash never leaves half a file behind.
+ * @param[in]   path        File to write.
+ * @param[in]   maxSize     Most bytes serialize may write.
+ * @param[in]   serialize   Writes the contents of the file, returns 0 if they fit.
+ * @param[in]   context     Passed to serialize.
+ * @return 0 if the file was written, not 0 otherwise.
+ */
+int file_save(const char* path, size_t maxSize, int (*serialize)(const void*, Buffer*), const void* context);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
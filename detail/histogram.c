@@ -0,0 +1,85 @@
+#include "histogram.h"
+
+static size_t ICACHE_FLASH_ATTR histogram_index(uint64_t value)
+{
+    if(value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    unsigned exponent = 63 - __builtin_clzll(value);
+    if(exponent >= HISTOGRAM_MAX_EXPONENT)
+        return HISTOGRAM_BUCKETS - 1;
+    // the bits below the top one select the sub-bucket within the power of two
+    size_t sub = (size_t)(value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) - HISTOGRAM_SUB_BUCKETS;
+    return (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+static uint64_t ICACHE_FLASH_ATTR histogram_highestValue(size_t index)
+{
+    if(index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    unsigned exponent = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << (exponent - HISTOGRAM_SUB_BUCKET_BITS)) - 1;
+}
+
+void ICACHE_FLASH_ATTR histogram_init(Histogram* h)
+{
+    memset(h, 0, sizeof(Histogram));
+}
+
+void ICACHE_FLASH_ATTR histogram_record(Histogram* h, uint64_t value)
+{
+    ++h->counts[histogram_index(value)];
+    if(h->count == 0 || value < h->min)
+        h->min = value;
+    if(value > h->max)
+        h->max = value;
+    ++h->count;
+    h->total += value;
+}
+
+void ICACHE_FLASH_ATTR histogram_merge(Histogram* dest, const Histogram* src)
+{
+    if(src->count == 0)
+        return;
+
+    size_t i = 0;
+    for(; i < HISTOGRAM_BUCKETS; ++i)
+        dest->counts[i] += src->counts[i];
+    if(dest->count == 0 || src->min < dest->min)
+        dest->min = src->min;
+    if(src->max > dest->max)
+        dest->max = src->max;
+    dest->count += src->count;
+    dest->total += src->total;
+}
+
+uint64_t ICACHE_FLASH_ATTR histogram_percentile(const Histogram* h, double percentile)
+{
+    if(h->count == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+    if(target == 0)
+        target = 1;
+    uint64_t seen = 0;
+    size_t i = 0;
+    for(; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += h->counts[i];
+        if(seen >= target)
+        {
+            if(i == HISTOGRAM_BUCKETS - 1) // everything too big to bucket
+                return h->max;
+            uint64_t value = histogram_highestValue(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t ICACHE_FLASH_ATTR histogram_mean(const Histogram* h)
+{
+    return h->count ? h->total / h->count : 0;
+}
@@ -0,0 +1,76 @@
+#ifndef DETAIL_HISTOGRAM
+#define DETAIL_HISTOGRAM
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log2 of the linear sub-buckets per power of two, bounds the relative error of a recorded value to
+// 1/HISTOGRAM_SUB_BUCKETS. The defaults keep a histogram near 400 bytes, hosts with memory to spare can use 4 and 40
+// for 1/16 up to 2^40.
+#ifndef HISTOGRAM_SUB_BUCKET_BITS
+#define HISTOGRAM_SUB_BUCKET_BITS 2
+#endif
+// Values at or above 2^HISTOGRAM_MAX_EXPONENT are recorded in the last bucket, 2^27 microseconds is over 2 minutes.
+#ifndef HISTOGRAM_MAX_EXPONENT
+#define HISTOGRAM_MAX_EXPONENT 27
+#endif
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * A log-linear histogram of unsigned values in the style of an HDR histogram.
+ * Typically used for latencies in microseconds.
+ */
+typedef struct
+{
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+/**
+ * Initialize an empty histogram.
+ * @param[out]  h   Histogram to initialize.
+ */
+void histogram_init(Histogram* h);
+
+/**
+ * Record a value.
+ * @param[io]   h       Histogram to record in.
+ * @param[in]   value   Value to record.
+ */
+void histogram_record(Histogram* h, uint64_t value);
+
+/**
+ * Add all the values recorded in one histogram to another.
+ * @param[io]   dest    Histogram to add to.
+ * @param[in]   src     Histogram to add.
+ */
+void histogram_merge(Histogram* dest, const Histogram* src);
+
+/**
+ * Get the value at a percentile.
+ * @param[in]   h           Histogram to query.
+ * @param[in]   percentile  Percentile between 0 and 100.
+ * @return The highest value equivalent to the value at the percentile, 0 if nothing has been recorded.
+ */
+uint64_t histogram_percentile(const Histogram* h, double percentile);
+
+/**
+ * Get the mean of the recorded values.
+ * @param[in]   h   Histogram to query.
+ * @return Mean of the recorded values, 0 if nothing has been recorded.
+ */
+uint64_t histogram_mean(const Histogram* h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
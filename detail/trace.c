@@ -0,0 +1,59 @@
+#include "trace.h"
+
+#ifdef TRACE_RECORDER
+
+#include <net/driver.h>
+
+static TraceEvent* trace_events = NULL;
+static size_t trace_size = 0;
+static size_t trace_next = 0;
+static size_t trace_count = 0;
+static uint8_t trace_recording = 0;
+
+void trace_startRecording(TraceEvent* events, size_t size)
+{
+    trace_events = events;
+    trace_size = size;
+    trace_next = 0;
+    trace_count = 0;
+    trace_recording = size > 0;
+}
+
+void trace_stopRecording(void)
+{
+    trace_recording = 0;
+}
+
+void trace_record(char phase, const char* name, const void* id, int64_t value)
+{
+    if(!trace_recording)
+        return;
+
+    TraceEvent* e = &trace_events[trace_next];
+    e->time = net_time();
+    e->name = name;
+    e->id = id;
+    e->value = value;
+    e->phase = phase;
+    trace_next = (trace_next + 1) % trace_size;
+    if(trace_count < trace_size)
+        ++trace_count;
+}
+
+size_t trace_writeChromeJson(FILE* file)
+{
+    fprintf(file, "{\"traceEvents\":[");
+    size_t first = (trace_next + trace_size - trace_count) % (trace_size ? trace_size : 1);
+    size_t i = 0;
+    for(; i < trace_count; ++i)
+    {
+        const TraceEvent* e = &trace_events[(first + i) % trace_size];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"sensorcloud\",\"ph\":\"%c\",\"id\":\"%p\",\"ts\":%llu,"
+            "\"pid\":1,\"tid\":1,\"args\":{\"value\":%lld}}", i ? "," : "", e->name, e->phase, e->id,
+            (unsigned long long)e->time, (long long)e->value);
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return trace_count;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef DETAIL_TRACE
+#define DETAIL_TRACE
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Static tracepoints for perf, bpftrace and friends, under the "sensorcloud" provider.
+ * They compile to a nop when sys/sdt.h is available and to nothing otherwise, define TRACE_NO_USDT to leave them
+ * out regardless.
+ */
+#if !defined(TRACE_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_USDT 1
+#endif
+#endif
+
+#ifdef TRACE_USDT
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(sensorcloud, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(sensorcloud, name, a, b)
+#define TRACE_PROBE3(name, a, b, c) DTRACE_PROBE3(sensorcloud, name, a, b, c)
+#define TRACE_PROBE4(name, a, b, c, d) DTRACE_PROBE4(sensorcloud, name, a, b, c, d)
+#else
+#define TRACE_PROBE1(name, a) do {} while(0)
+#define TRACE_PROBE2(name, a, b) do {} while(0)
+#define TRACE_PROBE3(name, a, b, c) do {} while(0)
+#define TRACE_PROBE4(name, a, b, c, d) do {} while(0)
+#endif
+
+/*
+ * In-process recorder of async trace events that can be written out as Chrome trace-event JSON.
+ * Only built when TRACE_RECORDER is defined, the TRACE_BEGIN/END/INSTANT macros are empty otherwise.
+ */
+#ifdef TRACE_RECORDER
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint64_t time;
+    const char* name;
+    const void* id;
+    int64_t value;
+    char phase;
+} TraceEvent;
+
+/**
+ * Start recording events, the oldest events are overwritten once the storage is full.
+ * @param[in]   events  Storage for the recorded events.
+ * @param[in]   size    Number of events that fit in the storage.
+ */
+void trace_startRecording(TraceEvent* events, size_t size);
+
+/**
+ * Stop recording events, already recorded events are kept.
+ */
+void trace_stopRecording(void);
+
+/**
+ * Record an event.
+ * @param[in]   phase   Chrome trace phase, 'b' to begin, 'e' to end or 'n' for an instant.
+ * @param[in]   name    Name of the event, must outlive the recording.
+ * @param[in]   id      Identifies the object the event is about, begin and end events are matched by name and id.
+ * @param[in]   value   A value to show with the event.
+ */
+void trace_record(char phase, const char* name, const void* id, int64_t value);
+
+/**
+ * Write the recorded events as Chrome trace-event JSON, loadable by chrome://tracing or Perfetto.
+ * @param[in]   file    File to write to.
+ * @return Number of events written.
+ */
+size_t trace_writeChromeJson(FILE* file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define TRACE_BEGIN(name, id) trace_record('b', #name, id, 0)
+#define TRACE_END(name, id, value) trace_record('e', #name, id, (int64_t)(value))
+#define TRACE_INSTANT(name, id, value) trace_record('n', #name, id, (int64_t)(value))
+
+#else
+
+#define TRACE_BEGIN(name, id) do {} while(0)
+#define TRACE_END(name, id, value) do {} while(0)
+#define TRACE_INSTANT(name, id, value) do {} while(0)
+
+#endif
+
+#endif
@@ -1,8 +1,10 @@
 #include "request.h"
+#include "stats.h"
 
 #include <buffer/buffer.h>
 #include <net/driver.h>
 #include <detail/algorithm.h>
+#include <detail/trace.h>
 
 #include <string.h>
 
@@ -21,6 +23,55 @@ HTTPError ICACHE_FLASH_ATTR http_writeEol(Buffer* buffer)
     return http_bufferError(buffer_write(buffer, "\r\n", http_eolSize));
 }
 
+void ICACHE_FLASH_ATTR http_stampPhase(HTTPRequest* request, HTTPPhase phase, uint64_t time)
+{
+    if(http_phaseReached(&request->stats, phase))
+        return;
+    request->stats.reached |= 1 << phase;
+    request->stats.timestamps[phase] = time ? time : net_time();
+}
+
+void ICACHE_FLASH_ATTR http_write(HTTPRequest* request, const void* data, size_t size)
+{
+    ++request->stats.writes;
+    request->stats.bytesOut += size;
+    net_asyncWrite(&request->connection.driver, data, size);
+}
+
+void ICACHE_FLASH_ATTR http_finish(HTTPRequest* request, HTTPError error)
+{
+    request->error = error;
+    TRACE_PROBE2(http_done, request, error);
+    if(http_phaseReached(&request->stats, httpPhase_firstByte))
+        TRACE_END(http_receive, request, request->stats.bytesIn);
+    TRACE_END(http_request, request, error);
+    http_stampPhase(request, httpPhase_complete, 0);
+    if(http_statsTable)
+        http_recordRequestStats(http_statsTable, request->connection.hostname, &request->stats, error);
+    net_asyncDisconnect(&request->connection.driver);
+}
+
+// a connection warmed up before the request started counts as made when it started
+static uint64_t ICACHE_FLASH_ATTR http_notBeforeStart(const HTTPRequest* request, uint64_t time)
+{
+    uint64_t started = request->stats.timestamps[httpPhase_started];
+    return time && time < started ? started : time;
+}
+
+void ICACHE_FLASH_ATTR http_connected(HTTPRequest* request)
+{
+	request->connection.connected = 1;
+    const NetConnectionTimes* times = &request->connection.driver.times;
+    if(times->resolved)
+        http_stampPhase(request, httpPhase_resolved, http_notBeforeStart(request, times->resolved));
+    http_stampPhase(request, httpPhase_connected, http_notBeforeStart(request, times->connected));
+    if(request->connection.secure)
+        http_stampPhase(request, httpPhase_secured, http_notBeforeStart(request, times->secured));
+    TRACE_PROBE2(http_head_write, request, buffer_size(&request->head));
+    TRACE_BEGIN(http_send, request);
+    http_write(request, request->head.getPtr, buffer_size(&request->head));
+}
+
 HTTPError ICACHE_FLASH_ATTR http_parseUrl(HTTPRequest* request, const char* url, const char** path)
 {
 	size_t urlLen = strlen(url);
@@ -59,6 +110,7 @@ HTTPError ICACHE_FLASH_ATTR http_initRequest(HTTPRequest* request, const char* m
     request->callback = callback;
     request->userData = userData;
     request->headSent = 0;
+    request->requested = 0;
     
     http_initResponse(&request->response, responseBuffer);
 
@@ -66,12 +118,14 @@ HTTPError ICACHE_FLASH_ATTR http_initRequest(HTTPRequest* request, const char* m
         http_disconnectCallback);
     request->connection.connected = 0;
     request->connection.secure = 0;
+    request->connection.warm = httpWarm_none;
 
     // parse the url
 	const char* path;
 	HTTPError r = http_parseUrl(request, url, &path);
 	if(r != http_ok)
 		return r;
+    TRACE_PROBE3(http_init, request, method, request->connection.hostname);
     
     // write the request line to the head buffer
 	size_t methodSize = strlen(method);
@@ -112,16 +166,52 @@ HTTPError ICACHE_FLASH_ATTR http_addRequestHeader(HTTPRequest* request, const ch
 
 HTTPError ICACHE_FLASH_ATTR http_asyncRequest(HTTPRequest* request, Buffer requestBody)
 {
+    bufferSequence_init(&request->bodyBuffer, requestBody.getPtr, buffer_size(&requestBody));
+    return http_asyncRequestSequence(request, &request->bodyBuffer);
+}
+
+HTTPError ICACHE_FLASH_ATTR http_asyncRequestSequence(HTTPRequest* request, const BufferSequence* requestBody)
+{
+    size_t bodySize = 0;
+    const BufferSequence* segment = requestBody;
+    for(; segment; segment = segment->next)
+        bodySize += segment->length;
+
     // finish off the headers
     char requestSize[11];
-    ets_sprintf(requestSize, "%u", buffer_size(&requestBody));
+    ets_sprintf(requestSize, "%u", bodySize);
     HTTPError e = http_addRequestHeader(request, "Content-Length", requestSize);
     if(e != http_ok)
         return e;
     e = http_writeEol(&request->head);
     if(e != http_ok)
         return e;
+    if(!requestBody)
+    { // no body
+        bufferSequence_init(&request->bodyBuffer, NULL, 0);
+        requestBody = &request->bodyBuffer;
+    }
     request->body = requestBody;
+
+    memset(&request->stats, 0, sizeof(request->stats));
+    http_stampPhase(request, httpPhase_started, 0);
+
+    TRACE_PROBE2(http_connect_start, request, request->connection.hostname);
+    TRACE_BEGIN(http_request, request);
+    TRACE_BEGIN(http_connect, request);
+    request->requested = 1;
+
+    HTTPWarmState warm = request->connection.warm;
+    request->connection.warm = httpWarm_none;
+    if(warm == httpWarm_ready)
+    { // connected ahead of time, send straight away
+        TRACE_PROBE2(http_connect_done, request, net_ok);
+        TRACE_END(http_connect, request, net_ok);
+        http_connected(request);
+        return http_ok;
+    }
+    if(warm == httpWarm_connecting) // the connect callback sends it
+        return http_ok;
     
     if(request->connection.secure)
         net_asyncSecureConnect(&request->connection.driver, request->connection.hostname);
@@ -131,6 +221,56 @@ HTTPError ICACHE_FLASH_ATTR http_asyncRequest(HTTPRequest* request, Buffer reque
     return http_ok;
 }
 
+HTTPError ICACHE_FLASH_ATTR http_warmUp(HTTPRequest* request, const char* url, void* userData,
+    HTTPRequestCallback callback)
+{
+    request->callback = callback;
+    request->userData = userData;
+    net_init(&request->connection.driver, request, http_connectCallback, http_receiveCallback, http_writeCallback,
+        http_disconnectCallback);
+    request->requested = 0;
+    request->connection.connected = 0;
+    request->connection.warm = httpWarm_none;
+
+	const char* path;
+	HTTPError r = http_parseUrl(request, url, &path);
+	if(r != http_ok)
+		return r;
+    TRACE_PROBE2(http_warm_start, request, request->connection.hostname);
+
+    request->connection.warm = httpWarm_connecting;
+    if(request->connection.secure)
+        net_asyncSecureConnect(&request->connection.driver, request->connection.hostname);
+    else
+        net_asyncConnect(&request->connection.driver, request->connection.hostname);
+    return http_ok;
+}
+
+void ICACHE_FLASH_ATTR http_detachWarm(const HTTPRequest* request, const char* hostname, HTTPWarmConnection* warm)
+{
+    warm->driverData = request->connection.driver.driverData;
+    warm->times = request->connection.driver.times;
+    warm->state = strcmp(request->connection.hostname, hostname) == 0 ? request->connection.warm : httpWarm_none;
+    warm->secure = request->connection.secure;
+}
+
+uint8_t ICACHE_FLASH_ATTR http_attachWarm(HTTPRequest* request, const HTTPWarmConnection* warm)
+{
+    // the driver still holds the connection even when it closed, connecting again releases it
+    request->connection.driver.driverData = warm->driverData;
+    if(warm->state == httpWarm_none || warm->secure != request->connection.secure)
+        return 0;
+    request->connection.driver.times = warm->times;
+    request->connection.warm = warm->state;
+    return 1;
+}
+
+HTTPError ICACHE_FLASH_ATTR http_getRequestStats(HTTPRequestStats* stats, const HTTPRequest* request)
+{
+    *stats = request->stats;
+    return http_ok;
+}
+
 HTTPError ICACHE_FLASH_ATTR http_netError(NetError e)
 {
     switch(e)
@@ -145,11 +285,27 @@ HTTPError ICACHE_FLASH_ATTR http_netError(NetError e)
 void ICACHE_FLASH_ATTR http_connectCallback(void* request, NetError error)
 {
 	HTTPRequest* r = (HTTPRequest*)request;
-	if(error != net_ok)
-		r->callback(r->userData, NULL, 0, http_netError(error));
+    if(!r->requested)
+    { // warming up, the request isn't there yet
+        TRACE_PROBE2(http_warm_done, r, error);
+        if(error != net_ok)
+        { // the request will connect on its own
+            r->connection.warm = httpWarm_none;
+            net_asyncDisconnect(&r->connection.driver);
+            return;
+        }
+        r->connection.warm = httpWarm_ready;
+        return;
+    }
 
-	r->connection.connected = 1;
-    net_asyncWrite(&r->connection.driver, r->head.getPtr, buffer_size(&r->head));
+    TRACE_PROBE2(http_connect_done, r, error);
+    TRACE_END(http_connect, r, error);
+	if(error != net_ok)
+    { // reported once the driver lets go of the connection, nothing was written on it
+        http_finish(r, http_netError(error));
+        return;
+    }
+    http_connected(r);
 }
 
 void ICACHE_FLASH_ATTR http_writeCallback(void* request, NetError error)
@@ -157,16 +313,28 @@ void ICACHE_FLASH_ATTR http_writeCallback(void* request, NetError error)
     HTTPRequest* r = (HTTPRequest*)request;
 	if(error != net_ok)
     {
-        r->error = http_netError(error);
-        net_asyncDisconnect(&r->connection.driver);
+        http_finish(r, http_netError(error));
         return;
     }
     
     if(!r->headSent)
     { // finished sending the request head
         r->headSent = 1;
+        http_stampPhase(r, httpPhase_headSent, 0);
         // send the body
-        net_asyncWrite(&r->connection.driver, r->body.getPtr, buffer_size(&r->body));
+        TRACE_PROBE2(http_body_write, r, r->body->length);
+        http_write(r, r->body->data, r->body->length);
+    }
+    else if(r->body->next)
+    { // send the next segment of the body
+        r->body = r->body->next;
+        TRACE_PROBE2(http_body_write, r, r->body->length);
+        http_write(r, r->body->data, r->body->length);
+    }
+    else
+    { // finished sending the body
+        http_stampPhase(r, httpPhase_bodySent, 0);
+        TRACE_END(http_send, r, r->stats.bytesOut);
     }
 }
 
@@ -174,16 +342,27 @@ void ICACHE_FLASH_ATTR http_receiveCallback(void* request, const void* buffer, s
 {
 
 	HTTPRequest* r = (HTTPRequest*)request;
+    if(!r->requested)
+    { // the peer closed a warm connection, or spoke before it was asked anything
+        r->connection.warm = httpWarm_none;
+        net_asyncDisconnect(&r->connection.driver);
+        return;
+    }
     if(r->response.bodyComplete)
         // we're done, just ignore the call
         return;
 
 	if(error != net_ok)
 	{
-        r->error = http_netError(error);
-        net_asyncDisconnect(&r->connection.driver);
+        http_finish(r, http_netError(error));
 		return;
 	}
+
+    ++r->stats.reads;
+    r->stats.bytesIn += bufferSize;
+    if(!http_phaseReached(&r->stats, httpPhase_firstByte))
+        TRACE_BEGIN(http_receive, r);
+    http_stampPhase(r, httpPhase_firstByte, 0);
 	
     const void* unconsumed = (const char*)buffer;
 	if(!r->response.headComplete)
@@ -192,19 +371,19 @@ void ICACHE_FLASH_ATTR http_receiveCallback(void* request, const void* buffer, s
         switch(e)
         {
         case http_complete: // finished parsing the header
+            http_stampPhase(r, httpPhase_headReceived, 0);
             bufferSize -= (const char*)unconsumed - (const char*)buffer;
+            buffer = unconsumed;
             if(r->response.bodyComplete)
             { // zero length body
-                r->error = http_complete;
-                net_asyncDisconnect(&r->connection.driver);
+                http_finish(r, http_complete);
                 return;
             }
             break;
         case http_ok: // not finished parsing the header
             return;
         default: // error parsing head
-            r->error = e;
-            net_asyncDisconnect(&r->connection.driver);
+            http_finish(r, e);
 			return;
         };
 	}
@@ -218,18 +397,24 @@ void ICACHE_FLASH_ATTR http_receiveCallback(void* request, const void* buffer, s
         {
             if(e == http_complete)
                 r->callback(r->userData, bodyData, bodyDataSize, http_ok);
-            r->error = e;
-            net_asyncDisconnect(&r->connection.driver);
+            http_finish(r, e);
             return;
         }
         r->callback(r->userData, bodyData, bodyDataSize, http_ok);
         bufferSize -= (const char*)unconsumed - (const char*)buffer;
+        buffer = unconsumed;
     }
 }
 
 void ICACHE_FLASH_ATTR http_disconnectCallback(void* request, NetError error)
 {
     HTTPRequest* r = (HTTPRequest*)request;
+    if(!r->requested)
+    { // a warm connection that closed before it was used
+        r->callback(r->userData, NULL, 0, http_error);
+        return;
+    }
+    r->requested = 0;
     r->callback(r->userData, NULL, 0, r->error);
 }
 
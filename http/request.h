@@ -11,31 +11,92 @@ extern "C" {
 #include <net/driver.h>
 
 #include <buffer/buffer.h>
+#include <buffer/buffer_sequence.h>
 
 #include <string.h>
 
 typedef void(*HTTPRequestCallback)(void*, const void*, size_t, HTTPError);
 
+/**
+ * Points in the life of a request, in the order they happen.
+ */
+typedef enum
+{
+    httpPhase_started,
+    httpPhase_resolved,
+    httpPhase_connected,
+    httpPhase_secured,
+    httpPhase_headSent,
+    httpPhase_bodySent,
+    httpPhase_firstByte,
+    httpPhase_headReceived,
+    httpPhase_complete,
+    httpPhase_count
+} HTTPPhase;
+
+typedef struct
+{
+    // net_time() of each phase the request reached
+    uint64_t timestamps[httpPhase_count];
+    // bit 1 << phase set for each phase the request reached
+    uint16_t reached;
+    uint64_t bytesOut;
+    uint64_t bytesIn;
+    uint32_t writes;
+    uint32_t reads;
+} HTTPRequestStats;
+
+/**
+ * Progress of a connection opened by http_warmUp ahead of the request that will use it.
+ */
+typedef enum
+{
+    httpWarm_none,
+    httpWarm_connecting,
+    // connected, waiting for a request
+    httpWarm_ready
+} HTTPWarmState;
+
 struct HTTPRequestData
 {
 	Buffer head;
-    Buffer body;
+    // segment of the body being sent, the rest follow it
+    const BufferSequence* body;
+    // storage for a body given as a single buffer
+    BufferSequence bodyBuffer;
     HTTPResponse response;
 	HTTPRequestCallback callback;
     void* userData;
     uint8_t headSent;
+    // a request was started, a warm connection reports nothing to the callback before it is
+    uint8_t requested;
     HTTPError error;
+    HTTPRequestStats stats;
 
     struct 
     {
         NetConnection driver;
         uint8_t connected;
         uint8_t secure;
+        HTTPWarmState warm;
         char hostname[256];
     } connection;
 };
 typedef struct HTTPRequestData HTTPRequest;
 
+/**
+ * A connection opened by http_warmUp, held while its request is initialized again.
+ * The host was checked when it was taken out of the request, so it is small enough to keep next to the request.
+ */
+typedef struct
+{
+    void* driverData;
+    NetConnectionTimes times;
+    // httpWarm_none if the connection closed or goes to another host
+    HTTPWarmState state;
+    uint8_t secure;
+} HTTPWarmConnection;
+
 /**
  * Initialize an HTTPRequest.
  * @param[io]   request         Request to initialize.
@@ -68,6 +129,80 @@ HTTPError http_addRequestHeader(HTTPRequest* request, const char* name, const ch
  */
 HTTPError http_asyncRequest(HTTPRequest* request, Buffer body);
 
+/**
+ * Start a request asynchronously with a body gathered from several buffers.
+ * Each segment is written as is, so a body can be assembled from pieces of other buffers without copying.
+ * @note Further calls to http_addRequestHeader will return an error.
+ * @param[io]   request Request to make.
+ * @param[in]   body    First segment of the body, the segments must stay alive until the request completes.
+ */
+HTTPError http_asyncRequestSequence(HTTPRequest* request, const BufferSequence* body);
+
+/**
+ * Connect and handshake to the host of a url ahead of a request, so the request doesn't wait for it.
+ * The connection stays quiet until a request is made on it, a failure or the peer closing it just leaves the request
+ * to connect again. http_initRequest forgets the connection, http_detachWarm and http_attachWarm carry it over.
+ * @param[out]  request     Request to open the connection on, initialized by the next http_initRequest.
+ * @param[in]   url         An http url on the host to connect to, only the protocol and host are used.
+ * @param[in]   userData    User data to be passed in the callback.
+ * @param[in]   callback    Called without data and with http_error once the connection failed or closed, unless a
+ *  request was initialized on it first, the request reports to its own callback from then on.
+ * @return http_ok if the connection is being opened, http_invalidURL otherwise.
+ */
+HTTPError http_warmUp(HTTPRequest* request, const char* url, void* userData, HTTPRequestCallback callback);
+
+/**
+ * Take the connection http_warmUp opened out of a request, before initializing the request for the next use.
+ * @param[in]   request     Request http_warmUp was called on and that wasn't initialized since.
+ * @param[in]   hostname    Host the next request goes to, a connection to another host isn't used.
+ * @param[out]  warm        The connection and its state.
+ */
+void http_detachWarm(const HTTPRequest* request, const char* hostname, HTTPWarmConnection* warm);
+
+/**
+ * Put a connection taken by http_detachWarm back into the request after initializing it.
+ * A connection to another host or protocol, or one that closed, is replaced when the request connects.
+ * @param[io]   request Request initialized by http_initRequest, not started yet.
+ * @param[in]   warm    Connection taken from the same request.
+ * @return 1 if the request goes out on the connection, 0 if it connects as usual.
+ */
+uint8_t http_attachWarm(HTTPRequest* request, const HTTPWarmConnection* warm);
+
+/**
+ * Get the timings and counters of a request.
+ * @note Valid once the request has started, phases not reached yet are 0.
+ * @param[out]  stats   Stats of the request.
+ * @param[in]   request Request to get the stats of.
+ * @return http_ok.
+ */
+HTTPError http_getRequestStats(HTTPRequestStats* stats, const HTTPRequest* request);
+
+/**
+ * Check if a request reached a phase.
+ * @param[in]   stats   Stats of the request.
+ * @param[in]   phase   Phase to check.
+ * @return 1 if the request reached the phase, 0 otherwise.
+ */
+static inline uint8_t http_phaseReached(const HTTPRequestStats* stats, HTTPPhase phase)
+{
+    return (stats->reached >> phase) & 1;
+}
+
+/**
+ * Time between two phases of a request.
+ * @param[in]   stats   Stats of the request.
+ * @param[in]   from    Earlier phase.
+ * @param[in]   to      Later phase.
+ * @return Microseconds between the phases, 0 if either wasn't reached.
+ */
+static inline uint64_t http_phaseDuration(const HTTPRequestStats* stats, HTTPPhase from, HTTPPhase to)
+{
+    if(!http_phaseReached(stats, from) || !http_phaseReached(stats, to) ||
+        stats->timestamps[to] < stats->timestamps[from])
+        return 0;
+    return stats->timestamps[to] - stats->timestamps[from];
+}
+
 /**
  * Get the code of the response.
  * @note Returns an error until the headers of the response have been received.
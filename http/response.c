@@ -2,6 +2,7 @@
 
 #include <buffer/buffer_sequence.h>
 #include "detail/algorithm.h"
+#include "detail/trace.h"
 
 HTTPError http_parseTransferEncoding(HTTPResponse* response);
 HTTPError http_parseStandardBody(HTTPResponse* response, const void** unconsumed, const void** bodyData,
@@ -21,6 +22,8 @@ void ICACHE_FLASH_ATTR http_initResponse(HTTPResponse* response, Buffer headBuff
 
 HTTPError ICACHE_FLASH_ATTR http_parseHead(HTTPResponse* response, const void** unconsumed, const void* data, size_t dataSize)
 {
+    TRACE_PROBE2(http_parse_head, response, dataSize);
+
 	static const char headerEnd[] = "\r\n\r\n";
 	static const size_t headerEndSize = sizeof(headerEnd) - 1;
 
@@ -74,6 +77,7 @@ HTTPError ICACHE_FLASH_ATTR http_parseHead(HTTPResponse* response, const void**
 HTTPError ICACHE_FLASH_ATTR http_parseBody(HTTPResponse* response, const void** unconsumed, const void** bodyData, size_t* bodyDataSize,
     const void* data, size_t dataSize)
 {
+    TRACE_PROBE3(http_parse_body, response, dataSize, response->transferEncoding);
     if(response->bodyComplete)
         return http_complete;
 
@@ -161,7 +165,9 @@ HTTPError ICACHE_FLASH_ATTR http_parseChunkedBody(HTTPResponse* response, const
 			}
 			else
 			{ // didn't find the end of the header
-				return http_bufferError(buffer_write(&response->parserBuffer, (const char*)*unconsumed, dataSize));
+				BufferError e = buffer_write(&response->parserBuffer, (const char*)*unconsumed, dataSize);
+				*unconsumed = (const char*)*unconsumed + dataSize;
+				return http_bufferError(e);
 			}
 		}
 		else
@@ -172,6 +178,7 @@ HTTPError ICACHE_FLASH_ATTR http_parseChunkedBody(HTTPResponse* response, const
                 *bodyData = *unconsumed;
                 *bodyDataSize = writeSize;
                 *unconsumed = (const char*)*unconsumed + writeSize;
+                response->dataLeft -= writeSize;
                 return http_ok;
 			}
 
@@ -0,0 +1,85 @@
+#include "stats.h"
+
+#include <detail/algorithm.h>
+
+HTTPStatsTable* http_statsTable = NULL;
+
+void ICACHE_FLASH_ATTR http_initStatsTable(HTTPStatsTable* table, HTTPHostStats* hosts, size_t size)
+{
+    table->hosts = hosts;
+    table->size = size;
+    table->used = 0;
+}
+
+void ICACHE_FLASH_ATTR http_setStatsTable(HTTPStatsTable* table)
+{
+    http_statsTable = table;
+}
+
+HTTPHostStats* ICACHE_FLASH_ATTR http_findHostStats(HTTPStatsTable* table, const char* hostname)
+{
+    if(strlen(hostname) >= sizeof(table->hosts[0].hostname))
+        return NULL; // cut short it could be mistaken for another host
+
+    size_t i = 0;
+    for(; i < table->used; ++i)
+    {
+        if(strcmp(table->hosts[i].hostname, hostname) == 0)
+            return &table->hosts[i];
+    }
+    if(table->used == table->size)
+        return NULL;
+
+    HTTPHostStats* host = &table->hosts[table->used++];
+    memset(host, 0, sizeof(HTTPHostStats));
+    strcpy(host->hostname, hostname);
+    histogram_init(&host->resolve);
+    histogram_init(&host->connect);
+    histogram_init(&host->handshake);
+    histogram_init(&host->send);
+    histogram_init(&host->firstByte);
+    histogram_init(&host->receive);
+    histogram_init(&host->total);
+    return host;
+}
+
+static void ICACHE_FLASH_ATTR http_recordPhase(Histogram* h, const HTTPRequestStats* stats, HTTPPhase from,
+    HTTPPhase to)
+{
+    if(http_phaseReached(stats, from) && http_phaseReached(stats, to))
+        histogram_record(h, http_phaseDuration(stats, from, to));
+}
+
+void ICACHE_FLASH_ATTR http_recordRequestStats(HTTPStatsTable* table, const char* hostname,
+    const HTTPRequestStats* stats, HTTPError error)
+{
+    HTTPHostStats* host = http_findHostStats(table, hostname);
+    if(!host)
+        return;
+
+    ++host->requests;
+    if(error != http_complete)
+        ++host->errors;
+    host->bytesOut += stats->bytesOut;
+    host->bytesIn += stats->bytesIn;
+
+    // phases a driver can't observe are skipped over
+    HTTPPhase connectFrom = http_phaseReached(stats, httpPhase_resolved) ? httpPhase_resolved : httpPhase_started;
+    HTTPPhase sendFrom = http_phaseReached(stats, httpPhase_secured) ? httpPhase_secured : httpPhase_connected;
+    http_recordPhase(&host->resolve, stats, httpPhase_started, httpPhase_resolved);
+    http_recordPhase(&host->connect, stats, connectFrom, httpPhase_connected);
+    http_recordPhase(&host->handshake, stats, httpPhase_connected, httpPhase_secured);
+    http_recordPhase(&host->send, stats, sendFrom, httpPhase_bodySent);
+    http_recordPhase(&host->firstByte, stats, httpPhase_bodySent, httpPhase_firstByte);
+    http_recordPhase(&host->receive, stats, httpPhase_firstByte, httpPhase_complete);
+    http_recordPhase(&host->total, stats, httpPhase_started, httpPhase_complete);
+}
+
+size_t ICACHE_FLASH_ATTR http_snapshotStats(HTTPHostStats* dest, size_t size, HTTPStatsTable* table, uint8_t reset)
+{
+    size_t count = min(size, table->used);
+    memcpy(dest, table->hosts, count * sizeof(HTTPHostStats));
+    if(reset)
+        table->used = 0;
+    return count;
+}
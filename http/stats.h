@@ -0,0 +1,100 @@
+#ifndef HTTP_STATS
+#define HTTP_STATS
+
+#include "error.h"
+#include "request.h"
+
+#include <detail/histogram.h>
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Timings of every request made to one host, all in microseconds.
+ */
+typedef struct
+{
+    char hostname[64];
+    uint32_t requests;
+    uint32_t errors;
+    uint64_t bytesOut;
+    uint64_t bytesIn;
+
+    // started to resolved
+    Histogram resolve;
+    // resolved to connected
+    Histogram connect;
+    // connected to secured
+    Histogram handshake;
+    // secured to the end of the body
+    Histogram send;
+    // end of the body to the first byte of the response
+    Histogram firstByte;
+    // first byte to the end of the response
+    Histogram receive;
+    // started to the end of the response
+    Histogram total;
+} HTTPHostStats;
+
+typedef struct
+{
+    HTTPHostStats* hosts;
+    size_t size;
+    size_t used;
+} HTTPStatsTable;
+
+/**
+ * Table requests record their stats into as they finish, NULL when stats aren't being kept.
+ */
+extern HTTPStatsTable* http_statsTable;
+
+/**
+ * Initialize a table of per host stats.
+ * @param[out]  table   Table to initialize.
+ * @param[in]   hosts   Storage for the stats of each host.
+ * @param[in]   size    Number of hosts that fit in the storage, requests to other hosts aren't recorded.
+ */
+void http_initStatsTable(HTTPStatsTable* table, HTTPHostStats* hosts, size_t size);
+
+/**
+ * Make finished requests record into a table.
+ * @param[in]   table   Table to record into, NULL to stop recording.
+ */
+void http_setStatsTable(HTTPStatsTable* table);
+
+/**
+ * Find the stats of a host, adding it to the table if it isn't there.
+ * @param[io]   table       Table to search.
+ * @param[in]   hostname    Host to find.
+ * @return Stats of the host, NULL if the table is full or the name doesn't fit in HTTPHostStats.
+ */
+HTTPHostStats* http_findHostStats(HTTPStatsTable* table, const char* hostname);
+
+/**
+ * Record the stats of a finished request.
+ * @param[io]   table       Table to record into.
+ * @param[in]   hostname    Host the request was made to.
+ * @param[in]   stats       Stats of the request.
+ * @param[in]   error       How the request finished.
+ */
+void http_recordRequestStats(HTTPStatsTable* table, const char* hostname, const HTTPRequestStats* stats,
+    HTTPError error);
+
+/**
+ * Copy the stats of every host out of a table.
+ * @param[out]  dest    Where to copy the stats.
+ * @param[in]   size    Number of hosts that fit in dest.
+ * @param[io]   table   Table to copy.
+ * @param[in]   reset   Clear the table after copying it.
+ * @return Number of hosts copied.
+ */
+size_t http_snapshotStats(HTTPHostStats* dest, size_t size, HTTPStatsTable* table, uint8_t reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,11 +1,17 @@
 #include "driver.h"
+#include "asio_driver.h"
+#include "resolver_cache.h"
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/bind.hpp>
 
+#include <chrono>
 #include <cstdio>
+#include <functional>
 #include <memory>
+#include <mutex>
 
 namespace asio = boost::asio;
 
@@ -16,16 +22,83 @@ void run()
     ioService.run();
 }
 
+namespace
+{
+
+asio::ip::tcp::resolver resolver(ioService);
+
+void lookupHandler(ResolverCache::Handler handler, const boost::system::error_code& error,
+    asio::ip::tcp::resolver::iterator iterator)
+{
+    ResolverCache::Endpoints endpoints;
+    for(; iterator != asio::ip::tcp::resolver::iterator(); ++iterator)
+        endpoints.push_back(iterator->endpoint());
+    handler(error, endpoints);
+}
+
+void lookup(const std::string& hostname, const std::string& service, ResolverCache::Handler handler)
+{
+    asio::ip::tcp::resolver::query query(hostname, service);
+    resolver.async_resolve(query, boost::bind(&lookupHandler, handler, asio::placeholders::error,
+        asio::placeholders::iterator));
+}
+
+void post(std::function<void()> handler)
+{
+    ioService.post(handler);
+}
+
+// cached answers are posted, so a connect never reports back from inside net_asyncConnect
+ResolverCache resolverCache(&lookup, &post);
+
+// RFC 8305 recommends 250ms between connection attempts
+std::chrono::steady_clock::duration connectionAttemptDelay = std::chrono::milliseconds(250);
+
+std::mutex statsMutex;
+Histogram connectTime;
+Histogram handshakeTime;
+
+uint64_t elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+void setResolverTtl(std::chrono::steady_clock::duration ttl, std::chrono::steady_clock::duration negativeTtl)
+{
+    resolverCache.setTtl(ttl, negativeTtl);
+}
+
+void setConnectionAttemptDelay(std::chrono::steady_clock::duration delay)
+{
+    connectionAttemptDelay = delay;
+}
+
+AsioDriverStats driverStats()
+{
+    AsioDriverStats stats;
+    stats.resolver = resolverCache.stats();
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.connectTime = connectTime;
+    stats.handshakeTime = handshakeTime;
+    return stats;
+}
+
 class AsioSSLTCPConnection : public std::enable_shared_from_this<AsioSSLTCPConnection>
 {
 public:
     AsioSSLTCPConnection(asio::io_service& ioService, NetConnection* conn) :
-    m_resolver(ioService),
     m_context(asio::ssl::context::tlsv12_client),
     m_socket(ioService),
     m_stream(m_socket, m_context),
     m_connection(conn),
-    m_secure(false)
+    m_secure(false),
+    m_attemptTimer(ioService),
+    m_nextEndpoint(0),
+    m_attemptsRunning(0),
+    m_connected(false),
+    m_closed(false)
     {
         printf("construct tcp\n");
         m_context.set_verify_mode(asio::ssl::verify_none);
@@ -40,6 +113,10 @@ public:
     {
         printf("disconnect\n");
         boost::system::error_code temp;
+        m_closed = true;
+        // the NetConnection may get a new connection before the handlers still running are done with this one
+        m_connection = NULL;
+        abandonAttempts();
         if(m_secure)
             m_stream.shutdown(temp);
         m_socket.shutdown(asio::socket_base::shutdown_both, temp);
@@ -49,18 +126,16 @@ public:
     {
         printf("connect\n");
         m_secure = false;
-        asio::ip::tcp::resolver::query query(hostname, "http");
-        m_resolver.async_resolve(query, boost::bind(&AsioSSLTCPConnection::resolveHandler, shared_from_this(),
-            asio::placeholders::error, asio::placeholders::iterator));
+        resolverCache.asyncResolve(hostname, "http", std::bind(&AsioSSLTCPConnection::resolveHandler,
+            shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     }
 
     void asyncSecureConnect(const std::string& hostname)
     {
         printf("secure connect\n");
         m_secure = true;
-        asio::ip::tcp::resolver::query query(hostname, "https");
-        m_resolver.async_resolve(query, boost::bind(&AsioSSLTCPConnection::resolveHandler, shared_from_this(),
-            asio::placeholders::error, asio::placeholders::iterator));
+        resolverCache.asyncResolve(hostname, "https", std::bind(&AsioSSLTCPConnection::resolveHandler,
+            shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     }
 
     void asyncWrite(const void* data, size_t size)
@@ -82,8 +157,8 @@ public:
 
 private:
     typedef asio::ssl::stream<asio::ip::tcp::socket&> Socket;
+    typedef std::shared_ptr<asio::ip::tcp::socket> Attempt;
 
-    asio::ip::tcp::resolver m_resolver;
     asio::ssl::context m_context;
     asio::ip::tcp::socket m_socket;
     Socket m_stream;
@@ -91,29 +166,119 @@ private:
     NetConnection* m_connection;
     bool m_secure;
 
-    void resolveHandler(const boost::system::error_code& error, asio::ip::tcp::resolver::iterator iterator)
+    // connection racing state
+    asio::steady_timer m_attemptTimer;
+    ResolverCache::Endpoints m_endpoints;
+    size_t m_nextEndpoint;
+    std::vector<Attempt> m_attempts;
+    size_t m_attemptsRunning;
+    bool m_connected;
+    std::chrono::steady_clock::time_point m_connectStart;
+    // disconnected by the user, handlers still running report nothing and m_connection is NULL
+    bool m_closed;
+
+    // failures are reported through the callbacks, an exception would unwind out of the io_service
+    void failConnect()
     {
+        if(!m_closed)
+            m_connection->connectCallback(m_connection->userData, net_error);
+    }
+
+    void resolveHandler(const boost::system::error_code& error, const ResolverCache::Endpoints& endpoints)
+    {
+        if(m_closed)
+            return;
         if(!error)
         {
-            if(iterator != asio::ip::tcp::resolver::iterator())
+            if(!endpoints.empty())
             {
-                printf("resolved %s\n", iterator->endpoint().address().to_string().c_str());
-                asio::async_connect(m_socket, iterator,
-                    boost::bind(&AsioSSLTCPConnection::connectHandler, shared_from_this(),
-                        asio::placeholders::error, asio::placeholders::iterator));
+                m_connection->times.resolved = net_time();
+                m_endpoints = interleaveAddressFamilies(endpoints);
+                m_nextEndpoint = 0;
+                m_connected = false;
+                m_connectStart = std::chrono::steady_clock::now();
+                startAttempt();
                 return;
             }
         }
-        throw boost::system::system_error(error);
+        failConnect();
+    }
+
+    void startAttempt()
+    {
+        if(m_closed)
+            return;
+        Attempt attempt = std::make_shared<asio::ip::tcp::socket>(ioService);
+        m_attempts.push_back(attempt);
+        ++m_attemptsRunning;
+        attempt->async_connect(m_endpoints[m_nextEndpoint++],
+            boost::bind(&AsioSSLTCPConnection::attemptHandler, shared_from_this(), attempt,
+                asio::placeholders::error));
+
+        if(m_nextEndpoint < m_endpoints.size())
+        { // give this attempt a head start before racing the next address
+            m_attemptTimer.expires_from_now(connectionAttemptDelay);
+            m_attemptTimer.async_wait(boost::bind(&AsioSSLTCPConnection::attemptTimerHandler, shared_from_this(),
+                asio::placeholders::error));
+        }
+    }
+
+    void attemptTimerHandler(const boost::system::error_code& error)
+    {
+        if(m_closed || error || m_connected || m_nextEndpoint >= m_endpoints.size())
+            return;
+        startAttempt();
+    }
+
+    void attemptHandler(Attempt attempt, const boost::system::error_code& error)
+    {
+        --m_attemptsRunning;
+        if(m_closed || m_connected)
+            return; // disconnected, or lost the race
+
+        if(!error)
+        {
+            m_connected = true;
+            m_connection->times.connected = net_time();
+            m_socket = std::move(*attempt);
+            abandonAttempts();
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                histogram_record(&connectTime, elapsedMicroseconds(m_connectStart));
+            }
+            connectHandler(error);
+            return;
+        }
+
+        if(m_nextEndpoint < m_endpoints.size())
+        { // don't wait out the delay when an attempt fails
+            m_attemptTimer.cancel();
+            startAttempt();
+            return;
+        }
+        if(m_attemptsRunning == 0)
+            failConnect();
+    }
+
+    void abandonAttempts()
+    {
+        boost::system::error_code temp;
+        m_attemptTimer.cancel(temp);
+        for(auto& attempt : m_attempts)
+            attempt->close(temp);
+        m_attempts.clear();
     }
 
-    void connectHandler(const boost::system::error_code& error, asio::ip::tcp::resolver::iterator)
+    void connectHandler(const boost::system::error_code& error)
     {
+        if(m_closed)
+            return;
         if(!error)
         {
             if(m_secure)
             {
                 printf("handshake\n");
+                m_connectStart = std::chrono::steady_clock::now();
                 m_stream.async_handshake(Socket::client,
                     boost::bind(&AsioSSLTCPConnection::handshakeHandler, shared_from_this(),
                         asio::placeholders::error));
@@ -128,25 +293,34 @@ private:
             }
             return;
         }
-        throw boost::system::system_error(error);
+        failConnect();
     }
 
     void handshakeHandler(const boost::system::error_code& error)
     {
+        if(m_closed)
+            return;
         if(!error)
         {
             printf("secure connected\n");
+            m_connection->times.secured = net_time();
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                histogram_record(&handshakeTime, elapsedMicroseconds(m_connectStart));
+            }
             m_connection->connectCallback(m_connection->userData, net_ok);
             m_stream.async_read_some(asio::mutable_buffers_1(m_buffer, sizeof(m_buffer)),
                 boost::bind(&AsioSSLTCPConnection::readHandler, shared_from_this(), asio::placeholders::error,
                     asio::placeholders::bytes_transferred));
             return;
         }
-        throw boost::system::system_error(error);
+        failConnect();
     }
 
     void readHandler(const boost::system::error_code& error, size_t bytesTransferred)
     {
+        if(m_closed)
+            return;
         if(!error)
         {
             printf("read %lu bytes\n", bytesTransferred);
@@ -165,23 +339,21 @@ private:
             }
             return;
         }
-        if(error.value() == asio::error::eof || error.value() == asio::error::shut_down)
-        {
-            printf("shutdown\n");
-            return;
-        }
-        throw boost::system::system_error(error);
+        // the peer hanging up before the response completed is as much an error as a reset
+        m_connection->readCallback(m_connection->userData, NULL, 0, net_error);
     }
 
     void writeHandler(const boost::system::error_code& error, size_t)
     {
+        if(m_closed)
+            return;
         if(!error)
         {
             printf("write finished\n");
             m_connection->writeCallback(m_connection->userData, net_ok);
             return;
         }
-        throw boost::system::system_error(error);
+        m_connection->writeCallback(m_connection->userData, net_error);
     }
 };
 
@@ -194,32 +366,58 @@ void net_init(NetConnection* conn, void* userData, ConnectCallback connectCallba
     conn->writeCallback = writeCallback;
     conn->disconnectCallback = disconnectCallback;
     conn->driverData = NULL;
+    memset(&conn->times, 0, sizeof(conn->times));
+}
+
+namespace
+{
+
+// what conn->driverData points to, replaced when conn connects again
+struct AsioConnectionHandle
+{
+    NetConnection* conn;
+    // NULL once disconnected
+    std::shared_ptr<AsioSSLTCPConnection> connection;
+};
+
+typedef std::shared_ptr<AsioConnectionHandle> AsioConnectionHandlePtr;
+
+AsioConnectionHandlePtr& getHandle(NetConnection* conn)
+{
+    return *static_cast<AsioConnectionHandlePtr*>(conn->driverData);
+}
+
 }
 
 void destroyConnection(NetConnection* conn)
 {
     if(conn->driverData)
     {
-        delete static_cast<std::shared_ptr<AsioSSLTCPConnection>*>(conn->driverData);
+        delete static_cast<AsioConnectionHandlePtr*>(conn->driverData);
         conn->driverData = NULL;
     }
 }
 
 AsioSSLTCPConnection* createConnection(NetConnection* conn)
 {
+    // a connection left open on conn is replaced, it lets go of conn and its handlers still running report nothing
+    if(conn->driverData && getHandle(conn)->connection)
+        getHandle(conn)->connection->disconnect();
     destroyConnection(conn);
-    auto asioConn = std::make_shared<AsioSSLTCPConnection>(ioService, conn);
-    conn->driverData = new std::shared_ptr<AsioSSLTCPConnection>(asioConn);
-    return asioConn.get();
+    auto handle = std::make_shared<AsioConnectionHandle>();
+    handle->conn = conn;
+    handle->connection = std::make_shared<AsioSSLTCPConnection>(ioService, conn);
+    conn->driverData = new AsioConnectionHandlePtr(handle);
+    return handle->connection.get();
 }
 
 AsioSSLTCPConnection* getConnection(NetConnection* conn)
 {
-    if(!conn->driverData)
+    if(!conn->driverData || !getHandle(conn)->connection)
     {
         return createConnection(conn);
     }
-    return static_cast<std::shared_ptr<AsioSSLTCPConnection>*>(conn->driverData)->get();
+    return getHandle(conn)->connection.get();
 }
 
 void net_asyncConnect(NetConnection* conn, const char* hostname)
@@ -246,5 +444,83 @@ void net_asyncDisconnect(NetConnection* conn)
     printf("netAsyncDisconnect\n");
     auto driver = getConnection(conn);
     driver->disconnect();
-    destroyConnection(conn);
+    AsioConnectionHandlePtr& handle = getHandle(conn);
+    handle->connection.reset();
+    // like the other drivers, the disconnect is reported once the call returned, unless conn connected again since
+    std::weak_ptr<AsioConnectionHandle> token = handle;
+    ioService.post([token]() {
+        AsioConnectionHandlePtr handle = token.lock();
+        if(!handle)
+            return;
+        NetConnection* conn = handle->conn;
+        if(!conn->driverData || getHandle(conn) != handle)
+            return; // initialized again since
+        destroyConnection(conn);
+        conn->disconnectCallback(conn->userData, net_ok);
+    });
+}
+
+namespace
+{
+
+// what timer->driverData points to, a wait still running only holds it weakly
+struct AsioTimer
+{
+    asio::steady_timer timer;
+    NetTimer* owner;
+    // bumped by every wait and cancel, a wait that finished after being replaced reports nothing
+    uint64_t generation;
+
+    AsioTimer(NetTimer* owner) : timer(ioService), owner(owner), generation(0) {}
+};
+
+typedef std::shared_ptr<AsioTimer> AsioTimerPtr;
+
+}
+
+void net_initTimer(NetTimer* timer, void* userData, TimerCallback callback)
+{
+    timer->driverData = NULL;
+    timer->userData = userData;
+    timer->callback = callback;
+}
+
+void net_asyncWait(NetTimer* timer, uint64_t delay)
+{
+    if(!timer->driverData)
+        timer->driverData = new AsioTimerPtr(std::make_shared<AsioTimer>(timer));
+    AsioTimerPtr& state = *static_cast<AsioTimerPtr*>(timer->driverData);
+    uint64_t generation = ++state->generation;
+    state->timer.expires_from_now(std::chrono::microseconds(delay));
+    std::weak_ptr<AsioTimer> token = state;
+    state->timer.async_wait([token, generation](const boost::system::error_code& error)
+    {
+        AsioTimerPtr state = token.lock();
+        if(!error && state && state->generation == generation)
+            state->owner->callback(state->owner->userData);
+    });
+}
+
+void net_cancelWait(NetTimer* timer)
+{
+    if(!timer->driverData)
+        return;
+    AsioTimerPtr& state = *static_cast<AsioTimerPtr*>(timer->driverData);
+    ++state->generation;
+    state->timer.cancel();
+}
+
+void net_destroyTimer(NetTimer* timer)
+{
+    if(!timer->driverData)
+        return;
+    net_cancelWait(timer);
+    delete static_cast<AsioTimerPtr*>(timer->driverData);
+    timer->driverData = NULL;
+}
+
+uint64_t net_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
@@ -1,11 +1,40 @@
 #ifndef NET_ASIODRIVER
 #define NET_ASIODRIVER
 
+#include "resolver_cache.h"
+
+#include <detail/histogram.h>
+
 #include <boost/asio.hpp>
 
+#include <chrono>
+
 extern boost::asio::io_service ioService;
 
 extern void run();
 
-#endif
+struct AsioDriverStats
+{
+    ResolverCache::Stats resolver;
+    // Microseconds from the first connection attempt to the winning connect.
+    Histogram connectTime;
+    // Microseconds spent in the TLS handshake.
+    Histogram handshakeTime;
+};
 
+/**
+ * Snapshot the resolver cache counters and connection timings of every connection made so far.
+ */
+extern AsioDriverStats driverStats();
+
+/**
+ * Set how long resolved hostnames, and failures to resolve them, are cached.
+ */
+extern void setResolverTtl(std::chrono::steady_clock::duration ttl, std::chrono::steady_clock::duration negativeTtl);
+
+/**
+ * Set how long a connection attempt runs alone before the next address is raced against it.
+ */
+extern void setConnectionAttemptDelay(std::chrono::steady_clock::duration delay);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef NET_DRIVER
 #define NET_DRIVER
 
+#include <stdint.h>
 #include <string.h>
 
 #ifdef __cplusplus
@@ -17,6 +18,18 @@ typedef void(*ConnectCallback)(void*, NetError);
 typedef void(*ReadCallback)(void*, const void*, size_t, NetError);
 typedef void(*WriteCallback)(void*, NetError);
 typedef void(*DisconnectCallback)(void*, NetError);
+typedef void(*TimerCallback)(void*);
+
+/**
+ * When the stages of connecting finished, as net_time() timestamps.
+ * Drivers leave a stage at 0 if they can't observe it.
+ */
+typedef struct
+{
+    uint64_t resolved;
+    uint64_t connected;
+    uint64_t secured;
+} NetConnectionTimes;
 
 typedef struct
 {
@@ -26,6 +39,7 @@ typedef struct
     ReadCallback readCallback;
     WriteCallback writeCallback;
     DisconnectCallback disconnectCallback;
+    NetConnectionTimes times;
 } NetConnection;
 
 extern void net_init(NetConnection* conn, void* userData, ConnectCallback connectCallback, ReadCallback readCallback,
@@ -39,6 +53,46 @@ extern void net_asyncWrite(NetConnection* conn, const void* data, size_t size);
 
 extern void net_asyncDisconnect(NetConnection* conn);
 
+typedef struct
+{
+    void* driverData;
+    void* userData;
+    TimerCallback callback;
+} NetTimer;
+
+/**
+ * Initialize a timer, the driver allocates what it needs for it on the first wait.
+ * @param[out]  timer       Timer to initialize, not initialized yet or destroyed with net_destroyTimer.
+ * @param[in]   userData    User data passed to callback.
+ * @param[in]   callback    Called when a wait finishes.
+ */
+extern void net_initTimer(NetTimer* timer, void* userData, TimerCallback callback);
+
+/**
+ * Stop the wait running on a timer and free what the driver allocated for it, the callback is never called again.
+ * @param[io]   timer   Initialized timer, it can be freed or initialized again afterwards.
+ */
+extern void net_destroyTimer(NetTimer* timer);
+
+/**
+ * Call the callback of a timer once a delay has passed, replacing any wait already running on it.
+ * @param[io]   timer   Initialized timer.
+ * @param[in]   delay   Microseconds to wait.
+ */
+extern void net_asyncWait(NetTimer* timer, uint64_t delay);
+
+/**
+ * Stop the wait running on a timer, if any, without calling its callback.
+ * @param[io]   timer   Initialized timer.
+ */
+extern void net_cancelWait(NetTimer* timer);
+
+/**
+ * Get a monotonic timestamp from the driver's clock.
+ * @return Microseconds since an arbitrary point in time.
+ */
+extern uint64_t net_time(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,8 +1,10 @@
 #include "driver.h"
 
 #include <mem.h>
+#include <osapi.h>
 #include <ip_addr.h>
 #include <espconn.h>
+#include <user_interface.h>
 
 typedef struct
 {
@@ -55,7 +57,11 @@ void ICACHE_FLASH_ATTR esp8266_connectCallback(void* arg)
     uart0_tx_buffer("connected\r\n", 11);
     struct espconn* conn = (struct espconn*)arg;
     NetConnection* netConn = (NetConnection*)conn->reverse;
+    HTTPESP8266ConnectionData* driver = esp8266_getConnection(netConn);
 
+    netConn->times.connected = net_time();
+    if(driver->secure)
+        netConn->times.secured = netConn->times.connected;
     netConn->connectCallback(netConn->userData, net_ok);
 }
 
@@ -126,6 +132,8 @@ void ICACHE_FLASH_ATTR esp8266_resolveCallback(const char* name, ip_addr_t* ip,
         return;
     }
 
+    netConn->times.resolved = net_time();
+
     char pageBuffer[20];
     ets_sprintf(pageBuffer, "r: %d.%d.%d.%d\r\n", IP2STR(ip));
     uart0_tx_buffer(pageBuffer, strlen(pageBuffer));
@@ -175,6 +183,7 @@ void ICACHE_FLASH_ATTR net_init(NetConnection* conn, void* userData, ConnectCall
     conn->writeCallback = writeCallback;
     conn->disconnectCallback = disconnectCallback;
     conn->driverData = NULL;
+    ets_memset(&conn->times, 0, sizeof(conn->times));
 }
 
 void ICACHE_FLASH_ATTR net_asyncConnect(NetConnection* conn, const char* hostname)
@@ -231,3 +240,56 @@ void ICACHE_FLASH_ATTR net_asyncDisconnect(NetConnection* conn)
         espconn_disconnect(&driver->connection);
 }
 
+void ICACHE_FLASH_ATTR esp8266_timerCallback(void* arg)
+{
+    NetTimer* timer = (NetTimer*)arg;
+    timer->callback(timer->userData);
+}
+
+void ICACHE_FLASH_ATTR net_initTimer(NetTimer* timer, void* userData, TimerCallback callback)
+{
+    timer->driverData = NULL;
+    timer->userData = userData;
+    timer->callback = callback;
+}
+
+void ICACHE_FLASH_ATTR net_asyncWait(NetTimer* timer, uint64_t delay)
+{
+    if(!timer->driverData)
+    {
+        timer->driverData = os_zalloc(sizeof(os_timer_t));
+        os_timer_setfn((os_timer_t*)timer->driverData, esp8266_timerCallback, timer);
+    }
+    os_timer_t* osTimer = (os_timer_t*)timer->driverData;
+    os_timer_disarm(osTimer);
+    // the SDK timer counts milliseconds
+    os_timer_arm(osTimer, (uint32_t)((delay + 999) / 1000), 0);
+}
+
+void ICACHE_FLASH_ATTR net_cancelWait(NetTimer* timer)
+{
+    if(timer->driverData)
+        os_timer_disarm((os_timer_t*)timer->driverData);
+}
+
+void ICACHE_FLASH_ATTR net_destroyTimer(NetTimer* timer)
+{
+    if(timer->driverData)
+    {
+        os_timer_disarm((os_timer_t*)timer->driverData);
+        os_free(timer->driverData);
+        timer->driverData = NULL;
+    }
+}
+
+uint64_t ICACHE_FLASH_ATTR net_time(void)
+{
+    // system_get_time wraps every ~71 minutes, extend it to 64 bits
+    static uint32_t last = 0;
+    static uint64_t high = 0;
+    uint32_t now = system_get_time();
+    if(now < last)
+        high += (uint64_t)1 << 32;
+    last = now;
+    return high | now;
+}
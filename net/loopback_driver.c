@@ -0,0 +1,620 @@
+#include "loopback_driver.h"
+
+#include <buffer/buffer.h>
+#include <detail/algorithm.h>
+#include <xdr/xdr.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum
+{
+    loopbackEvent_connect,
+    loopbackEvent_write,
+    loopbackEvent_read,
+    loopbackEvent_close,
+    loopbackEvent_disconnect,
+    loopbackEvent_refuse,
+    loopbackEvent_idle,
+    loopbackEvent_timer
+} LoopbackEventType;
+
+typedef struct
+{
+    char data[LOOPBACK_MAX_RESPONSE_SIZE];
+    size_t size;
+} LoopbackResponse;
+
+typedef struct
+{
+    NetConnection* conn;
+    uint8_t connected;
+    // the client wrote something, an idle timeout doesn't apply any more
+    uint8_t received;
+
+    // request parsing state
+    char head[1024];
+    size_t headSize;
+    uint32_t headTail;
+    uint8_t headComplete;
+    size_t bodyLeft;
+
+    // response being sent
+    LoopbackResponse response;
+} LoopbackConnection;
+
+struct LoopbackEventData;
+typedef struct LoopbackEventData
+{
+    uint64_t time;
+    LoopbackEventType type;
+    LoopbackConnection* connection;
+    size_t offset;
+    size_t size;
+    // set instead of connection for timers
+    NetTimer* timer;
+
+    struct LoopbackEventData* next;
+} LoopbackEvent;
+
+static LoopbackConfig loopback_config;
+static uint64_t loopback_clock;
+static uint32_t loopback_random;
+static LoopbackStats loopback_counters;
+
+static LoopbackResponse loopback_script[LOOPBACK_MAX_SCRIPT];
+static size_t loopback_scriptHead;
+static size_t loopback_scriptSize;
+static LoopbackResponse loopback_defaultResponse;
+static size_t loopback_refusals;
+static uint8_t loopback_hangupPercent;
+
+static char loopback_lastHead[1024];
+static size_t loopback_lastHeadSize;
+
+static LoopbackEvent loopback_eventPool[LOOPBACK_MAX_EVENTS];
+static LoopbackEvent* loopback_freeEvents;
+static LoopbackEvent* loopback_events;
+
+static uint32_t loopback_nextRandom(void)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = loopback_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    loopback_random = x;
+    return x;
+}
+
+static size_t loopback_readSize(size_t left)
+{
+    if(loopback_config.maxRead == 0)
+        return left;
+    size_t low = loopback_config.minRead > 0 ? loopback_config.minRead : 1;
+    size_t high = loopback_config.maxRead < low ? low : loopback_config.maxRead;
+    size_t size = low + loopback_nextRandom() % (high - low + 1);
+    return min(size, left);
+}
+
+// NULL when the pool is exhausted, the event is dropped and counted
+static LoopbackEvent* loopback_schedule(uint64_t time, LoopbackEventType type, LoopbackConnection* connection,
+    size_t offset, size_t size)
+{
+    LoopbackEvent* e = loopback_freeEvents;
+    if(!e)
+    {
+        ++loopback_counters.droppedEvents;
+        return NULL;
+    }
+    loopback_freeEvents = e->next;
+    e->time = time;
+    e->type = type;
+    e->connection = connection;
+    e->offset = offset;
+    e->size = size;
+    e->timer = NULL;
+
+    // keep the queue sorted by time, events at the same time run in the order they were scheduled
+    LoopbackEvent** i = &loopback_events;
+    while(*i && (*i)->time <= time)
+        i = &(*i)->next;
+    e->next = *i;
+    *i = e;
+    return e;
+}
+
+static void loopback_cancel(LoopbackConnection* connection)
+{
+    LoopbackEvent** i = &loopback_events;
+    while(*i)
+    {
+        if((*i)->connection == connection)
+        {
+            LoopbackEvent* e = *i;
+            *i = e->next;
+            e->next = loopback_freeEvents;
+            loopback_freeEvents = e;
+        }
+        else
+        {
+            i = &(*i)->next;
+        }
+    }
+}
+
+static void loopback_cancelTimer(NetTimer* timer)
+{
+    LoopbackEvent** i = &loopback_events;
+    while(*i)
+    {
+        if((*i)->timer == timer)
+        {
+            LoopbackEvent* e = *i;
+            *i = e->next;
+            e->next = loopback_freeEvents;
+            loopback_freeEvents = e;
+        }
+        else
+        {
+            i = &(*i)->next;
+        }
+    }
+}
+
+static void loopback_destroyConnection(NetConnection* conn)
+{
+    if(conn->driverData)
+    {
+        LoopbackConnection* connection = (LoopbackConnection*)conn->driverData;
+        loopback_cancel(connection);
+        free(connection);
+        if(loopback_counters.openConnections) // not counted if abandoned by a reset
+            --loopback_counters.openConnections;
+        conn->driverData = NULL;
+    }
+}
+
+static LoopbackConnection* loopback_createConnection(NetConnection* conn)
+{
+    loopback_destroyConnection(conn);
+    LoopbackConnection* connection = (LoopbackConnection*)calloc(1, sizeof(LoopbackConnection));
+    connection->conn = conn;
+    conn->driverData = connection;
+    ++loopback_counters.connections;
+    if(++loopback_counters.openConnections > loopback_counters.maxOpenConnections)
+        loopback_counters.maxOpenConnections = loopback_counters.openConnections;
+    return connection;
+}
+
+static size_t loopback_contentLength(const char* head, size_t size)
+{
+    static const char name[] = "Content-Length: ";
+    static const size_t nameSize = sizeof(name) - 1;
+
+    size_t i = 0;
+    for(; i + nameSize <= size; ++i)
+    {
+        if(memcmp(head + i, name, nameSize) == 0)
+        {
+            size_t length = 0;
+            for(i += nameSize; i < size && head[i] >= '0' && head[i] <= '9'; ++i)
+                length = length * 10 + (head[i] - '0');
+            return length;
+        }
+    }
+    return 0;
+}
+
+static void loopback_respond(LoopbackConnection* connection, uint64_t time)
+{
+    ++loopback_counters.requests;
+    memcpy(loopback_lastHead, connection->head, connection->headSize);
+    loopback_lastHeadSize = connection->headSize;
+
+    // reset the parser for the next request on this connection
+    connection->headSize = 0;
+    connection->headTail = 0;
+    connection->headComplete = 0;
+    connection->bodyLeft = 0;
+
+    time += loopback_config.responseLatency;
+    if(loopback_hangupPercent && loopback_nextRandom() % 100 < loopback_hangupPercent)
+        connection->response.size = 0;
+    else if(loopback_scriptSize > 0)
+    {
+        connection->response = loopback_script[loopback_scriptHead];
+        loopback_scriptHead = (loopback_scriptHead + 1) % LOOPBACK_MAX_SCRIPT;
+        --loopback_scriptSize;
+    }
+    else if(loopback_defaultResponse.size > 0)
+    {
+        connection->response = loopback_defaultResponse;
+    }
+    else
+    {
+        connection->response.size = 0;
+    }
+    if(connection->response.size == 0)
+    { // nothing to say, hang up on the client
+        loopback_schedule(time, loopbackEvent_close, connection, 0, 0);
+        return;
+    }
+
+    // split the response into reads
+    size_t offset = 0;
+    while(offset < connection->response.size)
+    {
+        size_t size = loopback_readSize(connection->response.size - offset);
+        loopback_schedule(time, loopbackEvent_read, connection, offset, size);
+        offset += size;
+        time += loopback_config.readLatency;
+    }
+}
+
+static void loopback_receive(LoopbackConnection* connection, const char* data, size_t size, uint64_t time)
+{
+    connection->received = 1;
+    while(size > 0)
+    {
+        if(!connection->headComplete)
+        { // look for the end of the head
+            char c = *data++;
+            --size;
+            if(connection->headSize < sizeof(connection->head))
+                connection->head[connection->headSize++] = c;
+            connection->headTail = (connection->headTail << 8) | (uint8_t)c;
+            if(connection->headTail == 0x0d0a0d0a)
+            {
+                connection->headComplete = 1;
+                connection->bodyLeft = loopback_contentLength(connection->head, connection->headSize);
+                if(connection->bodyLeft == 0)
+                    loopback_respond(connection, time);
+            }
+        }
+        else
+        { // skip over the body
+            size_t bodySize = min(connection->bodyLeft, size);
+            connection->bodyLeft -= bodySize;
+            data += bodySize;
+            size -= bodySize;
+            if(connection->bodyLeft == 0)
+                loopback_respond(connection, time);
+        }
+    }
+}
+
+static int loopback_storeResponse(LoopbackResponse* response, const void* data, size_t size)
+{
+    if(size > sizeof(response->data))
+        return 1;
+    memcpy(response->data, data, size);
+    response->size = size;
+    return 0;
+}
+
+void loopback_defaultConfig(LoopbackConfig* config)
+{
+    memset(config, 0, sizeof(LoopbackConfig));
+    config->seed = 1;
+}
+
+void loopback_reset(const LoopbackConfig* config)
+{
+    loopback_config = *config;
+    loopback_clock = 0;
+    loopback_random = config->seed ? config->seed : 1;
+    memset(&loopback_counters, 0, sizeof(loopback_counters));
+    loopback_scriptHead = 0;
+    loopback_scriptSize = 0;
+    loopback_defaultResponse.size = 0;
+    loopback_refusals = 0;
+    loopback_hangupPercent = 0;
+    loopback_lastHeadSize = 0;
+
+    // any connection still open is abandoned with its events
+    loopback_events = NULL;
+    loopback_freeEvents = NULL;
+    size_t i = 0;
+    for(; i < LOOPBACK_MAX_EVENTS; ++i)
+    {
+        loopback_eventPool[i].next = loopback_freeEvents;
+        loopback_freeEvents = &loopback_eventPool[i];
+    }
+}
+
+int loopback_queueRawResponse(const void* data, size_t size)
+{
+    if(loopback_scriptSize == LOOPBACK_MAX_SCRIPT)
+        return 1;
+    size_t index = (loopback_scriptHead + loopback_scriptSize) % LOOPBACK_MAX_SCRIPT;
+    if(loopback_storeResponse(&loopback_script[index], data, size) != 0)
+        return 1;
+    ++loopback_scriptSize;
+    return 0;
+}
+
+static int loopback_buildResponse(LoopbackResponse* response, int code, const char* reason, const void* body,
+    size_t bodySize, uint8_t chunked)
+{
+    static const size_t chunkSize = 32;
+
+    char* data = response->data;
+    size_t left = sizeof(response->data);
+    int n;
+    if(chunked)
+        n = snprintf(data, left, "HTTP/1.1 %d %s\r\nTransfer-Encoding: chunked\r\n\r\n", code, reason);
+    else
+        n = snprintf(data, left, "HTTP/1.1 %d %s\r\nContent-Length: %u\r\n\r\n", code, reason, (unsigned)bodySize);
+    if(n < 0 || (size_t)n >= left)
+        return 1;
+    data += n;
+    left -= n;
+
+    const char* bodyData = (const char*)body;
+    while(bodySize > 0)
+    {
+        size_t size = chunked ? min(chunkSize, bodySize) : bodySize;
+        if(chunked)
+        {
+            n = snprintf(data, left, "%x\r\n", (unsigned)size);
+            if(n < 0 || (size_t)n >= left)
+                return 1;
+            data += n;
+            left -= n;
+        }
+        if(size + (chunked ? 2 : 0) > left)
+            return 1;
+        memcpy(data, bodyData, size);
+        data += size;
+        left -= size;
+        if(chunked)
+        {
+            memcpy(data, "\r\n", 2);
+            data += 2;
+            left -= 2;
+        }
+        bodyData += size;
+        bodySize -= size;
+    }
+
+    if(chunked)
+    {
+        if(left < 5)
+            return 1;
+        memcpy(data, "0\r\n\r\n", 5);
+        data += 5;
+    }
+    response->size = data - response->data;
+    return 0;
+}
+
+int loopback_queueResponse(int code, const char* reason, const void* body, size_t bodySize, uint8_t chunked)
+{
+    LoopbackResponse response;
+    if(loopback_buildResponse(&response, code, reason, body, bodySize, chunked) != 0)
+        return 1;
+    return loopback_queueRawResponse(response.data, response.size);
+}
+
+int loopback_queueAuthResponse(const char* token, const char* server, uint8_t chunked)
+{
+    char bodyData[512];
+    Buffer body;
+    buffer_init(&body, bodyData, sizeof(bodyData));
+    size_t tokenSize = strlen(token);
+    size_t serverSize = strlen(server);
+    if(xdr_writeUInt(&body, tokenSize) != buffer_ok ||
+        xdr_writeString(&body, token, tokenSize) != buffer_ok ||
+        xdr_writeUInt(&body, serverSize) != buffer_ok ||
+        xdr_writeString(&body, server, serverSize) != buffer_ok ||
+        xdr_writeUInt(&body, 0) != buffer_ok)
+        return 1;
+    return loopback_queueResponse(200, "OK", body.getPtr, buffer_size(&body), chunked);
+}
+
+int loopback_queueHangup(void)
+{
+    if(loopback_scriptSize == LOOPBACK_MAX_SCRIPT)
+        return 1;
+    loopback_script[(loopback_scriptHead + loopback_scriptSize) % LOOPBACK_MAX_SCRIPT].size = 0;
+    ++loopback_scriptSize;
+    return 0;
+}
+
+void loopback_refuseConnections(size_t count)
+{
+    loopback_refusals = count;
+}
+
+void loopback_setHangupPercent(uint8_t percent)
+{
+    loopback_hangupPercent = percent;
+}
+
+int loopback_setDefaultResponse(const void* data, size_t size)
+{
+    if(!data)
+    {
+        loopback_defaultResponse.size = 0;
+        return 0;
+    }
+    return loopback_storeResponse(&loopback_defaultResponse, data, size);
+}
+
+const char* loopback_lastRequest(size_t* size)
+{
+    *size = loopback_lastHeadSize;
+    return loopback_lastHead;
+}
+
+uint64_t loopback_now(void)
+{
+    return loopback_clock;
+}
+
+LoopbackStats loopback_stats(void)
+{
+    return loopback_counters;
+}
+
+static void loopback_dispatch(LoopbackEvent* e)
+{
+    if(e->type == loopbackEvent_timer)
+    {
+        e->timer->callback(e->timer->userData);
+        return;
+    }
+
+    LoopbackConnection* connection = e->connection;
+    NetConnection* conn = connection->conn;
+    switch(e->type)
+    {
+    case loopbackEvent_connect:
+        connection->connected = 1;
+        conn->times.connected = loopback_clock;
+        conn->times.secured = loopback_clock;
+        if(loopback_config.idleTimeout)
+            loopback_schedule(loopback_clock + loopback_config.idleTimeout, loopbackEvent_idle, connection, 0, 0);
+        conn->connectCallback(conn->userData, net_ok);
+        break;
+    case loopbackEvent_refuse:
+        conn->connectCallback(conn->userData, net_error);
+        break;
+    case loopbackEvent_write:
+        conn->writeCallback(conn->userData, net_ok);
+        break;
+    case loopbackEvent_read:
+        ++loopback_counters.reads;
+        loopback_counters.bytesIn += e->size;
+        conn->readCallback(conn->userData, connection->response.data + e->offset, e->size, net_ok);
+        break;
+    case loopbackEvent_close:
+        conn->readCallback(conn->userData, NULL, 0, net_error);
+        break;
+    case loopbackEvent_idle:
+        if(!connection->received) // never asked anything, hang up
+            conn->readCallback(conn->userData, NULL, 0, net_error);
+        break;
+    case loopbackEvent_disconnect:
+        loopback_destroyConnection(conn);
+        conn->disconnectCallback(conn->userData, net_ok);
+        break;
+    case loopbackEvent_timer:
+        break;
+    }
+}
+
+size_t loopback_runUntil(uint64_t time)
+{
+    size_t count = 0;
+    while(loopback_events && loopback_events->time <= time)
+    {
+        LoopbackEvent event = *loopback_events;
+        loopback_events->next = loopback_freeEvents;
+        loopback_freeEvents = loopback_events;
+        loopback_events = event.next;
+
+        if(event.time > loopback_clock)
+            loopback_clock = event.time;
+        loopback_dispatch(&event);
+        ++count;
+    }
+    if(time > loopback_clock)
+        loopback_clock = time;
+    return count;
+}
+
+size_t loopback_run(void)
+{
+    size_t count = 0;
+    while(loopback_events)
+        count += loopback_runUntil(loopback_events->time);
+    return count;
+}
+
+void net_init(NetConnection* conn, void* userData, ConnectCallback connectCallback, ReadCallback readCallback,
+    WriteCallback writeCallback, DisconnectCallback disconnectCallback)
+{
+    conn->userData = userData;
+    conn->connectCallback = connectCallback;
+    conn->readCallback = readCallback;
+    conn->writeCallback = writeCallback;
+    conn->disconnectCallback = disconnectCallback;
+    conn->driverData = NULL;
+    memset(&conn->times, 0, sizeof(conn->times));
+}
+
+void net_asyncConnect(NetConnection* conn, const char* hostname)
+{
+    (void)hostname; // every host is the scripted peer
+    LoopbackConnection* connection = loopback_createConnection(conn);
+    conn->times.resolved = loopback_clock;
+    LoopbackEventType type = loopbackEvent_connect;
+    if(loopback_refusals)
+    {
+        --loopback_refusals;
+        type = loopbackEvent_refuse;
+    }
+    loopback_schedule(loopback_clock + loopback_config.connectLatency, type, connection, 0, 0);
+}
+
+void net_asyncSecureConnect(NetConnection* conn, const char* hostname)
+{
+    net_asyncConnect(conn, hostname);
+}
+
+void net_asyncWrite(NetConnection* conn, const void* data, size_t size)
+{
+    LoopbackConnection* connection = (LoopbackConnection*)conn->driverData;
+    if(!connection || !connection->connected)
+    {
+        conn->writeCallback(conn->userData, net_error);
+        return;
+    }
+
+    ++loopback_counters.writes;
+    loopback_counters.bytesOut += size;
+    uint64_t time = loopback_clock + loopback_config.writeLatency;
+    loopback_schedule(time, loopbackEvent_write, connection, 0, 0);
+    loopback_receive(connection, (const char*)data, size, time);
+}
+
+void net_asyncDisconnect(NetConnection* conn)
+{
+    LoopbackConnection* connection = (LoopbackConnection*)conn->driverData;
+    if(!connection)
+        return;
+    loopback_cancel(connection);
+    loopback_schedule(loopback_clock, loopbackEvent_disconnect, connection, 0, 0);
+}
+
+void net_initTimer(NetTimer* timer, void* userData, TimerCallback callback)
+{
+    timer->driverData = NULL;
+    timer->userData = userData;
+    timer->callback = callback;
+}
+
+void net_asyncWait(NetTimer* timer, uint64_t delay)
+{
+    loopback_cancelTimer(timer);
+    LoopbackEvent* e = loopback_schedule(loopback_clock + delay, loopbackEvent_timer, NULL, 0, 0);
+    if(e)
+        e->timer = timer;
+}
+
+void net_cancelWait(NetTimer* timer)
+{
+    loopback_cancelTimer(timer);
+}
+
+void net_destroyTimer(NetTimer* timer)
+{
+    loopback_cancelTimer(timer);
+}
+
+uint64_t net_time(void)
+{
+    return loopback_clock;
+}
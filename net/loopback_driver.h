@@ -0,0 +1,168 @@
+#ifndef NET_LOOPBACKDRIVER
+#define NET_LOOPBACKDRIVER
+
+#include "driver.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef LOOPBACK_MAX_RESPONSE_SIZE
+#define LOOPBACK_MAX_RESPONSE_SIZE 2048
+#endif
+
+#ifndef LOOPBACK_MAX_SCRIPT
+#define LOOPBACK_MAX_SCRIPT 32
+#endif
+
+// Most events pending at once, those scheduled beyond it are dropped and counted in LoopbackStats.droppedEvents.
+#ifndef LOOPBACK_MAX_EVENTS
+#define LOOPBACK_MAX_EVENTS 256
+#endif
+
+/**
+ * Behaviour of the scripted peer.
+ * All latencies are in microseconds of virtual time.
+ */
+typedef struct
+{
+    // Seed for the fragmentation generator, the same seed always produces the same reads.
+    uint32_t seed;
+    // Smallest read delivered to the connection.
+    size_t minRead;
+    // Largest read delivered to the connection.
+    size_t maxRead;
+    // Time to connect, including any handshake.
+    uint64_t connectLatency;
+    // Time for a write to complete.
+    uint64_t writeLatency;
+    // Time between the end of a request and the first byte of the response.
+    uint64_t responseLatency;
+    // Time between two reads of the same response.
+    uint64_t readLatency;
+    // Time the peer waits for the first request on a connection before closing it, 0 to wait forever.
+    uint64_t idleTimeout;
+} LoopbackConfig;
+
+/**
+ * Counters kept by the scripted peer.
+ */
+typedef struct
+{
+    uint32_t connections;
+    // Connections currently open and the most that were ever open at once.
+    uint32_t openConnections;
+    uint32_t maxOpenConnections;
+    uint32_t requests;
+    uint32_t reads;
+    uint32_t writes;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    // Events that didn't fit in LOOPBACK_MAX_EVENTS, what they would have done never happens.
+    uint32_t droppedEvents;
+} LoopbackStats;
+
+/**
+ * Populate a config with a zero latency peer that delivers each response in a single read.
+ * @param[out]  config  Config to populate.
+ */
+void loopback_defaultConfig(LoopbackConfig* config);
+
+/**
+ * Reset the peer, dropping any scripted responses, pending events and counters and rewinding the clock.
+ * @param[in]   config  Behaviour of the peer after the reset.
+ */
+void loopback_reset(const LoopbackConfig* config);
+
+/**
+ * Queue a raw response, it is sent in reply to the next complete request.
+ * @param[in]   data    Bytes of the response including the head.
+ * @param[in]   size    Number of bytes in the response.
+ * @return 0 if the response was queued, not 0 if the script is full or the response too big.
+ */
+int loopback_queueRawResponse(const void* data, size_t size);
+
+/**
+ * Queue a response built from a code and a body.
+ * @param[in]   code        HTTP status code.
+ * @param[in]   reason      Reason phrase sent after the code.
+ * @param[in]   body        Body of the response.
+ * @param[in]   bodySize    Number of bytes in the body.
+ * @param[in]   chunked     Send the body with chunked transfer encoding instead of a Content-Length.
+ * @return 0 if the response was queued, not 0 otherwise.
+ */
+int loopback_queueResponse(int code, const char* reason, const void* body, size_t bodySize, uint8_t chunked);
+
+/**
+ * Queue a SensorCloud authentication response carrying the token and server.
+ * @param[in]   token   Token to hand out.
+ * @param[in]   server  Server to upload data to.
+ * @param[in]   chunked Send the body with chunked transfer encoding.
+ * @return 0 if the response was queued, not 0 otherwise.
+ */
+int loopback_queueAuthResponse(const char* token, const char* server, uint8_t chunked);
+
+/**
+ * Queue a hang up, the peer closes the connection instead of replying to the next complete request.
+ * @return 0 if the hang up was queued, not 0 if the script is full.
+ */
+int loopback_queueHangup(void);
+
+/**
+ * Fail the next connection attempts, their connect callbacks get an error.
+ * @param[in]   count   Number of attempts to fail.
+ */
+void loopback_refuseConnections(size_t count);
+
+/**
+ * Make the peer hang up on a share of the requests instead of answering them, drawn from the seed.
+ * @param[in]   percent Percentage of requests to hang up on, 0 to answer all of them.
+ */
+void loopback_setHangupPercent(uint8_t percent);
+
+/**
+ * Set the response used once the script runs out, the peer disconnects instead if none is set.
+ * @param[in]   data    Bytes of the response including the head, NULL to clear it.
+ * @param[in]   size    Number of bytes in the response.
+ * @return 0 if the response was set, not 0 if it is too big.
+ */
+int loopback_setDefaultResponse(const void* data, size_t size);
+
+/**
+ * Get the head of the last complete request the peer received.
+ * @param[out]  size    Number of bytes in the head.
+ * @return The head of the request, not null terminated.
+ */
+const char* loopback_lastRequest(size_t* size);
+
+/**
+ * Current virtual time in microseconds.
+ */
+uint64_t loopback_now(void);
+
+/**
+ * Run pending events in time order until none are left, timers included.
+ * @return Number of events run.
+ */
+size_t loopback_run(void);
+
+/**
+ * Run pending events due up to a point in time, then move the clock to that time.
+ * @param[in]   time    Virtual time to run until.
+ * @return Number of events run.
+ */
+size_t loopback_runUntil(uint64_t time);
+
+/**
+ * Get the counters of the peer.
+ */
+LoopbackStats loopback_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
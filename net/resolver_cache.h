@@ -0,0 +1,205 @@
+#ifndef NET_RESOLVERCACHE
+#define NET_RESOLVERCACHE
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Caches hostname lookups so connections don't pay a resolver round trip each.
+ * Successful lookups are kept for ttl, failed lookups for negativeTtl. Lookups for a name that is already being
+ * resolved wait for that lookup instead of starting another.
+ * getaddrinfo doesn't report record TTLs, so the lifetimes are configured rather than taken from DNS.
+ */
+class ResolverCache
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::vector<boost::asio::ip::tcp::endpoint> Endpoints;
+    typedef std::function<void(const boost::system::error_code&, const Endpoints&)> Handler;
+    typedef std::function<void(const std::string&, const std::string&, Handler)> Lookup;
+    typedef std::function<void(std::function<void()>)> Post;
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t negativeHits;
+        uint64_t misses;
+        uint64_t coalesced;
+
+        double hitRate() const
+        {
+            uint64_t total = hits + negativeHits + misses + coalesced;
+            return total ? double(hits + negativeHits + coalesced) / total : 0.0;
+        }
+    };
+
+    ResolverCache(Lookup lookup, Clock::duration ttl = std::chrono::seconds(60),
+        Clock::duration negativeTtl = std::chrono::seconds(5)) :
+    ResolverCache(lookup, Post(), ttl, negativeTtl)
+    {
+    }
+
+    /**
+     * Run cached answers through post instead of calling their handler from asyncResolve, typically to deliver them
+     * from the io_service like answers that had to be looked up.
+     */
+    ResolverCache(Lookup lookup, Post post, Clock::duration ttl = std::chrono::seconds(60),
+        Clock::duration negativeTtl = std::chrono::seconds(5)) :
+    m_lookup(lookup),
+    m_post(post),
+    m_ttl(ttl),
+    m_negativeTtl(negativeTtl),
+    m_stats()
+    {
+    }
+
+    void setTtl(Clock::duration ttl, Clock::duration negativeTtl)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ttl = ttl;
+        m_negativeTtl = negativeTtl;
+    }
+
+    /**
+     * Resolve a hostname. A cached answer is passed to handler through the post function if there is one, otherwise
+     * immediately.
+     */
+    void asyncResolve(const std::string& hostname, const std::string& service, Handler handler)
+    {
+        Key key(hostname, service);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto i = m_entries.find(key);
+        if(i != m_entries.end())
+        {
+            Entry& entry = i->second;
+            if(entry.pending)
+            { // someone is already asking, wait for their answer
+                ++m_stats.coalesced;
+                entry.waiters.push_back(handler);
+                return;
+            }
+            if(Clock::now() < entry.expires)
+            {
+                if(entry.error)
+                    ++m_stats.negativeHits;
+                else
+                    ++m_stats.hits;
+                boost::system::error_code error = entry.error;
+                Endpoints endpoints = entry.endpoints;
+                lock.unlock();
+                if(m_post)
+                    m_post(std::bind(handler, error, endpoints));
+                else
+                    handler(error, endpoints);
+                return;
+            }
+        }
+
+        ++m_stats.misses;
+        Entry& entry = m_entries[key];
+        entry.pending = true;
+        entry.waiters.push_back(handler);
+        lock.unlock();
+        m_lookup(hostname, service, std::bind(&ResolverCache::lookupHandler, this, key, std::placeholders::_1,
+            std::placeholders::_2));
+    }
+
+    /**
+     * Drop every cached answer.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto i = m_entries.begin(); i != m_entries.end();)
+        {
+            if(i->second.pending)
+                ++i;
+            else
+                i = m_entries.erase(i);
+        }
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    typedef std::pair<std::string, std::string> Key;
+
+    struct Entry
+    {
+        Endpoints endpoints;
+        boost::system::error_code error;
+        Clock::time_point expires;
+        bool pending;
+        std::vector<Handler> waiters;
+
+        Entry() : pending(false) {}
+    };
+
+    Lookup m_lookup;
+    Post m_post;
+    Clock::duration m_ttl;
+    Clock::duration m_negativeTtl;
+    mutable std::mutex m_mutex;
+    std::map<Key, Entry> m_entries;
+    Stats m_stats;
+
+    void lookupHandler(const Key& key, const boost::system::error_code& error, const Endpoints& endpoints)
+    {
+        std::vector<Handler> waiters;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry& entry = m_entries[key];
+            entry.pending = false;
+            entry.error = error;
+            entry.endpoints = error ? Endpoints() : endpoints;
+            entry.expires = Clock::now() + (error || endpoints.empty() ? m_negativeTtl : m_ttl);
+            waiters.swap(entry.waiters);
+        }
+        for(auto& waiter : waiters)
+            waiter(error, endpoints);
+    }
+};
+
+/**
+ * Order endpoints for connection racing as described in RFC 8305, alternating address families starting with IPv6
+ * when both are present. The order within each family is kept.
+ */
+inline ResolverCache::Endpoints interleaveAddressFamilies(const ResolverCache::Endpoints& endpoints)
+{
+    ResolverCache::Endpoints first;
+    ResolverCache::Endpoints second;
+    for(auto& endpoint : endpoints)
+    {
+        if(first.empty() || endpoint.address().is_v6() == first.front().address().is_v6())
+            first.push_back(endpoint);
+        else
+            second.push_back(endpoint);
+    }
+
+    // prefer IPv6 when both are available
+    if(!second.empty() && second.front().address().is_v6())
+        std::swap(first, second);
+
+    ResolverCache::Endpoints ordered;
+    for(size_t i = 0; i < first.size() || i < second.size(); ++i)
+    {
+        if(i < first.size())
+            ordered.push_back(first[i]);
+        if(i < second.size())
+            ordered.push_back(second[i]);
+    }
+    return ordered;
+}
+
+#endif
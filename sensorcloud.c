@@ -1,6 +1,11 @@
 #include "sensorcloud.h"
 
 #include <app/esp8266-sensor/uart.h>
+#include <sensorcloud/endpoints.h>
+#include <sensorcloud/sensor_cache.h>
+#include <sensorcloud/token_store.h>
+#include <detail/algorithm.h>
+#include <detail/trace.h>
 #include <xdr/xdr.h>
 
 void ICACHE_FLASH_ATTR sensorCloud_initPointBuffer(SensorCloudPointBuffer* pointBuffer, void* data, size_t dataSize,
@@ -19,8 +24,200 @@ void ICACHE_FLASH_ATTR sensorCloud_addPoint(SensorCloudPointBuffer* pointBuffer,
     xdr_writeFloat(&pointBuffer->data, value);
 }
 
+size_t ICACHE_FLASH_ATTR sensorCloud_pointCount(const SensorCloudPointBuffer* pointBuffer)
+{
+    return (buffer_size(&pointBuffer->data) - sensorCloud_pointBufferHeaderSize) / sensorCloud_pointBufferDataSize;
+}
+
+void ICACHE_FLASH_ATTR sensorCloud_finishPointBuffer(SensorCloudPointBuffer* pointBuffer)
+{
+    Buffer pointCountWriter;
+    buffer_init(&pointCountWriter, pointBuffer->data.data + sensorCloud_pointBufferHeaderSize - 4, 4);
+    xdr_writeUInt(&pointCountWriter, sensorCloud_pointCount(pointBuffer));
+}
+
+void ICACHE_FLASH_ATTR sensorCloud_initPointDecoder(SensorCloudPointDecoder* decoder, Timestamp* times, float* values,
+    size_t capacity)
+{
+    decoder->times = times;
+    decoder->values = values;
+    decoder->capacity = capacity;
+    decoder->count = 0;
+    decoder->dropped = 0;
+    decoder->partialSize = 0;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloud_decodePoint(SensorCloudPointDecoder* decoder, const char* point)
+{
+    uint64_t time;
+    uint32_t value;
+    memcpy(&time, point, 8);
+    memcpy(&value, point + 8, 4);
+    decoder->times[decoder->count] = xdr_endianUhyper(time);
+    value = xdr_endianUint(value);
+    memcpy(&decoder->values[decoder->count], &value, 4);
+    ++decoder->count;
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloud_decodePoints(SensorCloudPointDecoder* decoder, const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    size_t decoded = 0;
+    if(decoder->partialSize)
+    { // finish the point the last fragment ended in
+        size_t take = min(sensorCloud_pointBufferDataSize - decoder->partialSize, size);
+        memcpy(decoder->partial + decoder->partialSize, bytes, take);
+        decoder->partialSize += take;
+        bytes += take;
+        size -= take;
+        if(decoder->partialSize < sensorCloud_pointBufferDataSize)
+            return 0;
+        if(decoder->count < decoder->capacity)
+            sensorCloud_decodePoint(decoder, decoder->partial);
+        else
+            ++decoder->dropped;
+        decoder->partialSize = 0;
+        ++decoded;
+    }
+
+    // whole points straight from the fragment
+    size_t whole = size / sensorCloud_pointBufferDataSize;
+    size_t fit = min(whole, decoder->capacity - decoder->count);
+    size_t i = 0;
+    for(; i < fit; ++i, bytes += sensorCloud_pointBufferDataSize)
+        sensorCloud_decodePoint(decoder, bytes);
+    decoder->dropped += whole - fit;
+    bytes += (whole - fit) * sensorCloud_pointBufferDataSize;
+
+    decoder->partialSize = size % sensorCloud_pointBufferDataSize;
+    memcpy(decoder->partial, bytes, decoder->partialSize);
+    return decoded + whole;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloud_appendTimestamp(char* url, Timestamp value)
+{
+    char digits[21];
+    char* digit = digits + sizeof(digits) - 1;
+    *digit = '\0';
+    do
+    {
+        *--digit = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    strcat(url, digit);
+}
+
+HTTPError ICACHE_FLASH_ATTR sensorCloud_initUploadRequest(HTTPRequest* request, Buffer requestHead,
+    Buffer responseHead, const char* server, const char* device, const char* token, const char* sensor,
+    const char* channel, void* userData, HTTPRequestCallback callback)
+{
+    char url[256];
+    memset(url, '\0', sizeof(url));
+    strcat(url, "https://");
+    strcat(url, server);
+    strcat(url, "/SensorCloud/devices/");
+    strcat(url, device);
+    strcat(url, "/sensors/");
+    strcat(url, sensor);
+    strcat(url, "/channels/");
+    strcat(url, channel);
+    strcat(url, "/streams/timeseries/data/?version=1&auth_token=");
+    strcat(url, token);
+
+    HTTPError e = http_initRequest(request, "POST", url, requestHead, responseHead, userData, callback);
+    if(e != http_ok)
+        return e;
+    return http_addRequestHeader(request, "Content-Type", "application/xdr");
+}
+
+HTTPError ICACHE_FLASH_ATTR sensorCloud_initAddSensorRequest(HTTPRequest* request, Buffer* body, Buffer requestHead,
+    Buffer responseHead, const char* server, const char* device, const char* token, const char* sensor,
+    void* userData, HTTPRequestCallback callback)
+{
+    // build the url
+    char url[256];
+    memset(url, '\0', sizeof(url));
+    strcat(url, "https://");
+    strcat(url, server);
+    strcat(url, "/SensorCloud/devices/");
+    strcat(url, device);
+    strcat(url, "/sensors/");
+    strcat(url, sensor);
+    strcat(url, "/?version=1&auth_token=");
+    strcat(url, token);
+
+    // build the header
+    HTTPError e = http_initRequest(request, "PUT", url, requestHead, responseHead, userData, callback);
+    if(e != http_ok)
+        return e;
+    e = http_addRequestHeader(request, "Content-Type", "application/xdr");
+    if(e != http_ok)
+        return e;
+
+    // build the body
+    buffer_init(body, body->data, body->length);
+    xdr_writeInt(body, 1);
+    xdr_writeUInt(body, 0);
+    xdr_writeUInt(body, 0);
+    xdr_writeUInt(body, 0);
+    return http_ok;
+}
+
+HTTPError ICACHE_FLASH_ATTR sensorCloud_initDownloadRequest(HTTPRequest* request, Buffer requestHead,
+    Buffer responseHead, const char* server, const char* device, const char* token, const char* sensor,
+    const char* channel, Timestamp start, Timestamp end, void* userData, HTTPRequestCallback callback)
+{
+    char url[256];
+    memset(url, '\0', sizeof(url));
+    strcat(url, "https://");
+    strcat(url, server);
+    strcat(url, "/SensorCloud/devices/");
+    strcat(url, device);
+    strcat(url, "/sensors/");
+    strcat(url, sensor);
+    strcat(url, "/channels/");
+    strcat(url, channel);
+    strcat(url, "/streams/timeseries/data/?version=1&auth_token=");
+    strcat(url, token);
+    strcat(url, "&starttime=");
+    sensorCloud_appendTimestamp(url, start);
+    strcat(url, "&endtime=");
+    sensorCloud_appendTimestamp(url, end);
+
+    HTTPError e = http_initRequest(request, "GET", url, requestHead, responseHead, userData, callback);
+    if(e != http_ok)
+        return e;
+    return http_addRequestHeader(request, "Accept", "application/xdr");
+}
+
+SensorCloudError ICACHE_FLASH_ATTR sensorCloud_responseError(const HTTPRequest* request)
+{
+    HTTPResponseCode code;
+    const char* reason;
+    size_t reasonSize;
+    if(http_getResponseCode(&code, &reason, &reasonSize, request) != http_ok)
+        return sensorCloud_netError;
+
+    switch(code)
+    {
+    case httpResponse_ok:
+    case httpResponse_created:
+        return sensorCloud_ok;
+    case httpResponse_notFound:
+        return sensorCloud_notFound;
+    case httpResponse_unauthorized:
+        if(reasonSize == 5 && memcmp(reason, "Quota", 5) == 0)
+            return sensorCloud_quotaExceeded;
+        return sensorCloud_unauthorized;
+    default:
+        return sensorCloud_badRequest;
+    }
+}
+
 void ICACHE_FLASH_ATTR sensorCloud_callback(SensorCloud* sensorCloud, SensorCloudError error)
 {
+    TRACE_PROBE2(sensorcloud_callback, sensorCloud, error);
+    TRACE_INSTANT(sensorcloud_callback, sensorCloud, error);
     sensorCloud->callback(sensorCloud->userData, error);
 }
 
@@ -29,70 +226,111 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncUploadDataCallback(void* userData, const
     SensorCloud* sensorCloud = (SensorCloud*)userData;
     if(error == http_ok)
         return;
+    TRACE_PROBE2(sensorcloud_upload_done, sensorCloud, error);
+    TRACE_END(sensorcloud_upload, sensorCloud, error);
+    sensorCloudEndpoints_recordRequest(sensorCloud->endpoints, sensorCloudEndpoint_upload, &sensorCloud->request,
+        error);
     if(error != http_complete)
     {
         sensorCloud_callback(sensorCloud, sensorCloud_netError);
         return;
     }
     
-    HTTPResponseCode code;
-    const char* reason;
-    size_t reasonSize;
-    http_getResponseCode(&code, &reason, &reasonSize, &sensorCloud->request);
-
-    if(code == httpResponse_notFound)
+    SensorCloudError result = sensorCloud_responseError(&sensorCloud->request);
+    SensorCloudUploadData* upload = &sensorCloud->pendingRequestData.upload;
+    if(result == sensorCloud_notFound)
     { // sensor doesn't exist
-        SensorCloudUploadData* data = &sensorCloud->pendingRequestData.upload;
-        sensorCloud_asyncAddSensor(sensorCloud, data->sensor, sensorCloud->callback);
+        if(sensorCloud->sensorCache)
+            sensorCloudSensorCache_remove(sensorCloud->sensorCache, upload->sensor);
+        sensorCloud_asyncAddSensor(sensorCloud, upload->sensor, sensorCloud->callback);
         return;
     }
+    if(result == sensorCloud_ok && sensorCloud->sensorCache)
+        sensorCloudSensorCache_add(sensorCloud->sensorCache, upload->sensor);
 
+    if(result == sensorCloud_unauthorized)
+        sensorCloud_invalidateToken(sensorCloud);
     sensorCloud->pendingRequest = sensorCloud_noRequest;
-    if(code == httpResponse_created)
-    { // success
-        sensorCloud_callback(sensorCloud, sensorCloud_ok);
-    }
-    else if(code == httpResponse_unauthorized)
-    { // not authorized
-        if(reasonSize == 5 && memcmp(reason, "Quota", 5))
-            sensorCloud_callback(sensorCloud, sensorCloud_quotaExceeded);
-        else
-            sensorCloud_callback(sensorCloud, sensorCloud_unauthorized);
-    }
-    else
-    {
-        sensorCloud_callback(sensorCloud, sensorCloud_badRequest);
-    }
+    sensorCloud_callback(sensorCloud, result);
 }
 
 void ICACHE_FLASH_ATTR sensorCloud_doUploadData(SensorCloud* sensorCloud)
 {
     SensorCloudUploadData* data = &sensorCloud->pendingRequestData.upload;
-    char url[256];
-    memset(url, '\0', sizeof(url));
-    strcat(url, "https://");
-    strcat(url, sensorCloud->server);
-    strcat(url, "/SensorCloud/devices/");
-    strcat(url, sensorCloud->device);
-    strcat(url, "/sensors/");
-    strcat(url, data->sensor);
-    strcat(url, "/channels/");
-    strcat(url, data->channel);
-    strcat(url, "/streams/timeseries/data/?version=1&auth_token=");
-    strcat(url, sensorCloud->token);
+    TRACE_BEGIN(sensorcloud_upload, sensorCloud);
 
     Buffer requestHead;
     buffer_init(&requestHead, sensorCloud->requestBuffer, sizeof(sensorCloud->requestBuffer));
     Buffer responseHead;
     buffer_init(&responseHead, sensorCloud->requestBuffer, sizeof(sensorCloud->requestBuffer));
     //buffer_init(&responseHead, sensorCloud->requestBuffer + 512, 512);
-    http_initRequest(&sensorCloud->request, "POST", url, requestHead, responseHead, sensorCloud,
+    sensorCloud_initUploadRequest(&sensorCloud->request, requestHead, responseHead,
+        sensorCloud_uploadServer(sensorCloud), sensorCloud->device, sensorCloud->token, data->sensor, data->channel, sensorCloud,
         sensorCloud_asyncUploadDataCallback);
-    http_addRequestHeader(&sensorCloud->request, "Content-Type", "application/xdr");
 
     http_asyncRequest(&sensorCloud->request, data->body);
 }
 
+void ICACHE_FLASH_ATTR sensorCloud_asyncDownloadDataCallback(void* userData, const void* data, size_t dataSize,
+    HTTPError error)
+{
+    SensorCloud* sensorCloud = (SensorCloud*)userData;
+    SensorCloudDownloadData* download = &sensorCloud->pendingRequestData.download;
+    if(error == http_ok)
+    { // decode the points as they arrive, the body of an error isn't points
+        HTTPResponseCode code;
+        const char* reason;
+        size_t reasonSize;
+        if(dataSize && http_getResponseCode(&code, &reason, &reasonSize, &sensorCloud->request) == http_ok &&
+            code == httpResponse_ok)
+            sensorCloud_decodePoints(download->decoder, data, dataSize);
+        return;
+    }
+    TRACE_PROBE3(sensorcloud_download_done, sensorCloud, error, download->decoder->count);
+    TRACE_END(sensorcloud_download, sensorCloud, error);
+    sensorCloudEndpoints_recordRequest(sensorCloud->endpoints, sensorCloudEndpoint_upload, &sensorCloud->request,
+        error);
+    sensorCloud->pendingRequest = sensorCloud_noRequest;
+    if(error != http_complete)
+    {
+        sensorCloud_callback(sensorCloud, sensorCloud_netError);
+        return;
+    }
+
+    SensorCloudError result = sensorCloud_responseError(&sensorCloud->request);
+    if(result == sensorCloud_unauthorized)
+        sensorCloud_invalidateToken(sensorCloud);
+    else if(result == sensorCloud_ok && download->decoder->partialSize)
+        result = sensorCloud_netError; // the body ended in the middle of a point
+    else if(result == sensorCloud_ok && download->decoder->dropped)
+        result = sensorCloud_tooManyPoints;
+    sensorCloud_callback(sensorCloud, result);
+}
+
+void ICACHE_FLASH_ATTR sensorCloud_doDownloadData(SensorCloud* sensorCloud)
+{
+    SensorCloudDownloadData* data = &sensorCloud->pendingRequestData.download;
+    TRACE_BEGIN(sensorcloud_download, sensorCloud);
+
+    Buffer requestHead;
+    buffer_init(&requestHead, sensorCloud->requestBuffer, 512);
+    Buffer responseHead;
+    buffer_init(&responseHead, sensorCloud->requestBuffer + 512, 512);
+    HTTPError e = sensorCloud_initDownloadRequest(&sensorCloud->request, requestHead, responseHead,
+        sensorCloud_uploadServer(sensorCloud), sensorCloud->device, sensorCloud->token, data->sensor, data->channel, data->start,
+        data->end, sensorCloud, sensorCloud_asyncDownloadDataCallback);
+    Buffer body;
+    buffer_init(&body, NULL, 0);
+    if(e == http_ok)
+        e = http_asyncRequest(&sensorCloud->request, body);
+    if(e != http_ok)
+    {
+        TRACE_END(sensorcloud_download, sensorCloud, e);
+        sensorCloud->pendingRequest = sensorCloud_noRequest;
+        sensorCloud_callback(sensorCloud, sensorCloud_netError);
+    }
+}
+
 void ICACHE_FLASH_ATTR sensorCloud_init(SensorCloud* sensorCloud, const char* device, const char* key, void* userData)
 {
     sensorCloud->device = device;
@@ -100,6 +338,64 @@ void ICACHE_FLASH_ATTR sensorCloud_init(SensorCloud* sensorCloud, const char* de
     sensorCloud->authenticated = 0;
     sensorCloud->userData = userData;
     sensorCloud->pendingRequest = sensorCloud_noRequest;
+    sensorCloud->tokenStore = NULL;
+    sensorCloud->sensorCache = NULL;
+    sensorCloud->sensor = NULL;
+    sensorCloud->endpoints = NULL;
+}
+
+void ICACHE_FLASH_ATTR sensorCloud_setSensorCache(SensorCloud* sensorCloud, SensorCloudSensorCache* sensorCache)
+{
+    sensorCloud->sensorCache = sensorCache;
+}
+
+void ICACHE_FLASH_ATTR sensorCloud_setEndpoints(SensorCloud* sensorCloud, SensorCloudEndpoints* endpoints)
+{
+    sensorCloud->endpoints = endpoints;
+}
+
+const char* ICACHE_FLASH_ATTR sensorCloud_uploadServer(SensorCloud* sensorCloud)
+{
+    const char* server = sensorCloud->endpoints ?
+        sensorCloudEndpoints_select(sensorCloud->endpoints, sensorCloudEndpoint_upload) : NULL;
+    return server ? server : sensorCloud->server;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloud_authWaiterCallback(void* userData, SensorCloudError error);
+
+void ICACHE_FLASH_ATTR sensorCloud_setTokenStore(SensorCloud* sensorCloud, SensorCloudTokenStore* tokenStore)
+{
+    sensorCloud->tokenStore = tokenStore;
+    sensorCloud->authWaiter.callback = sensorCloud_authWaiterCallback;
+    sensorCloud->authWaiter.userData = sensorCloud;
+    sensorCloud->authWaiter.next = NULL;
+}
+
+SensorCloudTokenState ICACHE_FLASH_ATTR sensorCloud_tokenState(SensorCloud* sensorCloud)
+{
+    if(!sensorCloud->tokenStore)
+        return sensorCloud->authenticated ? sensorCloudToken_fresh : sensorCloudToken_missing;
+
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(sensorCloud->tokenStore, sensorCloud->device);
+    SensorCloudTokenState state = sensorCloudTokenStore_state(sensorCloud->tokenStore, entry);
+    if(state == sensorCloudToken_fresh || state == sensorCloudToken_refresh)
+    { // use the stored copy, it is updated in place by refreshes
+        sensorCloud->token = entry->token;
+        sensorCloud->server = entry->server;
+        sensorCloud->authenticated = 1;
+    }
+    else
+    {
+        sensorCloud->authenticated = 0;
+    }
+    return state;
+}
+
+void ICACHE_FLASH_ATTR sensorCloud_invalidateToken(SensorCloud* sensorCloud)
+{
+    sensorCloud->authenticated = 0;
+    if(sensorCloud->tokenStore)
+        sensorCloudTokenStore_invalidate(sensorCloud->tokenStore, sensorCloud->device);
 }
 
 void ICACHE_FLASH_ATTR sensorCloud_executePending(SensorCloud* sensorCloud)
@@ -109,12 +405,47 @@ void ICACHE_FLASH_ATTR sensorCloud_executePending(SensorCloud* sensorCloud)
     case sensorCloud_uploadRequest:
         sensorCloud_doUploadData(sensorCloud);
         break;
+    case sensorCloud_downloadRequest:
+        sensorCloud_doDownloadData(sensorCloud);
+        break;
     default:
         sensorCloud_callback(sensorCloud, sensorCloud_ok);
         break;
     }
 }
 
+static void ICACHE_FLASH_ATTR sensorCloud_authenticateDone(SensorCloud* sensorCloud, SensorCloudError error)
+{
+    if(error == sensorCloud_netError && sensorCloud_tokenState(sensorCloud) == sensorCloudToken_refresh)
+        error = sensorCloud_ok; // a refresh the server never answered leaves the old token usable until it expires
+
+    if(error == sensorCloud_ok)
+        sensorCloud_executePending(sensorCloud);
+    else
+        sensorCloud_callback(sensorCloud, error);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloud_finishAuthenticate(SensorCloud* sensorCloud, SensorCloudError error)
+{
+    if(error == sensorCloud_unauthorized) // the key was rejected, the token it got before is no good either
+        sensorCloud_invalidateToken(sensorCloud);
+    if(sensorCloud->tokenStore)
+        sensorCloudTokenStore_endAuthenticate(sensorCloud->tokenStore, sensorCloud->device, error);
+    sensorCloud_authenticateDone(sensorCloud, error);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloud_authWaiterCallback(void* userData, SensorCloudError error)
+{
+    SensorCloud* sensorCloud = (SensorCloud*)userData;
+    SensorCloudTokenState state = sensorCloud_tokenState(sensorCloud);
+    if(error == sensorCloud_ok && state != sensorCloudToken_fresh && state != sensorCloudToken_refresh)
+    { // the token didn't make it into the store, get our own
+        sensorCloud_asyncAuthenticate(sensorCloud, sensorCloud->callback);
+        return;
+    }
+    sensorCloud_authenticateDone(sensorCloud, error);
+}
+
 void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticateCallback(void* userData, const void* data, size_t dataSize, HTTPError error)
 {
     SensorCloud* sensorCloud = (SensorCloud*)userData;
@@ -123,9 +454,13 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticateCallback(void* userData, con
         buffer_write(&sensorCloud->authDataBuffer, (const char*)data, dataSize);
         return; // wait for the next read
     }
+    TRACE_PROBE2(sensorcloud_authenticate_done, sensorCloud, error);
+    TRACE_END(sensorcloud_authenticate, sensorCloud, error);
+    sensorCloudEndpoints_recordRequest(sensorCloud->endpoints, sensorCloudEndpoint_auth, &sensorCloud->request,
+        error);
     if(error != http_complete)
     {
-        sensorCloud_callback(sensorCloud, sensorCloud_netError);
+        sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_netError);
         return;
     }
 
@@ -138,9 +473,11 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticateCallback(void* userData, con
     http_getResponseCode(&code, &reason, &reasonSize, &sensorCloud->request);
 
     if(code == httpResponse_unauthorized)
-        sensorCloud_callback(sensorCloud, sensorCloud_unauthorized);
+        sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_unauthorized);
+    else if(code >= 500 && code < 600)
+        sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_netError);
     else if(code != httpResponse_ok)
-        sensorCloud_callback(sensorCloud, sensorCloud_netError);
+        sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_badRequest);
     else
     { // we've authenticated
         sensorCloud->authenticated = 1;
@@ -157,28 +494,42 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticateCallback(void* userData, con
         xdr_readString(NULL, tokenSize, &sensorCloud->authDataBuffer);
         xdr_readUInt(&serverSize, &sensorCloud->authDataBuffer);
         sensorCloud->server = sensorCloud->authDataBuffer.getPtr;
-        
-        char* server = (char*)sensorCloud->authDataBuffer.getPtr;
-
-        memcpy(server, "10.51.50.111\0", 13);
         *((char*)sensorCloud->token + tokenSize) = '\0';
         *((char*)sensorCloud->server + serverSize) = '\0';
 
+        // share the token, from now on it is used from the store
+        if(sensorCloud->tokenStore && sensorCloudTokenStore_put(sensorCloud->tokenStore, sensorCloud->device,
+            sensorCloud->token, strlen(sensorCloud->token), sensorCloud->server, strlen(sensorCloud->server)) == 0)
+            sensorCloud_tokenState(sensorCloud);
+
         // execute the pending request if there is one
-        sensorCloud_executePending(sensorCloud);
+        sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_ok);
     }
 }
 
 void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticate(SensorCloud* sensorCloud, SensorCloudCallback callback)
 {
+    TRACE_PROBE2(sensorcloud_authenticate, sensorCloud, sensorCloud->device);
     sensorCloud->callback = callback;
+    if(sensorCloud->tokenStore &&
+        !sensorCloudTokenStore_beginAuthenticate(sensorCloud->tokenStore, sensorCloud->device, &sensorCloud->authWaiter))
+        return; // someone else is authenticating, wait for their token
+    TRACE_BEGIN(sensorcloud_authenticate, sensorCloud);
 
     buffer_init(&sensorCloud->authDataBuffer, sensorCloud->authData, sizeof(sensorCloud->authData));
 
     // build the url
+    const char* authServer = sensorCloud->endpoints ?
+        sensorCloudEndpoints_select(sensorCloud->endpoints, sensorCloudEndpoint_auth) : NULL;
     char url[256];
     memset(url, '\0', sizeof(url));
-    strcat(url, SENSORCLOUD_AUTH_URL);
+    if(authServer)
+    {
+        strcat(url, "https://");
+        strcat(url, authServer);
+    }
+    else
+        strcat(url, SENSORCLOUD_AUTH_URL);
     strcat(url, "/SensorCloud/devices/");
     strcat(url, sensorCloud->device);
     strcat(url, "/authenticate/?version=1&key=");
@@ -192,10 +543,10 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticate(SensorCloud* sensorCloud, S
     HTTPError e = http_initRequest(&sensorCloud->request, "GET", url, requestHead, responseHead, sensorCloud,
         sensorCloud_asyncAuthenticateCallback);
     if(e != http_ok)
-        return sensorCloud_callback(sensorCloud, sensorCloud_netError);
+        return sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_netError);
     e = http_addRequestHeader(&sensorCloud->request, "Accept", "application/xdr");
     if(e != http_ok)
-        return sensorCloud_callback(sensorCloud, sensorCloud_netError);
+        return sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_netError);
 
     Buffer body;
     buffer_init(&body, NULL, 0);
@@ -203,7 +554,7 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAuthenticate(SensorCloud* sensorCloud, S
     // initiate the request
     e = http_asyncRequest(&sensorCloud->request, body);
     if(e != http_ok)
-        return sensorCloud_callback(sensorCloud, sensorCloud_netError);
+        return sensorCloud_finishAuthenticate(sensorCloud, sensorCloud_netError);
 }
 
 void ICACHE_FLASH_ATTR sensorCloud_asyncAddSensorCallback(void* userData, const void* data, size_t dataSize, HTTPError error)
@@ -211,19 +562,22 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAddSensorCallback(void* userData, const
     SensorCloud* sensorCloud = (SensorCloud*)userData;
     if(error == http_ok) // response not complete
         return;
+    TRACE_PROBE2(sensorcloud_add_sensor_done, sensorCloud, error);
+    TRACE_END(sensorcloud_add_sensor, sensorCloud, error);
+    sensorCloudEndpoints_recordRequest(sensorCloud->endpoints, sensorCloudEndpoint_upload, &sensorCloud->request,
+        error);
     if(error != http_complete)
     {
         sensorCloud_callback(sensorCloud, sensorCloud_netError);
         return;
     }
     
-    HTTPResponseCode code;
-    const char* reason;
-    size_t reasonSize;
-    http_getResponseCode(&code, &reason, &reasonSize, &sensorCloud->request);
-    
-    if(code == httpResponse_created)
+    if(sensorCloud_responseError(&sensorCloud->request) == sensorCloud_ok)
+    {
+        if(sensorCloud->sensorCache)
+            sensorCloudSensorCache_add(sensorCloud->sensorCache, sensorCloud->sensor);
         sensorCloud_executePending(sensorCloud);
+    }
     else
     { // we've authenticated
         sensorCloud_callback(sensorCloud, sensorCloud_badRequest);
@@ -232,36 +586,20 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncAddSensorCallback(void* userData, const
 
 void ICACHE_FLASH_ATTR sensorCloud_asyncAddSensor(SensorCloud* sensorCloud, const char* sensor, SensorCloudCallback callback)
 {
+    TRACE_PROBE2(sensorcloud_add_sensor, sensorCloud, sensor);
+    TRACE_BEGIN(sensorcloud_add_sensor, sensorCloud);
     sensorCloud->callback = callback;
+    sensorCloud->sensor = sensor;
 
-    // build the url
-    char url[256];
-    memset(url, '\0', sizeof(url));
-    strcat(url, "https://");
-    strcat(url, sensorCloud->server);
-    strcat(url, "/SensorCloud/devices/");
-    strcat(url, sensorCloud->device);
-    strcat(url, "/sensors/");
-    strcat(url, sensor);
-    strcat(url, "/?version=1&auth_token=");
-    strcat(url, sensorCloud->token);
-
-    // build the header
     Buffer requestHead;
     buffer_init(&requestHead, sensorCloud->requestBuffer, 512);
     Buffer responseHead;
     buffer_init(&responseHead, sensorCloud->requestBuffer + 512, 512);
-    http_initRequest(&sensorCloud->request, "PUT", url, requestHead, responseHead, sensorCloud, 
-        sensorCloud_asyncAddSensorCallback);
-    http_addRequestHeader(&sensorCloud->request, "Content-Type", "application/xdr");
-
-    // build the body
     Buffer body;
     buffer_init(&body, sensorCloud->sensorInfo, sizeof(sensorCloud->sensorInfo));
-    xdr_writeInt(&body, 1);
-    xdr_writeUInt(&body, 0);
-    xdr_writeUInt(&body, 0);
-    xdr_writeUInt(&body, 0);
+    sensorCloud_initAddSensorRequest(&sensorCloud->request, &body, requestHead, responseHead,
+        sensorCloud_uploadServer(sensorCloud), sensorCloud->device, sensorCloud->token, sensor, sensorCloud,
+        sensorCloud_asyncAddSensorCallback);
 
     // initiate the request
     http_asyncRequest(&sensorCloud->request, body);
@@ -275,18 +613,36 @@ void ICACHE_FLASH_ATTR sensorCloud_asyncUploadData(SensorCloud* sensorCloud, con
     SensorCloudUploadData* data = &sensorCloud->pendingRequestData.upload;
     data->sensor = sensor;
     data->channel = channel;
-    data->body = points->data;
     sensorCloud->callback = callback;
 
     // write the point count to the body data
-    size_t pointCount = (buffer_size(&data->body) - sensorCloud_pointBufferHeaderSize) / 
-        sensorCloud_pointBufferDataSize;
-    Buffer pointCountWriter;
-    buffer_init(&pointCountWriter, data->body.data + sensorCloud_pointBufferHeaderSize - 4, 4);
-    xdr_writeUInt(&pointCountWriter, pointCount);
+    sensorCloud_finishPointBuffer(points);
+    data->body = points->data;
+    TRACE_PROBE4(sensorcloud_upload, sensorCloud, sensor, channel, sensorCloud_pointCount(points));
 
-    if(!sensorCloud->authenticated)
+    // a single request at a time means refreshing before the upload rather than alongside it
+    if(sensorCloud_tokenState(sensorCloud) != sensorCloudToken_fresh)
         sensorCloud_asyncAuthenticate(sensorCloud, callback);
     else
         sensorCloud_doUploadData(sensorCloud);
 }
+
+void ICACHE_FLASH_ATTR sensorCloud_asyncDownloadData(SensorCloud* sensorCloud, const char* sensor,
+    const char* channel, Timestamp start, Timestamp end, SensorCloudPointDecoder* decoder,
+    SensorCloudCallback callback)
+{
+    sensorCloud->pendingRequest = sensorCloud_downloadRequest;
+    SensorCloudDownloadData* data = &sensorCloud->pendingRequestData.download;
+    data->sensor = sensor;
+    data->channel = channel;
+    data->start = start;
+    data->end = end;
+    data->decoder = decoder;
+    sensorCloud->callback = callback;
+    TRACE_PROBE4(sensorcloud_download, sensorCloud, sensor, channel, start);
+
+    if(sensorCloud_tokenState(sensorCloud) != sensorCloudToken_fresh)
+        sensorCloud_asyncAuthenticate(sensorCloud, callback);
+    else
+        sensorCloud_doDownloadData(sensorCloud);
+}
@@ -20,7 +20,8 @@ typedef enum
     sensorCloud_tooManyPoints,
     sensorCloud_badRequest,
     sensorCloud_quotaExceeded,
-    sensorCloud_netError
+    sensorCloud_netError,
+    sensorCloud_notFound
 } SensorCloudError;
 
 typedef uint64_t Timestamp;
@@ -39,10 +40,35 @@ typedef struct
 
 typedef void (*SensorCloudCallback)(void*, SensorCloudError);
 
+typedef enum
+{
+    // never authenticated or the token was rejected
+    sensorCloudToken_missing,
+    sensorCloudToken_fresh,
+    // still usable but due to be refreshed
+    sensorCloudToken_refresh,
+    sensorCloudToken_expired
+} SensorCloudTokenState;
+
+/**
+ * Someone waiting for an authentication another context started.
+ */
+typedef struct SensorCloudAuthWaiterData
+{
+    SensorCloudCallback callback;
+    void* userData;
+    struct SensorCloudAuthWaiterData* next;
+} SensorCloudAuthWaiter;
+
+struct SensorCloudTokenStoreData;
+struct SensorCloudSensorCacheData;
+struct SensorCloudEndpointsData;
+
 typedef enum SensorCloudRequest
 {
     sensorCloud_noRequest,
-    sensorCloud_uploadRequest
+    sensorCloud_uploadRequest,
+    sensorCloud_downloadRequest
 } SensorCloudRequest;
 
 typedef struct
@@ -54,6 +80,31 @@ typedef struct
     void(*callback)(void*, SensorCloudError);
 } SensorCloudUploadData;
 
+/**
+ * Decodes a stream of XDR points into separate timestamp and value arrays as it arrives, in fragments of any size.
+ */
+typedef struct
+{
+    Timestamp* times;
+    float* values;
+    size_t capacity;
+    size_t count;
+    // points that didn't fit
+    size_t dropped;
+    // start of a point split across fragments
+    char partial[12];
+    size_t partialSize;
+} SensorCloudPointDecoder;
+
+typedef struct
+{
+    const char* sensor;
+    const char* channel;
+    Timestamp start;
+    Timestamp end;
+    SensorCloudPointDecoder* decoder;
+} SensorCloudDownloadData;
+
 typedef struct
 {
     const char* device;
@@ -72,7 +123,18 @@ typedef struct
     union
     {
         SensorCloudUploadData upload;
+        SensorCloudDownloadData download;
     } pendingRequestData;
+    // tokens shared with other contexts, NULL to keep the token to this one
+    struct SensorCloudTokenStoreData* tokenStore;
+    SensorCloudAuthWaiter authWaiter;
+    // sensors known to exist, NULL to find out from the server every time
+    struct SensorCloudSensorCacheData* sensorCache;
+    // sensor being added
+    const char* sensor;
+    // endpoints configured at runtime, NULL to authenticate at SENSORCLOUD_AUTH_URL and make the other requests to
+    // the server handed out with the token
+    struct SensorCloudEndpointsData* endpoints;
 } SensorCloud;
 
 static const size_t sensorCloud_pointBufferHeaderSize = 16;
@@ -89,8 +151,145 @@ void sensorCloud_initPointBuffer(SensorCloudPointBuffer* pointBuffer, void* data
 
 void sensorCloud_addPoint(SensorCloudPointBuffer* pointBuffer, Timestamp time, float value);
 
+/**
+ * Number of points in a point buffer.
+ * @param[in]   pointBuffer Buffer to count the points of.
+ */
+size_t sensorCloud_pointCount(const SensorCloudPointBuffer* pointBuffer);
+
+/**
+ * Write the point count into the header of a point buffer, making it ready to be sent.
+ * @param[io]   pointBuffer Buffer to finish.
+ */
+void sensorCloud_finishPointBuffer(SensorCloudPointBuffer* pointBuffer);
+
+/**
+ * Initialize a point decoder.
+ * @param[out]  decoder     Decoder to initialize.
+ * @param[in]   times       Storage for the timestamps of the points.
+ * @param[in]   values      Storage for the values of the points.
+ * @param[in]   capacity    Number of points that fit in the storage.
+ */
+void sensorCloud_initPointDecoder(SensorCloudPointDecoder* decoder, Timestamp* times, float* values,
+    size_t capacity);
+
+/**
+ * Decode the next fragment of a point stream.
+ * @param[io]   decoder Decoder to decode with.
+ * @param[in]   data    Fragment of the stream, a point may be split across fragments.
+ * @param[in]   size    Number of bytes in the fragment.
+ * @return Number of points decoded from the fragment, including those dropped because the storage is full.
+ */
+size_t sensorCloud_decodePoints(SensorCloudPointDecoder* decoder, const void* data, size_t size);
+
+/**
+ * Prepare a request that uploads a point buffer to a channel.
+ * @param[out]  request         Request to prepare, start it with http_asyncRequest and the point buffer data.
+ * @param[in]   requestHead     Buffer for the request head.
+ * @param[in]   responseHead    Buffer for the response head.
+ * @param[in]   server          Server handed out at authentication.
+ * @param[in]   device          Device the channel belongs to.
+ * @param[in]   token           Token handed out at authentication.
+ * @param[in]   sensor          Sensor the channel belongs to.
+ * @param[in]   channel         Channel to upload to.
+ * @param[in]   userData        User data passed to callback.
+ * @param[in]   callback        Called as the request progresses.
+ * @return http_ok if the request was prepared, another error otherwise.
+ */
+HTTPError sensorCloud_initUploadRequest(HTTPRequest* request, Buffer requestHead, Buffer responseHead,
+    const char* server, const char* device, const char* token, const char* sensor, const char* channel,
+    void* userData, HTTPRequestCallback callback);
+
+/**
+ * Prepare a request that creates a sensor.
+ * @param[out]  request         Request to prepare, start it with http_asyncRequest and body.
+ * @param[out]  body            Body of the request, written into its existing storage which needs 16 bytes.
+ * @param[in]   requestHead     Buffer for the request head.
+ * @param[in]   responseHead    Buffer for the response head.
+ * @param[in]   server          Server handed out at authentication.
+ * @param[in]   device          Device the sensor belongs to.
+ * @param[in]   token           Token handed out at authentication.
+ * @param[in]   sensor          Sensor to create.
+ * @param[in]   userData        User data passed to callback.
+ * @param[in]   callback        Called as the request progresses.
+ * @return http_ok if the request was prepared, another error otherwise.
+ */
+HTTPError sensorCloud_initAddSensorRequest(HTTPRequest* request, Buffer* body, Buffer requestHead,
+    Buffer responseHead, const char* server, const char* device, const char* token, const char* sensor,
+    void* userData, HTTPRequestCallback callback);
+
+/**
+ * Prepare a request that downloads the points of a channel as XDR.
+ * @param[out]  request         Request to prepare, start it with http_asyncRequest and an empty body.
+ * @param[in]   requestHead     Buffer for the request head.
+ * @param[in]   responseHead    Buffer for the response head.
+ * @param[in]   server          Server handed out at authentication.
+ * @param[in]   device          Device the channel belongs to.
+ * @param[in]   token           Token handed out at authentication.
+ * @param[in]   sensor          Sensor the channel belongs to.
+ * @param[in]   channel         Channel to download from.
+ * @param[in]   start           Timestamp of the first point to download, in nanoseconds.
+ * @param[in]   end             Timestamp of the last point to download, in nanoseconds.
+ * @param[in]   userData        User data passed to callback.
+ * @param[in]   callback        Called with each fragment of the body as it arrives.
+ * @return http_ok if the request was prepared, another error otherwise.
+ */
+HTTPError sensorCloud_initDownloadRequest(HTTPRequest* request, Buffer requestHead, Buffer responseHead,
+    const char* server, const char* device, const char* token, const char* sensor, const char* channel,
+    Timestamp start, Timestamp end, void* userData, HTTPRequestCallback callback);
+
+/**
+ * Interpret the response to a finished upload or add sensor request.
+ * @param[in]   request Request that finished with http_complete.
+ * @return sensorCloud_ok if the server accepted the request, sensorCloud_notFound if the sensor doesn't exist,
+ *  another error otherwise.
+ */
+SensorCloudError sensorCloud_responseError(const HTTPRequest* request);
+
 void sensorCloud_init(SensorCloud* sensorCloud, const char* device, const char* key, void* userData);
 
+/**
+ * Share tokens through a store, a valid token in the store saves authenticating.
+ * @param[io]   sensorCloud Initialized SensorCloud.
+ * @param[in]   tokenStore  Initialized store, NULL to stop using one.
+ */
+void sensorCloud_setTokenStore(SensorCloud* sensorCloud, struct SensorCloudTokenStoreData* tokenStore);
+
+/**
+ * Remember which sensors exist in a cache.
+ * @param[io]   sensorCloud Initialized SensorCloud.
+ * @param[in]   sensorCache Initialized cache, NULL to stop using one.
+ */
+void sensorCloud_setSensorCache(SensorCloud* sensorCloud, struct SensorCloudSensorCacheData* sensorCache);
+
+/**
+ * Authenticate and upload through endpoints configured at runtime, picking the fastest healthy one of each role.
+ * A role without endpoints keeps going where it did without them.
+ * @param[io]   sensorCloud Initialized SensorCloud.
+ * @param[in]   endpoints   Initialized endpoints, NULL to stop using them.
+ */
+void sensorCloud_setEndpoints(SensorCloud* sensorCloud, struct SensorCloudEndpointsData* endpoints);
+
+/**
+ * Server the next request made with the token goes to.
+ * @param[io]   sensorCloud Authenticated SensorCloud.
+ * @return The fastest healthy upload endpoint, the server handed out with the token if there are none.
+ */
+const char* sensorCloud_uploadServer(SensorCloud* sensorCloud);
+
+/**
+ * Get the state of the token, picking up a token another context stored.
+ * @param[io]   sensorCloud SensorCloud to check.
+ * @return sensorCloudToken_fresh or sensorCloudToken_missing without a store.
+ */
+SensorCloudTokenState sensorCloud_tokenState(SensorCloud* sensorCloud);
+
+/**
+ * Forget the token after the server rejected it, the next request authenticates again.
+ * @param[io]   sensorCloud SensorCloud to update.
+ */
+void sensorCloud_invalidateToken(SensorCloud* sensorCloud);
+
 void sensorCloud_asyncAuthenticate(SensorCloud* sensorCloud, SensorCloudCallback callback);
 
 void sensorCloud_asyncAddSensor(SensorCloud* sensorCloud, const char* sensor, SensorCloudCallback callback);
@@ -98,6 +297,20 @@ void sensorCloud_asyncAddSensor(SensorCloud* sensorCloud, const char* sensor, Se
 void sensorCloud_asyncUploadData(SensorCloud* sensorCloud, const char* sensor, const char* channel,
     SensorCloudPointBuffer* points, SensorCloudCallback callback);
 
+/**
+ * Download the points of a channel, decoding them as the response arrives without buffering the body.
+ * @param[io]   sensorCloud SensorCloud to download with.
+ * @param[in]   sensor      Sensor the channel belongs to.
+ * @param[in]   channel     Channel to download from.
+ * @param[in]   start       Timestamp of the first point to download, in nanoseconds.
+ * @param[in]   end         Timestamp of the last point to download, in nanoseconds.
+ * @param[io]   decoder     Initialized decoder the points are added to.
+ * @param[in]   callback    Called when the download finished, with sensorCloud_tooManyPoints if some points
+ *  didn't fit in the decoder.
+ */
+void sensorCloud_asyncDownloadData(SensorCloud* sensorCloud, const char* sensor, const char* channel,
+    Timestamp start, Timestamp end, SensorCloudPointDecoder* decoder, SensorCloudCallback callback);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,146 @@
+#include "backfill.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+
+static void ICACHE_FLASH_ATTR sensorCloudBackfill_completion(void* userData, SensorCloudSubmission* submission);
+
+static void ICACHE_FLASH_ATTR sensorCloudBackfill_submit(SensorCloudBackfill* backfill, SensorCloudBackfillRange* range)
+{
+    sensorCloudEngine_initRange(&range->submission, backfill->sensor, backfill->channel, backfill->points,
+        range->first, range->count, backfill);
+    sensorCloudEngine_pushCompletion(&range->submission, sensorCloudBackfill_completion, backfill);
+    sensorCloudStage_submit(&backfill->stage, &range->submission);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudBackfill_fill(SensorCloudBackfill* backfill)
+{
+    size_t end = sensorCloud_pointCount(backfill->points);
+    while(backfill->running && backfill->used < backfill->size && backfill->next < end)
+    {
+        SensorCloudBackfillRange* range = &backfill->ranges[(backfill->first + backfill->used) % backfill->size];
+        range->first = backfill->next;
+        range->count = min(end - backfill->next, backfill->rangePoints);
+        range->attempts = 1;
+        range->state = sensorCloudRange_uploading;
+        backfill->next += range->count;
+        ++backfill->used;
+        sensorCloudBackfill_submit(backfill, range);
+    }
+}
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudBackfill_retriable(SensorCloudError error)
+{
+    // a dropped connection or an expired token, anything else fails the same way again
+    return error == sensorCloud_netError || error == sensorCloud_unauthorized;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudBackfill_completion(void* userData, SensorCloudSubmission* submission)
+{
+    SensorCloudBackfill* backfill = (SensorCloudBackfill*)userData;
+    SensorCloudBackfillRange* range = (SensorCloudBackfillRange*)submission;
+    TRACE_PROBE4(sensorcloud_backfill_range, backfill, range->first, range->count, submission->error);
+    if(submission->error == sensorCloud_ok)
+    {
+        range->state = sensorCloudRange_done;
+        ++backfill->rangesUploaded;
+    }
+    else if(backfill->running && range->attempts < SENSORCLOUD_BACKFILL_ATTEMPTS &&
+        sensorCloudBackfill_retriable(submission->error))
+    { // only this range goes again, the others carry on
+        ++range->attempts;
+        ++backfill->retries;
+        sensorCloudBackfill_submit(backfill, range);
+        return;
+    }
+    else
+    { // stop handing out ranges, the resume point stays before this one
+        range->state = sensorCloudRange_failed;
+        if(backfill->running)
+            backfill->error = submission->error;
+        backfill->running = 0;
+    }
+
+    // the resume point moves over the ranges uploaded in order
+    uint8_t progressed = 0;
+    while(backfill->used)
+    {
+        SensorCloudBackfillRange* first = &backfill->ranges[backfill->first];
+        if(first->state != sensorCloudRange_done)
+            break;
+        backfill->resumePoint = first->first + first->count;
+        backfill->first = (backfill->first + 1) % backfill->size;
+        --backfill->used;
+        progressed = 1;
+    }
+
+    sensorCloudBackfill_fill(backfill);
+    if(backfill->used == 0)
+    {
+        backfill->running = 0;
+    }
+    else if(!backfill->running)
+    { // stopped, wait for the uploads still running
+        size_t i = 0;
+        for(; i < backfill->used; ++i)
+        {
+            if(backfill->ranges[(backfill->first + i) % backfill->size].state == sensorCloudRange_uploading)
+                break;
+        }
+        if(i < backfill->used)
+            return;
+        backfill->used = 0;
+        progressed = 1;
+    }
+
+    if((progressed || !backfill->running) && backfill->callback)
+        backfill->callback(backfill->userData, backfill);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBackfill_init(SensorCloudBackfill* backfill, SensorCloudEngine* engine,
+    SensorCloudBackfillRange* ranges, size_t size, size_t rangePoints, SensorCloudBackfillCallback callback,
+    void* userData)
+{
+    memset(backfill, 0, sizeof(SensorCloudBackfill));
+    backfill->engine = engine;
+    backfill->ranges = ranges;
+    backfill->size = size;
+    backfill->rangePoints = rangePoints && rangePoints < engine->maxPoints ? rangePoints : engine->maxPoints;
+    backfill->error = sensorCloud_ok;
+    backfill->callback = callback;
+    backfill->userData = userData;
+    sensorCloudEngine_initStage(&backfill->stage, engine);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBackfill_setStage(SensorCloudBackfill* backfill, const SensorCloudStage* stage)
+{
+    if(stage)
+        backfill->stage = *stage;
+    else
+        sensorCloudEngine_initStage(&backfill->stage, backfill->engine);
+}
+
+int ICACHE_FLASH_ATTR sensorCloudBackfill_start(SensorCloudBackfill* backfill, const char* sensor,
+    const char* channel, SensorCloudPointBuffer* points, size_t resumePoint)
+{
+    if(backfill->running || backfill->used)
+        return 1;
+
+    size_t end = sensorCloud_pointCount(points);
+    TRACE_PROBE3(sensorcloud_backfill, backfill, resumePoint, end);
+    backfill->sensor = sensor;
+    backfill->channel = channel;
+    backfill->points = points;
+    backfill->resumePoint = min(resumePoint, end);
+    backfill->next = backfill->resumePoint;
+    backfill->error = sensorCloud_ok;
+    backfill->running = 1;
+    sensorCloudBackfill_fill(backfill);
+    if(backfill->used == 0)
+    { // nothing left to upload
+        backfill->running = 0;
+        if(backfill->callback)
+            backfill->callback(backfill->userData, backfill);
+    }
+    return 0;
+}
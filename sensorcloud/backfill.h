@@ -0,0 +1,118 @@
+#ifndef SENSORCLOUD_BACKFILL
+#define SENSORCLOUD_BACKFILL
+
+#include <sensorcloud/engine.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Times a range is uploaded before the backfill gives up on it.
+#ifndef SENSORCLOUD_BACKFILL_ATTEMPTS
+#define SENSORCLOUD_BACKFILL_ATTEMPTS 3
+#endif
+
+typedef enum
+{
+    sensorCloudRange_uploading,
+    sensorCloudRange_done,
+    sensorCloudRange_failed
+} SensorCloudRangeState;
+
+/**
+ * A time range of the points being backfilled, uploaded straight from the point buffer.
+ */
+typedef struct
+{
+    // first so the completed submission leads back to the range
+    SensorCloudSubmission submission;
+    size_t first;
+    size_t count;
+    uint8_t attempts;
+    SensorCloudRangeState state;
+} SensorCloudBackfillRange;
+
+struct SensorCloudBackfillData;
+
+/**
+ * Called when the resume point of a backfill moves and once more when the backfill stops.
+ * @param[in]   userData    User data given to the backfill.
+ * @param[in]   backfill    Backfill that progressed, running is 0 when it stopped.
+ */
+typedef void (*SensorCloudBackfillCallback)(void*, struct SensorCloudBackfillData*);
+
+/**
+ * Uploads a large time ordered point buffer of one channel as disjoint ranges that run concurrently on the slots
+ * of an engine. Failed ranges are retried on their own, and the resume point tracks the points uploaded so far so
+ * a restarted backfill only uploads what is left.
+ */
+typedef struct SensorCloudBackfillData
+{
+    SensorCloudEngine* engine;
+    // where the ranges are submitted, engine unless they go through a stage in front of it
+    SensorCloudStage stage;
+    const char* sensor;
+    const char* channel;
+    SensorCloudPointBuffer* points;
+    // most points in a range, never more than the engine sends in one upload
+    size_t rangePoints;
+    // ranges in use form a ring in time order
+    SensorCloudBackfillRange* ranges;
+    size_t size;
+    size_t first;
+    size_t used;
+    // every point before the resume point was uploaded, next is the first point not in a range yet
+    size_t resumePoint;
+    size_t next;
+    uint8_t running;
+    // why the backfill stopped early, sensorCloud_ok otherwise
+    SensorCloudError error;
+
+    uint32_t rangesUploaded;
+    uint32_t retries;
+    SensorCloudBackfillCallback callback;
+    void* userData;
+} SensorCloudBackfill;
+
+/**
+ * Initialize a backfill, its ranges are submitted straight to engine until sensorCloudBackfill_setStage says otherwise.
+ * @param[out]  backfill    Backfill to initialize.
+ * @param[in]   engine      Initialized engine to upload with, its slots bound the number of uploads in flight.
+ * @param[in]   ranges      Storage for the ranges being uploaded, bounds how many are submitted to engine at once.
+ * @param[in]   size        Number of ranges that fit in the storage.
+ * @param[in]   rangePoints Most points in a range, 0 for the most the engine sends in one upload.
+ * @param[in]   callback    Called as the backfill progresses, may be NULL.
+ * @param[in]   userData    User data passed to callback.
+ */
+void sensorCloudBackfill_init(SensorCloudBackfill* backfill, SensorCloudEngine* engine,
+    SensorCloudBackfillRange* ranges, size_t size, size_t rangePoints, SensorCloudBackfillCallback callback,
+    void* userData);
+
+/**
+ * Submit the ranges through a stage in front of the engine, typically a scheduler flow so the backfill only uses the
+ * slots other uploads leave.
+ * @param[io]   backfill    Backfill that isn't running.
+ * @param[in]   stage       Initialized stage ending at the engine of the backfill, NULL for the engine itself.
+ */
+void sensorCloudBackfill_setStage(SensorCloudBackfill* backfill, const SensorCloudStage* stage);
+
+/**
+ * Start uploading the points of a channel.
+ * @param[io]   backfill    Backfill that isn't running.
+ * @param[in]   sensor      Sensor the channel belongs to.
+ * @param[in]   channel     Channel to upload to.
+ * @param[in]   points      Points to upload in time order, must not change until the backfill stops.
+ * @param[in]   resumePoint Points already uploaded by an earlier backfill of the same buffer, 0 to start over.
+ * @return 0 if the backfill started, not 0 if it is already running.
+ */
+int sensorCloudBackfill_start(SensorCloudBackfill* backfill, const char* sensor, const char* channel,
+    SensorCloudPointBuffer* points, size_t resumePoint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
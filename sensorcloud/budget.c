@@ -0,0 +1,173 @@
+#include "budget.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+
+size_t ICACHE_FLASH_ATTR sensorCloudBudget_used(const SensorCloudBudget* budget)
+{
+    return budget->buffered + budget->held[sensorCloudBudget_inFlight] + budget->held[sensorCloudBudget_spooled];
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudBudget_update(SensorCloudBudget* budget)
+{
+    size_t used = sensorCloudBudget_used(budget);
+    if(used > budget->peak)
+        budget->peak = used;
+
+    SensorCloudBudgetPressure pressure;
+    if(used + sensorCloud_pointBufferDataSize > budget->cap)
+        pressure = sensorCloudBudget_full;
+    else if(used >= budget->highWatermark ||
+        (budget->pressure != sensorCloudBudget_normal && used > budget->lowWatermark))
+        pressure = sensorCloudBudget_high;
+    else
+        pressure = sensorCloudBudget_normal;
+    if(pressure == budget->pressure)
+        return;
+
+    TRACE_PROBE3(sensorcloud_budget_pressure, budget, pressure, used);
+    budget->pressure = pressure;
+    ++budget->transitions;
+    if(pressure == sensorCloudBudget_normal)
+    { // the channels summarizing go back to keeping every point, with the summary so far out of the way
+        SensorCloudBudgetChannel* channel = budget->channels;
+        for(; channel; channel = channel->next)
+        {
+            if(channel->rollingUp)
+            {
+                sensorCloudRollup_flush(channel->rollup);
+                channel->rollingUp = 0;
+            }
+        }
+    }
+    if(budget->callback)
+        budget->callback(budget->userData, pressure);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_init(SensorCloudBudget* budget, size_t cap, size_t highWatermark,
+    size_t lowWatermark, SensorCloudBudgetCallback callback, void* userData)
+{
+    budget->cap = cap;
+    budget->highWatermark = highWatermark;
+    budget->lowWatermark = lowWatermark;
+    budget->buffered = 0;
+    budget->held[sensorCloudBudget_inFlight] = 0;
+    budget->held[sensorCloudBudget_spooled] = 0;
+    budget->pressure = sensorCloudBudget_normal;
+    budget->channels = NULL;
+    budget->callback = callback;
+    budget->userData = userData;
+    budget->peak = 0;
+    budget->transitions = 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_addChannel(SensorCloudBudget* budget, SensorCloudBudgetChannel* channel,
+    SensorCloudPointBuffer* points, SensorCloudBudgetPolicy policy)
+{
+    channel->points = points;
+    channel->policy = policy;
+    channel->decimation = 2;
+    channel->rollup = NULL;
+    channel->held = buffer_size(&points->data);
+    channel->skipped = 0;
+    channel->rollingUp = 0;
+    channel->droppedOldest = 0;
+    channel->droppedNewest = 0;
+    channel->decimated = 0;
+    channel->rolledUp = 0;
+    channel->next = budget->channels;
+    budget->channels = channel;
+
+    budget->buffered += channel->held;
+    sensorCloudBudget_update(budget);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_setDecimation(SensorCloudBudgetChannel* channel, uint32_t decimation)
+{
+    channel->decimation = max(decimation, 2u);
+    channel->skipped = 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_setRollup(SensorCloudBudgetChannel* channel, SensorCloudRollup* rollup)
+{
+    channel->rollup = rollup;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudBudget_removeOldest(SensorCloudPointBuffer* points)
+{
+    char* first = (char*)points->data.getPtr + sensorCloud_pointBufferHeaderSize;
+    size_t size = points->data.putPtr - first - sensorCloud_pointBufferDataSize;
+    memmove(first, first + sensorCloud_pointBufferDataSize, size);
+    points->data.putPtr -= sensorCloud_pointBufferDataSize;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudBudget_addPoint(SensorCloudBudget* budget, SensorCloudBudgetChannel* channel,
+    Timestamp time, float value)
+{
+    SensorCloudPointBuffer* points = channel->points;
+    uint8_t room = buffer_bytesAvailable(&points->data) >= sensorCloud_pointBufferDataSize;
+    uint8_t fits = sensorCloudBudget_used(budget) + sensorCloud_pointBufferDataSize <= budget->cap;
+    if(budget->pressure != sensorCloudBudget_normal || !room || !fits)
+    {
+        switch(channel->policy)
+        {
+        case sensorCloudBudget_dropOldest:
+            if(sensorCloud_pointCount(points) == 0)
+                break;
+            // the new point takes the place of the oldest one
+            sensorCloudBudget_removeOldest(points);
+            ++channel->droppedOldest;
+            room = fits = 1;
+            break;
+        case sensorCloudBudget_dropNewest:
+            room = 0;
+            break;
+        case sensorCloudBudget_decimate:
+            if(channel->skipped != 0)
+                room = 0;
+            channel->skipped = (channel->skipped + 1) % channel->decimation;
+            if(!room || !fits)
+            {
+                ++channel->decimated;
+                return 1;
+            }
+            break;
+        case sensorCloudBudget_rollup:
+            if(!channel->rollup)
+                break;
+            channel->rollingUp = 1;
+            sensorCloudRollup_addPoint(channel->rollup, time, value);
+            ++channel->rolledUp;
+            return 1;
+        }
+        if(!room || !fits)
+        {
+            ++channel->droppedNewest;
+            return 1;
+        }
+    }
+
+    sensorCloud_addPoint(points, time, value);
+    sensorCloudBudget_sync(budget, channel);
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_sync(SensorCloudBudget* budget, SensorCloudBudgetChannel* channel)
+{
+    size_t held = buffer_size(&channel->points->data);
+    budget->buffered = budget->buffered - channel->held + held;
+    channel->held = held;
+    sensorCloudBudget_update(budget);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_charge(SensorCloudBudget* budget, SensorCloudBudgetKind kind, size_t size)
+{
+    budget->held[kind] += size;
+    sensorCloudBudget_update(budget);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudBudget_release(SensorCloudBudget* budget, SensorCloudBudgetKind kind, size_t size)
+{
+    budget->held[kind] -= min(size, budget->held[kind]);
+    sensorCloudBudget_update(budget);
+}
@@ -0,0 +1,177 @@
+#ifndef SENSORCLOUD_BUDGET
+#define SENSORCLOUD_BUDGET
+
+#include <sensorcloud/rollup.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * What a channel does with a new point while memory is under pressure or its point buffer is full.
+ */
+typedef enum
+{
+    // make room by dropping the oldest point in the point buffer
+    sensorCloudBudget_dropOldest,
+    // drop the new point
+    sensorCloudBudget_dropNewest,
+    // keep one point out of every decimation
+    sensorCloudBudget_decimate,
+    // summarize the points in the rollup of the channel instead of keeping them
+    sensorCloudBudget_rollup
+} SensorCloudBudgetPolicy;
+
+typedef enum
+{
+    // below the low watermark, or not yet above the high one
+    sensorCloudBudget_normal,
+    // above the high watermark, policies apply until usage is back under the low watermark
+    sensorCloudBudget_high,
+    // at the cap, no point is added without another going
+    sensorCloudBudget_full
+} SensorCloudBudgetPressure;
+
+/**
+ * Memory held outside the point buffers of the channels.
+ */
+typedef enum
+{
+    // bodies of requests being uploaded
+    sensorCloudBudget_inFlight,
+    // records waiting in a spool
+    sensorCloudBudget_spooled,
+    sensorCloudBudget_kindCount
+} SensorCloudBudgetKind;
+
+/**
+ * A channel whose points are added through a budget.
+ */
+typedef struct SensorCloudBudgetChannelData
+{
+    SensorCloudPointBuffer* points;
+    SensorCloudBudgetPolicy policy;
+    // points kept out of every decimation with the decimate policy
+    uint32_t decimation;
+    // rollup the points go to with the rollup policy
+    SensorCloudRollup* rollup;
+    // size of the point buffer last accounted for
+    size_t held;
+    uint32_t skipped;
+    uint8_t rollingUp;
+    struct SensorCloudBudgetChannelData* next;
+
+    uint32_t droppedOldest;
+    uint32_t droppedNewest;
+    uint32_t decimated;
+    uint32_t rolledUp;
+} SensorCloudBudgetChannel;
+
+typedef void (*SensorCloudBudgetCallback)(void* userData, SensorCloudBudgetPressure pressure);
+
+/**
+ * Keeps the bytes held by the point buffers of its channels, the bodies in flight and the spooled records under a
+ * cap, and tells producers when they are getting close to it.
+ */
+typedef struct
+{
+    size_t cap;
+    size_t highWatermark;
+    size_t lowWatermark;
+    size_t buffered;
+    size_t held[sensorCloudBudget_kindCount];
+    SensorCloudBudgetPressure pressure;
+    SensorCloudBudgetChannel* channels;
+    SensorCloudBudgetCallback callback;
+    void* userData;
+
+    size_t peak;
+    uint32_t transitions;
+} SensorCloudBudget;
+
+/**
+ * Initialize a budget.
+ * @param[out]  budget          Budget to initialize.
+ * @param[in]   cap             Most bytes held at once.
+ * @param[in]   highWatermark   Usage from which the policies of the channels apply.
+ * @param[in]   lowWatermark    Usage under which they stop applying again.
+ * @param[in]   callback        Called when the pressure changes, may be NULL.
+ * @param[in]   userData        User data to pass to the callback.
+ */
+void sensorCloudBudget_init(SensorCloudBudget* budget, size_t cap, size_t highWatermark, size_t lowWatermark,
+    SensorCloudBudgetCallback callback, void* userData);
+
+/**
+ * Put a channel under a budget, its point buffer counts against the budget from now on.
+ * @param[io]   budget  Budget to add to.
+ * @param[out]  channel Channel to initialize.
+ * @param[in]   points  Initialized point buffer of the channel.
+ * @param[in]   policy  What to do with new points under pressure.
+ */
+void sensorCloudBudget_addChannel(SensorCloudBudget* budget, SensorCloudBudgetChannel* channel,
+    SensorCloudPointBuffer* points, SensorCloudBudgetPolicy policy);
+
+/**
+ * Configure the decimate policy of a channel.
+ * @param[io]   channel     Channel to configure.
+ * @param[in]   decimation  Keep one point out of this many, at least 2.
+ */
+void sensorCloudBudget_setDecimation(SensorCloudBudgetChannel* channel, uint32_t decimation);
+
+/**
+ * Configure the rollup policy of a channel.
+ * @param[io]   channel Channel to configure.
+ * @param[in]   rollup  Initialized rollup the points go to under pressure, it is flushed when the pressure goes.
+ */
+void sensorCloudBudget_setRollup(SensorCloudBudgetChannel* channel, SensorCloudRollup* rollup);
+
+/**
+ * Add a point to a channel, applying its policy under pressure.
+ * @param[io]   budget  Budget of the channel.
+ * @param[io]   channel Channel to add to.
+ * @param[in]   time    Timestamp of the point.
+ * @param[in]   value   Value of the point.
+ * @return 0 if the point was added to the point buffer, not 0 if the policy dropped, decimated or rolled it up.
+ */
+int sensorCloudBudget_addPoint(SensorCloudBudget* budget, SensorCloudBudgetChannel* channel, Timestamp time,
+    float value);
+
+/**
+ * Account for a point buffer of a channel changed other than through sensorCloudBudget_addPoint, such as when it
+ * is started over after an upload.
+ * @param[io]   budget  Budget of the channel.
+ * @param[io]   channel Channel to account for.
+ */
+void sensorCloudBudget_sync(SensorCloudBudget* budget, SensorCloudBudgetChannel* channel);
+
+/**
+ * Count bytes held outside the channels against the budget.
+ * @param[io]   budget  Budget to charge.
+ * @param[in]   kind    What holds the bytes.
+ * @param[in]   size    Number of bytes.
+ */
+void sensorCloudBudget_charge(SensorCloudBudget* budget, SensorCloudBudgetKind kind, size_t size);
+
+/**
+ * Give back bytes charged with sensorCloudBudget_charge.
+ * @param[io]   budget  Budget to release to.
+ * @param[in]   kind    What held the bytes.
+ * @param[in]   size    Number of bytes.
+ */
+void sensorCloudBudget_release(SensorCloudBudget* budget, SensorCloudBudgetKind kind, size_t size);
+
+/**
+ * Bytes held against a budget.
+ * @param[in]   budget  Budget to query.
+ * @return Sum of the point buffers of the channels and of the bytes charged.
+ */
+size_t sensorCloudBudget_used(const SensorCloudBudget* budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef SENSORCLOUD_COROUTINE
+#define SENSORCLOUD_COROUTINE
+
+/*
+ * co_await-able operations over the callbacks of the C API, only available to C++20 code.
+ * Each awaiter lives in the frame of the coroutine awaiting it, so an operation costs no allocation beyond the frame,
+ * and frames can be allocated through a SensorCloudFrameAllocator.
+ */
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <sensorcloud.h>
+#include <sensorcloud/engine.h>
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+
+/**
+ * Where the frames of SensorCloudTask coroutines come from, typically a pool sized for the number of concurrent
+ * uploads. allocate returns NULL when it is out of memory.
+ */
+struct SensorCloudFrameAllocator
+{
+    void* (*allocate)(size_t size, void* userData);
+    void (*deallocate)(void* frame, size_t size, void* userData);
+    void* userData;
+};
+
+// Allocator for the frames of coroutines started from now on, NULL for operator new.
+inline SensorCloudFrameAllocator* sensorCloudFrameAllocator = nullptr;
+
+/**
+ * A coroutine that starts running straight away and frees its frame when it returns.
+ * Nobody waits for it, results are reported by the coroutine itself.
+ */
+class SensorCloudTask
+{
+public:
+    struct promise_type
+    {
+        SensorCloudTask get_return_object()
+        {
+            return SensorCloudTask();
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            // the callbacks resuming the coroutine are C code, nothing could catch it
+            std::terminate();
+        }
+
+        static void* operator new(size_t size)
+        {
+            SensorCloudFrameAllocator* allocator = sensorCloudFrameAllocator;
+            size += sizeof(Header);
+            void* memory = allocator ? allocator->allocate(size, allocator->userData) : ::operator new(size);
+            if(!memory)
+                throw std::bad_alloc();
+            Header* header = static_cast<Header*>(memory);
+            header->allocator = allocator;
+            header->size = size;
+            return header + 1;
+        }
+
+        static void operator delete(void* frame)
+        {
+            Header* header = static_cast<Header*>(frame) - 1;
+            SensorCloudFrameAllocator* allocator = header->allocator;
+            if(allocator)
+                allocator->deallocate(header, header->size, allocator->userData);
+            else
+                ::operator delete(header);
+        }
+
+    private:
+        // in front of every frame so it goes back where it came from
+        struct alignas(std::max_align_t) Header
+        {
+            SensorCloudFrameAllocator* allocator;
+            size_t size;
+        };
+    };
+};
+
+/**
+ * Resumes the awaiting coroutine from a callback, or doesn't suspend it at all when the callback runs before the
+ * operation returns.
+ */
+class SensorCloudAwaiter
+{
+public:
+    SensorCloudAwaiter() :
+    m_state(idle)
+    {
+    }
+
+    SensorCloudAwaiter(const SensorCloudAwaiter&) = delete;
+    SensorCloudAwaiter& operator=(const SensorCloudAwaiter&) = delete;
+
+    bool await_ready() const
+    {
+        return false;
+    }
+
+protected:
+    enum State
+    {
+        idle,
+        starting,
+        waiting,
+        done
+    };
+
+    // call start, which begins the operation, and suspend unless it already completed
+    template<typename Start>
+    bool suspend(std::coroutine_handle<> handle, Start start)
+    {
+        m_handle = handle;
+        m_state = starting;
+        start();
+        if(m_state == done)
+            return false;
+        m_state = waiting;
+        return true;
+    }
+
+    void complete()
+    {
+        State state = m_state;
+        m_state = done;
+        if(state == waiting)
+            m_handle.resume();
+    }
+
+private:
+    std::coroutine_handle<> m_handle;
+    State m_state;
+};
+
+/**
+ * Authenticate a SensorCloud, co_await gives the SensorCloudError.
+ * The SensorCloud calls back with its user data, which is taken over while the operation runs.
+ */
+class SensorCloudAuthenticate : public SensorCloudAwaiter
+{
+public:
+    explicit SensorCloudAuthenticate(SensorCloud* sensorCloud) :
+    m_sensorCloud(sensorCloud),
+    m_error(sensorCloud_ok)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return suspend(handle, [this]
+        {
+            m_sensorCloud->userData = this;
+            sensorCloud_asyncAuthenticate(m_sensorCloud, &SensorCloudAuthenticate::callback);
+        });
+    }
+
+    SensorCloudError await_resume() const
+    {
+        return m_error;
+    }
+
+private:
+    static void callback(void* userData, SensorCloudError error)
+    {
+        SensorCloudAuthenticate* self = static_cast<SensorCloudAuthenticate*>(userData);
+        self->m_error = error;
+        self->complete();
+    }
+
+    SensorCloud* m_sensorCloud;
+    SensorCloudError m_error;
+};
+
+/**
+ * Upload a point buffer on a SensorCloud, authenticating first if needed, co_await gives the SensorCloudError.
+ * The SensorCloud calls back with its user data, which is taken over while the operation runs.
+ */
+class SensorCloudUpload : public SensorCloudAwaiter
+{
+public:
+    SensorCloudUpload(SensorCloud* sensorCloud, const char* sensor, const char* channel,
+        SensorCloudPointBuffer* points) :
+    m_sensorCloud(sensorCloud),
+    m_sensor(sensor),
+    m_channel(channel),
+    m_points(points),
+    m_error(sensorCloud_ok)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return suspend(handle, [this]
+        {
+            m_sensorCloud->userData = this;
+            sensorCloud_asyncUploadData(m_sensorCloud, m_sensor, m_channel, m_points, &SensorCloudUpload::callback);
+        });
+    }
+
+    SensorCloudError await_resume() const
+    {
+        return m_error;
+    }
+
+private:
+    static void callback(void* userData, SensorCloudError error)
+    {
+        SensorCloudUpload* self = static_cast<SensorCloudUpload*>(userData);
+        self->m_error = error;
+        self->complete();
+    }
+
+    SensorCloud* m_sensorCloud;
+    const char* m_sensor;
+    const char* m_channel;
+    SensorCloudPointBuffer* m_points;
+    SensorCloudError m_error;
+};
+
+/**
+ * Run a submission on an engine, co_await gives the SensorCloudError of the submission.
+ * The engine must be initialized with SensorCloudSubmit::callback as its callback, and the user data of the
+ * submission is taken over while the operation runs. Any number of coroutines can await submissions concurrently.
+ */
+class SensorCloudSubmit : public SensorCloudAwaiter
+{
+public:
+    SensorCloudSubmit(SensorCloudEngine* engine, SensorCloudSubmission* submission) :
+    m_engine(engine),
+    m_submission(submission)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return suspend(handle, [this]
+        {
+            m_submission->userData = this;
+            sensorCloudEngine_submit(m_engine, m_submission);
+        });
+    }
+
+    SensorCloudError await_resume() const
+    {
+        return m_submission->error;
+    }
+
+    static void callback(void*, SensorCloudSubmission* submission)
+    {
+        static_cast<SensorCloudSubmit*>(submission->userData)->complete();
+    }
+
+private:
+    SensorCloudEngine* m_engine;
+    SensorCloudSubmission* m_submission;
+};
+
+/**
+ * Send an initialized HTTP request, co_await gives http_complete or the error that ended it.
+ * The callback and user data the request was initialized with are replaced. Body fragments of the response are
+ * written to responseBody as they arrive, those that don't fit are dropped.
+ */
+class HTTPRequestOperation : public SensorCloudAwaiter
+{
+public:
+    HTTPRequestOperation(HTTPRequest* request, Buffer body, Buffer* responseBody = nullptr) :
+    m_request(request),
+    m_body(body),
+    m_responseBody(responseBody),
+    m_error(http_ok)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return suspend(handle, [this]
+        {
+            m_request->callback = &HTTPRequestOperation::callback;
+            m_request->userData = this;
+            HTTPError e = http_asyncRequest(m_request, m_body);
+            if(e != http_ok)
+            {
+                m_error = e;
+                complete();
+            }
+        });
+    }
+
+    HTTPError await_resume() const
+    {
+        return m_error;
+    }
+
+private:
+    static void callback(void* userData, const void* data, size_t dataSize, HTTPError error)
+    {
+        HTTPRequestOperation* self = static_cast<HTTPRequestOperation*>(userData);
+        if(self->m_responseBody && dataSize)
+            buffer_write(self->m_responseBody, static_cast<const char*>(data), dataSize);
+        if(error == http_ok) // more to come
+            return;
+        self->m_error = error;
+        self->complete();
+    }
+
+    HTTPRequest* m_request;
+    Buffer m_body;
+    Buffer* m_responseBody;
+    HTTPError m_error;
+};
+
+#endif
+
+#endif
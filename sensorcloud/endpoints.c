@@ -0,0 +1,131 @@
+#include "endpoints.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+#include <net/driver.h>
+
+static SensorCloudEndpoint* ICACHE_FLASH_ATTR sensorCloudEndpoints_find(SensorCloudEndpoints* endpoints,
+    SensorCloudEndpointRole role, const char* host)
+{
+    size_t i = 0;
+    for(; i < endpoints->counts[role]; ++i)
+    {
+        if(strcmp(endpoints->endpoints[role][i].host, host) == 0)
+            return &endpoints->endpoints[role][i];
+    }
+    return NULL;
+}
+
+// expected time until a request gets through, the failed attempts its error rate predicts included
+static uint64_t ICACHE_FLASH_ATTR sensorCloudEndpoints_cost(const SensorCloudEndpoint* endpoint)
+{
+    if(!endpoint->requests)
+        return 0; // never tried, measure it first
+    if(!endpoint->rtt)
+        return UINT64_MAX; // tried and never answered
+    uint32_t errorRate = min(endpoint->errorRate, (uint32_t)65535);
+    return endpoint->rtt * 65536 / (65536 - errorRate);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEndpoints_init(SensorCloudEndpoints* endpoints, uint32_t threshold, uint64_t cooldown)
+{
+    memset(endpoints, 0, sizeof(SensorCloudEndpoints));
+    endpoints->threshold = threshold ? threshold : 1;
+    endpoints->cooldown = cooldown;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudEndpoints_add(SensorCloudEndpoints* endpoints, SensorCloudEndpointRole role,
+    const char* host)
+{
+    size_t* count = &endpoints->counts[role];
+    if(*count == SENSORCLOUD_ENDPOINTS_MAX || strlen(host) >= sizeof(endpoints->endpoints[role][0].host))
+        return 1;
+    SensorCloudEndpoint* endpoint = &endpoints->endpoints[role][(*count)++];
+    memset(endpoint, 0, sizeof(SensorCloudEndpoint));
+    strcpy(endpoint->host, host);
+    return 0;
+}
+
+const char* ICACHE_FLASH_ATTR sensorCloudEndpoints_select(SensorCloudEndpoints* endpoints,
+    SensorCloudEndpointRole role)
+{
+    uint64_t now = net_time();
+    const SensorCloudEndpoint* best = NULL;
+    uint64_t bestCost = 0;
+    const SensorCloudEndpoint* soonest = NULL;
+    size_t i = 0;
+    for(; i < endpoints->counts[role]; ++i)
+    {
+        const SensorCloudEndpoint* endpoint = &endpoints->endpoints[role][i];
+        if(endpoint->downUntil > now)
+        {
+            if(!soonest || endpoint->downUntil < soonest->downUntil)
+                soonest = endpoint;
+            continue;
+        }
+        uint64_t cost = sensorCloudEndpoints_cost(endpoint);
+        if(!best || cost < bestCost)
+        {
+            best = endpoint;
+            bestCost = cost;
+        }
+    }
+    if(!best) // everything is down, the first one back is the best bet
+        best = soonest;
+    if(!best)
+        return NULL;
+
+    const SensorCloudEndpoint* previous = endpoints->selected[role];
+    if(previous && previous != best && previous->downUntil > now)
+    {
+        ++endpoints->failovers;
+        TRACE_PROBE3(sensorcloud_endpoint_failover, endpoints, previous->host, best->host);
+    }
+    endpoints->selected[role] = best;
+    return best->host;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEndpoints_record(SensorCloudEndpoints* endpoints, SensorCloudEndpointRole role,
+    const char* host, uint8_t failed, uint64_t rtt)
+{
+    SensorCloudEndpoint* endpoint = sensorCloudEndpoints_find(endpoints, role, host);
+    if(!endpoint)
+        return;
+
+    ++endpoint->requests;
+    if(failed)
+    {
+        ++endpoint->errors;
+        endpoint->errorRate += (65536 - endpoint->errorRate) / 8;
+        if(++endpoint->failures >= endpoints->threshold)
+        {
+            endpoint->downUntil = net_time() + endpoints->cooldown;
+            TRACE_PROBE3(sensorcloud_endpoint_down, endpoints, endpoint->host, endpoint->failures);
+        }
+        return;
+    }
+
+    // smoothed like the flush policy does, an answer brings a down endpoint straight back
+    endpoint->errorRate -= endpoint->errorRate / 8;
+    endpoint->failures = 0;
+    endpoint->downUntil = 0;
+    if(rtt == 0)
+        rtt = 1;
+    endpoint->rtt = endpoint->rtt ? endpoint->rtt - endpoint->rtt / 8 + rtt / 8 : rtt;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEndpoints_recordRequest(SensorCloudEndpoints* endpoints,
+    SensorCloudEndpointRole role, const HTTPRequest* request, HTTPError error)
+{
+    if(!endpoints)
+        return;
+    HTTPResponseCode code;
+    const char* reason;
+    size_t reasonSize;
+    uint8_t failed = error != http_complete ||
+        (http_getResponseCode(&code, &reason, &reasonSize, request) == http_ok && code >= 500 && code < 600);
+    HTTPRequestStats stats;
+    http_getRequestStats(&stats, request);
+    sensorCloudEndpoints_record(endpoints, role, request->connection.hostname, failed,
+        http_phaseDuration(&stats, httpPhase_started, httpPhase_complete));
+}
@@ -0,0 +1,118 @@
+#ifndef SENSORCLOUD_ENDPOINTS
+#define SENSORCLOUD_ENDPOINTS
+
+#include <http/request.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most endpoints of each role.
+#ifndef SENSORCLOUD_ENDPOINTS_MAX
+#define SENSORCLOUD_ENDPOINTS_MAX 4
+#endif
+
+typedef enum
+{
+    // authenticates the device, in place of SENSORCLOUD_AUTH_URL
+    sensorCloudEndpoint_auth,
+    // takes uploads and the other requests made with a token, in place of the server handed out with it
+    sensorCloudEndpoint_upload,
+    sensorCloudEndpoint_roleCount
+} SensorCloudEndpointRole;
+
+/**
+ * A host requests can go to, with what was measured of it.
+ */
+typedef struct
+{
+    // host name, with a port if it isn't the default one
+    char host[64];
+    // smoothed round trip time of requests it answered, 0 until one was
+    uint64_t rtt;
+    // smoothed share of requests that failed, out of 65536
+    uint32_t errorRate;
+    // failures in a row
+    uint32_t failures;
+    // net_time() it is avoided until after failing, 0 when it is healthy
+    uint64_t downUntil;
+
+    uint32_t requests;
+    uint32_t errors;
+} SensorCloudEndpoint;
+
+/**
+ * Auth and upload endpoints configured at runtime, typically the SensorCloud servers and regional proxies in front of
+ * them. Requests go to the healthy endpoint expected to answer first, its round trip time stretched by the retries its
+ * error rate predicts. Endpoints never tried are tried before the rest, ones tried that never answered after all the
+ * others. An endpoint that fails threshold times in a row is avoided for the cooldown, the next best one takes over.
+ * All times are net_time() microseconds.
+ */
+typedef struct SensorCloudEndpointsData
+{
+    SensorCloudEndpoint endpoints[sensorCloudEndpoint_roleCount][SENSORCLOUD_ENDPOINTS_MAX];
+    size_t counts[sensorCloudEndpoint_roleCount];
+    uint32_t threshold;
+    uint64_t cooldown;
+
+    // endpoint picked last, and the times the pick moved away from one that went down
+    const SensorCloudEndpoint* selected[sensorCloudEndpoint_roleCount];
+    uint32_t failovers;
+} SensorCloudEndpoints;
+
+/**
+ * Initialize an empty endpoint list, requests keep going where they did without one until endpoints are added.
+ * @param[out]  endpoints   Endpoints to initialize.
+ * @param[in]   threshold   Failures in a row that take an endpoint down, at least 1.
+ * @param[in]   cooldown    Time a down endpoint is avoided for.
+ */
+void sensorCloudEndpoints_init(SensorCloudEndpoints* endpoints, uint32_t threshold, uint64_t cooldown);
+
+/**
+ * Add an endpoint.
+ * @param[io]   endpoints   Endpoints to add to.
+ * @param[in]   role        What the endpoint is used for.
+ * @param[in]   host        Host name of the endpoint, with a port if it isn't the default one.
+ * @return 0 if the endpoint was added, not 0 if the role has SENSORCLOUD_ENDPOINTS_MAX endpoints or the host is too
+ *  long.
+ */
+int sensorCloudEndpoints_add(SensorCloudEndpoints* endpoints, SensorCloudEndpointRole role, const char* host);
+
+/**
+ * Pick the endpoint the next request of a role goes to.
+ * @param[io]   endpoints   Endpoints to pick from.
+ * @param[in]   role        Role of the request.
+ * @return Host of the fastest healthy endpoint, of the one back the soonest when all are down, NULL if the role has
+ *  no endpoints.
+ */
+const char* sensorCloudEndpoints_select(SensorCloudEndpoints* endpoints, SensorCloudEndpointRole role);
+
+/**
+ * Record how a request to an endpoint went. Hosts that aren't endpoints of the role are ignored.
+ * @param[io]   endpoints   Endpoints to update.
+ * @param[in]   role        Role of the request.
+ * @param[in]   host        Host the request went to.
+ * @param[in]   failed      The request didn't get an answer, or got a 5xx.
+ * @param[in]   rtt         Time the request took, ignored when it failed.
+ */
+void sensorCloudEndpoints_record(SensorCloudEndpoints* endpoints, SensorCloudEndpointRole role, const char* host,
+    uint8_t failed, uint64_t rtt);
+
+/**
+ * Record how a completed request went, from its host, response and stats.
+ * @param[io]   endpoints   Endpoints to update, NULL to do nothing.
+ * @param[in]   role        Role of the request.
+ * @param[in]   request     Request that completed.
+ * @param[in]   error       Error the request completed with, it failed unless it is http_complete without a 5xx.
+ */
+void sensorCloudEndpoints_recordRequest(SensorCloudEndpoints* endpoints, SensorCloudEndpointRole role,
+    const HTTPRequest* request, HTTPError error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
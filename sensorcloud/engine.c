@@ -0,0 +1,614 @@
+#include "engine.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+#include <sensorcloud/endpoints.h>
+#include <sensorcloud/sensor_cache.h>
+#include <xdr/xdr.h>
+
+static void sensorCloudEngine_dispatch(SensorCloudEngine* engine);
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_notifyIdle(SensorCloudEngine* engine)
+{
+    if(engine->idleCallback && sensorCloudEngine_idle(engine))
+        engine->idleCallback(engine->idleUserData, engine);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_complete(SensorCloudEngine* engine, SensorCloudSubmission* submission,
+    SensorCloudError error)
+{
+    TRACE_PROBE2(sensorcloud_engine_complete, submission, error);
+    submission->error = error;
+    submission->next = NULL;
+    sensorCloudEngine_completeStage(engine, submission);
+}
+
+static size_t ICACHE_FLASH_ATTR sensorCloudEngine_rangeEnd(const SensorCloudSubmission* submission)
+{
+    return submission->points ? submission->rangeEnd : 0;
+}
+
+static SensorCloudSubmission* ICACHE_FLASH_ATTR sensorCloudEngine_pop(SensorCloudEngine* engine)
+{
+    SensorCloudSubmission* submission = engine->queueHead;
+    engine->queueHead = submission->next;
+    if(!engine->queueHead)
+        engine->queueTail = NULL;
+    submission->next = NULL;
+    --engine->queued;
+    ++engine->active;
+    return submission;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_finishSlot(SensorCloudEngineSlot* slot, SensorCloudError error)
+{
+    SensorCloudEngine* engine = slot->engine;
+    TRACE_END(sensorcloud_engine_upload, slot, error);
+    if(error == sensorCloud_unauthorized)
+        sensorCloud_invalidateToken(engine->sensorCloud);
+    // callbacks may submit more work, which can start on this slot straight away
+    SensorCloudEnginePart parts[SENSORCLOUD_ENGINE_MAX_PARTS];
+    size_t partCount = slot->partCount;
+    memcpy(parts, slot->parts, partCount * sizeof(SensorCloudEnginePart));
+    slot->state = sensorCloudSlot_idle;
+    slot->partCount = 0;
+    slot->retries = 0;
+
+    // a submission completes once all of its points were sent, with the first error any of its uploads had
+    size_t i = 0;
+    for(; i < partCount; ++i)
+    {
+        SensorCloudSubmission* submission = parts[i].submission;
+        if(submission->error == sensorCloud_ok)
+            submission->error = error;
+        if(--submission->partsLeft == 0 && submission->pointsDispatched == sensorCloudEngine_rangeEnd(submission))
+        {
+            --engine->active;
+            sensorCloudEngine_complete(engine, submission, submission->error);
+        }
+    }
+
+    sensorCloudEngine_dispatch(engine);
+    sensorCloudEngine_notifyIdle(engine);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_requestCallback(void* userData, const void* data, size_t dataSize,
+    HTTPError error);
+
+// initializing the request forgets the connection warmed up on it, so it is carried over
+static void ICACHE_FLASH_ATTR sensorCloudEngine_detachWarm(SensorCloudEngineSlot* slot)
+{
+    if(slot->warm)
+        http_detachWarm(&slot->request, sensorCloud_uploadServer(slot->engine->sensorCloud), &slot->warmConnection);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_attachWarm(SensorCloudEngineSlot* slot)
+{
+    if(!slot->warm)
+        return;
+    slot->warm = 0;
+    if(http_attachWarm(&slot->request, &slot->warmConnection))
+        ++slot->engine->warmUsed;
+    else
+        ++slot->engine->warmWasted;
+    TRACE_PROBE2(sensorcloud_engine_warm_use, slot, slot->request.connection.warm);
+}
+
+static HTTPError ICACHE_FLASH_ATTR sensorCloudEngine_startUpload(SensorCloudEngineSlot* slot)
+{
+    SensorCloud* sensorCloud = slot->engine->sensorCloud;
+    SensorCloudSubmission* submission = slot->parts[0].submission;
+    slot->state = sensorCloudSlot_upload;
+
+    sensorCloudEngine_detachWarm(slot);
+    Buffer requestHead;
+    buffer_init(&requestHead, slot->requestBuffer, 512);
+    Buffer responseHead;
+    buffer_init(&responseHead, slot->requestBuffer + 512, 512);
+    HTTPError e = sensorCloud_initUploadRequest(&slot->request, requestHead, responseHead,
+        sensorCloud_uploadServer(sensorCloud), sensorCloud->device, sensorCloud->token, submission->sensor,
+        submission->channel, slot, sensorCloudEngine_requestCallback);
+    sensorCloudEngine_attachWarm(slot);
+    if(e != http_ok)
+        return e;
+    return http_asyncRequestSequence(&slot->request, &slot->body[0]);
+}
+
+static HTTPError ICACHE_FLASH_ATTR sensorCloudEngine_startAddSensor(SensorCloudEngineSlot* slot)
+{
+    SensorCloud* sensorCloud = slot->engine->sensorCloud;
+    slot->state = sensorCloudSlot_addSensor;
+
+    sensorCloudEngine_detachWarm(slot);
+    Buffer requestHead;
+    buffer_init(&requestHead, slot->requestBuffer, 512);
+    Buffer responseHead;
+    buffer_init(&responseHead, slot->requestBuffer + 512, 512);
+    Buffer body;
+    buffer_init(&body, slot->sensorInfo, sizeof(slot->sensorInfo));
+    HTTPError e = sensorCloud_initAddSensorRequest(&slot->request, &body, requestHead, responseHead,
+        sensorCloud_uploadServer(sensorCloud), sensorCloud->device, sensorCloud->token,
+        slot->parts[0].submission->sensor, slot, sensorCloudEngine_requestCallback);
+    sensorCloudEngine_attachWarm(slot);
+    if(e != http_ok)
+        return e;
+    return http_asyncRequest(&slot->request, body);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_retryTimer(void* userData)
+{
+    SensorCloudEngineSlot* slot = (SensorCloudEngineSlot*)userData;
+    SensorCloudEngine* engine = slot->engine;
+    uint64_t wait = sensorCloudRetry_acquire(engine->retry, sensorCloud_uploadServer(engine->sensorCloud));
+    if(wait)
+    {
+        net_asyncWait(&slot->retryTimer, wait);
+        return;
+    }
+
+    // the body still refers to the points of the parts, it goes out again as it is
+    TRACE_PROBE2(sensorcloud_engine_resend, slot, slot->retries);
+    HTTPError e = slot->state == sensorCloudSlot_upload ? sensorCloudEngine_startUpload(slot) :
+        sensorCloudEngine_startAddSensor(slot);
+    if(e != http_ok)
+        sensorCloudEngine_finishSlot(slot, sensorCloud_netError);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_failSlot(SensorCloudEngineSlot* slot, SensorCloudRetryClass errorClass,
+    SensorCloudError error)
+{
+    SensorCloudEngine* engine = slot->engine;
+    if(!engine->retry)
+    {
+        sensorCloudEngine_finishSlot(slot, error);
+        return;
+    }
+
+    uint64_t delay = sensorCloudRetry_failed(engine->retry, slot->request.connection.hostname, errorClass,
+        slot->retries);
+    if(delay == UINT64_MAX)
+    {
+        sensorCloudEngine_finishSlot(slot, error);
+        return;
+    }
+    ++slot->retries;
+    TRACE_PROBE3(sensorcloud_engine_retry, slot, errorClass, delay);
+    net_asyncWait(&slot->retryTimer, delay);
+}
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudEngine_serverError(const HTTPRequest* request)
+{
+    HTTPResponseCode code;
+    const char* reason;
+    size_t reasonSize;
+    return http_getResponseCode(&code, &reason, &reasonSize, request) == http_ok && code >= 500 && code < 600;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_requestCallback(void* userData, const void* data, size_t dataSize,
+    HTTPError error)
+{
+    (void)data; // the response body isn't read, only its code
+    (void)dataSize;
+    SensorCloudEngineSlot* slot = (SensorCloudEngineSlot*)userData;
+    SensorCloudEngine* engine = slot->engine;
+    if(slot->state == sensorCloudSlot_idle)
+    { // the warm connection failed or the server closed it before an upload went out on it
+        slot->warm = 0;
+        ++engine->warmWasted;
+        TRACE_PROBE2(sensorcloud_engine_warm_use, slot, httpWarm_none);
+        return;
+    }
+    if(error == http_ok) // response not complete
+        return;
+    sensorCloudEndpoints_recordRequest(engine->sensorCloud->endpoints, sensorCloudEndpoint_upload, &slot->request,
+        error);
+    if(error != http_complete)
+    {
+        sensorCloudEngine_failSlot(slot, slot->request.connection.connected ? sensorCloudRetry_reset :
+            sensorCloudRetry_connect, sensorCloud_netError);
+        return;
+    }
+
+    SensorCloudError result = sensorCloud_responseError(&slot->request);
+    if(sensorCloudEngine_serverError(&slot->request))
+    {
+        sensorCloudEngine_failSlot(slot, sensorCloudRetry_serverError, result);
+        return;
+    }
+    if(engine->retry)
+        sensorCloudRetry_succeeded(engine->retry, slot->request.connection.hostname);
+    SensorCloudSensorCache* cache = slot->engine->sensorCloud->sensorCache;
+    SensorCloudSubmission* submission = slot->parts[0].submission;
+    if(slot->state == sensorCloudSlot_upload && result == sensorCloud_notFound)
+    { // sensor doesn't exist, create it and upload again on the same slot
+        if(cache)
+            sensorCloudSensorCache_remove(cache, submission->sensor);
+        if(sensorCloudEngine_startAddSensor(slot) != http_ok)
+            sensorCloudEngine_finishSlot(slot, sensorCloud_netError);
+        return;
+    }
+    if(result == sensorCloud_ok && cache)
+        sensorCloudSensorCache_add(cache, submission->sensor);
+    if(slot->state == sensorCloudSlot_addSensor && result == sensorCloud_ok && submission->points)
+    { // sensor created
+        if(sensorCloudEngine_startUpload(slot) != http_ok)
+            sensorCloudEngine_finishSlot(slot, sensorCloud_netError);
+        return;
+    }
+
+    sensorCloudEngine_finishSlot(slot, result);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_failQueued(SensorCloudEngine* engine, SensorCloudError error)
+{
+    while(engine->queueHead)
+    {
+        SensorCloudSubmission* submission = sensorCloudEngine_pop(engine);
+        if(submission->partsLeft)
+        { // some of its points are being uploaded, it completes when they are
+            submission->error = error;
+            submission->pointsDispatched = sensorCloudEngine_rangeEnd(submission);
+            continue;
+        }
+        --engine->active;
+        sensorCloudEngine_complete(engine, submission, error);
+    }
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_authenticateCallback(void* userData, SensorCloudError error)
+{
+    SensorCloudEngine* engine = (SensorCloudEngine*)userData;
+    engine->authenticating = 0;
+    SensorCloudTokenState state = sensorCloud_tokenState(engine->sensorCloud);
+    if(state != sensorCloudToken_fresh && state != sensorCloudToken_refresh)
+    { // nothing can be uploaded without a token
+        sensorCloudEngine_failQueued(engine, error != sensorCloud_ok ? error : sensorCloud_netError);
+        sensorCloudEngine_notifyIdle(engine);
+        return;
+    }
+    engine->refreshFailed = state == sensorCloudToken_refresh;
+    sensorCloudEngine_dispatch(engine);
+    sensorCloudEngine_notifyIdle(engine);
+}
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudEngine_mergeable(const SensorCloudSubmission* a,
+    const SensorCloudSubmission* b)
+{
+    // same channel, version and sample rate, only the point count in the header differs
+    return a->points && b->points && strcmp(a->sensor, b->sensor) == 0 && strcmp(a->channel, b->channel) == 0 &&
+        memcmp(a->points->data.data, b->points->data.data, sensorCloud_pointBufferHeaderSize - 4) == 0;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_fillSlot(SensorCloudEngine* engine, SensorCloudEngineSlot* slot)
+{
+    size_t total = 0;
+    slot->partCount = 0;
+    while(engine->queueHead && slot->partCount < SENSORCLOUD_ENGINE_MAX_PARTS)
+    {
+        SensorCloudSubmission* submission = engine->queueHead;
+        if(slot->partCount && (total == engine->maxPoints ||
+            !sensorCloudEngine_mergeable(slot->parts[0].submission, submission)))
+            break;
+
+        size_t rangeEnd = sensorCloudEngine_rangeEnd(submission);
+        size_t count = min(rangeEnd - submission->pointsDispatched, engine->maxPoints - total);
+        SensorCloudEnginePart* part = &slot->parts[slot->partCount++];
+        part->submission = submission;
+        part->first = submission->pointsDispatched;
+        part->count = count;
+        submission->pointsDispatched += count;
+        ++submission->partsLeft;
+        total += count;
+
+        if(submission->pointsDispatched < rangeEnd)
+            break; // the rest goes to the next slot
+        sensorCloudEngine_pop(engine);
+        if(!submission->points)
+            break; // creating a sensor isn't merged with anything
+    }
+    if(!slot->parts[0].submission->points)
+        return;
+
+    // the header of the first part with the total point count, followed by the points of every part in place
+    memcpy(slot->header, slot->parts[0].submission->points->data.data, sensorCloud_pointBufferHeaderSize);
+    Buffer pointCountWriter;
+    buffer_init(&pointCountWriter, slot->header + sensorCloud_pointBufferHeaderSize - 4, 4);
+    xdr_writeUInt(&pointCountWriter, total);
+    bufferSequence_init(&slot->body[0], slot->header, sensorCloud_pointBufferHeaderSize);
+    size_t i = 0;
+    for(; i < slot->partCount; ++i)
+    {
+        const SensorCloudEnginePart* part = &slot->parts[i];
+        bufferSequence_init(&slot->body[i + 1], part->submission->points->data.data +
+            sensorCloud_pointBufferHeaderSize + part->first * sensorCloud_pointBufferDataSize,
+            part->count * sensorCloud_pointBufferDataSize);
+        slot->body[i].next = &slot->body[i + 1];
+    }
+}
+
+// a warm slot first, so the upload doesn't wait for a connection
+static SensorCloudEngineSlot* ICACHE_FLASH_ATTR sensorCloudEngine_idleSlot(SensorCloudEngine* engine)
+{
+    SensorCloudEngineSlot* idle = NULL;
+    size_t i = 0;
+    for(; i < engine->slotCount; ++i)
+    {
+        SensorCloudEngineSlot* slot = &engine->slots[i];
+        if(slot->state != sensorCloudSlot_idle)
+            continue;
+        if(slot->warm)
+            return slot;
+        if(!idle)
+            idle = slot;
+    }
+    return idle;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_dispatch(SensorCloudEngine* engine)
+{
+    if(!engine->queueHead)
+        return;
+    SensorCloudTokenState state = sensorCloud_tokenState(engine->sensorCloud);
+    if(!engine->authenticating && (state == sensorCloudToken_missing || state == sensorCloudToken_expired ||
+        (state == sensorCloudToken_refresh && !engine->refreshFailed)))
+    { // refreshes run on the sensorCloud's own request while the slots keep uploading with the current token
+        engine->authenticating = 1;
+        sensorCloud_asyncAuthenticate(engine->sensorCloud, sensorCloudEngine_authenticateCallback);
+        state = sensorCloud_tokenState(engine->sensorCloud);
+    }
+    if(state != sensorCloudToken_fresh && state != sensorCloudToken_refresh)
+        return;
+
+    SensorCloudEngineSlot* slot;
+    while(engine->queueHead && (slot = sensorCloudEngine_idleSlot(engine)))
+    {
+        const char* server = sensorCloud_uploadServer(engine->sensorCloud);
+        if(engine->retry && sensorCloudRetry_acquire(engine->retry, server))
+        { // an open breaker fails uploads fast, a half open one holds them until its probe is answered
+            if(sensorCloudRetry_state(engine->retry, server) == sensorCloudBreaker_open)
+                sensorCloudEngine_failQueued(engine, sensorCloud_netError);
+            return;
+        }
+
+        sensorCloudEngine_fillSlot(engine, slot);
+        TRACE_BEGIN(sensorcloud_engine_upload, slot);
+        HTTPError e = slot->parts[0].submission->points ? sensorCloudEngine_startUpload(slot) :
+            sensorCloudEngine_startAddSensor(slot);
+        if(e != http_ok)
+            sensorCloudEngine_finishSlot(slot, sensorCloud_netError);
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_init(SensorCloudEngine* engine, SensorCloud* sensorCloud,
+    SensorCloudEngineSlot* slots, size_t slotCount, SensorCloudEngineCallback callback, void* userData)
+{
+    memset(engine, 0, sizeof(SensorCloudEngine));
+    engine->sensorCloud = sensorCloud;
+    engine->slots = slots;
+    engine->slotCount = slotCount;
+    engine->maxPoints = SENSORCLOUD_MAX_POINTS;
+    engine->callback = callback;
+    engine->userData = userData;
+    sensorCloud->userData = engine;
+
+    size_t i = 0;
+    for(; i < slotCount; ++i)
+    {
+        slots[i].engine = engine;
+        slots[i].state = sensorCloudSlot_idle;
+        slots[i].partCount = 0;
+        slots[i].retries = 0;
+        slots[i].warm = 0;
+        net_initTimer(&slots[i].retryTimer, &slots[i], sensorCloudEngine_retryTimer);
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_destroy(SensorCloudEngine* engine)
+{
+    size_t i = 0;
+    for(; i < engine->slotCount; ++i)
+        net_destroyTimer(&engine->slots[i].retryTimer);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_setRetry(SensorCloudEngine* engine, SensorCloudRetry* retry)
+{
+    engine->retry = retry;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_setIdleCallback(SensorCloudEngine* engine,
+    SensorCloudEngineIdleCallback callback, void* userData)
+{
+    engine->idleCallback = callback;
+    engine->idleUserData = userData;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_setMaxPoints(SensorCloudEngine* engine, size_t maxPoints)
+{
+    engine->maxPoints = maxPoints ? maxPoints : 1;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudEngine_warmUp(SensorCloudEngine* engine)
+{
+    SensorCloud* sensorCloud = engine->sensorCloud;
+    SensorCloudTokenState state = sensorCloud_tokenState(sensorCloud);
+    if(state != sensorCloudToken_fresh && state != sensorCloudToken_refresh)
+        return 1; // the server comes with the token
+    const char* server = sensorCloud_uploadServer(sensorCloud);
+    if(engine->retry && sensorCloudRetry_state(engine->retry, server) == sensorCloudBreaker_open)
+        return 1;
+
+    size_t i = 0;
+    for(; i < engine->slotCount; ++i)
+    {
+        SensorCloudEngineSlot* slot = &engine->slots[i];
+        if(slot->state != sensorCloudSlot_idle || slot->warm)
+            continue;
+
+        char url[256];
+        memset(url, '\0', sizeof(url));
+        strcat(url, "https://");
+        strncat(url, server, sizeof(url) - 10);
+        strcat(url, "/");
+        if(http_warmUp(&slot->request, url, slot, sensorCloudEngine_requestCallback) != http_ok)
+            return 1;
+        slot->warm = 1;
+        ++engine->warmUps;
+        TRACE_PROBE2(sensorcloud_engine_warm_up, slot, server);
+        return 0;
+    }
+    return 1;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_initSubmission(SensorCloudSubmission* submission, const char* sensor,
+    const char* channel, SensorCloudPointBuffer* points, void* userData)
+{
+    submission->sensor = sensor;
+    submission->channel = channel;
+    submission->points = points;
+    submission->userData = userData;
+    submission->error = sensorCloud_ok;
+    submission->next = NULL;
+    submission->pointsDispatched = 0;
+    submission->partsLeft = 0;
+    submission->rangeFirst = 0;
+    submission->rangeEnd = 0;
+    submission->ranged = 0;
+    submission->completionCount = 0;
+    submission->held = 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_initRange(SensorCloudSubmission* submission, const char* sensor,
+    const char* channel, SensorCloudPointBuffer* points, size_t first, size_t count, void* userData)
+{
+    sensorCloudEngine_initSubmission(submission, sensor, channel, points, userData);
+    submission->rangeFirst = first;
+    submission->rangeEnd = first + count;
+    submission->ranged = 1;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_initProvision(SensorCloudSubmission* submission, const char* sensor,
+    void* userData)
+{
+    sensorCloudEngine_initSubmission(submission, sensor, NULL, NULL, userData);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_provision(SensorCloudEngine* engine, SensorCloudSubmission* submissions,
+    const char* const* sensors, size_t count, void* userData)
+{
+    size_t i = 0;
+    for(; i < count; ++i)
+    {
+        sensorCloudEngine_initProvision(&submissions[i], sensors[i], userData);
+        sensorCloudEngine_submit(engine, &submissions[i]);
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_submit(SensorCloudEngine* engine, SensorCloudSubmission* submission)
+{
+    SensorCloudSensorCache* cache = engine->sensorCloud->sensorCache;
+    if(!submission->points)
+    {
+        TRACE_PROBE2(sensorcloud_engine_provision, submission, submission->sensor);
+        if(cache && sensorCloudSensorCache_contains(cache, submission->sensor))
+        { // already exists
+            sensorCloudEngine_complete(engine, submission, sensorCloud_ok);
+            return;
+        }
+    }
+    else
+    {
+        sensorCloud_finishPointBuffer(submission->points);
+        if(!submission->ranged)
+        {
+            submission->rangeFirst = 0;
+            submission->rangeEnd = sensorCloud_pointCount(submission->points);
+        }
+        TRACE_PROBE4(sensorcloud_engine_submit, submission, submission->sensor, submission->channel,
+            submission->rangeEnd - submission->rangeFirst);
+    }
+    submission->error = sensorCloud_ok;
+    submission->next = NULL;
+    submission->pointsDispatched = submission->rangeFirst;
+    submission->partsLeft = 0;
+    if(engine->queueTail)
+        engine->queueTail->next = submission;
+    else
+        engine->queueHead = submission;
+    engine->queueTail = submission;
+    ++engine->queued;
+
+    sensorCloudEngine_dispatch(engine);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudEngine_stageSubmit(void* engine, SensorCloudSubmission* submission)
+{
+    sensorCloudEngine_submit((SensorCloudEngine*)engine, submission);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_initStage(SensorCloudStage* stage, SensorCloudEngine* engine)
+{
+    stage->submit = sensorCloudEngine_stageSubmit;
+    stage->target = engine;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudStage_submit(const SensorCloudStage* stage, SensorCloudSubmission* submission)
+{
+    stage->submit(stage->target, submission);
+}
+
+int ICACHE_FLASH_ATTR sensorCloudEngine_pushCompletion(SensorCloudSubmission* submission,
+    SensorCloudEngineCallback callback, void* userData)
+{
+    if(submission->completionCount == SENSORCLOUD_ENGINE_MAX_STAGES)
+        return 1;
+    SensorCloudCompletion* completion = &submission->completions[submission->completionCount++];
+    completion->callback = callback;
+    completion->userData = userData;
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudEngine_completeStage(SensorCloudEngine* engine, SensorCloudSubmission* submission)
+{
+    if(submission->completionCount)
+    {
+        SensorCloudCompletion* completion = &submission->completions[--submission->completionCount];
+        completion->callback(completion->userData, submission);
+        return;
+    }
+    if(engine->callback)
+    {
+        engine->callback(engine->userData, submission);
+        return;
+    }
+
+    if(engine->completedTail)
+        engine->completedTail->next = submission;
+    else
+        engine->completedHead = submission;
+    engine->completedTail = submission;
+    ++engine->completed;
+}
+
+SensorCloudSubmission* ICACHE_FLASH_ATTR sensorCloudEngine_reap(SensorCloudEngine* engine)
+{
+    SensorCloudSubmission* submission = engine->completedHead;
+    if(!submission)
+        return NULL;
+
+    engine->completedHead = submission->next;
+    if(!engine->completedHead)
+        engine->completedTail = NULL;
+    --engine->completed;
+    submission->next = NULL;
+    return submission;
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudEngine_pending(const SensorCloudEngine* engine)
+{
+    return engine->queued + engine->active;
+}
+
+uint8_t ICACHE_FLASH_ATTR sensorCloudEngine_idle(const SensorCloudEngine* engine)
+{
+    return !engine->authenticating && sensorCloudEngine_pending(engine) == 0;
+}
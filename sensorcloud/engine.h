@@ -0,0 +1,339 @@
+#ifndef SENSORCLOUD_ENGINE
+#define SENSORCLOUD_ENGINE
+
+#include <sensorcloud.h>
+#include <sensorcloud/retry.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most points sent in one upload unless sensorCloudEngine_setMaxPoints says otherwise.
+#ifndef SENSORCLOUD_MAX_POINTS
+#define SENSORCLOUD_MAX_POINTS 10000
+#endif
+
+// Most submissions merged into one upload.
+#ifndef SENSORCLOUD_ENGINE_MAX_PARTS
+#define SENSORCLOUD_ENGINE_MAX_PARTS 8
+#endif
+
+// Most stages a submission goes through on its way to an engine, see SensorCloudStage.
+#ifndef SENSORCLOUD_ENGINE_MAX_STAGES
+#define SENSORCLOUD_ENGINE_MAX_STAGES 3
+#endif
+
+struct SensorCloudSubmissionData;
+
+/**
+ * Called when a submission completes.
+ * @param[in]   userData    User data given to the engine, or pushed with the completion by a stage.
+ * @param[in]   submission  Submission that completed, it is no longer used by the engine.
+ */
+typedef void (*SensorCloudEngineCallback)(void*, struct SensorCloudSubmissionData*);
+
+/**
+ * A completion a stage pushed on a submission going through it.
+ */
+typedef struct
+{
+    SensorCloudEngineCallback callback;
+    void* userData;
+} SensorCloudCompletion;
+
+/**
+ * An upload submitted to an engine.
+ * The engine doesn't copy submissions, they and their point buffers must stay alive until they complete.
+ */
+typedef struct SensorCloudSubmissionData
+{
+    const char* sensor;
+    const char* channel;
+    // NULL to only create the sensor
+    SensorCloudPointBuffer* points;
+    void* userData;
+    // Result of the upload, valid once the submission completed.
+    SensorCloudError error;
+    struct SensorCloudSubmissionData* next;
+    // points handed to slots so far and the number of those uploads still running
+    size_t pointsDispatched;
+    uint32_t partsLeft;
+    // points of the buffer to upload, [rangeFirst, rangeEnd), the whole buffer unless ranged
+    size_t rangeFirst;
+    size_t rangeEnd;
+    uint8_t ranged;
+    // completions pushed by the stages it went through, called last pushed first before the callback of the engine
+    SensorCloudCompletion completions[SENSORCLOUD_ENGINE_MAX_STAGES];
+    uint8_t completionCount;
+    // net_time() a stage in front of the engine started holding it back
+    uint64_t held;
+} SensorCloudSubmission;
+
+struct SensorCloudEngineData;
+
+/**
+ * Hands a submission to a stage.
+ * @param[io]   target      Stage the submission goes to.
+ * @param[in]   submission  Initialized submission.
+ */
+typedef void (*SensorCloudStageSubmit)(void*, SensorCloudSubmission*);
+
+/**
+ * Where submissions go next on their way to an engine, the engine itself or a stage in front of it such as a
+ * scheduler or a quota.
+ * Stages don't take over the callback of the engine, a stage that needs to see a submission complete pushes a
+ * completion on it and passes it back with sensorCloudEngine_completeStage once done, so stages stack.
+ */
+typedef struct
+{
+    SensorCloudStageSubmit submit;
+    void* target;
+} SensorCloudStage;
+
+/**
+ * Called when an engine runs out of work.
+ * @param[in]   userData    User data given with the callback.
+ * @param[in]   engine      Engine that has nothing pending and no authentication in flight.
+ */
+typedef void (*SensorCloudEngineIdleCallback)(void*, struct SensorCloudEngineData*);
+
+typedef enum
+{
+    sensorCloudSlot_idle,
+    sensorCloudSlot_upload,
+    sensorCloudSlot_addSensor
+} SensorCloudSlotState;
+
+/**
+ * Points of one submission sent in an upload.
+ */
+typedef struct
+{
+    SensorCloudSubmission* submission;
+    size_t first;
+    size_t count;
+} SensorCloudEnginePart;
+
+/**
+ * A connection of an engine, with the memory for the one request it runs at a time.
+ * An upload is gathered from the point buffers of its parts behind a header of its own, without copying points.
+ */
+typedef struct
+{
+    struct SensorCloudEngineData* engine;
+    SensorCloudSlotState state;
+    SensorCloudEnginePart parts[SENSORCLOUD_ENGINE_MAX_PARTS];
+    size_t partCount;
+    char header[16];
+    BufferSequence body[SENSORCLOUD_ENGINE_MAX_PARTS + 1];
+    HTTPRequest request;
+    char requestBuffer[1024];
+    char sensorInfo[16];
+    // waits out the backoff before the request is sent again
+    NetTimer retryTimer;
+    uint8_t retries;
+    // sensorCloudEngine_warmUp opened a connection on the request that no request went out on yet
+    uint8_t warm;
+    // the warm connection while the request is initialized for the upload that uses it
+    HTTPWarmConnection warmConnection;
+} SensorCloudEngineSlot;
+
+typedef struct SensorCloudEngineData
+{
+    SensorCloud* sensorCloud;
+    SensorCloudEngineSlot* slots;
+    size_t slotCount;
+    // submissions waiting for a slot
+    SensorCloudSubmission* queueHead;
+    SensorCloudSubmission* queueTail;
+    // completed submissions waiting to be reaped
+    SensorCloudSubmission* completedHead;
+    SensorCloudSubmission* completedTail;
+    size_t queued;
+    size_t active;
+    size_t completed;
+    uint8_t authenticating;
+    // the last refresh didn't produce a new token, the current one is used until it expires
+    uint8_t refreshFailed;
+    size_t maxPoints;
+    // NULL when failed requests aren't retried
+    SensorCloudRetry* retry;
+    // connections opened ahead of requests, those a request went out on and those that closed or went unused
+    uint32_t warmUps;
+    uint32_t warmUsed;
+    uint32_t warmWasted;
+    SensorCloudEngineCallback callback;
+    void* userData;
+    SensorCloudEngineIdleCallback idleCallback;
+    void* idleUserData;
+} SensorCloudEngine;
+
+/**
+ * Initialize an engine that runs uploads concurrently, one per slot.
+ * @note The engine authenticates through sensorCloud and takes over its user data, sensorCloud must not be used for
+ *  anything else while the engine is. Tokens due for a refresh are refreshed on it while uploads carry on.
+ * @param[out]  engine          Engine to initialize, destroyed first if it was initialized before.
+ * @param[in]   sensorCloud     Initialized SensorCloud holding the device and key to authenticate with.
+ * @param[in]   slots           Storage for the slots, bounds the number of uploads in flight.
+ * @param[in]   slotCount       Number of slots.
+ * @param[in]   callback        Called as submissions complete, NULL to queue them for sensorCloudEngine_reap instead.
+ * @param[in]   userData        User data passed to callback.
+ */
+void sensorCloudEngine_init(SensorCloudEngine* engine, SensorCloud* sensorCloud, SensorCloudEngineSlot* slots,
+    size_t slotCount, SensorCloudEngineCallback callback, void* userData);
+
+/**
+ * Free what the driver allocated for the timers of the slots, typically before initializing the engine again.
+ * Nothing must be pending, the slots can be reused afterwards.
+ * @param[io]   engine  Idle engine.
+ */
+void sensorCloudEngine_destroy(SensorCloudEngine* engine);
+
+/**
+ * Set the most points sent in one upload.
+ * Consecutive submissions to the same channel with the same sample rate are merged up to it, bigger submissions
+ * are split into several uploads that run concurrently.
+ * @param[io]   engine      Engine to configure.
+ * @param[in]   maxPoints   Most points in an upload, SENSORCLOUD_MAX_POINTS by default.
+ */
+void sensorCloudEngine_setMaxPoints(SensorCloudEngine* engine, size_t maxPoints);
+
+/**
+ * Retry requests that fail to connect, break off or get a 5xx, backing off and breaking the circuit as retry says.
+ * A retry sends the body it already gathered from the point buffers again, the points are neither copied nor
+ * encoded again. While the breaker of the server is open queued uploads fail straight away with
+ * sensorCloud_netError.
+ * @param[io]   engine  Engine to configure.
+ * @param[in]   retry   Initialized retry state, NULL to not retry.
+ */
+void sensorCloudEngine_setRetry(SensorCloudEngine* engine, SensorCloudRetry* retry);
+
+/**
+ * Be told when the engine runs out of work, typically to hand its SensorCloud to another device.
+ * @param[io]   engine      Engine to configure.
+ * @param[in]   callback    Called once the last pending submission completed and no authentication is in flight,
+ *  from the completion of a request. NULL to not be told.
+ * @param[in]   userData    User data passed to callback.
+ */
+void sensorCloudEngine_setIdleCallback(SensorCloudEngine* engine, SensorCloudEngineIdleCallback callback,
+    void* userData);
+
+/**
+ * Connect and handshake to the upload server on an idle slot ahead of an upload, typically when a point buffer is
+ * nearly full or about to be flushed. The next request to start picks the slot and skips connecting.
+ * A warm connection the server closes before it is used costs nothing but the connection, the upload connects again.
+ * @param[io]   engine  Engine to warm up.
+ * @return 0 if a connection is being opened, not 0 if there is no token yet, the breaker of the server is open or
+ *  every idle slot is warm already.
+ */
+int sensorCloudEngine_warmUp(SensorCloudEngine* engine);
+
+/**
+ * Initialize a submission.
+ * @param[out]  submission  Submission to initialize.
+ * @param[in]   sensor      Sensor the channel belongs to, created if it doesn't exist.
+ * @param[in]   channel     Channel to upload to.
+ * @param[in]   points      Points to upload.
+ * @param[in]   userData    User data kept with the submission.
+ */
+void sensorCloudEngine_initSubmission(SensorCloudSubmission* submission, const char* sensor, const char* channel,
+    SensorCloudPointBuffer* points, void* userData);
+
+/**
+ * Initialize a submission that uploads part of a point buffer, without copying it.
+ * @param[out]  submission  Submission to initialize.
+ * @param[in]   sensor      Sensor the channel belongs to, created if it doesn't exist.
+ * @param[in]   channel     Channel to upload to.
+ * @param[in]   points      Points to upload part of.
+ * @param[in]   first       Index of the first point to upload.
+ * @param[in]   count       Number of points to upload.
+ * @param[in]   userData    User data kept with the submission.
+ */
+void sensorCloudEngine_initRange(SensorCloudSubmission* submission, const char* sensor, const char* channel,
+    SensorCloudPointBuffer* points, size_t first, size_t count, void* userData);
+
+/**
+ * Initialize a submission that creates a sensor without uploading to it.
+ * @param[out]  submission  Submission to initialize.
+ * @param[in]   sensor      Sensor to create.
+ * @param[in]   userData    User data kept with the submission.
+ */
+void sensorCloudEngine_initProvision(SensorCloudSubmission* submission, const char* sensor, void* userData);
+
+/**
+ * Create sensors concurrently, typically every configured sensor at startup so uploads never find one missing.
+ * Sensors the sensor cache of the SensorCloud knows exist complete straight away without a request.
+ * @param[io]   engine      Engine to run the requests.
+ * @param[out]  submissions Storage for a submission per sensor, they complete like uploads do.
+ * @param[in]   sensors     Sensors to create.
+ * @param[in]   count       Number of sensors.
+ * @param[in]   userData    User data kept with every submission.
+ */
+void sensorCloudEngine_provision(SensorCloudEngine* engine, SensorCloudSubmission* submissions,
+    const char* const* sensors, size_t count, void* userData);
+
+/**
+ * Submit an upload, it starts as soon as the engine is authenticated and a slot is free.
+ * @param[io]   engine      Engine to run the upload.
+ * @param[in]   submission  Initialized submission.
+ */
+void sensorCloudEngine_submit(SensorCloudEngine* engine, SensorCloudSubmission* submission);
+
+/**
+ * Initialize a stage that submits straight to an engine.
+ * @param[out]  stage   Stage to initialize.
+ * @param[in]   engine  Engine to submit to.
+ */
+void sensorCloudEngine_initStage(SensorCloudStage* stage, SensorCloudEngine* engine);
+
+/**
+ * Hand a submission to a stage.
+ * @param[in]   stage       Initialized stage.
+ * @param[in]   submission  Initialized submission.
+ */
+void sensorCloudStage_submit(const SensorCloudStage* stage, SensorCloudSubmission* submission);
+
+/**
+ * Be called back when a submission completes, before the stages it went through earlier.
+ * @param[io]   submission  Submission going through the stage.
+ * @param[in]   callback    Called when the submission completes, it must finish with sensorCloudEngine_completeStage
+ *  unless the stage pushing it is the one that submitted it.
+ * @param[in]   userData    User data passed to callback.
+ * @return 0 if the completion was pushed, not 0 if the submission already has SENSORCLOUD_ENGINE_MAX_STAGES.
+ */
+int sensorCloudEngine_pushCompletion(SensorCloudSubmission* submission, SensorCloudEngineCallback callback,
+    void* userData);
+
+/**
+ * Pass a completed submission on to the completion pushed before the last one, or to the callback or completion
+ * queue of the engine once none is left.
+ * @param[io]   engine      Engine the submission ran on.
+ * @param[in]   submission  Completed submission whose last completion was called.
+ */
+void sensorCloudEngine_completeStage(SensorCloudEngine* engine, SensorCloudSubmission* submission);
+
+/**
+ * Take a completed submission off the completion queue.
+ * @param[io]   engine  Engine without a callback.
+ * @return The oldest completed submission, NULL if none has completed.
+ */
+SensorCloudSubmission* sensorCloudEngine_reap(SensorCloudEngine* engine);
+
+/**
+ * Number of submitted uploads that haven't completed yet.
+ * @param[in]   engine  Engine to query.
+ */
+size_t sensorCloudEngine_pending(const SensorCloudEngine* engine);
+
+/**
+ * Check if an engine has nothing pending and no authentication in flight, its SensorCloud can be changed.
+ * @param[in]   engine  Engine to query.
+ * @return 1 if the engine is idle, 0 otherwise.
+ */
+uint8_t sensorCloudEngine_idle(const SensorCloudEngine* engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
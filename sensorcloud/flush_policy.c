@@ -0,0 +1,139 @@
+#include "flush_policy.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+#include <net/driver.h>
+
+static size_t ICACHE_FLASH_ATTR sensorCloudFlushPolicy_capacity(const SensorCloudFlushPolicy* policy)
+{
+    return (policy->points->data.length - sensorCloud_pointBufferHeaderSize) / sensorCloud_pointBufferDataSize;
+}
+
+static uint64_t ICACHE_FLASH_ATTR sensorCloudFlushPolicy_budget(const SensorCloudFlushPolicy* policy)
+{
+    // oldest the batch may get and still be delivered within the target
+    return policy->latencyTarget > policy->rtt ? policy->latencyTarget - policy->rtt : 0;
+}
+
+static uint64_t ICACHE_FLASH_ATTR sensorCloudFlushPolicy_hold(const SensorCloudFlushPolicy* policy)
+{
+    // about one round trip of points when the link is idle, growing with the square of how much slower than its best
+    // the link currently is so a congested link sees fewer requests
+    uint64_t hold = policy->latencyTarget / 2;
+    if(policy->rtt)
+        hold = policy->rtt * policy->rtt / policy->minRtt;
+    hold = min(hold, sensorCloudFlushPolicy_budget(policy));
+    return min(hold, policy->maxAge);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudFlushPolicy_init(SensorCloudFlushPolicy* policy, SensorCloudPointBuffer* points,
+    uint8_t fillPercent, uint64_t maxAge, uint64_t latencyTarget)
+{
+    memset(policy, 0, sizeof(SensorCloudFlushPolicy));
+    policy->points = points;
+    policy->fillPercent = fillPercent;
+    policy->maxAge = maxAge;
+    policy->latencyTarget = latencyTarget;
+    policy->hold = sensorCloudFlushPolicy_hold(policy);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudFlushPolicy_addPoint(SensorCloudFlushPolicy* policy, Timestamp time, float value)
+{
+    if(sensorCloud_pointCount(policy->points) == 0)
+        policy->oldest = net_time();
+    sensorCloud_addPoint(policy->points, time, value);
+}
+
+SensorCloudFlushReason ICACHE_FLASH_ATTR sensorCloudFlushPolicy_check(SensorCloudFlushPolicy* policy)
+{
+    SensorCloudFlushReason reason = sensorCloudFlush_none;
+    size_t count = sensorCloud_pointCount(policy->points);
+    policy->hold = sensorCloudFlushPolicy_hold(policy);
+    if(count == 0)
+    {
+        policy->lastReason = reason;
+        return reason;
+    }
+
+    uint64_t now = net_time();
+    uint64_t age = now > policy->oldest ? now - policy->oldest : 0;
+    if(count * 100 >= sensorCloudFlushPolicy_capacity(policy) * policy->fillPercent)
+        reason = sensorCloudFlush_full;
+    else if(policy->uploading) // keep batching behind the running upload
+        reason = sensorCloudFlush_none;
+    else if(age >= policy->maxAge)
+        reason = sensorCloudFlush_maxAge;
+    else if(age >= sensorCloudFlushPolicy_budget(policy))
+        reason = sensorCloudFlush_latency;
+    else if(age >= policy->hold)
+        reason = sensorCloudFlush_batch;
+
+    policy->lastReason = reason;
+    return reason;
+}
+
+uint64_t ICACHE_FLASH_ATTR sensorCloudFlushPolicy_deadline(const SensorCloudFlushPolicy* policy)
+{
+    if(policy->uploading || sensorCloud_pointCount(policy->points) == 0)
+        return 0;
+    return policy->oldest + sensorCloudFlushPolicy_hold(policy);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudFlushPolicy_setWarmUp(SensorCloudFlushPolicy* policy, uint8_t fillPercent,
+    uint64_t lead)
+{
+    policy->warmPercent = fillPercent;
+    policy->warmLead = lead;
+}
+
+uint8_t ICACHE_FLASH_ATTR sensorCloudFlushPolicy_warmUp(SensorCloudFlushPolicy* policy)
+{
+    size_t count = sensorCloud_pointCount(policy->points);
+    if(policy->warmed || policy->uploading || count == 0)
+        return 0;
+
+    uint8_t near = policy->warmPercent && count * 100 >= sensorCloudFlushPolicy_capacity(policy) * policy->warmPercent;
+    uint64_t deadline = sensorCloudFlushPolicy_deadline(policy);
+    if(!near && policy->warmLead && deadline)
+        near = net_time() + policy->warmLead >= deadline;
+    if(!near)
+        return 0;
+    policy->warmed = 1;
+    TRACE_PROBE2(sensorcloud_flush_warm, policy, count);
+    return 1;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudFlushPolicy_begin(SensorCloudFlushPolicy* policy, SensorCloudFlushReason reason)
+{
+    TRACE_PROBE3(sensorcloud_flush, policy, reason, sensorCloud_pointCount(policy->points));
+    ++policy->flushes[reason];
+    policy->uploadStarted = net_time();
+    policy->uploading = 1;
+    policy->warmed = 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudFlushPolicy_end(SensorCloudFlushPolicy* policy, SensorCloudError error)
+{
+    if(!policy->uploading)
+        return;
+
+    uint64_t now = net_time();
+    uint64_t rtt = now > policy->uploadStarted ? now - policy->uploadStarted : 0;
+    policy->uploading = 0;
+    ++policy->uploads;
+    if(error != sensorCloud_ok)
+    { // how long a failure took says little about the link
+        ++policy->failures;
+        return;
+    }
+    if(rtt == 0)
+        rtt = 1;
+
+    // smoothed like TCP does, the lowest round trip creeps up so a slower route becomes the new idle
+    policy->rtt = policy->rtt ? policy->rtt - policy->rtt / 8 + rtt / 8 : rtt;
+    if(!policy->minRtt || rtt < policy->minRtt)
+        policy->minRtt = rtt;
+    else
+        policy->minRtt += (rtt - policy->minRtt) / 64;
+    policy->hold = sensorCloudFlushPolicy_hold(policy);
+}
@@ -0,0 +1,136 @@
+#ifndef SENSORCLOUD_FLUSHPOLICY
+#define SENSORCLOUD_FLUSHPOLICY
+
+#include <sensorcloud.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Why a channel should be uploaded.
+ */
+typedef enum
+{
+    // keep collecting points
+    sensorCloudFlush_none,
+    // the point buffer reached its fill ratio
+    sensorCloudFlush_full,
+    // the oldest point reached the maximum age
+    sensorCloudFlush_maxAge,
+    // waiting any longer would deliver the oldest point after the latency target
+    sensorCloudFlush_latency,
+    // the batch is as big as the current round trip time warrants
+    sensorCloudFlush_batch,
+    sensorCloudFlush_reasonCount
+} SensorCloudFlushReason;
+
+/**
+ * Decides when the points collected for one channel are uploaded.
+ * Batches grow with the upload round trip time, so a congested link gets fewer, bigger uploads and an idle one gets
+ * points through quickly, always within the latency target and the maximum age. All times are net_time()
+ * microseconds.
+ */
+typedef struct
+{
+    // buffer points are collected in, may be replaced by another one between uploads
+    SensorCloudPointBuffer* points;
+    // percentage of the buffer that triggers an upload
+    uint8_t fillPercent;
+    uint64_t maxAge;
+    // time from collecting a point to its upload completing that the policy aims for
+    uint64_t latencyTarget;
+
+    // when the oldest point in the buffer was added
+    uint64_t oldest;
+    // when the running upload started
+    uint64_t uploadStarted;
+    uint8_t uploading;
+    // smoothed and lowest round trip time of successful uploads, 0 until one completed
+    uint64_t rtt;
+    uint64_t minRtt;
+    // age the batch is collected to, updated by sensorCloudFlushPolicy_check
+    uint64_t hold;
+    // fill percentage and time before the deadline that warm up a connection for the upload, 0 for neither
+    uint8_t warmPercent;
+    uint64_t warmLead;
+    // a warm up was asked for since the last upload began
+    uint8_t warmed;
+
+    SensorCloudFlushReason lastReason;
+    uint32_t flushes[sensorCloudFlush_reasonCount];
+    uint32_t uploads;
+    uint32_t failures;
+} SensorCloudFlushPolicy;
+
+/**
+ * Initialize a flush policy.
+ * @param[out]  policy          Policy to initialize.
+ * @param[in]   points          Initialized buffer the points of the channel are collected in.
+ * @param[in]   fillPercent     Percentage of the buffer that triggers an upload regardless of age.
+ * @param[in]   maxAge          Oldest a point may get before it is uploaded.
+ * @param[in]   latencyTarget   Time from adding a point to its upload completing the policy aims for.
+ */
+void sensorCloudFlushPolicy_init(SensorCloudFlushPolicy* policy, SensorCloudPointBuffer* points, uint8_t fillPercent,
+    uint64_t maxAge, uint64_t latencyTarget);
+
+/**
+ * Add a point to the buffer of the policy.
+ * @param[io]   policy  Policy to add to.
+ * @param[in]   time    Timestamp of the point.
+ * @param[in]   value   Value of the point.
+ */
+void sensorCloudFlushPolicy_addPoint(SensorCloudFlushPolicy* policy, Timestamp time, float value);
+
+/**
+ * Check whether the buffer should be uploaded now.
+ * While an upload is running only a full buffer is reported, everything else keeps batching until it completes.
+ * @param[io]   policy  Policy to check.
+ * @return Why the buffer should be uploaded, sensorCloudFlush_none to keep collecting.
+ */
+SensorCloudFlushReason sensorCloudFlushPolicy_check(SensorCloudFlushPolicy* policy);
+
+/**
+ * Time at which sensorCloudFlushPolicy_check will ask for an upload if no more points are added.
+ * @param[in]   policy  Policy to query.
+ * @return net_time() of the next upload, 0 if the buffer is empty or an upload is running.
+ */
+uint64_t sensorCloudFlushPolicy_deadline(const SensorCloudFlushPolicy* policy);
+
+/**
+ * Set when the connection for the next upload is opened ahead of it.
+ * @param[io]   policy      Policy to configure.
+ * @param[in]   fillPercent Percentage of the buffer that warms up a connection, 0 to not go by fill.
+ * @param[in]   lead        Time before the deadline that warms up a connection, 0 to not go by time.
+ */
+void sensorCloudFlushPolicy_setWarmUp(SensorCloudFlushPolicy* policy, uint8_t fillPercent, uint64_t lead);
+
+/**
+ * Check whether the upload is close enough to open its connection now, with sensorCloudEngine_warmUp.
+ * @param[io]   policy  Policy to check.
+ * @return 1 once per batch, when the buffer crosses the warm up fill or the deadline is within the lead, 0 otherwise.
+ */
+uint8_t sensorCloudFlushPolicy_warmUp(SensorCloudFlushPolicy* policy);
+
+/**
+ * Record that the buffer is being uploaded.
+ * @param[io]   policy  Policy of the channel.
+ * @param[in]   reason  Why it is uploaded, usually what sensorCloudFlushPolicy_check returned.
+ */
+void sensorCloudFlushPolicy_begin(SensorCloudFlushPolicy* policy, SensorCloudFlushReason reason);
+
+/**
+ * Record that the upload started by sensorCloudFlushPolicy_begin completed, learning from its round trip time.
+ * @param[io]   policy  Policy of the channel.
+ * @param[in]   error   Result of the upload.
+ */
+void sensorCloudFlushPolicy_end(SensorCloudFlushPolicy* policy, SensorCloudError error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,215 @@
+#include "gateway.h"
+
+#include <detail/trace.h>
+
+static void sensorCloudGateway_dispatch(SensorCloudGateway* gateway);
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudGateway_tenantIdle(const SensorCloudGatewayTenant* tenant)
+{
+    return sensorCloudEngine_idle(&tenant->engine) && !tenant->binding;
+}
+
+// the tenant of the device first so it keeps its token and warm connections, then an unbound tenant so other idle
+// devices keep theirs as long as possible
+static SensorCloudGatewayTenant* ICACHE_FLASH_ATTR sensorCloudGateway_idleTenant(SensorCloudGateway* gateway,
+    const SensorCloudGatewayDevice* device)
+{
+    if(device->tenant && sensorCloudGateway_tenantIdle(device->tenant))
+        return device->tenant;
+    SensorCloudGatewayTenant* idle = NULL;
+    size_t i = 0;
+    for(; i < gateway->tenantCount; ++i)
+    {
+        SensorCloudGatewayTenant* tenant = &gateway->tenants[i];
+        if(!sensorCloudGateway_tenantIdle(tenant))
+            continue;
+        if(!tenant->device)
+            return tenant;
+        if(!idle)
+            idle = tenant;
+    }
+    return idle;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudGateway_bind(SensorCloudGateway* gateway, SensorCloudGatewayTenant* tenant,
+    SensorCloudGatewayDevice* device)
+{
+    TRACE_PROBE3(sensorcloud_gateway_bind, tenant, device->device, tenant->device ? tenant->device->device : NULL);
+    if(tenant->device != device)
+    {
+        if(tenant->device)
+            tenant->device->tenant = NULL;
+        // a tenant the device leaves still finishes the uploads it has
+        if(device->tenant)
+            device->tenant->device = NULL;
+        tenant->device = device;
+        device->tenant = tenant;
+        ++gateway->binds;
+
+        // the engine is idle, its SensorCloud can change hands
+        SensorCloud* sensorCloud = &tenant->sensorCloud;
+        sensorCloud->device = device->device;
+        sensorCloud->key = device->key;
+        sensorCloud->authenticated = 0;
+        sensorCloud_setSensorCache(sensorCloud, device->sensorCache);
+        tenant->engine.refreshFailed = 0; // that was the refresh of the previous device
+    }
+
+    // taken one at a time, the engine may complete an upload straight away and its callback submit more
+    tenant->binding = 1;
+    while(device->waitingHead)
+    {
+        SensorCloudGatewayUpload* upload = device->waitingHead;
+        device->waitingHead = (SensorCloudGatewayUpload*)upload->submission.next;
+        if(!device->waitingHead)
+            device->waitingTail = NULL;
+        upload->submission.next = NULL;
+        sensorCloudEngine_submit(&tenant->engine, &upload->submission);
+    }
+    tenant->binding = 0;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudGateway_completionCallback(void* userData, SensorCloudSubmission* submission)
+{
+    SensorCloudGatewayTenant* tenant = (SensorCloudGatewayTenant*)userData;
+    SensorCloudGateway* gateway = tenant->gateway;
+    SensorCloudGatewayUpload* upload = (SensorCloudGatewayUpload*)submission;
+    TRACE_PROBE2(sensorcloud_gateway_complete, upload, submission->error);
+    --gateway->pending;
+    ++gateway->uploads;
+    gateway->callback(gateway->userData, upload);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudGateway_idleCallback(void* userData, SensorCloudEngine* engine)
+{
+    (void)engine; // the tenant it belongs to is the user data
+    SensorCloudGatewayTenant* tenant = (SensorCloudGatewayTenant*)userData;
+    sensorCloudGateway_dispatch(tenant->gateway);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudGateway_dispatch(SensorCloudGateway* gateway)
+{
+    SensorCloudGatewayTenant* tenant;
+    while(gateway->waitingHead && (tenant = sensorCloudGateway_idleTenant(gateway, gateway->waitingHead)))
+    {
+        SensorCloudGatewayDevice* device = gateway->waitingHead;
+        gateway->waitingHead = device->nextWaiting;
+        if(!gateway->waitingHead)
+            gateway->waitingTail = NULL;
+        device->nextWaiting = NULL;
+        sensorCloudGateway_bind(gateway, tenant, device);
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_init(SensorCloudGateway* gateway, SensorCloudTokenStore* tokenStore,
+    SensorCloudGatewayTenant* tenants, size_t tenantCount, SensorCloudEngineSlot* slots, size_t slotCount,
+    SensorCloudGatewayCallback callback, void* userData)
+{
+    memset(gateway, 0, sizeof(SensorCloudGateway));
+    gateway->tokenStore = tokenStore;
+    gateway->tenants = tenants;
+    gateway->tenantCount = tenantCount;
+    gateway->callback = callback;
+    gateway->userData = userData;
+
+    size_t slotsPerTenant = tenantCount ? slotCount / tenantCount : 0;
+    size_t i = 0;
+    for(; i < tenantCount; ++i)
+    {
+        SensorCloudGatewayTenant* tenant = &tenants[i];
+        tenant->gateway = gateway;
+        tenant->device = NULL;
+        tenant->binding = 0;
+        sensorCloud_init(&tenant->sensorCloud, "", "", NULL);
+        sensorCloud_setTokenStore(&tenant->sensorCloud, tokenStore);
+        sensorCloudEngine_init(&tenant->engine, &tenant->sensorCloud, slots + i * slotsPerTenant, slotsPerTenant,
+            sensorCloudGateway_completionCallback, tenant);
+        sensorCloudEngine_setIdleCallback(&tenant->engine, sensorCloudGateway_idleCallback, tenant);
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_destroy(SensorCloudGateway* gateway)
+{
+    size_t i = 0;
+    for(; i < gateway->tenantCount; ++i)
+        sensorCloudEngine_destroy(&gateway->tenants[i].engine);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_setRetry(SensorCloudGateway* gateway, SensorCloudRetry* retry)
+{
+    size_t i = 0;
+    for(; i < gateway->tenantCount; ++i)
+        sensorCloudEngine_setRetry(&gateway->tenants[i].engine, retry);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_setEndpoints(SensorCloudGateway* gateway,
+    struct SensorCloudEndpointsData* endpoints)
+{
+    size_t i = 0;
+    for(; i < gateway->tenantCount; ++i)
+        sensorCloud_setEndpoints(&gateway->tenants[i].sensorCloud, endpoints);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_initDevice(SensorCloudGatewayDevice* device, const char* id,
+    const char* key)
+{
+    device->device = id;
+    device->key = key;
+    device->sensorCache = NULL;
+    device->tenant = NULL;
+    device->waitingHead = NULL;
+    device->waitingTail = NULL;
+    device->nextWaiting = NULL;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_setSensorCache(SensorCloudGatewayDevice* device,
+    struct SensorCloudSensorCacheData* sensorCache)
+{
+    device->sensorCache = sensorCache;
+    if(device->tenant)
+        sensorCloud_setSensorCache(&device->tenant->sensorCloud, sensorCache);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_initUpload(SensorCloudGatewayUpload* upload,
+    SensorCloudGatewayDevice* device, const char* sensor, const char* channel, SensorCloudPointBuffer* points,
+    void* userData)
+{
+    sensorCloudEngine_initSubmission(&upload->submission, sensor, channel, points, userData);
+    upload->device = device;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudGateway_submit(SensorCloudGateway* gateway, SensorCloudGatewayUpload* upload)
+{
+    SensorCloudGatewayDevice* device = upload->device;
+    TRACE_PROBE4(sensorcloud_gateway_submit, upload, device->device, upload->submission.channel,
+        sensorCloud_pointCount(upload->submission.points));
+    ++gateway->pending;
+    if(device->tenant && !device->waitingHead && !gateway->waitingHead)
+    {
+        sensorCloudEngine_submit(&device->tenant->engine, &upload->submission);
+        return;
+    }
+
+    // wait for a tenant behind the devices already waiting, the device joins the queue with its first waiting upload
+    upload->submission.next = NULL;
+    if(device->waitingTail)
+    {
+        device->waitingTail->submission.next = &upload->submission;
+    }
+    else
+    {
+        device->waitingHead = upload;
+        if(gateway->waitingTail)
+            gateway->waitingTail->nextWaiting = device;
+        else
+            gateway->waitingHead = device;
+        gateway->waitingTail = device;
+    }
+    device->waitingTail = upload;
+    sensorCloudGateway_dispatch(gateway);
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudGateway_pending(const SensorCloudGateway* gateway)
+{
+    return gateway->pending;
+}
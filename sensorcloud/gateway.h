@@ -0,0 +1,177 @@
+#ifndef SENSORCLOUD_GATEWAY
+#define SENSORCLOUD_GATEWAY
+
+#include <sensorcloud/engine.h>
+#include <sensorcloud/token_store.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct SensorCloudGatewayUploadData;
+struct SensorCloudGatewayTenantData;
+
+/**
+ * A device fronted by a gateway.
+ * It only holds its credentials and the uploads waiting for a tenant, the token and server live in the token store of
+ * the gateway while the device is active and everything else in the tenant it is bound to while it uploads.
+ */
+typedef struct SensorCloudGatewayDeviceData
+{
+    const char* device;
+    const char* key;
+    // sensors of the device known to exist, NULL to find out with a 404
+    struct SensorCloudSensorCacheData* sensorCache;
+    // tenant uploading for the device, NULL when it has none
+    struct SensorCloudGatewayTenantData* tenant;
+    // uploads waiting for a tenant
+    struct SensorCloudGatewayUploadData* waitingHead;
+    struct SensorCloudGatewayUploadData* waitingTail;
+    // next device waiting for a tenant
+    struct SensorCloudGatewayDeviceData* nextWaiting;
+} SensorCloudGatewayDevice;
+
+/**
+ * An upload of a device submitted to a gateway.
+ */
+typedef struct SensorCloudGatewayUploadData
+{
+    // first so the upload can be handed around as a submission
+    SensorCloudSubmission submission;
+    SensorCloudGatewayDevice* device;
+} SensorCloudGatewayUpload;
+
+struct SensorCloudGatewayData;
+
+/**
+ * Called when an upload completes.
+ * @param[in]   userData    User data given to the gateway.
+ * @param[in]   upload      Upload that completed, it is no longer used by the gateway.
+ */
+typedef void (*SensorCloudGatewayCallback)(void*, SensorCloudGatewayUpload*);
+
+/**
+ * An engine of a gateway and the SensorCloud it authenticates with, bound to one device at a time.
+ */
+typedef struct SensorCloudGatewayTenantData
+{
+    struct SensorCloudGatewayData* gateway;
+    SensorCloud sensorCloud;
+    SensorCloudEngine engine;
+    // device the engine uploads for, kept once it is idle until another device needs the tenant
+    SensorCloudGatewayDevice* device;
+    // handing the waiting uploads of its device to the engine, it can't change hands even if the engine is idle
+    uint8_t binding;
+} SensorCloudGatewayTenant;
+
+/**
+ * Uploads for many devices over a few engines.
+ * A device with uploads is bound to an idle tenant and its uploads run on the engine of the tenant, with the retries,
+ * sensor cache, warm connections and endpoint routing the engine has. Devices waiting for a tenant are bound in the
+ * order they submitted. A bound device only hands new uploads straight to its engine while no other device waits,
+ * otherwise it queues behind them, so a device that keeps submitting can't hold on to its tenant. The slots are
+ * split evenly between the tenants, an engine only uses its own. Tokens are kept in a token store that can be much
+ * smaller than the number of devices, but should hold at least a token per tenant.
+ */
+typedef struct SensorCloudGatewayData
+{
+    SensorCloudTokenStore* tokenStore;
+    SensorCloudGatewayTenant* tenants;
+    size_t tenantCount;
+    // devices with uploads waiting for a tenant
+    SensorCloudGatewayDevice* waitingHead;
+    SensorCloudGatewayDevice* waitingTail;
+    size_t pending;
+    SensorCloudGatewayCallback callback;
+    void* userData;
+
+    // times a device was bound to a tenant
+    uint32_t binds;
+    uint32_t uploads;
+} SensorCloudGateway;
+
+/**
+ * Initialize a gateway.
+ * @param[out]  gateway     Gateway to initialize.
+ * @param[in]   tokenStore  Initialized store for the tokens of the active devices, the oldest is dropped when full.
+ * @param[in]   tenants     Storage for the tenants, bounds the number of devices uploading at once.
+ * @param[in]   tenantCount Number of tenants.
+ * @param[in]   slots       Storage for the slots, shared out evenly between the tenants.
+ * @param[in]   slotCount   Number of slots, at least one per tenant.
+ * @param[in]   callback    Called as uploads complete.
+ * @param[in]   userData    User data passed to callback.
+ */
+void sensorCloudGateway_init(SensorCloudGateway* gateway, SensorCloudTokenStore* tokenStore,
+    SensorCloudGatewayTenant* tenants, size_t tenantCount, SensorCloudEngineSlot* slots, size_t slotCount,
+    SensorCloudGatewayCallback callback, void* userData);
+
+/**
+ * Free what the driver allocated for the engines of the tenants, see sensorCloudEngine_destroy.
+ * @param[io]   gateway Gateway with nothing pending.
+ */
+void sensorCloudGateway_destroy(SensorCloudGateway* gateway);
+
+/**
+ * Retry failed requests of every tenant, see sensorCloudEngine_setRetry.
+ * @param[io]   gateway Gateway to configure.
+ * @param[in]   retry   Initialized retry state shared by the tenants, NULL to not retry.
+ */
+void sensorCloudGateway_setRetry(SensorCloudGateway* gateway, SensorCloudRetry* retry);
+
+/**
+ * Send the requests of every tenant to the endpoints picked from a list, see sensorCloud_setEndpoints.
+ * @param[io]   gateway     Gateway to configure.
+ * @param[in]   endpoints   Initialized endpoints shared by the tenants, NULL to stop using them.
+ */
+void sensorCloudGateway_setEndpoints(SensorCloudGateway* gateway, struct SensorCloudEndpointsData* endpoints);
+
+/**
+ * Initialize a device.
+ * @param[out]  device  Device to initialize.
+ * @param[in]   id      Id of the device, must outlive it.
+ * @param[in]   key     Key of the device, must outlive it.
+ */
+void sensorCloudGateway_initDevice(SensorCloudGatewayDevice* device, const char* id, const char* key);
+
+/**
+ * Remember which sensors of a device exist in a cache, used by the tenant the device is bound to.
+ * @param[io]   device      Initialized device.
+ * @param[in]   sensorCache Initialized cache of the device, NULL to stop using one.
+ */
+void sensorCloudGateway_setSensorCache(SensorCloudGatewayDevice* device,
+    struct SensorCloudSensorCacheData* sensorCache);
+
+/**
+ * Initialize an upload.
+ * @param[out]  upload      Upload to initialize.
+ * @param[in]   device      Device uploading.
+ * @param[in]   sensor      Sensor the channel belongs to, created if it doesn't exist.
+ * @param[in]   channel     Channel to upload to.
+ * @param[in]   points      Points to upload.
+ * @param[in]   userData    User data kept with the upload.
+ */
+void sensorCloudGateway_initUpload(SensorCloudGatewayUpload* upload, SensorCloudGatewayDevice* device,
+    const char* sensor, const char* channel, SensorCloudPointBuffer* points, void* userData);
+
+/**
+ * Submit an upload, it goes to the engine of its device straight away if the device is bound to a tenant and no
+ * other device is waiting, otherwise once the device gets its turn at a tenant.
+ * @param[io]   gateway Gateway to run the upload.
+ * @param[in]   upload  Initialized upload, it and its points must stay alive until it completes.
+ */
+void sensorCloudGateway_submit(SensorCloudGateway* gateway, SensorCloudGatewayUpload* upload);
+
+/**
+ * Number of submitted uploads that haven't completed yet.
+ * @param[in]   gateway Gateway to query.
+ */
+size_t sensorCloudGateway_pending(const SensorCloudGateway* gateway);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+#include "ingest.h"
+
+#include <detail/trace.h>
+
+/*
+ * The queue is an intrusive linked list of batches in the manner of Vyukov's MPSC queue: a producer swaps its batch
+ * in as the head and then links the previous head to it, the consumer follows the links from the tail. Between the
+ * two steps of a push the list is briefly cut, the consumer then stops and picks the rest up on its next drain.
+ */
+
+static void ICACHE_FLASH_ATTR sensorCloudIngest_push(SensorCloudIngestQueue* queue, SensorCloudIngestBatch* batch)
+{
+    __atomic_store_n(&batch->next, NULL, __ATOMIC_RELAXED);
+    SensorCloudIngestBatch* previous = __atomic_exchange_n(&queue->head, batch, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&previous->next, batch, __ATOMIC_RELEASE);
+}
+
+static SensorCloudIngestBatch* ICACHE_FLASH_ATTR sensorCloudIngest_pop(SensorCloudIngestQueue* queue)
+{
+    SensorCloudIngestBatch* tail = queue->tail;
+    SensorCloudIngestBatch* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if(tail == &queue->stub)
+    { // skip the stub
+        if(!next)
+            return NULL;
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if(next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+    if(tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+        return NULL; // a push is half way, its batch comes next time
+
+    // tail is the last batch, put the stub behind it so it can be taken out
+    sensorCloudIngest_push(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if(next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudIngest_init(SensorCloudIngestQueue* queue)
+{
+    queue->stub.next = NULL;
+    queue->stub.count = 0;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+    queue->drained = 0;
+    queue->dropped = 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudIngest_initProducer(SensorCloudIngestProducer* producer,
+    SensorCloudIngestQueue* queue, SensorCloudIngestBatch* batches, size_t batchCount)
+{
+    producer->queue = queue;
+    producer->batches = batches;
+    producer->batchCount = batchCount;
+    producer->current = NULL;
+    producer->next = 0;
+    producer->refused = 0;
+
+    size_t i;
+    for(i = 0; i < batchCount; ++i)
+    {
+        batches[i].next = NULL;
+        batches[i].count = 0;
+        batches[i].free = 1;
+    }
+}
+
+int ICACHE_FLASH_ATTR sensorCloudIngest_put(SensorCloudIngestProducer* producer, uint32_t channel, Timestamp time,
+    float value)
+{
+    SensorCloudIngestBatch* batch = producer->current;
+    if(!batch)
+    { // batches go round in order, and come back in the order they were pushed
+        batch = &producer->batches[producer->next];
+        if(!producer->batchCount || !__atomic_load_n(&batch->free, __ATOMIC_ACQUIRE))
+        {
+            ++producer->refused;
+            return 1;
+        }
+        producer->next = (producer->next + 1) % producer->batchCount;
+        batch->free = 0;
+        batch->count = 0;
+        producer->current = batch;
+    }
+
+    SensorCloudIngestPoint* point = &batch->points[batch->count++];
+    point->time = time;
+    point->value = value;
+    point->channel = channel;
+
+    if(batch->count == SENSORCLOUD_INGEST_BATCH)
+        sensorCloudIngest_publish(producer);
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudIngest_publish(SensorCloudIngestProducer* producer)
+{
+    SensorCloudIngestBatch* batch = producer->current;
+    if(!batch || !batch->count)
+        return;
+    producer->current = NULL;
+    sensorCloudIngest_push(producer->queue, batch);
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudIngest_drain(SensorCloudIngestQueue* queue, SensorCloudPointBuffer* const* channels,
+    size_t channelCount)
+{
+    size_t moved = 0;
+    size_t dropped = 0;
+    SensorCloudIngestBatch* batch;
+    while((batch = sensorCloudIngest_pop(queue)))
+    {
+        size_t i;
+        for(i = 0; i < batch->count; ++i)
+        {
+            const SensorCloudIngestPoint* point = &batch->points[i];
+            SensorCloudPointBuffer* points = point->channel < channelCount ? channels[point->channel] : NULL;
+            if(!points || buffer_bytesAvailable(&points->data) < sensorCloud_pointBufferDataSize)
+            {
+                ++dropped;
+                continue;
+            }
+            sensorCloud_addPoint(points, point->time, point->value);
+            ++moved;
+        }
+        // hand the batch back, the producer may refill it from here on
+        __atomic_store_n(&batch->free, 1, __ATOMIC_RELEASE);
+    }
+
+    if(dropped)
+        TRACE_PROBE2(sensorcloud_ingest_dropped, queue, dropped);
+    queue->drained += moved;
+    queue->dropped += dropped;
+    return moved;
+}
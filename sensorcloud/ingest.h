@@ -0,0 +1,117 @@
+#ifndef SENSORCLOUD_INGEST
+#define SENSORCLOUD_INGEST
+
+#include <sensorcloud.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Points a producer collects before handing them to the queue.
+#ifndef SENSORCLOUD_INGEST_BATCH
+#define SENSORCLOUD_INGEST_BATCH 64
+#endif
+
+typedef struct
+{
+    Timestamp time;
+    float value;
+    uint32_t channel;
+} SensorCloudIngestPoint;
+
+/**
+ * Points of one producer travelling through the queue.
+ */
+typedef struct SensorCloudIngestBatchData
+{
+    struct SensorCloudIngestBatchData* next;
+    // set by the consumer once the points were drained, the producer then reuses the batch
+    uint8_t free;
+    size_t count;
+    SensorCloudIngestPoint points[SENSORCLOUD_INGEST_BATCH];
+} SensorCloudIngestBatch;
+
+/**
+ * Carries points from any number of producer threads to the one thread that uploads them.
+ * Producers never wait on each other or on the consumer: publishing a batch is a single atomic exchange. The uploader
+ * thread drains the queue into the point buffers of the channels and submits those to an engine, so the SensorCloud
+ * and the point buffers stay on one thread.
+ */
+typedef struct
+{
+    // producers push at the head, the consumer pops at the tail
+    SensorCloudIngestBatch* head;
+    SensorCloudIngestBatch* tail;
+    SensorCloudIngestBatch stub;
+
+    // only touched by the consumer
+    uint64_t drained;
+    uint64_t dropped;
+} SensorCloudIngestQueue;
+
+/**
+ * One thread adding points to a queue, it owns the batches it fills.
+ */
+typedef struct
+{
+    SensorCloudIngestQueue* queue;
+    SensorCloudIngestBatch* batches;
+    size_t batchCount;
+    // batch being filled, NULL when every batch is in the queue
+    SensorCloudIngestBatch* current;
+    size_t next;
+
+    // points refused because every batch was waiting for the consumer
+    uint64_t refused;
+} SensorCloudIngestProducer;
+
+/**
+ * Initialize an empty queue.
+ * @param[out]  queue   Queue to initialize.
+ */
+void sensorCloudIngest_init(SensorCloudIngestQueue* queue);
+
+/**
+ * Initialize a producer, to be used by one thread.
+ * @param[out]  producer    Producer to initialize.
+ * @param[in]   queue       Queue to add to.
+ * @param[in]   batches     Storage for the batches of the producer, bounds how far it can get ahead of the consumer.
+ * @param[in]   batchCount  Number of batches.
+ */
+void sensorCloudIngest_initProducer(SensorCloudIngestProducer* producer, SensorCloudIngestQueue* queue,
+    SensorCloudIngestBatch* batches, size_t batchCount);
+
+/**
+ * Add a point, publishing the batch when it fills up.
+ * @param[io]   producer    Producer adding the point.
+ * @param[in]   channel     Index of the channel of the point.
+ * @param[in]   time        Timestamp of the point.
+ * @param[in]   value       Value of the point.
+ * @return 0 if the point was added, not 0 if every batch of the producer is waiting for the consumer.
+ */
+int sensorCloudIngest_put(SensorCloudIngestProducer* producer, uint32_t channel, Timestamp time, float value);
+
+/**
+ * Hand the points added so far to the consumer without waiting for the batch to fill up.
+ * @param[io]   producer    Producer to publish.
+ */
+void sensorCloudIngest_publish(SensorCloudIngestProducer* producer);
+
+/**
+ * Move the published points into the point buffer of their channel, on the consumer thread.
+ * Points for a channel past channelCount or whose point buffer is full are dropped. Returns once the queue is empty.
+ * @param[io]   queue           Queue to drain.
+ * @param[io]   channels        Point buffer of each channel.
+ * @param[in]   channelCount    Number of channels.
+ * @return Number of points moved.
+ */
+size_t sensorCloudIngest_drain(SensorCloudIngestQueue* queue, SensorCloudPointBuffer* const* channels,
+    size_t channelCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
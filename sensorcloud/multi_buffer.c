@@ -0,0 +1,88 @@
+#include "multi_buffer.h"
+
+#include <detail/trace.h>
+#include <xdr/xdr.h>
+
+void ICACHE_FLASH_ATTR sensorCloudMultiBuffer_init(SensorCloudMultiBuffer* buffer, SensorCloudSampleRate sampleRate,
+    size_t channelCount, Timestamp* times, float* values, size_t capacity)
+{
+    buffer->sampleRate = sampleRate;
+    buffer->times = times;
+    buffer->values = values;
+    buffer->channelCount = channelCount;
+    buffer->capacity = capacity;
+    buffer->count = 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudMultiBuffer_append(SensorCloudMultiBuffer* buffer, Timestamp time,
+    const float* values)
+{
+    if(buffer->count == buffer->capacity)
+        return 1;
+
+    buffer->times[buffer->count] = time;
+    size_t c = 0;
+    for(; c < buffer->channelCount; ++c)
+        buffer->values[c * buffer->capacity + buffer->count] = values[c];
+    ++buffer->count;
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudMultiBuffer_clear(SensorCloudMultiBuffer* buffer)
+{
+    buffer->count = 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudMultiBuffer_encode(const SensorCloudMultiBuffer* buffer,
+    SensorCloudPointBuffer* points)
+{
+    size_t bodySize = buffer->count * sensorCloud_pointBufferDataSize;
+    size_t c = 0;
+    for(; c < buffer->channelCount; ++c)
+    {
+        sensorCloud_initPointBuffer(&points[c], points[c].data.data, points[c].data.length, buffer->sampleRate);
+        if(buffer_bytesAvailable(&points[c].data) < bodySize)
+            return 1;
+    }
+
+    // sample by sample so each timestamp is converted once, written straight after the headers
+    size_t i = 0;
+    for(; i < buffer->count; ++i)
+    {
+        uint64_t time = xdr_endianUhyper(buffer->times[i]);
+        const float* value = buffer->values + i;
+        for(c = 0; c < buffer->channelCount; ++c, value += buffer->capacity)
+        {
+            char* point = points[c].data.putPtr + i * sensorCloud_pointBufferDataSize;
+            uint32_t bits;
+            memcpy(&bits, value, 4);
+            bits = xdr_endianUint(bits);
+            memcpy(point, &time, 8);
+            memcpy(point + 8, &bits, 4);
+        }
+    }
+
+    for(c = 0; c < buffer->channelCount; ++c)
+    {
+        buffer_commit(&points[c].data, bodySize);
+        sensorCloud_finishPointBuffer(&points[c]);
+    }
+    return 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudMultiBuffer_submit(const SensorCloudMultiBuffer* buffer, SensorCloudEngine* engine,
+    const char* sensor, const char* const* channels, SensorCloudPointBuffer* points,
+    SensorCloudSubmission* submissions, void* userData)
+{
+    if(sensorCloudMultiBuffer_encode(buffer, points) != 0)
+        return 1;
+
+    TRACE_PROBE3(sensorcloud_multi_submit, buffer, buffer->channelCount, buffer->count);
+    size_t c = 0;
+    for(; c < buffer->channelCount; ++c)
+    {
+        sensorCloudEngine_initSubmission(&submissions[c], sensor, channels[c], &points[c], userData);
+        sensorCloudEngine_submit(engine, &submissions[c]);
+    }
+    return 0;
+}
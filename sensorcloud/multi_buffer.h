@@ -0,0 +1,85 @@
+#ifndef SENSORCLOUD_MULTIBUFFER
+#define SENSORCLOUD_MULTIBUFFER
+
+#include <sensorcloud/engine.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Samples of several channels taken on the same clock, kept as one timestamp column and a value column per channel.
+ * Each timestamp is stored once however many channels there are.
+ */
+typedef struct
+{
+    SensorCloudSampleRate sampleRate;
+    Timestamp* times;
+    // column of channel c starts at values + c * capacity
+    float* values;
+    size_t channelCount;
+    size_t capacity;
+    size_t count;
+} SensorCloudMultiBuffer;
+
+/**
+ * Initialize an empty multi-channel buffer.
+ * @param[out]  buffer          Buffer to initialize.
+ * @param[in]   sampleRate      Sample rate of every channel.
+ * @param[in]   channelCount    Number of channels.
+ * @param[in]   times           Storage for the timestamp column, capacity timestamps.
+ * @param[in]   values          Storage for the value columns, channelCount * capacity values.
+ * @param[in]   capacity        Number of samples that fit in the buffer.
+ */
+void sensorCloudMultiBuffer_init(SensorCloudMultiBuffer* buffer, SensorCloudSampleRate sampleRate,
+    size_t channelCount, Timestamp* times, float* values, size_t capacity);
+
+/**
+ * Add a sample of every channel.
+ * @param[io]   buffer  Buffer to add to.
+ * @param[in]   time    Timestamp of the sample.
+ * @param[in]   values  Value of each channel, in channel order.
+ * @return 0 if the sample was added, not 0 if the buffer is full.
+ */
+int sensorCloudMultiBuffer_append(SensorCloudMultiBuffer* buffer, Timestamp time, const float* values);
+
+/**
+ * Drop every sample in the buffer.
+ * @param[io]   buffer  Buffer to clear.
+ */
+void sensorCloudMultiBuffer_clear(SensorCloudMultiBuffer* buffer);
+
+/**
+ * Write the samples of each channel as the XDR body of its upload.
+ * Each timestamp is converted to XDR once and copied into every channel.
+ * @param[in]   buffer  Buffer to encode.
+ * @param[io]   points  A point buffer per channel, reinitialized over its own memory and finished.
+ * @return 0 if every channel was encoded, not 0 if the samples don't fit in a point buffer.
+ */
+int sensorCloudMultiBuffer_encode(const SensorCloudMultiBuffer* buffer, SensorCloudPointBuffer* points);
+
+/**
+ * Encode every channel and submit them together to an engine, which uploads them concurrently.
+ * The buffer can be cleared and reused straight away, the point buffers and submissions must stay alive until
+ * the submissions complete.
+ * @param[in]   buffer      Buffer to upload.
+ * @param[io]   engine      Engine to submit to.
+ * @param[in]   sensor      Sensor the channels belong to.
+ * @param[in]   channels    Name of each channel.
+ * @param[io]   points      A point buffer per channel.
+ * @param[out]  submissions A submission per channel.
+ * @param[in]   userData    User data kept with every submission.
+ * @return 0 if the channels were submitted, not 0 if they didn't fit in the point buffers.
+ */
+int sensorCloudMultiBuffer_submit(const SensorCloudMultiBuffer* buffer, SensorCloudEngine* engine,
+    const char* sensor, const char* const* channels, SensorCloudPointBuffer* points,
+    SensorCloudSubmission* submissions, void* userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,276 @@
+#include "quota.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+#include <net/driver.h>
+
+static uint64_t ICACHE_FLASH_ATTR sensorCloudQuota_cost(const SensorCloudSubmission* submission,
+    SensorCloudQuotaUnit unit)
+{
+    if(!submission->points)
+        return 0;
+    uint64_t points = submission->ranged ? submission->rangeEnd - submission->rangeFirst :
+        sensorCloud_pointCount(submission->points);
+    if(unit == sensorCloudQuota_points)
+        return points;
+    return sensorCloud_pointBufferHeaderSize + points * sensorCloud_pointBufferDataSize;
+}
+
+// microseconds until the bucket holds need tokens, UINT64_MAX if it never will
+static uint64_t ICACHE_FLASH_ATTR sensorCloudQuota_wait(const SensorCloudQuotaBucket* bucket, uint64_t need)
+{
+    if(!bucket->capacity || need <= bucket->tokens)
+        return 0;
+    if(!bucket->estimate)
+        return UINT64_MAX;
+    uint64_t missing = (need - bucket->tokens) * 1000000 - bucket->remainder;
+    return (missing + bucket->estimate - 1) / bucket->estimate;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudQuota_refill(SensorCloudQuota* quota)
+{
+    uint64_t now = net_time();
+    uint64_t elapsed = now - quota->refilled;
+    quota->refilled = now;
+    size_t unit = 0;
+    for(; unit < sensorCloudQuota_unitCount; ++unit)
+    {
+        SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+        if(!bucket->capacity)
+            continue;
+        uint64_t accrued = bucket->estimate * elapsed + bucket->remainder;
+        bucket->tokens += accrued / 1000000;
+        bucket->remainder = accrued % 1000000;
+        if(bucket->tokens >= bucket->capacity)
+        {
+            bucket->tokens = bucket->capacity;
+            bucket->remainder = 0;
+        }
+    }
+}
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudQuota_fits(const SensorCloudQuota* quota,
+    const SensorCloudSubmission* submission)
+{
+    size_t unit = 0;
+    for(; unit < sensorCloudQuota_unitCount; ++unit)
+    {
+        const SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+        if(bucket->capacity && sensorCloudQuota_cost(submission, (SensorCloudQuotaUnit)unit) > bucket->tokens)
+            return 0;
+    }
+    return 1;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudQuota_completion(void* userData, SensorCloudSubmission* submission);
+
+static void ICACHE_FLASH_ATTR sensorCloudQuota_send(SensorCloudQuota* quota, SensorCloudSubmission* submission)
+{
+    size_t unit = 0;
+    for(; unit < sensorCloudQuota_unitCount; ++unit)
+    {
+        SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+        if(bucket->capacity)
+            bucket->tokens -= sensorCloudQuota_cost(submission, (SensorCloudQuotaUnit)unit);
+    }
+    ++quota->sent;
+    if(sensorCloudEngine_pushCompletion(submission, sensorCloudQuota_completion, quota) != 0)
+    { // stacked deeper than SENSORCLOUD_ENGINE_MAX_STAGES, what it cost couldn't be accounted for
+        submission->error = sensorCloud_badRequest;
+        sensorCloudEngine_completeStage(quota->engine, submission);
+        return;
+    }
+    sensorCloudStage_submit(&quota->stage, submission);
+}
+
+// the server says the buckets are empty, so what it granted since the last time it said so is its actual rate
+static void ICACHE_FLASH_ATTR sensorCloudQuota_resync(SensorCloudQuota* quota)
+{
+    sensorCloudQuota_refill(quota);
+    uint64_t now = quota->refilled;
+    size_t unit = 0;
+    for(; unit < sensorCloudQuota_unitCount; ++unit)
+    {
+        SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+        if(!bucket->capacity)
+            continue;
+        if(quota->sent != quota->sentAtResync)
+        { // uploads still running when the last rejection came in don't lower the rate again
+            uint64_t lowered = bucket->estimate - bucket->estimate / 4;
+            if(quota->resynced && now > quota->resynced)
+                lowered = min(lowered, bucket->spent * 1000000 / (now - quota->resynced));
+            bucket->estimate = max(lowered, (uint64_t)1);
+        }
+        bucket->tokens = 0;
+        bucket->remainder = 0;
+        bucket->spent = 0;
+    }
+    quota->resynced = now;
+    quota->sentAtResync = quota->sent;
+    ++quota->rejections;
+    TRACE_PROBE2(sensorcloud_quota_resync, quota, quota->buckets[sensorCloudQuota_points].estimate);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudQuota_completion(void* userData, SensorCloudSubmission* submission)
+{
+    SensorCloudQuota* quota = (SensorCloudQuota*)userData;
+    if(submission->error == sensorCloud_quotaExceeded)
+        sensorCloudQuota_resync(quota);
+    else
+    {
+        size_t unit = 0;
+        for(; unit < sensorCloudQuota_unitCount; ++unit)
+        {
+            SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+            if(!bucket->capacity)
+                continue;
+            uint64_t cost = sensorCloudQuota_cost(submission, (SensorCloudQuotaUnit)unit);
+            if(submission->error == sensorCloud_ok)
+            { // the server had room, work back towards the configured rate
+                bucket->spent += cost;
+                if(bucket->estimate < bucket->rate)
+                    bucket->estimate += (bucket->rate - bucket->estimate + 7) / 8;
+            }
+            else // never counted by the server
+                bucket->tokens = min(bucket->tokens + cost, bucket->capacity);
+        }
+    }
+
+    sensorCloudEngine_completeStage(quota->engine, submission);
+    sensorCloudQuota_poll(quota);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudQuota_stageSubmit(void* quota, SensorCloudSubmission* submission)
+{
+    if(sensorCloudQuota_submit((SensorCloudQuota*)quota, submission) != sensorCloudQuota_refused)
+        return;
+    submission->error = sensorCloud_quotaExceeded;
+    sensorCloudEngine_completeStage(((SensorCloudQuota*)quota)->engine, submission);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudQuota_init(SensorCloudQuota* quota, SensorCloudEngine* engine, uint64_t maxDefer)
+{
+    memset(quota, 0, sizeof(SensorCloudQuota));
+    quota->engine = engine;
+    sensorCloudEngine_initStage(&quota->stage, engine);
+    quota->refilled = net_time();
+    quota->maxDefer = maxDefer;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudQuota_setStage(SensorCloudQuota* quota, const SensorCloudStage* stage)
+{
+    if(stage)
+        quota->stage = *stage;
+    else
+        sensorCloudEngine_initStage(&quota->stage, quota->engine);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudQuota_initStage(SensorCloudStage* stage, SensorCloudQuota* quota)
+{
+    stage->submit = sensorCloudQuota_stageSubmit;
+    stage->target = quota;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudQuota_setLimit(SensorCloudQuota* quota, SensorCloudQuotaUnit unit, uint64_t capacity,
+    uint64_t rate)
+{
+    SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+    bucket->capacity = capacity;
+    bucket->rate = rate;
+    bucket->estimate = rate;
+    bucket->tokens = capacity;
+    bucket->remainder = 0;
+    bucket->spent = 0;
+}
+
+SensorCloudQuotaDecision ICACHE_FLASH_ATTR sensorCloudQuota_submit(SensorCloudQuota* quota,
+    SensorCloudSubmission* submission)
+{
+    sensorCloudQuota_refill(quota);
+    if(!quota->deferredHead && sensorCloudQuota_fits(quota, submission))
+    {
+        sensorCloudQuota_send(quota, submission);
+        return sensorCloudQuota_sent;
+    }
+
+    // it goes after the uploads already waiting
+    uint64_t wait = 0;
+    size_t unit = 0;
+    for(; unit < sensorCloudQuota_unitCount; ++unit)
+    {
+        const SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+        uint64_t cost = sensorCloudQuota_cost(submission, (SensorCloudQuotaUnit)unit);
+        if(bucket->capacity && cost > bucket->capacity)
+            wait = UINT64_MAX;
+        else
+        {
+            uint64_t unitWait = sensorCloudQuota_wait(bucket, bucket->deferred + cost);
+            wait = max(wait, unitWait);
+        }
+    }
+    if(wait > quota->maxDefer)
+    {
+        ++quota->refusals;
+        TRACE_PROBE2(sensorcloud_quota_refuse, submission, wait);
+        return sensorCloudQuota_refused;
+    }
+
+    for(unit = 0; unit < sensorCloudQuota_unitCount; ++unit)
+        quota->buckets[unit].deferred += sensorCloudQuota_cost(submission, (SensorCloudQuotaUnit)unit);
+    submission->next = NULL;
+    if(quota->deferredTail)
+        quota->deferredTail->next = submission;
+    else
+        quota->deferredHead = submission;
+    quota->deferredTail = submission;
+    ++quota->deferredCount;
+    ++quota->deferrals;
+    TRACE_PROBE2(sensorcloud_quota_defer, submission, wait);
+    return sensorCloudQuota_deferred;
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudQuota_poll(SensorCloudQuota* quota)
+{
+    sensorCloudQuota_refill(quota);
+    size_t sent = 0;
+    while(quota->deferredHead && sensorCloudQuota_fits(quota, quota->deferredHead))
+    {
+        SensorCloudSubmission* submission = quota->deferredHead;
+        quota->deferredHead = submission->next;
+        if(!quota->deferredHead)
+            quota->deferredTail = NULL;
+        --quota->deferredCount;
+        size_t unit = 0;
+        for(; unit < sensorCloudQuota_unitCount; ++unit)
+            quota->buckets[unit].deferred -= sensorCloudQuota_cost(submission, (SensorCloudQuotaUnit)unit);
+        // released together, so the engine can merge the ones to the same channel that wait for a slot
+        sensorCloudQuota_send(quota, submission);
+        ++sent;
+    }
+    return sent;
+}
+
+uint64_t ICACHE_FLASH_ATTR sensorCloudQuota_deadline(SensorCloudQuota* quota)
+{
+    if(!quota->deferredHead)
+        return 0;
+    sensorCloudQuota_refill(quota);
+    uint64_t wait = 0;
+    size_t unit = 0;
+    for(; unit < sensorCloudQuota_unitCount; ++unit)
+    {
+        uint64_t unitWait = sensorCloudQuota_wait(&quota->buckets[unit],
+            sensorCloudQuota_cost(quota->deferredHead, (SensorCloudQuotaUnit)unit));
+        wait = max(wait, unitWait);
+    }
+    return wait == UINT64_MAX ? UINT64_MAX : quota->refilled + wait;
+}
+
+uint64_t ICACHE_FLASH_ATTR sensorCloudQuota_headroom(SensorCloudQuota* quota, SensorCloudQuotaUnit unit)
+{
+    const SensorCloudQuotaBucket* bucket = &quota->buckets[unit];
+    if(!bucket->capacity)
+        return UINT64_MAX;
+    sensorCloudQuota_refill(quota);
+    return bucket->tokens > bucket->deferred ? bucket->tokens - bucket->deferred : 0;
+}
@@ -0,0 +1,150 @@
+#ifndef SENSORCLOUD_QUOTA
+#define SENSORCLOUD_QUOTA
+
+#include <sensorcloud/engine.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    sensorCloudQuota_points,
+    // bytes of the point buffers uploaded, header included
+    sensorCloudQuota_bytes,
+    sensorCloudQuota_unitCount
+} SensorCloudQuotaUnit;
+
+typedef enum
+{
+    // handed to the engine
+    sensorCloudQuota_sent,
+    // held until the quota has room for it, it goes out together with whatever else was held
+    sensorCloudQuota_deferred,
+    // would wait longer than the quota allows or never fit, the caller should spool it or add it to a later upload
+    sensorCloudQuota_refused
+} SensorCloudQuotaDecision;
+
+/**
+ * Token bucket modelling what the server lets the device upload in one unit.
+ */
+typedef struct
+{
+    // most tokens the bucket holds, 0 when the unit isn't limited
+    uint64_t capacity;
+    // tokens per second the server is configured to grant, and what it is believed to grant after rejections
+    uint64_t rate;
+    uint64_t estimate;
+    uint64_t tokens;
+    // token microseconds accrued that don't make a whole token yet
+    uint64_t remainder;
+    // tokens of uploads the server accepted since the last resync
+    uint64_t spent;
+    // tokens of the deferred uploads
+    uint64_t deferred;
+} SensorCloudQuotaBucket;
+
+/**
+ * Client side model of the upload quota of a device, so uploads the server would reject with a quota error wait on
+ * the device instead of going out.
+ * Every rejection resynchronizes the model, emptying the buckets and lowering their rates to what the server granted
+ * since the one before, successes bring the rates back up towards the configured ones.
+ */
+typedef struct
+{
+    SensorCloudEngine* engine;
+    // where uploads are sent, engine unless they go through a stage in front of it
+    SensorCloudStage stage;
+    SensorCloudQuotaBucket buckets[sensorCloudQuota_unitCount];
+    // net_time() the buckets were last refilled at and the last rejection arrived at, 0 before the first one
+    uint64_t refilled;
+    uint64_t resynced;
+    // uploads sent by the last rejection, rejections of those don't tell anything new
+    uint32_t sentAtResync;
+    // longest an upload is deferred for, longer waits are refused
+    uint64_t maxDefer;
+    // deferred uploads, oldest first
+    SensorCloudSubmission* deferredHead;
+    SensorCloudSubmission* deferredTail;
+    size_t deferredCount;
+
+    uint32_t sent;
+    uint32_t deferrals;
+    uint32_t refusals;
+    uint32_t rejections;
+} SensorCloudQuota;
+
+/**
+ * Initialize a quota, no unit is limited until sensorCloudQuota_setLimit is called.
+ * Uploads sent are submitted straight to engine until sensorCloudQuota_setStage says otherwise, and complete through
+ * the stages they came from or the callback of engine. Every upload of the device must go through the quota.
+ * @param[out]  quota       Quota to initialize.
+ * @param[in]   engine      Initialized engine the uploads of the device go through.
+ * @param[in]   maxDefer    Longest an upload is held for before it's refused instead, in microseconds.
+ */
+void sensorCloudQuota_init(SensorCloudQuota* quota, SensorCloudEngine* engine, uint64_t maxDefer);
+
+/**
+ * Send uploads through a stage in front of the engine, typically a scheduler flow. The quota and the scheduler stack,
+ * uploads wait on the quota first and for a slot after.
+ * @param[io]   quota   Quota with nothing deferred.
+ * @param[in]   stage   Initialized stage ending at the engine of the quota, NULL for the engine itself.
+ */
+void sensorCloudQuota_setStage(SensorCloudQuota* quota, const SensorCloudStage* stage);
+
+/**
+ * Initialize a stage that hands the submissions to a quota, typically for a backfill or a spool drainer.
+ * Submissions the quota refuses complete with sensorCloud_quotaExceeded without going out.
+ * @param[out]  stage   Stage to initialize.
+ * @param[in]   quota   Initialized quota.
+ */
+void sensorCloudQuota_initStage(SensorCloudStage* stage, SensorCloudQuota* quota);
+
+/**
+ * Limit a unit, the bucket starts out full.
+ * @param[io]   quota       Quota to configure.
+ * @param[in]   unit        Unit to limit.
+ * @param[in]   capacity    Most of the unit the server lets the device upload in a burst, 0 for no limit.
+ * @param[in]   rate        Amount of the unit the server grants per second.
+ */
+void sensorCloudQuota_setLimit(SensorCloudQuota* quota, SensorCloudQuotaUnit unit, uint64_t capacity, uint64_t rate);
+
+/**
+ * Send an upload if the quota has room for it, otherwise hold it until it does.
+ * @param[io]   quota       Quota of the device.
+ * @param[in]   submission  Initialized submission, left alone when refused.
+ * @return What became of the upload.
+ */
+SensorCloudQuotaDecision sensorCloudQuota_submit(SensorCloudQuota* quota, SensorCloudSubmission* submission);
+
+/**
+ * Send the deferred uploads the quota has room for by now.
+ * Uploads also go out as others complete, polling is only needed while none are running.
+ * @param[io]   quota   Quota of the device.
+ * @return Number of uploads sent.
+ */
+size_t sensorCloudQuota_poll(SensorCloudQuota* quota);
+
+/**
+ * Time at which sensorCloudQuota_poll will be able to send the oldest deferred upload.
+ * @param[io]   quota   Quota to query.
+ * @return net_time() it fits at, 0 if nothing is deferred, UINT64_MAX if it never will.
+ */
+uint64_t sensorCloudQuota_deadline(SensorCloudQuota* quota);
+
+/**
+ * Predicted amount of a unit that can be uploaded right now without being rejected, after the deferred uploads.
+ * @param[io]   quota   Quota to query.
+ * @param[in]   unit    Unit to query.
+ * @return The headroom, UINT64_MAX if the unit isn't limited.
+ */
+uint64_t sensorCloudQuota_headroom(SensorCloudQuota* quota, SensorCloudQuotaUnit unit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#include "reorder.h"
+
+#include <detail/trace.h>
+
+static void ICACHE_FLASH_ATTR sensorCloudReorder_push(SensorCloudReorderBuffer* reorder, Timestamp time, float value)
+{
+    size_t i = reorder->count++;
+    while(i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if(reorder->heap[parent].time <= time)
+            break;
+        reorder->heap[i] = reorder->heap[parent];
+        i = parent;
+    }
+    reorder->heap[i].time = time;
+    reorder->heap[i].value = value;
+}
+
+static SensorCloudReorderPoint ICACHE_FLASH_ATTR sensorCloudReorder_pop(SensorCloudReorderBuffer* reorder)
+{
+    SensorCloudReorderPoint oldest = reorder->heap[0];
+    SensorCloudReorderPoint last = reorder->heap[--reorder->count];
+    size_t i = 0;
+    for(;;)
+    {
+        size_t child = 2 * i + 1;
+        if(child >= reorder->count)
+            break;
+        if(child + 1 < reorder->count && reorder->heap[child + 1].time < reorder->heap[child].time)
+            ++child;
+        if(last.time <= reorder->heap[child].time)
+            break;
+        reorder->heap[i] = reorder->heap[child];
+        i = child;
+    }
+    if(reorder->count)
+        reorder->heap[i] = last;
+    return oldest;
+}
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudReorder_full(const SensorCloudReorderBuffer* reorder)
+{
+    return buffer_bytesAvailable(&reorder->points->data) < sensorCloud_pointBufferDataSize;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudReorder_release(SensorCloudReorderBuffer* reorder, Timestamp time,
+    float value)
+{
+    sensorCloud_addPoint(reorder->points, time, value);
+    reorder->released = time;
+    reorder->started = 1;
+}
+
+static int ICACHE_FLASH_ATTR sensorCloudReorder_drain(SensorCloudReorderBuffer* reorder, uint8_t all)
+{
+    while(reorder->count && (all || reorder->newest - reorder->heap[0].time >= reorder->lateness))
+    {
+        if(sensorCloudReorder_full(reorder))
+            return 1;
+        SensorCloudReorderPoint point = sensorCloudReorder_pop(reorder);
+        sensorCloudReorder_release(reorder, point.time, point.value);
+    }
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudReorder_init(SensorCloudReorderBuffer* reorder, SensorCloudPointBuffer* points,
+    SensorCloudReorderPoint* heap, size_t capacity, Timestamp lateness)
+{
+    memset(reorder, 0, sizeof(SensorCloudReorderBuffer));
+    reorder->points = points;
+    reorder->heap = heap;
+    reorder->capacity = capacity;
+    reorder->lateness = lateness;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudReorder_addPoint(SensorCloudReorderBuffer* reorder, Timestamp time, float value)
+{
+    if(reorder->started && time < reorder->released)
+    {
+        TRACE_PROBE3(sensorcloud_reorder_late, reorder, time, reorder->released);
+        ++reorder->late;
+        return 1;
+    }
+
+    if(reorder->count == reorder->capacity)
+    { // make room by releasing the oldest point before its time
+        if(!reorder->capacity || sensorCloudReorder_full(reorder))
+        {
+            ++reorder->overflow;
+            return 1;
+        }
+        ++reorder->forced;
+        if(time <= reorder->heap[0].time)
+        {
+            sensorCloudReorder_release(reorder, time, value);
+            return 0;
+        }
+        SensorCloudReorderPoint point = sensorCloudReorder_pop(reorder);
+        sensorCloudReorder_release(reorder, point.time, point.value);
+    }
+
+    sensorCloudReorder_push(reorder, time, value);
+    if(time > reorder->newest)
+        reorder->newest = time;
+    sensorCloudReorder_drain(reorder, 0);
+    return 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudReorder_flush(SensorCloudReorderBuffer* reorder)
+{
+    return sensorCloudReorder_drain(reorder, 1);
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudReorder_pending(const SensorCloudReorderBuffer* reorder)
+{
+    return reorder->count;
+}
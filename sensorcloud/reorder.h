@@ -0,0 +1,82 @@
+#ifndef SENSORCLOUD_REORDER
+#define SENSORCLOUD_REORDER
+
+#include <sensorcloud.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    Timestamp time;
+    float value;
+} SensorCloudReorderPoint;
+
+/**
+ * Puts the points of a channel that arrive slightly out of order back in time order before they reach its point
+ * buffer. Points wait in a min-heap until they are older than the watermark, the newest time seen less the
+ * lateness allowed, and points arriving after a newer point was released are dropped as late.
+ */
+typedef struct
+{
+    SensorCloudPointBuffer* points;
+    SensorCloudReorderPoint* heap;
+    size_t capacity;
+    size_t count;
+    Timestamp lateness;
+    Timestamp newest;
+    // time of the last point released, later points must not be older
+    Timestamp released;
+    uint8_t started;
+
+    // points dropped for arriving after a newer point was released
+    uint32_t late;
+    // points released early because the heap was full
+    uint32_t forced;
+    // points dropped because both the heap and the point buffer were full
+    uint32_t overflow;
+} SensorCloudReorderBuffer;
+
+/**
+ * Initialize a reorder buffer.
+ * @param[out]  reorder     Reorder buffer to initialize.
+ * @param[in]   points      Point buffer the points are released to in time order.
+ * @param[in]   heap        Storage for the points waiting to be released.
+ * @param[in]   capacity    Number of points that fit in the storage.
+ * @param[in]   lateness    How far behind the newest point a point may arrive, in the units of the timestamps.
+ */
+void sensorCloudReorder_init(SensorCloudReorderBuffer* reorder, SensorCloudPointBuffer* points,
+    SensorCloudReorderPoint* heap, size_t capacity, Timestamp lateness);
+
+/**
+ * Add a point and release the points that are older than the watermark.
+ * @param[io]   reorder Reorder buffer to add to.
+ * @param[in]   time    Timestamp of the point.
+ * @param[in]   value   Value of the point.
+ * @return 0 if the point was kept, not 0 if it was dropped.
+ */
+int sensorCloudReorder_addPoint(SensorCloudReorderBuffer* reorder, Timestamp time, float value);
+
+/**
+ * Release every waiting point, typically right before the point buffer is uploaded.
+ * Points arriving afterwards that are older than the last point released are dropped as late.
+ * @param[io]   reorder Reorder buffer to flush.
+ * @return 0 if every point was released, not 0 if the point buffer filled up first.
+ */
+int sensorCloudReorder_flush(SensorCloudReorderBuffer* reorder);
+
+/**
+ * Number of points waiting to be released.
+ * @param[in]   reorder Reorder buffer to query.
+ */
+size_t sensorCloudReorder_pending(const SensorCloudReorderBuffer* reorder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+#include "retry.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+#include <net/driver.h>
+
+static uint32_t ICACHE_FLASH_ATTR sensorCloudRetry_nextRandom(SensorCloudRetry* retry)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = retry->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    retry->random = x;
+    return x;
+}
+
+static SensorCloudBreaker* ICACHE_FLASH_ATTR sensorCloudRetry_find(const SensorCloudRetry* retry, const char* host)
+{
+    size_t i = 0;
+    for(; i < retry->breakerCount; ++i)
+    {
+        const SensorCloudBreaker* breaker = &retry->breakers[i];
+        if(strncmp(breaker->host, host, sizeof(breaker->host) - 1) == 0)
+            return (SensorCloudBreaker*)breaker;
+    }
+    return NULL;
+}
+
+// NULL when every breaker is taken by a host that is failing
+static SensorCloudBreaker* ICACHE_FLASH_ATTR sensorCloudRetry_breaker(SensorCloudRetry* retry, const char* host)
+{
+    SensorCloudBreaker* breaker = sensorCloudRetry_find(retry, host);
+    if(breaker)
+        return breaker;
+    if(retry->breakerCount < SENSORCLOUD_RETRY_MAX_HOSTS)
+        breaker = &retry->breakers[retry->breakerCount++];
+    else
+    { // take over one of a host that is doing fine
+        size_t i = 0;
+        for(; i < retry->breakerCount && !breaker; ++i)
+        {
+            if(retry->breakers[i].state == sensorCloudBreaker_closed && retry->breakers[i].failures == 0)
+                breaker = &retry->breakers[i];
+        }
+        if(!breaker)
+            return NULL;
+    }
+    memset(breaker, 0, sizeof(SensorCloudBreaker));
+    strncpy(breaker->host, host, sizeof(breaker->host) - 1);
+    return breaker;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRetry_init(SensorCloudRetry* retry, uint32_t threshold, uint64_t cooldown,
+    uint32_t seed)
+{
+    memset(retry, 0, sizeof(SensorCloudRetry));
+    retry->threshold = threshold;
+    retry->cooldown = cooldown;
+    retry->random = seed ? seed : 1;
+    size_t i = 0;
+    for(; i < sensorCloudRetry_classCount; ++i)
+        sensorCloudRetry_setPolicy(retry, (SensorCloudRetryClass)i, 3, 100000, 10000000);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRetry_setPolicy(SensorCloudRetry* retry, SensorCloudRetryClass errorClass,
+    uint8_t maxRetries, uint64_t baseDelay, uint64_t maxDelay)
+{
+    SensorCloudRetryPolicy* policy = &retry->policies[errorClass];
+    policy->maxRetries = maxRetries;
+    policy->baseDelay = baseDelay ? baseDelay : 1;
+    policy->maxDelay = max(maxDelay, policy->baseDelay);
+}
+
+uint64_t ICACHE_FLASH_ATTR sensorCloudRetry_acquire(SensorCloudRetry* retry, const char* host)
+{
+    SensorCloudBreaker* breaker = sensorCloudRetry_find(retry, host);
+    if(!breaker || breaker->state == sensorCloudBreaker_closed)
+        return 0;
+
+    if(breaker->state == sensorCloudBreaker_open)
+    {
+        uint64_t now = net_time();
+        if(now < breaker->openUntil)
+            return breaker->openUntil - now;
+        breaker->state = sensorCloudBreaker_halfOpen;
+        breaker->probing = 0;
+    }
+    if(breaker->probing) // the answer to the probe decides what happens next
+        return retry->cooldown ? retry->cooldown : 1;
+    breaker->probing = 1;
+    TRACE_PROBE2(sensorcloud_retry_probe, retry, breaker);
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRetry_succeeded(SensorCloudRetry* retry, const char* host)
+{
+    SensorCloudBreaker* breaker = sensorCloudRetry_find(retry, host);
+    if(!breaker)
+        return;
+    breaker->state = sensorCloudBreaker_closed;
+    breaker->failures = 0;
+    breaker->probing = 0;
+}
+
+uint64_t ICACHE_FLASH_ATTR sensorCloudRetry_failed(SensorCloudRetry* retry, const char* host,
+    SensorCloudRetryClass errorClass, uint8_t retries)
+{
+    uint64_t now = net_time();
+    SensorCloudBreaker* breaker = retry->threshold ? sensorCloudRetry_breaker(retry, host) : NULL;
+    if(breaker)
+    {
+        ++breaker->failures;
+        if(breaker->state == sensorCloudBreaker_halfOpen ||
+            (breaker->state == sensorCloudBreaker_closed && breaker->failures >= retry->threshold))
+        {
+            breaker->state = sensorCloudBreaker_open;
+            breaker->openUntil = now + retry->cooldown;
+            breaker->probing = 0;
+            ++retry->opened;
+            TRACE_PROBE3(sensorcloud_retry_open, retry, breaker, breaker->failures);
+        }
+    }
+
+    const SensorCloudRetryPolicy* policy = &retry->policies[errorClass];
+    if(retries >= policy->maxRetries)
+    {
+        ++retry->exhausted;
+        return UINT64_MAX;
+    }
+
+    // exponential backoff with the lower half of it jittered, so failed uploads don't come back all at once
+    uint64_t delay = policy->maxDelay;
+    if(retries < 63 && policy->baseDelay <= policy->maxDelay >> retries)
+        delay = policy->baseDelay << retries;
+    delay -= sensorCloudRetry_nextRandom(retry) % (delay / 2 + 1);
+    if(breaker && breaker->state == sensorCloudBreaker_open && breaker->openUntil > now)
+        delay = max(delay, breaker->openUntil - now);
+
+    ++retry->retries[errorClass];
+    TRACE_PROBE3(sensorcloud_retry_backoff, retry, errorClass, delay);
+    return delay;
+}
+
+SensorCloudBreakerState ICACHE_FLASH_ATTR sensorCloudRetry_state(const SensorCloudRetry* retry, const char* host)
+{
+    const SensorCloudBreaker* breaker = sensorCloudRetry_find(retry, host);
+    return breaker ? breaker->state : sensorCloudBreaker_closed;
+}
@@ -0,0 +1,140 @@
+#ifndef SENSORCLOUD_RETRY
+#define SENSORCLOUD_RETRY
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most hosts a retry state keeps a circuit breaker for.
+#ifndef SENSORCLOUD_RETRY_MAX_HOSTS
+#define SENSORCLOUD_RETRY_MAX_HOSTS 4
+#endif
+
+typedef enum
+{
+    // the connection couldn't be made, nothing reached the server
+    sensorCloudRetry_connect,
+    // the connection broke after it was made, the request may or may not have arrived
+    sensorCloudRetry_reset,
+    // the server answered with a 5xx
+    sensorCloudRetry_serverError,
+    sensorCloudRetry_classCount
+} SensorCloudRetryClass;
+
+/**
+ * How the failures of a class are retried.
+ * Attempt n waits a random time between half and all of baseDelay * 2^n, capped at maxDelay.
+ */
+typedef struct
+{
+    // retries after the first attempt, 0 to not retry the class
+    uint8_t maxRetries;
+    uint64_t baseDelay;
+    uint64_t maxDelay;
+} SensorCloudRetryPolicy;
+
+typedef enum
+{
+    // requests go out
+    sensorCloudBreaker_closed,
+    // too many failures in a row, requests fail without going out until the cooldown passed
+    sensorCloudBreaker_open,
+    // the cooldown passed, one request goes out to find out whether the host is back
+    sensorCloudBreaker_halfOpen
+} SensorCloudBreakerState;
+
+typedef struct
+{
+    char host[64];
+    SensorCloudBreakerState state;
+    // failures in a row
+    uint32_t failures;
+    // net_time() the cooldown of an open breaker ends at
+    uint64_t openUntil;
+    // the request of a half open breaker is out
+    uint8_t probing;
+} SensorCloudBreaker;
+
+/**
+ * Retry policies and circuit breakers shared by the uploads of an engine. All times are net_time() microseconds.
+ */
+typedef struct SensorCloudRetryData
+{
+    SensorCloudRetryPolicy policies[sensorCloudRetry_classCount];
+    // failures in a row that open a breaker, 0 to never open one
+    uint32_t threshold;
+    uint64_t cooldown;
+    SensorCloudBreaker breakers[SENSORCLOUD_RETRY_MAX_HOSTS];
+    size_t breakerCount;
+    uint32_t random;
+
+    uint32_t retries[sensorCloudRetry_classCount];
+    // failures that ran out of retries
+    uint32_t exhausted;
+    // times a breaker opened
+    uint32_t opened;
+} SensorCloudRetry;
+
+/**
+ * Initialize a retry state, every class is retried up to 3 times starting at 100ms and backing off to 10s.
+ * @param[out]  retry       Retry state to initialize.
+ * @param[in]   threshold   Failures in a row that open the breaker of a host, 0 to never open one.
+ * @param[in]   cooldown    Time an open breaker keeps requests from going out.
+ * @param[in]   seed        Seed for the jitter, the same seed always produces the same delays.
+ */
+void sensorCloudRetry_init(SensorCloudRetry* retry, uint32_t threshold, uint64_t cooldown, uint32_t seed);
+
+/**
+ * Set how the failures of a class are retried.
+ * @param[io]   retry       Retry state to configure.
+ * @param[in]   errorClass  Class of failure.
+ * @param[in]   maxRetries  Retries after the first attempt, 0 to not retry.
+ * @param[in]   baseDelay   Delay before the first retry, before jitter.
+ * @param[in]   maxDelay    Longest delay before a retry.
+ */
+void sensorCloudRetry_setPolicy(SensorCloudRetry* retry, SensorCloudRetryClass errorClass, uint8_t maxRetries,
+    uint64_t baseDelay, uint64_t maxDelay);
+
+/**
+ * Ask whether a request to a host may go out now, a half open breaker lets the first caller through.
+ * @param[io]   retry   Retry state.
+ * @param[in]   host    Host the request goes to.
+ * @return 0 if the request may go out, otherwise the time until it is worth asking again.
+ */
+uint64_t sensorCloudRetry_acquire(SensorCloudRetry* retry, const char* host);
+
+/**
+ * Record that a host answered, closing its breaker.
+ * @param[io]   retry   Retry state.
+ * @param[in]   host    Host that answered.
+ */
+void sensorCloudRetry_succeeded(SensorCloudRetry* retry, const char* host);
+
+/**
+ * Record a failed request and work out when to try it again.
+ * @param[io]   retry       Retry state.
+ * @param[in]   host        Host the request went to.
+ * @param[in]   errorClass  How the request failed.
+ * @param[in]   retries     Retries the request already had.
+ * @return Time to wait before the next attempt, which includes the cooldown of a breaker the failure opened,
+ *  UINT64_MAX if the request shouldn't be retried.
+ */
+uint64_t sensorCloudRetry_failed(SensorCloudRetry* retry, const char* host, SensorCloudRetryClass errorClass,
+    uint8_t retries);
+
+/**
+ * State of the breaker of a host.
+ * @param[in]   retry   Retry state.
+ * @param[in]   host    Host to query.
+ * @return The state, closed for hosts without a breaker.
+ */
+SensorCloudBreakerState sensorCloudRetry_state(const SensorCloudRetry* retry, const char* host);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#include "rollup.h"
+
+#include <detail/trace.h>
+#include <xdr/xdr.h>
+
+static void ICACHE_FLASH_ATTR sensorCloudRollup_emit(SensorCloudRollup* rollup)
+{
+    float values[sensorCloudRollup_statCount];
+    values[sensorCloudRollup_min] = rollup->min;
+    values[sensorCloudRollup_max] = rollup->max;
+    values[sensorCloudRollup_mean] = (float)(rollup->sum / rollup->count);
+    values[sensorCloudRollup_count] = (float)rollup->count;
+    values[sensorCloudRollup_last] = rollup->last;
+
+    TRACE_PROBE3(sensorcloud_rollup_window, rollup, rollup->windowStart, rollup->count);
+    size_t s = 0;
+    for(; s < sensorCloudRollup_statCount; ++s)
+    {
+        SensorCloudPointBuffer* output = rollup->outputs[s];
+        if(!output)
+            continue;
+        if(buffer_bytesAvailable(&output->data) < sensorCloud_pointBufferDataSize)
+            ++rollup->dropped;
+        else
+            sensorCloud_addPoint(output, rollup->windowStart, values[s]);
+    }
+    ++rollup->windows;
+    rollup->count = 0;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudRollup_open(SensorCloudRollup* rollup, Timestamp time, float value)
+{
+    if(rollup->count)
+        sensorCloudRollup_emit(rollup);
+    rollup->windowStart = time - time % rollup->window;
+    rollup->count = 1;
+    rollup->min = value;
+    rollup->max = value;
+    rollup->last = value;
+    rollup->sum = value;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRollup_init(SensorCloudRollup* rollup, Timestamp window,
+    SensorCloudPointBuffer* const outputs[sensorCloudRollup_statCount])
+{
+    memset(rollup, 0, sizeof(SensorCloudRollup));
+    rollup->window = window;
+    memcpy(rollup->outputs, outputs, sizeof(rollup->outputs));
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRollup_addPoint(SensorCloudRollup* rollup, Timestamp time, float value)
+{
+    if(!rollup->count || time - rollup->windowStart >= rollup->window)
+    {
+        sensorCloudRollup_open(rollup, time, value);
+        return;
+    }
+
+    if(value < rollup->min)
+        rollup->min = value;
+    if(value > rollup->max)
+        rollup->max = value;
+    rollup->sum += value;
+    rollup->last = value;
+    ++rollup->count;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRollup_addPoints(SensorCloudRollup* rollup, const SensorCloudPointBuffer* points)
+{
+    const char* point = points->data.getPtr + sensorCloud_pointBufferHeaderSize;
+    size_t count = sensorCloud_pointCount(points);
+    size_t i = 0;
+    while(i < count)
+    {
+        uint64_t time;
+        uint32_t bits;
+        float value;
+        memcpy(&time, point, 8);
+        memcpy(&bits, point + 8, 4);
+        time = xdr_endianUhyper(time);
+        bits = xdr_endianUint(bits);
+        memcpy(&value, &bits, 4);
+        sensorCloudRollup_addPoint(rollup, time, value);
+        point += sensorCloud_pointBufferDataSize;
+        ++i;
+
+        // the rest of the window in one pass, keeping the running values in locals
+        Timestamp end = rollup->windowStart + rollup->window;
+        float low = rollup->min;
+        float high = rollup->max;
+        double sum = 0;
+        size_t run = 0;
+        for(; i < count; ++i, ++run, point += sensorCloud_pointBufferDataSize)
+        {
+            memcpy(&time, point, 8);
+            if(xdr_endianUhyper(time) >= end)
+                break;
+            memcpy(&bits, point + 8, 4);
+            bits = xdr_endianUint(bits);
+            memcpy(&value, &bits, 4);
+            low = value < low ? value : low;
+            high = value > high ? value : high;
+            sum += value;
+        }
+        if(run)
+        {
+            rollup->min = low;
+            rollup->max = high;
+            rollup->sum += sum;
+            rollup->last = value;
+            rollup->count += run;
+        }
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudRollup_flush(SensorCloudRollup* rollup)
+{
+    if(rollup->count)
+        sensorCloudRollup_emit(rollup);
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudRollup_submit(SensorCloudRollup* rollup, SensorCloudEngine* engine,
+    const char* sensor, const char* const channels[sensorCloudRollup_statCount], SensorCloudSubmission* submissions,
+    void* userData)
+{
+    size_t submitted = 0;
+    size_t s = 0;
+    for(; s < sensorCloudRollup_statCount; ++s)
+    {
+        SensorCloudPointBuffer* output = rollup->outputs[s];
+        if(!output || sensorCloud_pointCount(output) == 0)
+            continue;
+        sensorCloud_finishPointBuffer(output);
+        sensorCloudEngine_initSubmission(&submissions[s], sensor, channels[s], output, userData);
+        sensorCloudEngine_submit(engine, &submissions[s]);
+        ++submitted;
+    }
+    return submitted;
+}
@@ -0,0 +1,96 @@
+#ifndef SENSORCLOUD_ROLLUP
+#define SENSORCLOUD_ROLLUP
+
+#include <sensorcloud/engine.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    sensorCloudRollup_min,
+    sensorCloudRollup_max,
+    sensorCloudRollup_mean,
+    sensorCloudRollup_count,
+    sensorCloudRollup_last,
+    sensorCloudRollup_statCount
+} SensorCloudRollupStat;
+
+/**
+ * Summarizes a channel over fixed windows of time, adding a point per window to a derived channel for each
+ * statistic. Windows are aligned to multiples of their length and each summary point has the timestamp of the
+ * start of its window.
+ */
+typedef struct
+{
+    // length of a window, in the units of the timestamps
+    Timestamp window;
+    // a point buffer per statistic, NULL for statistics that aren't kept
+    SensorCloudPointBuffer* outputs[sensorCloudRollup_statCount];
+
+    // the window being summarized
+    Timestamp windowStart;
+    uint32_t count;
+    float min;
+    float max;
+    float last;
+    double sum;
+
+    uint32_t windows;
+    // summary points that didn't fit in their output
+    uint32_t dropped;
+} SensorCloudRollup;
+
+/**
+ * Initialize a rollup.
+ * @param[out]  rollup  Rollup to initialize.
+ * @param[in]   window  Length of a window, in the units of the timestamps.
+ * @param[in]   outputs Initialized point buffer for each statistic, with a sample rate of one point per window,
+ *  NULL for statistics that aren't kept.
+ */
+void sensorCloudRollup_init(SensorCloudRollup* rollup, Timestamp window,
+    SensorCloudPointBuffer* const outputs[sensorCloudRollup_statCount]);
+
+/**
+ * Add a point, closing the window being summarized if the point is past its end.
+ * @param[io]   rollup  Rollup to add to.
+ * @param[in]   time    Timestamp of the point, points must be added in order.
+ * @param[in]   value   Value of the point.
+ */
+void sensorCloudRollup_addPoint(SensorCloudRollup* rollup, Timestamp time, float value);
+
+/**
+ * Add every point of a point buffer.
+ * @param[io]   rollup  Rollup to add to.
+ * @param[in]   points  Points to add, in order.
+ */
+void sensorCloudRollup_addPoints(SensorCloudRollup* rollup, const SensorCloudPointBuffer* points);
+
+/**
+ * Close the window being summarized, adding its summary to the outputs.
+ * @param[io]   rollup  Rollup to flush.
+ */
+void sensorCloudRollup_flush(SensorCloudRollup* rollup);
+
+/**
+ * Submit the outputs that hold points to an engine.
+ * @param[in]   rollup      Rollup to upload the outputs of, they must not be changed until the submissions complete.
+ * @param[io]   engine      Engine to submit to.
+ * @param[in]   sensor      Sensor the derived channels belong to.
+ * @param[in]   channels    Name of the derived channel of each statistic.
+ * @param[out]  submissions A submission per statistic.
+ * @param[in]   userData    User data kept with every submission.
+ * @return Number of outputs submitted.
+ */
+size_t sensorCloudRollup_submit(SensorCloudRollup* rollup, SensorCloudEngine* engine, const char* sensor,
+    const char* const channels[sensorCloudRollup_statCount], SensorCloudSubmission* submissions, void* userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+#include "scheduler.h"
+
+#include <detail/algorithm.h>
+#include <detail/trace.h>
+#include <net/driver.h>
+
+static size_t ICACHE_FLASH_ATTR sensorCloudScheduler_points(const SensorCloudSubmission* submission)
+{
+    if(!submission->points)
+        return 1;
+    size_t points = submission->ranged ? submission->rangeEnd - submission->rangeFirst :
+        sensorCloud_pointCount(submission->points);
+    return max(points, 1u);
+}
+
+static size_t ICACHE_FLASH_ATTR sensorCloudScheduler_limit(const SensorCloudScheduler* scheduler,
+    SensorCloudPriority priority)
+{
+    size_t slotCount = scheduler->engine->slotCount;
+    if(priority == sensorCloudPriority_critical)
+        return slotCount;
+    return slotCount > scheduler->reserved ? slotCount - scheduler->reserved : 1;
+}
+
+// slots an upload is counted as taking while it runs, the same when it completes as when it was dispatched
+static size_t ICACHE_FLASH_ATTR sensorCloudScheduler_slots(const SensorCloudScheduler* scheduler,
+    SensorCloudPriority priority, const SensorCloudSubmission* submission)
+{
+    size_t maxPoints = scheduler->engine->maxPoints;
+    return min((sensorCloudScheduler_points(submission) + maxPoints - 1) / maxPoints,
+        sensorCloudScheduler_limit(scheduler, priority));
+}
+
+// flow of a class whose turn it is and whose next upload fits in its deficit
+static SensorCloudSchedulerFlow* ICACHE_FLASH_ATTR sensorCloudScheduler_select(SensorCloudScheduler* scheduler,
+    SensorCloudPriority priority)
+{
+    for(;;)
+    {
+        SensorCloudSchedulerFlow* flow = scheduler->roundHead[priority];
+        if(!flow->visited)
+        {
+            flow->deficit += flow->quantum;
+            flow->visited = 1;
+        }
+        if(sensorCloudScheduler_points(flow->head) <= flow->deficit)
+            return flow;
+
+        // its turn is over, the deficit carries over to the next one
+        flow->visited = 0;
+        if(flow->next)
+        {
+            scheduler->roundHead[priority] = flow->next;
+            flow->next = NULL;
+            scheduler->roundTail[priority]->next = flow;
+            scheduler->roundTail[priority] = flow;
+        }
+    }
+}
+
+static SensorCloudSubmission* ICACHE_FLASH_ATTR sensorCloudScheduler_pop(SensorCloudScheduler* scheduler,
+    SensorCloudSchedulerFlow* flow)
+{
+    SensorCloudSubmission* submission = flow->head;
+    flow->head = submission->next;
+    submission->next = NULL;
+    flow->deficit -= sensorCloudScheduler_points(submission);
+    --scheduler->queued[flow->priority];
+    if(flow->head)
+        return submission;
+
+    // out of the round until it has uploads again, without keeping credit for them
+    flow->tail = NULL;
+    flow->deficit = 0;
+    flow->visited = 0;
+    flow->active = 0;
+    scheduler->roundHead[flow->priority] = flow->next;
+    if(!flow->next)
+        scheduler->roundTail[flow->priority] = NULL;
+    flow->next = NULL;
+    return submission;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudScheduler_completion(void* userData, SensorCloudSubmission* submission);
+
+static void ICACHE_FLASH_ATTR sensorCloudScheduler_dispatch(SensorCloudScheduler* scheduler)
+{
+    size_t priority = 0;
+    while(priority < sensorCloudPriority_classCount)
+    {
+        if(!scheduler->roundHead[priority])
+        {
+            ++priority;
+            continue;
+        }
+
+        // only the highest class waiting goes, lower ones wait for it to empty
+        size_t limit = sensorCloudScheduler_limit(scheduler, (SensorCloudPriority)priority);
+        if(scheduler->busy >= limit)
+            return; // picking a flow now would hand out turns nobody can take
+        SensorCloudSchedulerFlow* flow = sensorCloudScheduler_select(scheduler, (SensorCloudPriority)priority);
+        size_t slots = sensorCloudScheduler_slots(scheduler, (SensorCloudPriority)priority, flow->head);
+        if(scheduler->busy + slots > limit)
+            return;
+
+        SensorCloudSubmission* submission = sensorCloudScheduler_pop(scheduler, flow);
+        scheduler->busy += slots;
+        if(scheduler->stats)
+        {
+            SensorCloudSchedulerStats* stats = &scheduler->stats[priority];
+            ++stats->dispatched;
+            histogram_record(&stats->wait, net_time() - submission->held);
+        }
+        TRACE_PROBE3(sensorcloud_scheduler_dispatch, submission, priority, slots);
+        sensorCloudEngine_submit(scheduler->engine, submission);
+    }
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudScheduler_completion(void* userData, SensorCloudSubmission* submission)
+{
+    SensorCloudSchedulerFlow* flow = (SensorCloudSchedulerFlow*)userData;
+    SensorCloudScheduler* scheduler = flow->scheduler;
+    scheduler->busy -= sensorCloudScheduler_slots(scheduler, flow->priority, submission);
+    sensorCloudEngine_completeStage(scheduler->engine, submission);
+    sensorCloudScheduler_dispatch(scheduler);
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudScheduler_stageSubmit(void* flow, SensorCloudSubmission* submission)
+{
+    sensorCloudScheduler_submit((SensorCloudSchedulerFlow*)flow, submission);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudScheduler_init(SensorCloudScheduler* scheduler, SensorCloudEngine* engine,
+    size_t reserved)
+{
+    memset(scheduler, 0, sizeof(SensorCloudScheduler));
+    scheduler->engine = engine;
+    scheduler->reserved = reserved;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudScheduler_setStats(SensorCloudScheduler* scheduler,
+    SensorCloudSchedulerStats stats[sensorCloudPriority_classCount])
+{
+    scheduler->stats = stats;
+    if(!stats)
+        return;
+    size_t i = 0;
+    for(; i < sensorCloudPriority_classCount; ++i)
+    {
+        stats[i].dispatched = 0;
+        stats[i].maxQueued = 0;
+        histogram_init(&stats[i].wait);
+    }
+}
+
+void ICACHE_FLASH_ATTR sensorCloudScheduler_initFlow(SensorCloudSchedulerFlow* flow, SensorCloudScheduler* scheduler,
+    SensorCloudPriority priority, size_t quantum)
+{
+    memset(flow, 0, sizeof(SensorCloudSchedulerFlow));
+    flow->scheduler = scheduler;
+    flow->priority = priority;
+    flow->quantum = quantum ? quantum : 1;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudScheduler_initStage(SensorCloudStage* stage, SensorCloudSchedulerFlow* flow)
+{
+    stage->submit = sensorCloudScheduler_stageSubmit;
+    stage->target = flow;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudScheduler_submit(SensorCloudSchedulerFlow* flow, SensorCloudSubmission* submission)
+{
+    SensorCloudScheduler* scheduler = flow->scheduler;
+    SensorCloudPriority priority = flow->priority;
+    if(sensorCloudEngine_pushCompletion(submission, sensorCloudScheduler_completion, flow) != 0)
+    { // stacked deeper than SENSORCLOUD_ENGINE_MAX_STAGES, the slots it takes couldn't be given back
+        submission->error = sensorCloud_badRequest;
+        sensorCloudEngine_completeStage(scheduler->engine, submission);
+        return;
+    }
+    submission->held = net_time();
+    submission->next = NULL;
+    if(flow->tail)
+        flow->tail->next = submission;
+    else
+        flow->head = submission;
+    flow->tail = submission;
+
+    if(!flow->active)
+    { // joins the round at the back
+        flow->active = 1;
+        if(scheduler->roundTail[priority])
+            scheduler->roundTail[priority]->next = flow;
+        else
+            scheduler->roundHead[priority] = flow;
+        scheduler->roundTail[priority] = flow;
+    }
+    ++scheduler->queued[priority];
+    if(scheduler->stats)
+        scheduler->stats[priority].maxQueued = max(scheduler->stats[priority].maxQueued, scheduler->queued[priority]);
+
+    TRACE_PROBE3(sensorcloud_scheduler_submit, submission, flow, priority);
+    sensorCloudScheduler_dispatch(scheduler);
+}
+
+size_t ICACHE_FLASH_ATTR sensorCloudScheduler_queued(const SensorCloudScheduler* scheduler,
+    SensorCloudPriority priority)
+{
+    return scheduler->queued[priority];
+}
@@ -0,0 +1,126 @@
+#ifndef SENSORCLOUD_SCHEDULER
+#define SENSORCLOUD_SCHEDULER
+
+#include <sensorcloud/engine.h>
+
+#include <detail/histogram.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    // alarms and the like, ahead of everything else and allowed on the reserved slots
+    sensorCloudPriority_critical,
+    sensorCloudPriority_normal,
+    // backfills and other uploads that only go when nothing else is waiting
+    sensorCloudPriority_bulk,
+    sensorCloudPriority_classCount
+} SensorCloudPriority;
+
+struct SensorCloudSchedulerData;
+
+/**
+ * Uploads that share their turn, typically those of one device or channel.
+ * Flows of a class take turns with deficit round robin, each turn sending about quantum points.
+ */
+typedef struct SensorCloudSchedulerFlowData
+{
+    struct SensorCloudSchedulerData* scheduler;
+    SensorCloudPriority priority;
+    size_t quantum;
+    size_t deficit;
+    // waiting uploads, oldest first
+    SensorCloudSubmission* head;
+    SensorCloudSubmission* tail;
+    // in the round of its class
+    uint8_t active;
+    // got its quantum for the current turn
+    uint8_t visited;
+    struct SensorCloudSchedulerFlowData* next;
+} SensorCloudSchedulerFlow;
+
+/**
+ * Counters of a priority class, wait times are in microseconds.
+ */
+typedef struct
+{
+    uint32_t dispatched;
+    uint32_t maxQueued;
+    Histogram wait;
+} SensorCloudSchedulerStats;
+
+typedef struct SensorCloudSchedulerData
+{
+    SensorCloudEngine* engine;
+    // slots only critical uploads use
+    size_t reserved;
+    // slots taken by the uploads handed to the engine
+    size_t busy;
+    // flows with waiting uploads in each class, in round robin order
+    SensorCloudSchedulerFlow* roundHead[sensorCloudPriority_classCount];
+    SensorCloudSchedulerFlow* roundTail[sensorCloudPriority_classCount];
+    size_t queued[sensorCloudPriority_classCount];
+    // NULL when stats aren't being kept
+    SensorCloudSchedulerStats* stats;
+} SensorCloudScheduler;
+
+/**
+ * Initialize a scheduler, which keeps uploads waiting until the engine has a slot for them rather than in the queue
+ * of the engine, so the order they start in is its own.
+ * Uploads complete through the stages they came from, or the callback of engine when they were submitted straight
+ * to the scheduler. Every upload of engine must go through the scheduler, or it can't tell which slots are taken.
+ * @param[out]  scheduler   Scheduler to initialize.
+ * @param[in]   engine      Initialized engine to upload with.
+ * @param[in]   reserved    Slots of engine kept for critical uploads.
+ */
+void sensorCloudScheduler_init(SensorCloudScheduler* scheduler, SensorCloudEngine* engine, size_t reserved);
+
+/**
+ * Keep stats for each priority class.
+ * @param[io]   scheduler   Scheduler to keep stats for.
+ * @param[in]   stats       Storage for the stats of each class, NULL to stop keeping them.
+ */
+void sensorCloudScheduler_setStats(SensorCloudScheduler* scheduler,
+    SensorCloudSchedulerStats stats[sensorCloudPriority_classCount]);
+
+/**
+ * Initialize a flow.
+ * @param[out]  flow        Flow to initialize.
+ * @param[in]   scheduler   Scheduler the flow takes turns on.
+ * @param[in]   priority    Class of the uploads of the flow.
+ * @param[in]   quantum     Points the flow sends in a turn, relative to the other flows of its class.
+ */
+void sensorCloudScheduler_initFlow(SensorCloudSchedulerFlow* flow, SensorCloudScheduler* scheduler,
+    SensorCloudPriority priority, size_t quantum);
+
+/**
+ * Initialize a stage that schedules the submissions handed to it in a flow, typically for a backfill or a quota.
+ * @param[out]  stage   Stage to initialize.
+ * @param[in]   flow    Initialized flow the submissions belong to.
+ */
+void sensorCloudScheduler_initStage(SensorCloudStage* stage, SensorCloudSchedulerFlow* flow);
+
+/**
+ * Schedule an upload.
+ * @param[io]   flow        Flow the upload belongs to.
+ * @param[in]   submission  Initialized submission.
+ */
+void sensorCloudScheduler_submit(SensorCloudSchedulerFlow* flow, SensorCloudSubmission* submission);
+
+/**
+ * Number of uploads of a class waiting for a slot.
+ * @param[in]   scheduler   Scheduler to query.
+ * @param[in]   priority    Class to count.
+ */
+size_t sensorCloudScheduler_queued(const SensorCloudScheduler* scheduler, SensorCloudPriority priority);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
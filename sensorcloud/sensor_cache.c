@@ -0,0 +1,156 @@
+#include "sensor_cache.h"
+
+#include <detail/file.h>
+#include <xdr/xdr.h>
+
+static const uint32_t sensorCloudSensorCache_version = 1;
+
+static uint32_t ICACHE_FLASH_ATTR sensorCloudSensorCache_hash(const char* sensor)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    const char* c = sensor;
+    for(; *c; ++c)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    return hash;
+}
+
+static SensorCloudKnownName* ICACHE_FLASH_ATTR sensorCloudSensorCache_find(SensorCloudSensorCache* cache,
+    const char* sensor)
+{
+    uint32_t hash = sensorCloudSensorCache_hash(sensor);
+    size_t i = 0;
+    for(; i < cache->used; ++i)
+    {
+        SensorCloudKnownName* name = &cache->names[i];
+        if(name->hash == hash && strcmp(name->sensor, sensor) == 0)
+            return name;
+    }
+    return NULL;
+}
+
+static void ICACHE_FLASH_ATTR sensorCloudSensorCache_changed(SensorCloudSensorCache* cache)
+{
+#ifndef SENSORCLOUD_NO_STDIO
+    sensorCloudSensorCache_save(cache);
+#endif
+}
+
+static uint8_t ICACHE_FLASH_ATTR sensorCloudSensorCache_insert(SensorCloudSensorCache* cache, const char* sensor)
+{
+    if(sensorCloudSensorCache_find(cache, sensor) || cache->size == 0)
+        return 0;
+    if(strlen(sensor) >= SENSORCLOUD_NAME_SIZE)
+        return 0; // too long to remember, it costs a 404 each time instead
+
+    SensorCloudKnownName* name;
+    if(cache->used < cache->size)
+    {
+        name = &cache->names[cache->used++];
+    }
+    else
+    {
+        name = &cache->names[cache->victim];
+        cache->victim = (cache->victim + 1) % cache->size;
+    }
+    strcpy(name->sensor, sensor);
+    name->hash = sensorCloudSensorCache_hash(sensor);
+    return 1;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudSensorCache_init(SensorCloudSensorCache* cache, SensorCloudKnownName* names,
+    size_t size)
+{
+    memset(cache, 0, sizeof(SensorCloudSensorCache));
+    cache->names = names;
+    cache->size = size;
+}
+
+uint8_t ICACHE_FLASH_ATTR sensorCloudSensorCache_contains(SensorCloudSensorCache* cache, const char* sensor)
+{
+    if(sensorCloudSensorCache_find(cache, sensor))
+    {
+        ++cache->hits;
+        return 1;
+    }
+    ++cache->misses;
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudSensorCache_add(SensorCloudSensorCache* cache, const char* sensor)
+{
+    if(sensorCloudSensorCache_insert(cache, sensor))
+        sensorCloudSensorCache_changed(cache);
+}
+
+void ICACHE_FLASH_ATTR sensorCloudSensorCache_remove(SensorCloudSensorCache* cache, const char* sensor)
+{
+    SensorCloudKnownName* name = sensorCloudSensorCache_find(cache, sensor);
+    if(!name)
+        return;
+
+    // move the last name into the hole
+    *name = cache->names[--cache->used];
+    if(cache->victim >= cache->used)
+        cache->victim = 0;
+    sensorCloudSensorCache_changed(cache);
+}
+
+int ICACHE_FLASH_ATTR sensorCloudSensorCache_serialize(const SensorCloudSensorCache* cache, Buffer* buffer)
+{
+    if(xdr_writeUInt(buffer, sensorCloudSensorCache_version) != buffer_ok ||
+        xdr_writeUInt(buffer, cache->used) != buffer_ok)
+        return 1;
+    size_t i = 0;
+    for(; i < cache->used; ++i)
+    {
+        if(xdr_writeCString(buffer, cache->names[i].sensor) != buffer_ok)
+            return 1;
+    }
+    return 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudSensorCache_deserialize(SensorCloudSensorCache* cache, Buffer* buffer)
+{
+    uint32_t version;
+    uint32_t count;
+    if(xdr_readUInt(&version, buffer) != buffer_ok || version != sensorCloudSensorCache_version ||
+        xdr_readUInt(&count, buffer) != buffer_ok)
+        return 1;
+
+    uint32_t i = 0;
+    for(; i < count; ++i)
+    {
+        char sensor[SENSORCLOUD_NAME_SIZE];
+        if(xdr_readCString(sensor, sizeof(sensor), buffer) != buffer_ok)
+            return 1;
+        sensorCloudSensorCache_insert(cache, sensor);
+    }
+    return 0;
+}
+
+#ifndef SENSORCLOUD_NO_STDIO
+static int sensorCloudSensorCache_parse(void* cache, Buffer* buffer)
+{
+    return sensorCloudSensorCache_deserialize((SensorCloudSensorCache*)cache, buffer);
+}
+
+static int sensorCloudSensorCache_write(const void* cache, Buffer* buffer)
+{
+    return sensorCloudSensorCache_serialize((const SensorCloudSensorCache*)cache, buffer);
+}
+
+int sensorCloudSensorCache_load(SensorCloudSensorCache* cache, const char* path)
+{
+    cache->path = path;
+    return file_load(path, sensorCloudSensorCache_parse, cache);
+}
+
+int sensorCloudSensorCache_save(const SensorCloudSensorCache* cache)
+{
+    if(!cache->path)
+        return 0;
+    return file_save(cache->path, 8 + cache->used * (SENSORCLOUD_NAME_SIZE + 4), sensorCloudSensorCache_write,
+        cache);
+}
+#endif
@@ -0,0 +1,111 @@
+#ifndef SENSORCLOUD_SENSORCACHE
+#define SENSORCLOUD_SENSORCACHE
+
+#include <buffer/buffer.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SENSORCLOUD_NAME_SIZE
+#define SENSORCLOUD_NAME_SIZE 64
+#endif
+
+/**
+ * A sensor known to exist on the server.
+ */
+typedef struct
+{
+    char sensor[SENSORCLOUD_NAME_SIZE];
+    uint32_t hash;
+} SensorCloudKnownName;
+
+/**
+ * Sensors known to exist, so uploads to them don't have to find out with a 404. Channels aren't tracked, an upload
+ * creates the channel it goes to.
+ */
+typedef struct SensorCloudSensorCacheData
+{
+    SensorCloudKnownName* names;
+    size_t size;
+    size_t used;
+    // next name replaced once the cache is full
+    size_t victim;
+    // file the cache is saved to after every change, NULL to keep it in memory only
+    const char* path;
+
+    uint32_t hits;
+    uint32_t misses;
+} SensorCloudSensorCache;
+
+/**
+ * Initialize an empty cache.
+ * @param[out]  cache   Cache to initialize.
+ * @param[in]   names   Storage for the known names.
+ * @param[in]   size    Number of names that fit in the storage, names are replaced in turn once it is full.
+ */
+void sensorCloudSensorCache_init(SensorCloudSensorCache* cache, SensorCloudKnownName* names, size_t size);
+
+/**
+ * Check if a sensor is known to exist.
+ * @param[io]   cache   Cache to search.
+ * @param[in]   sensor  Sensor to look for.
+ * @return 1 if it is known to exist, 0 otherwise.
+ */
+uint8_t sensorCloudSensorCache_contains(SensorCloudSensorCache* cache, const char* sensor);
+
+/**
+ * Remember that a sensor exists.
+ * @param[io]   cache   Cache to update.
+ * @param[in]   sensor  Sensor that exists.
+ */
+void sensorCloudSensorCache_add(SensorCloudSensorCache* cache, const char* sensor);
+
+/**
+ * Forget a sensor, typically after the server said it doesn't exist.
+ * @param[io]   cache   Cache to update.
+ * @param[in]   sensor  Sensor to forget.
+ */
+void sensorCloudSensorCache_remove(SensorCloudSensorCache* cache, const char* sensor);
+
+/**
+ * Write the known names as XDR.
+ * @param[in]   cache   Cache to write.
+ * @param[out]  buffer  Buffer to write to.
+ * @return 0 if the cache was written, not 0 if it didn't fit.
+ */
+int sensorCloudSensorCache_serialize(const SensorCloudSensorCache* cache, Buffer* buffer);
+
+/**
+ * Add the names written by sensorCloudSensorCache_serialize to a cache.
+ * @param[io]   cache   Cache to add to.
+ * @param[in]   buffer  Buffer to read from.
+ * @return 0 if the names were read, not 0 if the data is malformed.
+ */
+int sensorCloudSensorCache_deserialize(SensorCloudSensorCache* cache, Buffer* buffer);
+
+#ifndef SENSORCLOUD_NO_STDIO
+/**
+ * Load the names saved in a file and save the cache to it from now on.
+ * @param[io]   cache   Cache to load into.
+ * @param[in]   path    File to use, it doesn't need to exist yet.
+ * @return 0 if the file was loaded or doesn't exist, not 0 if it couldn't be read.
+ */
+int sensorCloudSensorCache_load(SensorCloudSensorCache* cache, const char* path);
+
+/**
+ * Save the cache to its file.
+ * @param[in]   cache   Cache to save.
+ * @return 0 if the cache was saved or has no file, not 0 otherwise.
+ */
+int sensorCloudSensorCache_save(const SensorCloudSensorCache* cache);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,327 @@
+#include "shm_ring.h"
+
+#if !defined(SENSORCLOUD_NO_STDIO) && defined(__linux__)
+
+#include <detail/trace.h>
+#include <xdr/xdr.h>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// "SCSR"
+static const uint32_t sensorCloudShmRing_magic = 0x53435352;
+static const uint32_t sensorCloudShmRing_version = 1;
+// type and payload size
+static const uint32_t sensorCloudShmRing_recordHeaderSize = 8;
+
+enum
+{
+    sensorCloudShmRing_padding = 0,
+    sensorCloudShmRing_registration = 1,
+    sensorCloudShmRing_points = 2
+};
+
+static uint32_t sensorCloudShmRing_readWord(const char* data)
+{
+    Buffer buffer;
+    buffer_init(&buffer, (char*)data, 4);
+    buffer_commit(&buffer, 4);
+    uint32_t value = 0;
+    xdr_readUInt(&value, &buffer);
+    return value;
+}
+
+static void sensorCloudShmRing_writeWord(char* data, uint32_t value)
+{
+    Buffer buffer;
+    buffer_init(&buffer, data, 4);
+    xdr_writeUInt(&buffer, value);
+}
+
+static uint32_t sensorCloudShmRing_recordSize(uint32_t payloadSize)
+{
+    return (sensorCloudShmRing_recordHeaderSize + payloadSize + 7) & ~(uint32_t)7;
+}
+
+static char* sensorCloudShmRing_at(const SensorCloudShmRing* ring, uint32_t position)
+{
+    return ring->data + (position & (ring->size - 1));
+}
+
+static long sensorCloudShmRing_futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+int sensorCloudShmRing_create(SensorCloudShmRing* ring, const char* name, uint32_t size)
+{
+    if(size < 64 || size > 0x80000000u || (size & (size - 1)) != 0)
+        return 1;
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600) : (int)syscall(SYS_memfd_create, "sensorcloud", 0);
+    if(fd < 0)
+        return 1;
+    if(ftruncate(fd, sizeof(SensorCloudShmHeader) + size) != 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    void* memory = mmap(NULL, sizeof(SensorCloudShmHeader) + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED)
+    {
+        close(fd);
+        return 1;
+    }
+    SensorCloudShmHeader* header = (SensorCloudShmHeader*)memory;
+    memset(header, 0, sizeof(*header));
+    header->magic = sensorCloudShmRing_magic;
+    header->version = sensorCloudShmRing_version;
+    header->size = size;
+    munmap(memory, sizeof(SensorCloudShmHeader) + size);
+    return sensorCloudShmRing_attach(ring, fd);
+}
+
+int sensorCloudShmRing_open(SensorCloudShmRing* ring, const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0600);
+    if(fd < 0)
+        return 1;
+    return sensorCloudShmRing_attach(ring, fd);
+}
+
+int sensorCloudShmRing_attach(SensorCloudShmRing* ring, int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size <= sizeof(SensorCloudShmHeader))
+    {
+        close(fd);
+        return 1;
+    }
+    void* memory = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED)
+    {
+        close(fd);
+        return 1;
+    }
+
+    SensorCloudShmHeader* header = (SensorCloudShmHeader*)memory;
+    if(header->magic != sensorCloudShmRing_magic || header->version != sensorCloudShmRing_version ||
+        sizeof(SensorCloudShmHeader) + header->size != (size_t)st.st_size)
+    {
+        munmap(memory, st.st_size);
+        close(fd);
+        return 1;
+    }
+
+    ring->fd = fd;
+    ring->header = header;
+    ring->data = (char*)(header + 1);
+    ring->size = header->size;
+    ring->reserved = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    ring->reservedEnd = ring->reserved;
+    ring->read = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+    ring->outstanding = 0;
+    ring->channels = NULL;
+    ring->channelCount = 0;
+    ring->records = 0;
+    ring->wakeups = 0;
+    ring->unregistered = 0;
+    return 0;
+}
+
+void sensorCloudShmRing_close(SensorCloudShmRing* ring)
+{
+    munmap(ring->header, sizeof(SensorCloudShmHeader) + ring->size);
+    close(ring->fd);
+}
+
+// room for a record of up to payloadSize bytes, contiguous in the ring
+static char* sensorCloudShmRing_reserveRecord(SensorCloudShmRing* ring, uint32_t type, uint32_t payloadSize)
+{
+    uint32_t head = ring->header->head;
+    uint32_t tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+    uint32_t size = sensorCloudShmRing_recordSize(payloadSize);
+    uint32_t left = ring->size - (head & (ring->size - 1));
+    uint32_t padding = left < size ? left : 0;
+    if(size > ring->size || head - tail + padding + size > ring->size)
+        return NULL;
+
+    if(padding)
+    { // the reader skips to the start of the ring
+        char* record = sensorCloudShmRing_at(ring, head);
+        sensorCloudShmRing_writeWord(record, sensorCloudShmRing_padding);
+        sensorCloudShmRing_writeWord(record + 4, padding - sensorCloudShmRing_recordHeaderSize);
+    }
+    ring->reserved = head + padding;
+    ring->reservedEnd = ring->reserved + size;
+    char* record = sensorCloudShmRing_at(ring, ring->reserved);
+    sensorCloudShmRing_writeWord(record, type);
+    return record + sensorCloudShmRing_recordHeaderSize;
+}
+
+static void sensorCloudShmRing_commitRecord(SensorCloudShmRing* ring, uint32_t payloadSize)
+{
+    sensorCloudShmRing_writeWord(sensorCloudShmRing_at(ring, ring->reserved) + 4, payloadSize);
+    __atomic_store_n(&ring->header->head, ring->reserved + sensorCloudShmRing_recordSize(payloadSize),
+        __ATOMIC_SEQ_CST);
+    // the reader only waits once it read everything, so this is the record that ended an empty ring
+    if(__atomic_exchange_n(&ring->header->waiting, 0, __ATOMIC_SEQ_CST))
+    {
+        ++ring->wakeups;
+        sensorCloudShmRing_futex(&ring->header->head, FUTEX_WAKE, 1, NULL);
+    }
+}
+
+int sensorCloudShmRing_register(SensorCloudShmRing* ring, uint32_t channelId, const char* sensor,
+    const char* channel, SensorCloudSampleRate sampleRate)
+{
+    size_t sensorSize = strlen(sensor);
+    size_t channelSize = strlen(channel);
+    if(sensorSize >= SENSORCLOUD_SHM_NAME_SIZE || channelSize >= SENSORCLOUD_SHM_NAME_SIZE)
+        return 1;
+    uint32_t payloadSize = 12 + 4 + xdr_lineSize(sensorSize) + 4 + xdr_lineSize(channelSize);
+    char* payload = sensorCloudShmRing_reserveRecord(ring, sensorCloudShmRing_registration, payloadSize);
+    if(!payload)
+        return 1;
+
+    Buffer buffer;
+    buffer_init(&buffer, payload, payloadSize);
+    xdr_writeUInt(&buffer, channelId);
+    xdr_writeInt(&buffer, (int32_t)sampleRate.type);
+    xdr_writeUInt(&buffer, sampleRate.value);
+    xdr_writeCString(&buffer, sensor);
+    xdr_writeCString(&buffer, channel);
+    sensorCloudShmRing_commitRecord(ring, payloadSize);
+    return 0;
+}
+
+int sensorCloudShmRing_reserve(SensorCloudShmRing* ring, uint32_t channelId, size_t maxPoints,
+    SensorCloudPointBuffer* points)
+{
+    size_t dataSize = sensorCloud_pointBufferHeaderSize + maxPoints * sensorCloud_pointBufferDataSize;
+    if(dataSize + 4 > ring->size)
+        return 1;
+    char* payload = sensorCloudShmRing_reserveRecord(ring, sensorCloudShmRing_points, 4 + dataSize);
+    if(!payload)
+        return 1;
+
+    sensorCloudShmRing_writeWord(payload, channelId);
+    // the reader fills in the sample rate the channel was registered with
+    SensorCloudSampleRate sampleRate = {0, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(points, payload + 4, dataSize, sampleRate);
+    return 0;
+}
+
+void sensorCloudShmRing_commit(SensorCloudShmRing* ring, const SensorCloudPointBuffer* points)
+{
+    sensorCloudShmRing_commitRecord(ring, 4 + buffer_size(&points->data));
+}
+
+void sensorCloudShmRing_initReader(SensorCloudShmRing* ring, SensorCloudShmChannel* channels, size_t channelCount)
+{
+    ring->channels = channels;
+    ring->channelCount = channelCount;
+    size_t i;
+    for(i = 0; i < channelCount; ++i)
+        channels[i].registered = 0;
+}
+
+static void sensorCloudShmRing_takeRegistration(SensorCloudShmRing* ring, char* payload, uint32_t payloadSize)
+{
+    Buffer buffer;
+    buffer_init(&buffer, payload, payloadSize);
+    buffer_commit(&buffer, payloadSize);
+    uint32_t channelId = 0;
+    int32_t type = 0;
+    uint32_t value = 0;
+    xdr_readUInt(&channelId, &buffer);
+    xdr_readInt(&type, &buffer);
+    xdr_readUInt(&value, &buffer);
+    if(channelId >= ring->channelCount)
+        return;
+
+    SensorCloudShmChannel* channel = &ring->channels[channelId];
+    if(xdr_readCString(channel->sensor, sizeof(channel->sensor), &buffer) != buffer_ok ||
+        xdr_readCString(channel->channel, sizeof(channel->channel), &buffer) != buffer_ok)
+    {
+        channel->registered = 0;
+        return;
+    }
+    channel->sampleRate.type = (SensorCloudSampleRateType)type;
+    channel->sampleRate.value = value;
+    channel->registered = 1;
+    TRACE_PROBE3(sensorcloud_shm_register, ring, channelId, channel->channel);
+}
+
+int sensorCloudShmRing_read(SensorCloudShmRing* ring, SensorCloudShmRecord* record)
+{
+    uint32_t head;
+    while(ring->read != (head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE)))
+    {
+        char* data = sensorCloudShmRing_at(ring, ring->read);
+        uint32_t type = sensorCloudShmRing_readWord(data);
+        uint32_t payloadSize = sensorCloudShmRing_readWord(data + 4);
+        uint32_t size = sensorCloudShmRing_recordSize(payloadSize);
+        if(size > head - ring->read)
+            return 1; // not a record the writer made, leave it rather than read past the head
+        char* payload = data + sensorCloudShmRing_recordHeaderSize;
+
+        if(type == sensorCloudShmRing_points && payloadSize >= 4 + sensorCloud_pointBufferHeaderSize)
+        {
+            uint32_t channelId = sensorCloudShmRing_readWord(payload);
+            if(channelId < ring->channelCount && ring->channels[channelId].registered)
+            {
+                const SensorCloudShmChannel* channel = &ring->channels[channelId];
+                // the sample rate words of the point buffer header
+                sensorCloudShmRing_writeWord(payload + 8, (uint32_t)channel->sampleRate.type);
+                sensorCloudShmRing_writeWord(payload + 12, channel->sampleRate.value);
+                record->channelId = channelId;
+                record->channel = channel;
+                buffer_init(&record->points.data, payload + 4, payloadSize - 4);
+                buffer_commit(&record->points.data, payloadSize - 4);
+                ring->read += size;
+                record->end = ring->read;
+                ++ring->outstanding;
+                ++ring->records;
+                return 0;
+            }
+            ++ring->unregistered;
+        }
+        else if(type == sensorCloudShmRing_registration)
+            sensorCloudShmRing_takeRegistration(ring, payload, payloadSize);
+
+        ring->read += size;
+        if(!ring->outstanding)
+            __atomic_store_n(&ring->header->tail, ring->read, __ATOMIC_RELEASE);
+    }
+    return 1;
+}
+
+void sensorCloudShmRing_release(SensorCloudShmRing* ring, const SensorCloudShmRecord* record)
+{
+    // with nothing else outstanding the records skipped after this one go too
+    uint32_t tail = --ring->outstanding ? record->end : ring->read;
+    __atomic_store_n(&ring->header->tail, tail, __ATOMIC_RELEASE);
+}
+
+int sensorCloudShmRing_wait(SensorCloudShmRing* ring, uint32_t timeoutMs)
+{
+    __atomic_store_n(&ring->header->waiting, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&ring->header->head, __ATOMIC_SEQ_CST) == ring->read)
+    {
+        struct timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        // returns straight away if the head moved since it was read
+        sensorCloudShmRing_futex(&ring->header->head, FUTEX_WAIT, ring->read, &timeout);
+    }
+    __atomic_store_n(&ring->header->waiting, 0, __ATOMIC_RELAXED);
+    return __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE) == ring->read;
+}
+
+#endif
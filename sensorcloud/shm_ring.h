@@ -0,0 +1,202 @@
+#ifndef SENSORCLOUD_SHM_RING
+#define SENSORCLOUD_SHM_RING
+
+#include <sensorcloud.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Points from an acquisition process to an uploader process through shared memory, only built on Linux hosts and
+ * not when SENSORCLOUD_NO_STDIO is defined.
+ *
+ * The ring holds records of an 8 byte XDR header, the type and size of the payload, followed by the payload:
+ *  - register: channel id, sample rate type and value, sensor and channel names. Sent once per channel before its
+ *    points.
+ *  - points: channel id followed by a whole point buffer, header included, so the reader uploads it where it lies.
+ *  - padding: fills the end of the ring when the next record doesn't fit there.
+ * One process writes and one process reads. The reader only sleeps on an empty ring, and the writer only makes a
+ * system call to wake it when its record is the one that made the ring non-empty.
+ */
+#if !defined(SENSORCLOUD_NO_STDIO) && defined(__linux__)
+
+#ifndef SENSORCLOUD_SHM_NAME_SIZE
+#define SENSORCLOUD_SHM_NAME_SIZE 64
+#endif
+
+/**
+ * Start of the shared memory, the records follow it.
+ * The positions grow without wrapping around the ring, their difference is the amount of data in it.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t spare;
+    uint8_t padding0[48];
+    // written by the writer only, on a cache line of its own
+    uint32_t head;
+    uint8_t padding1[60];
+    // written by the reader only
+    uint32_t tail;
+    uint32_t waiting;
+    uint8_t padding2[56];
+} SensorCloudShmHeader;
+
+/**
+ * A channel registered by the writer.
+ */
+typedef struct
+{
+    char sensor[SENSORCLOUD_SHM_NAME_SIZE];
+    char channel[SENSORCLOUD_SHM_NAME_SIZE];
+    SensorCloudSampleRate sampleRate;
+    uint8_t registered;
+} SensorCloudShmChannel;
+
+/**
+ * A process's view of a ring, the writer and the reader each have their own.
+ */
+typedef struct
+{
+    int fd;
+    SensorCloudShmHeader* header;
+    char* data;
+    uint32_t size;
+
+    // writer: start of the record being written and where it ends
+    uint32_t reserved;
+    uint32_t reservedEnd;
+
+    // reader: next record to read, records read but not released
+    uint32_t read;
+    uint32_t outstanding;
+    SensorCloudShmChannel* channels;
+    size_t channelCount;
+
+    uint32_t records;
+    uint32_t wakeups;
+    // points records of channels that weren't registered
+    uint32_t unregistered;
+} SensorCloudShmRing;
+
+/**
+ * A points record read from the ring, ready to upload.
+ */
+typedef struct
+{
+    uint32_t channelId;
+    const SensorCloudShmChannel* channel;
+    // over the ring memory, carries the sample rate the channel was registered with
+    SensorCloudPointBuffer points;
+    // position right after the record
+    uint32_t end;
+} SensorCloudShmRecord;
+
+/**
+ * Create the shared memory of a ring.
+ * @param[out]  ring    Ring to create.
+ * @param[in]   name    shm_open name of the memory, NULL for an anonymous memfd whose descriptor is passed on to
+ *                      the other process.
+ * @param[in]   size    Size of the ring, a power of 2.
+ * @return 0 if the ring was created, not 0 otherwise.
+ */
+int sensorCloudShmRing_create(SensorCloudShmRing* ring, const char* name, uint32_t size);
+
+/**
+ * Map a ring created by another process.
+ * @param[out]  ring    Ring to open.
+ * @param[in]   name    shm_open name of the memory.
+ * @return 0 if the ring was opened, not 0 if it doesn't exist or isn't a ring.
+ */
+int sensorCloudShmRing_open(SensorCloudShmRing* ring, const char* name);
+
+/**
+ * Map a ring from a descriptor received from another process, the ring takes the descriptor over.
+ * @param[out]  ring    Ring to open.
+ * @param[in]   fd      Descriptor of the memory.
+ * @return 0 if the ring was opened, not 0 if the memory isn't a ring.
+ */
+int sensorCloudShmRing_attach(SensorCloudShmRing* ring, int fd);
+
+/**
+ * Unmap a ring and close its descriptor, a named ring stays until shm_unlink.
+ * @param[io]   ring    Ring to close.
+ */
+void sensorCloudShmRing_close(SensorCloudShmRing* ring);
+
+/**
+ * Register a channel, writer side.
+ * @param[io]   ring        Ring to write to.
+ * @param[in]   channelId   Id the points of the channel are written with.
+ * @param[in]   sensor      Sensor the channel belongs to.
+ * @param[in]   channel     Channel to upload to.
+ * @param[in]   sampleRate  Sample rate of the channel.
+ * @return 0 if the registration was written, not 0 if the ring is full or a name is too long.
+ */
+int sensorCloudShmRing_register(SensorCloudShmRing* ring, uint32_t channelId, const char* sensor,
+    const char* channel, SensorCloudSampleRate sampleRate);
+
+/**
+ * Reserve room for points of a channel, writer side. They are added with sensorCloud_addPoint straight into the
+ * ring and become visible to the reader with sensorCloudShmRing_commit.
+ * @param[io]   ring        Ring to write to.
+ * @param[in]   channelId   Registered id of the channel.
+ * @param[in]   maxPoints   Number of points that fit in points.
+ * @param[out]  points      Point buffer over the reserved room.
+ * @return 0 if the room was reserved, not 0 if the ring doesn't have it.
+ */
+int sensorCloudShmRing_reserve(SensorCloudShmRing* ring, uint32_t channelId, size_t maxPoints,
+    SensorCloudPointBuffer* points);
+
+/**
+ * Publish the points added since sensorCloudShmRing_reserve, writer side.
+ * @param[io]   ring    Ring to write to.
+ * @param[in]   points  Point buffer returned by the reservation.
+ */
+void sensorCloudShmRing_commit(SensorCloudShmRing* ring, const SensorCloudPointBuffer* points);
+
+/**
+ * Prepare the reader side.
+ * @param[io]   ring            Opened ring.
+ * @param[in]   channels        Storage for the channels, indexed by channel id.
+ * @param[in]   channelCount    Number of channels.
+ */
+void sensorCloudShmRing_initReader(SensorCloudShmRing* ring, SensorCloudShmChannel* channels, size_t channelCount);
+
+/**
+ * Read the next points record, reader side. Registrations are taken in along the way.
+ * The record stays in the ring until it is released, records must be released in the order they were read.
+ * @param[io]   ring    Ring to read.
+ * @param[out]  record  Record read.
+ * @return 0 if a record was read, not 0 if the ring is empty.
+ */
+int sensorCloudShmRing_read(SensorCloudShmRing* ring, SensorCloudShmRecord* record);
+
+/**
+ * Give the room of a record back to the writer, typically once its upload completed.
+ * @param[io]   ring    Ring read.
+ * @param[in]   record  Oldest record not released.
+ */
+void sensorCloudShmRing_release(SensorCloudShmRing* ring, const SensorCloudShmRecord* record);
+
+/**
+ * Sleep until the ring has something to read, reader side.
+ * @param[io]   ring        Ring to wait on.
+ * @param[in]   timeoutMs   Longest time to sleep.
+ * @return 0 if there is something to read, not 0 on timeout.
+ */
+int sensorCloudShmRing_wait(SensorCloudShmRing* ring, uint32_t timeoutMs);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
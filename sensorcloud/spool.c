@@ -0,0 +1,463 @@
+#include "spool.h"
+
+#ifndef SENSORCLOUD_NO_STDIO
+
+#include <detail/crc.h>
+#include <detail/trace.h>
+#include <xdr/xdr.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// "SCSP"
+static const uint32_t sensorCloudSpool_magic = 0x53435350;
+static const uint32_t sensorCloudSpool_version = 1;
+// magic, version, consumed offset and a spare word
+static const size_t sensorCloudSpool_headerSize = 16;
+// payload size and CRC of the payload
+static const size_t sensorCloudSpool_recordHeaderSize = 8;
+
+static void sensorCloudSpool_path(const SensorCloudSpool* spool, uint64_t sequence, char* path, size_t size)
+{
+    snprintf(path, size, "%s/spool-%016llx", spool->directory, (unsigned long long)sequence);
+}
+
+static uint32_t sensorCloudSpool_readWord(const char* data)
+{
+    Buffer buffer;
+    buffer_init(&buffer, (char*)data, 4);
+    buffer_commit(&buffer, 4);
+    uint32_t value = 0;
+    xdr_readUInt(&value, &buffer);
+    return value;
+}
+
+static void sensorCloudSpool_writeWord(char* data, uint32_t value)
+{
+    Buffer buffer;
+    buffer_init(&buffer, data, 4);
+    xdr_writeUInt(&buffer, value);
+}
+
+static int sensorCloudSpool_map(SensorCloudSpoolSegment* segment, const char* path, size_t size, uint8_t create)
+{
+    segment->fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if(segment->fd < 0)
+        return 1;
+    struct stat st;
+    if(create ? ftruncate(segment->fd, size) != 0 : (fstat(segment->fd, &st) != 0 || (size = st.st_size) == 0))
+    {
+        close(segment->fd);
+        return 1;
+    }
+
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if(data == MAP_FAILED)
+    {
+        close(segment->fd);
+        return 1;
+    }
+    segment->data = (char*)data;
+    segment->size = size;
+    return 0;
+}
+
+static void sensorCloudSpool_unmap(SensorCloudSpoolSegment* segment)
+{
+    munmap(segment->data, segment->size);
+    close(segment->fd);
+}
+
+static void sensorCloudSpool_setConsumed(SensorCloudSpoolSegment* segment, size_t consumed)
+{
+    segment->consumed = consumed;
+    sensorCloudSpool_writeWord(segment->data + 8, consumed);
+}
+
+// size of the valid record at offset, 0 at the end of the records or if the record is damaged
+static size_t sensorCloudSpool_recordSize(const SensorCloudSpoolSegment* segment, size_t offset, uint8_t* damaged)
+{
+    *damaged = 0;
+    if(segment->size - offset < sensorCloudSpool_recordHeaderSize)
+        return 0;
+    uint32_t payloadSize = sensorCloudSpool_readWord(segment->data + offset);
+    if(payloadSize == 0)
+        return 0;
+
+    const char* payload = segment->data + offset + sensorCloudSpool_recordHeaderSize;
+    if(payloadSize > segment->size - offset - sensorCloudSpool_recordHeaderSize ||
+        crc32_update(0, payload, payloadSize) != sensorCloudSpool_readWord(segment->data + offset + 4))
+    {
+        *damaged = 1;
+        return 0;
+    }
+    return sensorCloudSpool_recordHeaderSize + payloadSize;
+}
+
+static int sensorCloudSpool_load(SensorCloudSpool* spool, SensorCloudSpoolSegment* segment)
+{
+    char path[256];
+    sensorCloudSpool_path(spool, segment->sequence, path, sizeof(path));
+    if(sensorCloudSpool_map(segment, path, 0, 0) != 0)
+        return 1;
+    if(segment->size < sensorCloudSpool_headerSize ||
+        sensorCloudSpool_readWord(segment->data) != sensorCloudSpool_magic ||
+        sensorCloudSpool_readWord(segment->data + 4) != sensorCloudSpool_version)
+    {
+        sensorCloudSpool_unmap(segment);
+        return 1;
+    }
+
+    segment->consumed = sensorCloudSpool_readWord(segment->data + 8);
+    size_t offset = sensorCloudSpool_headerSize;
+    uint8_t damaged;
+    size_t size;
+    while((size = sensorCloudSpool_recordSize(segment, offset, &damaged)) != 0)
+    {
+        if(offset >= segment->consumed)
+            ++spool->pending;
+        offset += size;
+    }
+    if(damaged)
+    { // a torn write, drop it and whatever follows so appends carry on from a clean end
+        ++spool->corrupt;
+        memset(segment->data + offset, 0, segment->size - offset);
+    }
+    segment->end = offset;
+    if(segment->consumed < sensorCloudSpool_headerSize || segment->consumed > segment->end)
+        sensorCloudSpool_setConsumed(segment, segment->end);
+    return 0;
+}
+
+static void sensorCloudSpool_remove(SensorCloudSpool* spool, size_t index)
+{
+    char path[256];
+    sensorCloudSpool_path(spool, spool->segments[index].sequence, path, sizeof(path));
+    sensorCloudSpool_unmap(&spool->segments[index]);
+    unlink(path);
+    --spool->segmentCount;
+    memmove(&spool->segments[index], &spool->segments[index + 1],
+        (spool->segmentCount - index) * sizeof(SensorCloudSpoolSegment));
+}
+
+static int sensorCloudSpool_rotate(SensorCloudSpool* spool)
+{
+    uint64_t sequence = 0;
+    if(spool->segmentCount)
+    {
+        SensorCloudSpoolSegment* last = &spool->segments[spool->segmentCount - 1];
+        sequence = last->sequence + 1;
+        if(spool->syncOnRotate && msync(last->data, last->size, MS_SYNC) == 0)
+            ++spool->syncs;
+        if(last->consumed == last->end) // everything in it was uploaded already
+            sensorCloudSpool_remove(spool, spool->segmentCount - 1);
+    }
+    if(spool->segmentCount == spool->maxSegments)
+        return 1;
+
+    SensorCloudSpoolSegment* segment = &spool->segments[spool->segmentCount];
+    char path[256];
+    sensorCloudSpool_path(spool, sequence, path, sizeof(path));
+    if(sensorCloudSpool_map(segment, path, spool->segmentSize, 1) != 0)
+        return 1;
+    segment->sequence = sequence;
+    sensorCloudSpool_writeWord(segment->data, sensorCloudSpool_magic);
+    sensorCloudSpool_writeWord(segment->data + 4, sensorCloudSpool_version);
+    sensorCloudSpool_setConsumed(segment, sensorCloudSpool_headerSize);
+    segment->end = sensorCloudSpool_headerSize;
+    ++spool->segmentCount;
+    ++spool->rotations;
+    TRACE_PROBE2(sensorcloud_spool_rotate, spool, sequence);
+    return 0;
+}
+
+static int sensorCloudSpool_compare(const void* a, const void* b)
+{
+    uint64_t x = ((const SensorCloudSpoolSegment*)a)->sequence;
+    uint64_t y = ((const SensorCloudSpoolSegment*)b)->sequence;
+    return x < y ? -1 : x > y;
+}
+
+int sensorCloudSpool_open(SensorCloudSpool* spool, SensorCloudSpoolSegment* segments, size_t maxSegments,
+    const char* directory, size_t segmentSize)
+{
+    memset(spool, 0, sizeof(SensorCloudSpool));
+    spool->directory = directory;
+    spool->segments = segments;
+    spool->maxSegments = maxSegments;
+    spool->segmentSize = segmentSize;
+
+    DIR* dir = opendir(directory);
+    if(!dir)
+        return 1;
+    int result = 0;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(strncmp(entry->d_name, "spool-", 6) != 0 || strlen(entry->d_name) != 6 + 16)
+            continue;
+        if(spool->segmentCount == maxSegments)
+        {
+            result = 1;
+            break;
+        }
+        segments[spool->segmentCount++].sequence = strtoull(entry->d_name + 6, NULL, 16);
+    }
+    closedir(dir);
+    qsort(segments, spool->segmentCount, sizeof(SensorCloudSpoolSegment), sensorCloudSpool_compare);
+
+    size_t count = spool->segmentCount;
+    size_t i = 0;
+    spool->segmentCount = 0;
+    for(; i < count; ++i)
+    {
+        SensorCloudSpoolSegment segment = segments[i];
+        if(sensorCloudSpool_load(spool, &segment) == 0)
+            segments[spool->segmentCount++] = segment;
+        else
+            ++spool->corrupt;
+    }
+    if(result != 0)
+        sensorCloudSpool_close(spool);
+    return result;
+}
+
+void sensorCloudSpool_close(SensorCloudSpool* spool)
+{
+    sensorCloudSpool_sync(spool);
+    size_t i = 0;
+    for(; i < spool->segmentCount; ++i)
+        sensorCloudSpool_unmap(&spool->segments[i]);
+    spool->segmentCount = 0;
+    spool->pending = 0;
+}
+
+void sensorCloudSpool_setDurability(SensorCloudSpool* spool, size_t syncBytes, uint8_t syncOnRotate)
+{
+    spool->syncBytes = syncBytes;
+    spool->syncOnRotate = syncOnRotate;
+}
+
+int sensorCloudSpool_sync(SensorCloudSpool* spool)
+{
+    int result = 0;
+    size_t i = 0;
+    for(; i < spool->segmentCount; ++i)
+    {
+        if(msync(spool->segments[i].data, spool->segments[i].size, MS_SYNC) != 0)
+            result = 1;
+    }
+    spool->unsynced = 0;
+    ++spool->syncs;
+    return result;
+}
+
+int sensorCloudSpool_append(SensorCloudSpool* spool, const char* sensor, const char* channel,
+    SensorCloudPointBuffer* points)
+{
+    sensorCloud_finishPointBuffer(points);
+    size_t bodySize = buffer_size(&points->data);
+    size_t payloadSize = 4 + xdr_lineSize(strlen(sensor)) + 4 + xdr_lineSize(strlen(channel)) + 4 +
+        xdr_lineSize(bodySize);
+    size_t recordSize = sensorCloudSpool_recordHeaderSize + payloadSize;
+    if(strlen(sensor) >= SENSORCLOUD_SPOOL_NAME_SIZE || strlen(channel) >= SENSORCLOUD_SPOOL_NAME_SIZE ||
+        recordSize > spool->segmentSize - sensorCloudSpool_headerSize)
+        return 1;
+
+    SensorCloudSpoolSegment* segment = spool->segmentCount ? &spool->segments[spool->segmentCount - 1] : NULL;
+    if(!segment || recordSize > segment->size - segment->end)
+    {
+        if(sensorCloudSpool_rotate(spool) != 0)
+            return 1;
+        segment = &spool->segments[spool->segmentCount - 1];
+    }
+
+    // the size goes in last, a record without one is the end of the segment
+    char* record = segment->data + segment->end;
+    Buffer payload;
+    buffer_init(&payload, record + sensorCloudSpool_recordHeaderSize, payloadSize);
+    xdr_writeCString(&payload, sensor);
+    xdr_writeCString(&payload, channel);
+    xdr_writeUInt(&payload, bodySize);
+    xdr_writeString(&payload, points->data.data, bodySize);
+    sensorCloudSpool_writeWord(record + 4, crc32_update(0, payload.data, payloadSize));
+    sensorCloudSpool_writeWord(record, payloadSize);
+    segment->end += recordSize;
+    ++spool->pending;
+    ++spool->records;
+    TRACE_PROBE3(sensorcloud_spool_append, spool, segment->sequence, recordSize);
+
+    spool->unsynced += recordSize;
+    if(spool->syncBytes && spool->unsynced >= spool->syncBytes)
+    { // start writing back without waiting for it
+        if(msync(segment->data, segment->size, MS_ASYNC) == 0)
+            ++spool->syncs;
+        spool->unsynced = 0;
+    }
+    return 0;
+}
+
+void sensorCloudSpool_rewind(const SensorCloudSpool* spool, SensorCloudSpoolCursor* cursor)
+{
+    cursor->sequence = spool->segmentCount ? spool->segments[0].sequence : 0;
+    cursor->offset = spool->segmentCount ? spool->segments[0].consumed : sensorCloudSpool_headerSize;
+}
+
+int sensorCloudSpool_read(SensorCloudSpool* spool, SensorCloudSpoolCursor* cursor, SensorCloudSpoolRecord* record)
+{
+    size_t i = 0;
+    for(; i < spool->segmentCount; ++i)
+    {
+        SensorCloudSpoolSegment* segment = &spool->segments[i];
+        if(segment->sequence < cursor->sequence)
+            continue;
+        if(segment->sequence > cursor->sequence)
+        {
+            cursor->sequence = segment->sequence;
+            cursor->offset = segment->consumed;
+        }
+        if(cursor->offset >= segment->end)
+            continue;
+
+        size_t payloadSize = sensorCloudSpool_readWord(segment->data + cursor->offset);
+        Buffer payload;
+        buffer_init(&payload, segment->data + cursor->offset + sensorCloudSpool_recordHeaderSize, payloadSize);
+        buffer_commit(&payload, payloadSize);
+        uint32_t bodySize;
+        if(xdr_readCString(record->sensor, sizeof(record->sensor), &payload) != buffer_ok ||
+            xdr_readCString(record->channel, sizeof(record->channel), &payload) != buffer_ok ||
+            xdr_readUInt(&bodySize, &payload) != buffer_ok || bodySize > buffer_size(&payload))
+            return 1;
+        record->body = (char*)payload.getPtr;
+        record->bodySize = bodySize;
+        cursor->offset += sensorCloudSpool_recordHeaderSize + payloadSize;
+        record->next = *cursor;
+        return 0;
+    }
+    return 1;
+}
+
+void sensorCloudSpool_consume(SensorCloudSpool* spool, const SensorCloudSpoolCursor* next)
+{
+    // everything before the segment of the record was consumed already
+    while(spool->segmentCount && spool->segments[0].sequence < next->sequence)
+        sensorCloudSpool_remove(spool, 0);
+    if(!spool->segmentCount || spool->segments[0].sequence != next->sequence)
+        return;
+
+    SensorCloudSpoolSegment* segment = &spool->segments[0];
+    sensorCloudSpool_setConsumed(segment, next->offset);
+    if(spool->pending)
+        --spool->pending;
+    if(segment->consumed == segment->end && spool->segmentCount > 1)
+        sensorCloudSpool_remove(spool, 0);
+}
+
+static void sensorCloudSpoolDrainer_fill(SensorCloudSpoolDrainer* drainer);
+
+static void sensorCloudSpoolDrainer_completion(void* userData, SensorCloudSubmission* submission)
+{
+    SensorCloudSpoolDrainer* drainer = (SensorCloudSpoolDrainer*)userData;
+    SensorCloudSpoolDrain* drain = (SensorCloudSpoolDrain*)submission;
+    drain->done = 1;
+    if(submission->error == sensorCloud_ok)
+    {
+        ++drainer->uploaded;
+    }
+    else if(submission->error == sensorCloud_badRequest)
+    {
+        ++drainer->rejected;
+    }
+    else
+    { // the network or the account is down, stop until someone starts the drainer again
+        ++drainer->failures;
+        drainer->lastError = submission->error;
+        drainer->running = 0;
+    }
+
+    // consume the records uploaded in order
+    while(drainer->used)
+    {
+        SensorCloudSpoolDrain* first = &drainer->drains[drainer->first];
+        if(!first->done || (first->submission.error != sensorCloud_ok &&
+            first->submission.error != sensorCloud_badRequest))
+            break;
+        sensorCloudSpool_consume(drainer->spool, &first->record.next);
+        drainer->first = (drainer->first + 1) % drainer->size;
+        --drainer->used;
+    }
+
+    if(drainer->running)
+    {
+        sensorCloudSpoolDrainer_fill(drainer);
+        return;
+    }
+
+    // stopped, forget the records after the failure once their uploads are over
+    size_t i = 0;
+    for(; i < drainer->used; ++i)
+    {
+        if(!drainer->drains[(drainer->first + i) % drainer->size].done)
+            return;
+    }
+    drainer->used = 0;
+}
+
+static void sensorCloudSpoolDrainer_fill(SensorCloudSpoolDrainer* drainer)
+{
+    while(drainer->running && drainer->used < drainer->size)
+    {
+        SensorCloudSpoolDrain* drain = &drainer->drains[(drainer->first + drainer->used) % drainer->size];
+        if(sensorCloudSpool_read(drainer->spool, &drainer->cursor, &drain->record) != 0)
+            break;
+
+        buffer_init(&drain->points.data, drain->record.body, drain->record.bodySize);
+        buffer_commit(&drain->points.data, drain->record.bodySize);
+        drain->done = 0;
+        sensorCloudEngine_initSubmission(&drain->submission, drain->record.sensor, drain->record.channel,
+            &drain->points, drainer);
+        ++drainer->used;
+        sensorCloudEngine_pushCompletion(&drain->submission, sensorCloudSpoolDrainer_completion, drainer);
+        sensorCloudStage_submit(&drainer->stage, &drain->submission);
+    }
+    if(drainer->used == 0) // drained
+        drainer->running = 0;
+}
+
+void sensorCloudSpoolDrainer_init(SensorCloudSpoolDrainer* drainer, SensorCloudSpool* spool,
+    SensorCloudEngine* engine, SensorCloudSpoolDrain* drains, size_t size)
+{
+    memset(drainer, 0, sizeof(SensorCloudSpoolDrainer));
+    drainer->spool = spool;
+    drainer->engine = engine;
+    drainer->drains = drains;
+    drainer->size = size;
+    drainer->lastError = sensorCloud_ok;
+    sensorCloudEngine_initStage(&drainer->stage, engine);
+}
+
+void sensorCloudSpoolDrainer_setStage(SensorCloudSpoolDrainer* drainer, const SensorCloudStage* stage)
+{
+    if(stage)
+        drainer->stage = *stage;
+    else
+        sensorCloudEngine_initStage(&drainer->stage, drainer->engine);
+}
+
+void sensorCloudSpoolDrainer_start(SensorCloudSpoolDrainer* drainer)
+{
+    if(drainer->running || drainer->used)
+        return;
+
+    TRACE_PROBE2(sensorcloud_spool_drain, drainer, drainer->spool->pending);
+    drainer->running = 1;
+    sensorCloudSpool_rewind(drainer->spool, &drainer->cursor);
+    sensorCloudSpoolDrainer_fill(drainer);
+}
+
+#endif
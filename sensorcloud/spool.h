@@ -0,0 +1,226 @@
+#ifndef SENSORCLOUD_SPOOL
+#define SENSORCLOUD_SPOOL
+
+#include <sensorcloud/engine.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Durable store-and-forward of uploads for hosts with a filesystem, not built when SENSORCLOUD_NO_STDIO is defined.
+ */
+#ifndef SENSORCLOUD_NO_STDIO
+
+#ifndef SENSORCLOUD_SPOOL_NAME_SIZE
+#define SENSORCLOUD_SPOOL_NAME_SIZE 64
+#endif
+
+/**
+ * A memory mapped file of the spool.
+ * It starts with a header holding the offset of the first record that wasn't uploaded, followed by the records.
+ */
+typedef struct
+{
+    uint64_t sequence;
+    int fd;
+    char* data;
+    size_t size;
+    // end of the records written and of the records uploaded, both offsets into data
+    size_t end;
+    size_t consumed;
+} SensorCloudSpoolSegment;
+
+/**
+ * An append-only log of point buffers waiting to be uploaded, split into segment files that are deleted once every
+ * record in them was uploaded.
+ * Appending only copies into the mapped segment, the data reaches the disk when the OS writes it back or at the
+ * durability points configured with sensorCloudSpool_setDurability.
+ */
+typedef struct
+{
+    const char* directory;
+    SensorCloudSpoolSegment* segments;
+    size_t maxSegments;
+    // segments in use, oldest first, the last one is appended to
+    size_t segmentCount;
+    size_t segmentSize;
+    // records written that weren't uploaded yet
+    size_t pending;
+
+    // appended bytes after which the segment is written back without waiting for it, 0 to leave it to the OS
+    size_t syncBytes;
+    size_t unsynced;
+    // wait for a segment to reach the disk when it fills up
+    uint8_t syncOnRotate;
+
+    uint32_t records;
+    uint32_t rotations;
+    uint32_t syncs;
+    // records dropped because their CRC didn't match when the spool was opened
+    uint32_t corrupt;
+} SensorCloudSpool;
+
+/**
+ * Where a record is in the spool.
+ */
+typedef struct
+{
+    uint64_t sequence;
+    size_t offset;
+} SensorCloudSpoolCursor;
+
+/**
+ * A record read from the spool, the body points into the mapped segment.
+ */
+typedef struct
+{
+    char sensor[SENSORCLOUD_SPOOL_NAME_SIZE];
+    char channel[SENSORCLOUD_SPOOL_NAME_SIZE];
+    char* body;
+    size_t bodySize;
+    // position right after the record
+    SensorCloudSpoolCursor next;
+} SensorCloudSpoolRecord;
+
+/**
+ * Open a spool, picking up the records a previous process left in the directory.
+ * @param[out]  spool       Spool to open.
+ * @param[in]   segments    Storage for the segments, bounds the size of the spool.
+ * @param[in]   maxSegments Number of segments that fit in the storage.
+ * @param[in]   directory   Existing directory to keep the segment files in, must outlive the spool.
+ * @param[in]   segmentSize Size of the segment files created, bounds the size of a record.
+ * @return 0 if the spool was opened, not 0 if the directory couldn't be read or has more segments than fit.
+ */
+int sensorCloudSpool_open(SensorCloudSpool* spool, SensorCloudSpoolSegment* segments, size_t maxSegments,
+    const char* directory, size_t segmentSize);
+
+/**
+ * Write back and unmap every segment.
+ * @param[io]   spool   Spool to close.
+ */
+void sensorCloudSpool_close(SensorCloudSpool* spool);
+
+/**
+ * Configure when appended records are written to disk.
+ * @param[io]   spool           Spool to configure.
+ * @param[in]   syncBytes       Start writing back the segment after this many appended bytes, 0 to leave it to the OS.
+ * @param[in]   syncOnRotate    Wait for a full segment to be on disk before starting the next one.
+ */
+void sensorCloudSpool_setDurability(SensorCloudSpool* spool, size_t syncBytes, uint8_t syncOnRotate);
+
+/**
+ * Wait for everything appended so far to be on disk.
+ * @param[io]   spool   Spool to sync.
+ * @return 0 if the spool is on disk, not 0 otherwise.
+ */
+int sensorCloudSpool_sync(SensorCloudSpool* spool);
+
+/**
+ * Append a point buffer to the spool.
+ * @param[io]   spool   Spool to append to.
+ * @param[in]   sensor  Sensor the channel belongs to.
+ * @param[in]   channel Channel to upload to.
+ * @param[io]   points  Points to upload, finished and copied into the spool.
+ * @return 0 if the points were appended, not 0 if the spool is full or the record is bigger than a segment.
+ */
+int sensorCloudSpool_append(SensorCloudSpool* spool, const char* sensor, const char* channel,
+    SensorCloudPointBuffer* points);
+
+/**
+ * Point a cursor at the oldest record that wasn't uploaded.
+ * @param[in]   spool   Spool to read.
+ * @param[out]  cursor  Cursor to set.
+ */
+void sensorCloudSpool_rewind(const SensorCloudSpool* spool, SensorCloudSpoolCursor* cursor);
+
+/**
+ * Read the record at a cursor and move the cursor past it.
+ * @param[in]   spool   Spool to read.
+ * @param[io]   cursor  Where to read, moved to the next record.
+ * @param[out]  record  Record read, valid until it is consumed.
+ * @return 0 if a record was read, not 0 if there are no more.
+ */
+int sensorCloudSpool_read(SensorCloudSpool* spool, SensorCloudSpoolCursor* cursor, SensorCloudSpoolRecord* record);
+
+/**
+ * Mark the oldest record that wasn't uploaded as uploaded, deleting its segment once nothing in it is left.
+ * @param[io]   spool   Spool to update.
+ * @param[in]   next    Position right after the record.
+ */
+void sensorCloudSpool_consume(SensorCloudSpool* spool, const SensorCloudSpoolCursor* next);
+
+/**
+ * A record being uploaded by a drainer.
+ */
+typedef struct
+{
+    // first so the completed submission leads back to the drain
+    SensorCloudSubmission submission;
+    SensorCloudPointBuffer points;
+    SensorCloudSpoolRecord record;
+    uint8_t done;
+} SensorCloudSpoolDrain;
+
+/**
+ * Uploads the records of a spool oldest first through an engine.
+ * Records are only consumed in order, once every record before them was uploaded, so after a failure some records
+ * may be uploaded twice.
+ */
+typedef struct
+{
+    SensorCloudSpool* spool;
+    SensorCloudEngine* engine;
+    // where the records are submitted, engine unless they go through a stage in front of it
+    SensorCloudStage stage;
+    // drains in use form a ring in spool order
+    SensorCloudSpoolDrain* drains;
+    size_t size;
+    size_t first;
+    size_t used;
+    // next record to submit
+    SensorCloudSpoolCursor cursor;
+    uint8_t running;
+
+    uint32_t uploaded;
+    // records the server refused, they are dropped so they don't hold up the spool forever
+    uint32_t rejected;
+    uint32_t failures;
+    SensorCloudError lastError;
+} SensorCloudSpoolDrainer;
+
+/**
+ * Initialize a drainer, its records are submitted straight to engine until sensorCloudSpoolDrainer_setStage says
+ * otherwise.
+ * @param[out]  drainer Drainer to initialize.
+ * @param[in]   spool   Open spool to drain.
+ * @param[in]   engine  Initialized engine to upload with.
+ * @param[in]   drains  Storage for the records being uploaded, bounds how many are submitted to engine at once.
+ * @param[in]   size    Number of records that fit in the storage.
+ */
+void sensorCloudSpoolDrainer_init(SensorCloudSpoolDrainer* drainer, SensorCloudSpool* spool,
+    SensorCloudEngine* engine, SensorCloudSpoolDrain* drains, size_t size);
+
+/**
+ * Submit the records through a stage in front of the engine, typically a scheduler flow or a quota.
+ * @param[io]   drainer Drainer that isn't running.
+ * @param[in]   stage   Initialized stage ending at the engine of the drainer, NULL for the engine itself.
+ */
+void sensorCloudSpoolDrainer_setStage(SensorCloudSpoolDrainer* drainer, const SensorCloudStage* stage);
+
+/**
+ * Upload the records of the spool until it is empty or an upload fails, typically when the network came back.
+ * @param[io]   drainer Drainer to start, nothing happens if it is already running.
+ */
+void sensorCloudSpoolDrainer_start(SensorCloudSpoolDrainer* drainer);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
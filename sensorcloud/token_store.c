@@ -0,0 +1,241 @@
+#include "token_store.h"
+
+#include <detail/file.h>
+#include <detail/trace.h>
+#include <net/driver.h>
+#include <xdr/xdr.h>
+
+static const uint32_t sensorCloudTokenStore_version = 1;
+
+static uint64_t ICACHE_FLASH_ATTR sensorCloudTokenStore_now(const SensorCloudTokenStore* store)
+{
+    return store->clock ? store->clock() : net_time() / 1000000;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudTokenStore_init(SensorCloudTokenStore* store, SensorCloudTokenEntry* entries,
+    size_t size, uint64_t lifetime, uint64_t (*clock)(void))
+{
+    memset(store, 0, sizeof(SensorCloudTokenStore));
+    store->entries = entries;
+    store->size = size;
+    store->lifetime = lifetime;
+    store->refreshMargin = lifetime / 5;
+    store->clock = clock;
+}
+
+SensorCloudTokenEntry* ICACHE_FLASH_ATTR sensorCloudTokenStore_find(SensorCloudTokenStore* store, const char* device)
+{
+    size_t i = 0;
+    for(; i < store->used; ++i)
+    {
+        if(strncmp(store->entries[i].device, device, SENSORCLOUD_TOKEN_DEVICE_SIZE - 1) == 0)
+            return &store->entries[i];
+    }
+    return NULL;
+}
+
+static SensorCloudTokenEntry* ICACHE_FLASH_ATTR sensorCloudTokenStore_findOrAdd(SensorCloudTokenStore* store,
+    const char* device)
+{
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(store, device);
+    if(entry)
+        return entry;
+
+    if(store->used < store->size)
+    {
+        entry = &store->entries[store->used++];
+    }
+    else
+    { // full, replace the oldest token nobody is waiting on
+        size_t i = 0;
+        for(; i < store->used; ++i)
+        {
+            SensorCloudTokenEntry* candidate = &store->entries[i];
+            if(candidate->authenticating)
+                continue;
+            if(!entry || !candidate->valid || (entry->valid && candidate->obtained < entry->obtained))
+                entry = candidate;
+        }
+        if(!entry)
+            return NULL;
+    }
+
+    memset(entry, 0, sizeof(SensorCloudTokenEntry));
+    strncpy(entry->device, device, sizeof(entry->device) - 1);
+    return entry;
+}
+
+SensorCloudTokenState ICACHE_FLASH_ATTR sensorCloudTokenStore_state(const SensorCloudTokenStore* store,
+    const SensorCloudTokenEntry* entry)
+{
+    if(!entry || !entry->valid)
+        return sensorCloudToken_missing;
+
+    uint64_t now = sensorCloudTokenStore_now(store);
+    uint64_t age = now > entry->obtained ? now - entry->obtained : 0;
+    if(age >= store->lifetime)
+        return sensorCloudToken_expired;
+    if(age + store->refreshMargin >= store->lifetime)
+        return sensorCloudToken_refresh;
+    return sensorCloudToken_fresh;
+}
+
+static int ICACHE_FLASH_ATTR sensorCloudTokenStore_set(SensorCloudTokenEntry* entry, const char* token,
+    size_t tokenSize, const char* server, size_t serverSize, uint64_t obtained)
+{
+    if(tokenSize >= sizeof(entry->token) || serverSize >= sizeof(entry->server))
+        return 1;
+
+    memcpy(entry->token, token, tokenSize);
+    entry->token[tokenSize] = '\0';
+    memcpy(entry->server, server, serverSize);
+    entry->server[serverSize] = '\0';
+    entry->obtained = obtained;
+    entry->valid = 1;
+    return 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudTokenStore_put(SensorCloudTokenStore* store, const char* device, const char* token,
+    size_t tokenSize, const char* server, size_t serverSize)
+{
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_findOrAdd(store, device);
+    if(!entry)
+        return 1;
+    if(sensorCloudTokenStore_set(entry, token, tokenSize, server, serverSize, sensorCloudTokenStore_now(store)) != 0)
+        return 1;
+
+    store->dirty = 1;
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudTokenStore_invalidate(SensorCloudTokenStore* store, const char* device)
+{
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(store, device);
+    if(!entry || !entry->valid)
+        return;
+
+    entry->valid = 0;
+    store->dirty = 1;
+}
+
+uint8_t ICACHE_FLASH_ATTR sensorCloudTokenStore_beginAuthenticate(SensorCloudTokenStore* store, const char* device,
+    SensorCloudAuthWaiter* waiter)
+{
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_findOrAdd(store, device);
+    if(!entry) // no room to track it, authenticate without sharing
+        return 1;
+
+    if(entry->authenticating)
+    {
+        TRACE_PROBE2(sensorcloud_token_coalesced, store, device);
+        ++store->coalesced;
+        waiter->next = entry->waiters;
+        entry->waiters = waiter;
+        return 0;
+    }
+
+    ++store->authentications;
+    entry->authenticating = 1;
+    return 1;
+}
+
+void ICACHE_FLASH_ATTR sensorCloudTokenStore_endAuthenticate(SensorCloudTokenStore* store, const char* device,
+    SensorCloudError error)
+{
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(store, device);
+    if(!entry)
+        return;
+
+    // the waiters may start another authentication
+    SensorCloudAuthWaiter* waiter = entry->waiters;
+    entry->waiters = NULL;
+    entry->authenticating = 0;
+    while(waiter)
+    {
+        SensorCloudAuthWaiter* next = waiter->next;
+        waiter->next = NULL;
+        waiter->callback(waiter->userData, error);
+        waiter = next;
+    }
+}
+
+int ICACHE_FLASH_ATTR sensorCloudTokenStore_serialize(const SensorCloudTokenStore* store, Buffer* buffer)
+{
+    uint32_t count = 0;
+    size_t i = 0;
+    for(; i < store->used; ++i)
+        count += store->entries[i].valid;
+
+    if(xdr_writeUInt(buffer, sensorCloudTokenStore_version) != buffer_ok ||
+        xdr_writeUInt(buffer, count) != buffer_ok)
+        return 1;
+    for(i = 0; i < store->used; ++i)
+    {
+        const SensorCloudTokenEntry* entry = &store->entries[i];
+        if(!entry->valid)
+            continue;
+        if(xdr_writeCString(buffer, entry->device) != buffer_ok ||
+            xdr_writeCString(buffer, entry->token) != buffer_ok ||
+            xdr_writeCString(buffer, entry->server) != buffer_ok ||
+            xdr_writeUHyper(buffer, entry->obtained) != buffer_ok)
+            return 1;
+    }
+    return 0;
+}
+
+int ICACHE_FLASH_ATTR sensorCloudTokenStore_deserialize(SensorCloudTokenStore* store, Buffer* buffer)
+{
+    uint32_t version;
+    uint32_t count;
+    if(xdr_readUInt(&version, buffer) != buffer_ok || version != sensorCloudTokenStore_version ||
+        xdr_readUInt(&count, buffer) != buffer_ok)
+        return 1;
+
+    uint32_t i = 0;
+    for(; i < count; ++i)
+    {
+        SensorCloudTokenEntry read;
+        if(xdr_readCString(read.device, sizeof(read.device), buffer) != buffer_ok ||
+            xdr_readCString(read.token, sizeof(read.token), buffer) != buffer_ok ||
+            xdr_readCString(read.server, sizeof(read.server), buffer) != buffer_ok ||
+            xdr_readUHyper(&read.obtained, buffer) != buffer_ok)
+            return 1;
+
+        SensorCloudTokenEntry* entry = sensorCloudTokenStore_findOrAdd(store, read.device);
+        if(entry && (!entry->valid || entry->obtained < read.obtained))
+            sensorCloudTokenStore_set(entry, read.token, strlen(read.token), read.server, strlen(read.server),
+                read.obtained);
+    }
+    return 0;
+}
+
+#ifndef SENSORCLOUD_NO_STDIO
+static int sensorCloudTokenStore_parse(void* store, Buffer* buffer)
+{
+    return sensorCloudTokenStore_deserialize((SensorCloudTokenStore*)store, buffer);
+}
+
+static int sensorCloudTokenStore_write(const void* store, Buffer* buffer)
+{
+    return sensorCloudTokenStore_serialize((const SensorCloudTokenStore*)store, buffer);
+}
+
+int sensorCloudTokenStore_load(SensorCloudTokenStore* store, const char* path)
+{
+    if(!store->clock) // net_time starts over with every boot, the saved timestamps would mean nothing
+        return 1;
+    store->path = path;
+    return file_load(path, sensorCloudTokenStore_parse, store);
+}
+
+int sensorCloudTokenStore_save(SensorCloudTokenStore* store)
+{
+    if(!store->path || !store->dirty)
+        return 0;
+    if(file_save(store->path, 8 + store->used * (sizeof(SensorCloudTokenEntry) + 16), sensorCloudTokenStore_write,
+        store) != 0)
+        return 1;
+    store->dirty = 0;
+    return 0;
+}
+#endif
@@ -0,0 +1,175 @@
+#ifndef SENSORCLOUD_TOKENSTORE
+#define SENSORCLOUD_TOKENSTORE
+
+#include <sensorcloud.h>
+
+#include <buffer/buffer.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SENSORCLOUD_TOKEN_DEVICE_SIZE
+#define SENSORCLOUD_TOKEN_DEVICE_SIZE 64
+#endif
+
+#ifndef SENSORCLOUD_TOKEN_SIZE
+#define SENSORCLOUD_TOKEN_SIZE 256
+#endif
+
+#ifndef SENSORCLOUD_TOKEN_SERVER_SIZE
+#define SENSORCLOUD_TOKEN_SERVER_SIZE 128
+#endif
+
+/**
+ * The token and server handed out to one device.
+ */
+typedef struct
+{
+    char device[SENSORCLOUD_TOKEN_DEVICE_SIZE];
+    char token[SENSORCLOUD_TOKEN_SIZE];
+    char server[SENSORCLOUD_TOKEN_SERVER_SIZE];
+    // clock of the store when the token was handed out, in seconds
+    uint64_t obtained;
+    uint8_t valid;
+    uint8_t authenticating;
+    // contexts waiting for the authentication in flight
+    SensorCloudAuthWaiter* waiters;
+} SensorCloudTokenEntry;
+
+/**
+ * Tokens shared by every SensorCloud that uses the store, optionally persisted to a file.
+ * Only one authentication per device is in flight at a time, everyone else asking waits for its result.
+ */
+typedef struct SensorCloudTokenStoreData
+{
+    SensorCloudTokenEntry* entries;
+    size_t size;
+    size_t used;
+    // seconds a token is used for
+    uint64_t lifetime;
+    // seconds before the end of the lifetime a token is refreshed
+    uint64_t refreshMargin;
+    // seconds since some fixed point, the same across restarts when the store is persisted
+    uint64_t (*clock)(void);
+    // file sensorCloudTokenStore_save writes to, NULL to keep the store in memory only
+    const char* path;
+    // changed since it was last saved
+    uint8_t dirty;
+
+    uint32_t authentications;
+    uint32_t coalesced;
+} SensorCloudTokenStore;
+
+/**
+ * Initialize an empty token store.
+ * @param[out]  store       Store to initialize.
+ * @param[in]   entries     Storage for the tokens of each device.
+ * @param[in]   size        Number of devices that fit in the storage, the oldest token is dropped when it is full.
+ * @param[in]   lifetime    Seconds a token is used for, refreshing starts a fifth of it before the end.
+ * @param[in]   clock       Returns the wall clock time in seconds, NULL to use net_time which doesn't survive a restart
+ *  and can't be used with a file.
+ */
+void sensorCloudTokenStore_init(SensorCloudTokenStore* store, SensorCloudTokenEntry* entries, size_t size,
+    uint64_t lifetime, uint64_t (*clock)(void));
+
+/**
+ * Get the token of a device.
+ * @param[in]   store   Store to search.
+ * @param[in]   device  Device to get the token of.
+ * @return The entry of the device, NULL if the store knows nothing about it.
+ */
+SensorCloudTokenEntry* sensorCloudTokenStore_find(SensorCloudTokenStore* store, const char* device);
+
+/**
+ * Get the state of the token of an entry.
+ * @param[in]   store   Store holding the entry.
+ * @param[in]   entry   Entry to check, may be NULL.
+ */
+SensorCloudTokenState sensorCloudTokenStore_state(const SensorCloudTokenStore* store,
+    const SensorCloudTokenEntry* entry);
+
+/**
+ * Store a newly handed out token, the store isn't saved until sensorCloudTokenStore_save is called.
+ * @param[io]   store       Store to update.
+ * @param[in]   device      Device the token belongs to.
+ * @param[in]   token       Token, not null terminated.
+ * @param[in]   tokenSize   Number of characters in the token.
+ * @param[in]   server      Server to upload to, not null terminated.
+ * @param[in]   serverSize  Number of characters in the server.
+ * @return 0 if the token was stored, not 0 if it doesn't fit.
+ */
+int sensorCloudTokenStore_put(SensorCloudTokenStore* store, const char* device, const char* token,
+    size_t tokenSize, const char* server, size_t serverSize);
+
+/**
+ * Forget the token of a device, typically after the server rejected it.
+ * @param[io]   store   Store to update.
+ * @param[in]   device  Device to forget the token of.
+ */
+void sensorCloudTokenStore_invalidate(SensorCloudTokenStore* store, const char* device);
+
+/**
+ * Claim the authentication of a device.
+ * @param[io]   store   Store to update.
+ * @param[in]   device  Device to authenticate.
+ * @param[in]   waiter  Called by sensorCloudTokenStore_endAuthenticate if someone else is already authenticating.
+ * @return 1 if the caller must authenticate and then call sensorCloudTokenStore_endAuthenticate, 0 if waiter was
+ *  queued behind the authentication in flight.
+ */
+uint8_t sensorCloudTokenStore_beginAuthenticate(SensorCloudTokenStore* store, const char* device,
+    SensorCloudAuthWaiter* waiter);
+
+/**
+ * Finish the authentication of a device, calling everyone that waited for it.
+ * @param[io]   store   Store to update.
+ * @param[in]   device  Device that was authenticated.
+ * @param[in]   error   Result of the authentication.
+ */
+void sensorCloudTokenStore_endAuthenticate(SensorCloudTokenStore* store, const char* device, SensorCloudError error);
+
+/**
+ * Write the valid tokens of a store as XDR.
+ * @param[in]   store   Store to write.
+ * @param[out]  buffer  Buffer to write to.
+ * @return 0 if the store was written, not 0 if it didn't fit.
+ */
+int sensorCloudTokenStore_serialize(const SensorCloudTokenStore* store, Buffer* buffer);
+
+/**
+ * Add the tokens written by sensorCloudTokenStore_serialize to a store.
+ * @param[io]   store   Store to add to.
+ * @param[in]   buffer  Buffer to read from.
+ * @return 0 if the tokens were read, not 0 if the data is malformed.
+ */
+int sensorCloudTokenStore_deserialize(SensorCloudTokenStore* store, Buffer* buffer);
+
+#ifndef SENSORCLOUD_NO_STDIO
+/**
+ * Load the tokens saved in a file and let sensorCloudTokenStore_save write to it from now on. The store needs a clock
+ * that survives a restart, the times tokens were handed out are saved with them.
+ * @param[io]   store   Store to load into.
+ * @param[in]   path    File to use, it doesn't need to exist yet.
+ * @return 0 if the file was loaded or doesn't exist, not 0 if it couldn't be read or the store has no clock.
+ */
+int sensorCloudTokenStore_load(SensorCloudTokenStore* store, const char* path);
+
+/**
+ * Save the store to its file if it changed since it was last saved, replacing the file atomically and syncing it.
+ * Changes aren't saved as they happen, that would write and sync the whole store on every authentication. The
+ * application saves at points of its choosing instead, typically on a timer or after a batch of devices
+ * authenticated. Tokens handed out since the last save are only lost, the devices authenticate again after a restart.
+ * @param[io]   store   Store to save.
+ * @return 0 if the store was saved, had nothing to save or has no file, not 0 otherwise.
+ */
+int sensorCloudTokenStore_save(SensorCloudTokenStore* store);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
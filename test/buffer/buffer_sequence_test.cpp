@@ -106,6 +106,23 @@ BOOST_AUTO_TEST_CASE(SearchThroughTwoBufferSequences)
     BOOST_CHECK_EQUAL(output.length, 4);
 }
 
+BOOST_AUTO_TEST_CASE(SearchForSequenceSplitAcrossBufferSequences)
+{
+    char data1[] = "200 OK\r\n\r";
+    char data2[] = "\nbody";
+    BufferSequence input1;
+    bufferSequence_init(&input1, data1, 9);
+    BufferSequence input2;
+    bufferSequence_init(&input2, data2, 5);
+    bufferSequence_append(&input1, &input2);
+    BufferSequence output;
+
+    bufferSequence_search(&output, &input1, "\r\n\r\n", 4);
+
+    BOOST_CHECK_EQUAL(output.data, data1 + 6);
+    BOOST_CHECK_EQUAL(output.length, 3);
+}
+
 BOOST_AUTO_TEST_CASE(ByteSequenceDoesntExist)
 {
     char data[] = "200 OK\r\n\r\r";
@@ -0,0 +1,19 @@
+#include <detail/crc.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(CrcTest)
+
+BOOST_AUTO_TEST_CASE(Crc32_CheckValue)
+{
+    BOOST_CHECK_EQUAL(crc32_update(0, "123456789", 9), 0xcbf43926u);
+}
+
+BOOST_AUTO_TEST_CASE(Crc32_Incremental)
+{
+    uint32_t crc = crc32_update(0, "1234", 4);
+    BOOST_CHECK_EQUAL(crc32_update(crc, "56789", 5), 0xcbf43926u);
+    BOOST_CHECK_EQUAL(crc32_update(0, "", 0), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
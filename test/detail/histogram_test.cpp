@@ -0,0 +1,66 @@
+#include <detail/histogram.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(HistogramTest)
+
+BOOST_AUTO_TEST_CASE(Empty_Zero)
+{
+    Histogram h;
+    histogram_init(&h);
+
+    BOOST_CHECK_EQUAL(histogram_percentile(&h, 50), 0);
+    BOOST_CHECK_EQUAL(histogram_mean(&h), 0);
+}
+
+BOOST_AUTO_TEST_CASE(SmallValues_Exact)
+{
+    Histogram h;
+    histogram_init(&h);
+    for(uint64_t i = 1; i <= 10; ++i)
+        histogram_record(&h, i);
+
+    BOOST_CHECK_EQUAL(histogram_percentile(&h, 50), 5);
+    BOOST_CHECK_EQUAL(histogram_percentile(&h, 100), 10);
+    BOOST_CHECK_EQUAL(h.min, 1);
+    BOOST_CHECK_EQUAL(histogram_mean(&h), 5);
+}
+
+BOOST_AUTO_TEST_CASE(LargeValues_WithinPrecision)
+{
+    Histogram h;
+    histogram_init(&h);
+    for(uint64_t i = 1; i <= 1000; ++i)
+        histogram_record(&h, i * 1000);
+
+    uint64_t p99 = histogram_percentile(&h, 99);
+    BOOST_CHECK_GE(p99, 990000);
+    BOOST_CHECK_LE(p99, 990000 + 990000 / HISTOGRAM_SUB_BUCKETS);
+}
+
+BOOST_AUTO_TEST_CASE(Huge_ClampedToMax)
+{
+    Histogram h;
+    histogram_init(&h);
+    histogram_record(&h, (uint64_t)1 << 50);
+
+    BOOST_CHECK_EQUAL(histogram_percentile(&h, 50), (uint64_t)1 << 50);
+}
+
+BOOST_AUTO_TEST_CASE(Merge_CombinesCounts)
+{
+    Histogram a;
+    histogram_init(&a);
+    Histogram b;
+    histogram_init(&b);
+    histogram_record(&a, 1);
+    histogram_record(&b, 100);
+
+    histogram_merge(&a, &b);
+
+    BOOST_CHECK_EQUAL(a.count, 2);
+    BOOST_CHECK_EQUAL(a.min, 1);
+    BOOST_CHECK_EQUAL(a.max, 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+#include <detail/trace.h>
+#include <net/loopback_driver.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Fixture
+{
+    LoopbackConfig config;
+    TraceEvent events[4];
+
+    Fixture()
+    {
+        loopback_defaultConfig(&config);
+        loopback_reset(&config);
+        trace_startRecording(events, 4);
+    }
+
+    ~Fixture()
+    {
+        trace_stopRecording();
+    }
+
+    std::string json(size_t* written)
+    {
+        FILE* file = tmpfile();
+        *written = trace_writeChromeJson(file);
+        std::string text;
+        rewind(file);
+        char buffer[256];
+        size_t size;
+        while((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            text.append(buffer, size);
+        fclose(file);
+        return text;
+    }
+
+    boost::property_tree::ptree parse()
+    {
+        size_t written;
+        std::istringstream stream(json(&written));
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(stream, tree);
+        return tree;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(TraceTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(BeginEnd_PairedByNameAndId)
+{
+    int first = 0;
+    int second = 0;
+    TRACE_BEGIN(upload, &first);
+    loopback_runUntil(10);
+    TRACE_BEGIN(upload, &second);
+    loopback_runUntil(25);
+    TRACE_END(upload, &first, 201);
+
+    const boost::property_tree::ptree tree = parse();
+    std::vector<boost::property_tree::ptree> events;
+    for(const auto& event : tree.get_child("traceEvents"))
+        events.push_back(event.second);
+    BOOST_REQUIRE_EQUAL(events.size(), 3u);
+    BOOST_CHECK_EQUAL(events[0].get<std::string>("ph"), "b");
+    BOOST_CHECK_EQUAL(events[2].get<std::string>("ph"), "e");
+    BOOST_CHECK_EQUAL(events[0].get<std::string>("name"), "upload");
+    BOOST_CHECK_EQUAL(events[2].get<std::string>("name"), "upload");
+    // the end matches the begin of the same object, not the latest one
+    BOOST_CHECK_EQUAL(events[0].get<std::string>("id"), events[2].get<std::string>("id"));
+    BOOST_CHECK(events[1].get<std::string>("id") != events[2].get<std::string>("id"));
+    BOOST_CHECK_EQUAL(events[0].get<uint64_t>("ts"), 0u);
+    BOOST_CHECK_EQUAL(events[1].get<uint64_t>("ts"), 10u);
+    BOOST_CHECK_EQUAL(events[2].get<uint64_t>("ts"), 25u);
+    BOOST_CHECK_EQUAL(events[2].get<int64_t>("args.value"), 201);
+}
+
+BOOST_AUTO_TEST_CASE(Full_OldestOverwritten)
+{
+    int id = 0;
+    for(int i = 0; i < 6; ++i)
+    {
+        loopback_runUntil(i);
+        TRACE_INSTANT(tick, &id, i);
+    }
+
+    size_t written;
+    json(&written);
+    BOOST_CHECK_EQUAL(written, 4u);
+    const boost::property_tree::ptree tree = parse();
+    int64_t value = 2;
+    for(const auto& event : tree.get_child("traceEvents"))
+    {
+        BOOST_CHECK_EQUAL(event.second.get<std::string>("ph"), "n");
+        BOOST_CHECK_EQUAL(event.second.get<int64_t>("args.value"), value);
+        ++value;
+    }
+    BOOST_CHECK_EQUAL(value, 6);
+}
+
+BOOST_AUTO_TEST_CASE(Stopped_NothingRecorded)
+{
+    int id = 0;
+    TRACE_INSTANT(tick, &id, 1);
+    trace_stopRecording();
+    TRACE_INSTANT(tick, &id, 2);
+
+    const boost::property_tree::ptree tree = parse();
+    BOOST_CHECK_EQUAL(tree.get_child("traceEvents").size(), 1u);
+    BOOST_CHECK_EQUAL(tree.get<std::string>("displayTimeUnit"), "ms");
+
+    // an empty recording is still a valid document
+    trace_startRecording(events, 4);
+    BOOST_CHECK_EQUAL(parse().get_child("traceEvents").size(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+#include <http/request.h>
+#include <http/stats.h>
+#include <net/loopback_driver.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+void ignoreCallback(void*, const void*, size_t, HTTPError)
+{
+}
+
+struct Fixture
+{
+    LoopbackConfig config;
+    HTTPRequest request;
+    char requestBuffer[512];
+    char responseBuffer[512];
+    std::vector<HTTPHostStats> hosts;
+    HTTPStatsTable table;
+
+    Fixture() :
+    hosts(2)
+    {
+        loopback_defaultConfig(&config);
+        config.connectLatency = 1000;
+        config.writeLatency = 10;
+        config.responseLatency = 500;
+        config.readLatency = 1;
+        config.minRead = 10;
+        config.maxRead = 10;
+        loopback_reset(&config);
+        http_initStatsTable(&table, hosts.data(), hosts.size());
+        http_setStatsTable(&table);
+    }
+
+    ~Fixture()
+    {
+        http_setStatsTable(NULL);
+    }
+
+    void post(const char* url, const char* body)
+    {
+        Buffer requestHead;
+        buffer_init(&requestHead, requestBuffer, sizeof(requestBuffer));
+        Buffer responseHead;
+        buffer_init(&responseHead, responseBuffer, sizeof(responseBuffer));
+        http_initRequest(&request, "POST", url, requestHead, responseHead, NULL, ignoreCallback);
+        Buffer bodyBuffer;
+        buffer_init(&bodyBuffer, const_cast<char*>(body), strlen(body));
+        buffer_commit(&bodyBuffer, strlen(body));
+        http_asyncRequest(&request, bodyBuffer);
+        loopback_run();
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(RequestStatsTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Phases_FollowVirtualClock)
+{
+    loopback_queueResponse(201, "Created", "0123456789", 10, 0);
+
+    post("http://example.com/path", "body");
+
+    HTTPRequestStats stats;
+    BOOST_CHECK_EQUAL(http_getRequestStats(&stats, &request), http_ok);
+    // the clock starts at 0, the request still counts as started
+    BOOST_CHECK(http_phaseReached(&stats, httpPhase_started));
+    BOOST_CHECK_EQUAL(stats.timestamps[httpPhase_started], 0);
+    BOOST_CHECK(!http_phaseReached(&stats, httpPhase_secured));
+    BOOST_CHECK_EQUAL(http_phaseDuration(&stats, httpPhase_started, httpPhase_connected), 1000);
+    BOOST_CHECK_EQUAL(http_phaseDuration(&stats, httpPhase_connected, httpPhase_headSent), 10);
+    BOOST_CHECK_EQUAL(http_phaseDuration(&stats, httpPhase_headSent, httpPhase_bodySent), 10);
+    BOOST_CHECK_EQUAL(http_phaseDuration(&stats, httpPhase_bodySent, httpPhase_firstByte), 500);
+    BOOST_CHECK_GT(stats.timestamps[httpPhase_complete], stats.timestamps[httpPhase_headReceived]);
+    BOOST_CHECK_EQUAL(stats.writes, 2);
+    BOOST_CHECK_EQUAL(stats.bytesOut, buffer_size(&request.head) + 4);
+    BOOST_CHECK_EQUAL(stats.bytesIn, loopback_stats().bytesIn);
+    BOOST_CHECK_EQUAL(stats.reads, loopback_stats().reads);
+}
+
+BOOST_AUTO_TEST_CASE(FinishedRequests_AggregatedPerHost)
+{
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+
+    post("http://a.example.com/path", "body");
+    post("http://a.example.com/path", "body");
+    post("http://b.example.com/path", "body");
+
+    std::vector<HTTPHostStats> snapshot(4);
+    size_t count = http_snapshotStats(snapshot.data(), snapshot.size(), &table, 1);
+
+    BOOST_REQUIRE_EQUAL(count, 2);
+    BOOST_CHECK_EQUAL(snapshot[0].hostname, "a.example.com");
+    BOOST_CHECK_EQUAL(snapshot[0].requests, 2);
+    BOOST_CHECK_EQUAL(snapshot[0].errors, 0);
+    BOOST_CHECK_EQUAL(histogram_percentile(&snapshot[0].connect, 50), 1000);
+    BOOST_CHECK_EQUAL(snapshot[1].requests, 1);
+    BOOST_CHECK_EQUAL(table.used, 0);
+}
+
+BOOST_AUTO_TEST_CASE(FailedRequest_CountedAsError)
+{
+    post("http://example.com/path", "body");
+
+    HTTPHostStats* host = http_findHostStats(&table, "example.com");
+    BOOST_REQUIRE(host);
+    BOOST_CHECK_EQUAL(host->requests, 1);
+    BOOST_CHECK_EQUAL(host->errors, 1);
+}
+
+BOOST_AUTO_TEST_CASE(FindHostStats_ComparesWholeNames)
+{
+    std::string longName(63, 'a');
+    HTTPHostStats* host = http_findHostStats(&table, longName.c_str());
+    BOOST_REQUIRE(host);
+    // sharing the first 63 characters doesn't make it the same host, too long to store it isn't recorded
+    BOOST_CHECK(http_findHostStats(&table, (longName + "b").c_str()) == NULL);
+    BOOST_CHECK(http_findHostStats(&table, longName.substr(1).c_str()) != host);
+    BOOST_CHECK_EQUAL(http_findHostStats(&table, longName.c_str()), host);
+    BOOST_CHECK_EQUAL(table.used, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,261 @@
+#include <net/loopback_driver.h>
+#include <http/request.h>
+#include <sensorcloud.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct RequestResult
+{
+    std::string body;
+    HTTPError error;
+    int calls;
+
+    RequestResult() : error(http_ok), calls(0) {}
+};
+
+void requestCallback(void* userData, const void* data, size_t dataSize, HTTPError error)
+{
+    RequestResult* result = static_cast<RequestResult*>(userData);
+    if(data)
+        result->body.append(static_cast<const char*>(data), dataSize);
+    result->error = error;
+    ++result->calls;
+}
+
+struct Fixture
+{
+    LoopbackConfig config;
+    HTTPRequest request;
+    char requestBuffer[512];
+    char responseBuffer[512];
+    RequestResult result;
+
+    Fixture()
+    {
+        loopback_defaultConfig(&config);
+    }
+
+    void get(const char* url)
+    {
+        Buffer requestHead;
+        buffer_init(&requestHead, requestBuffer, sizeof(requestBuffer));
+        Buffer responseHead;
+        buffer_init(&responseHead, responseBuffer, sizeof(responseBuffer));
+        http_initRequest(&request, "GET", url, requestHead, responseHead, &result, requestCallback);
+        Buffer body;
+        buffer_init(&body, NULL, 0);
+        http_asyncRequest(&request, body);
+        loopback_run();
+    }
+};
+
+struct SensorCloudResult
+{
+    SensorCloudError error;
+    int calls;
+};
+
+void sensorCloudCallback(void* userData, SensorCloudError error)
+{
+    SensorCloudResult* result = static_cast<SensorCloudResult*>(userData);
+    result->error = error;
+    ++result->calls;
+}
+
+void timerCallback(void* userData)
+{
+    static_cast<std::vector<uint64_t>*>(userData)->push_back(net_time());
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(LoopbackDriverTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(ContentLength_SingleByteReads)
+{
+    config.minRead = 1;
+    config.maxRead = 1;
+    loopback_reset(&config);
+    loopback_queueResponse(200, "OK", "abcdefghij", 10, 0);
+
+    get("http://example.com/path");
+
+    BOOST_CHECK_EQUAL(result.body, "abcdefghij");
+    BOOST_CHECK_EQUAL(result.error, http_complete);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 1);
+}
+
+BOOST_AUTO_TEST_CASE(Chunked_RandomReads)
+{
+    std::string expected;
+    for(int i = 0; i < 100; ++i)
+        expected += static_cast<char>('a' + i % 26);
+
+    config.minRead = 1;
+    config.maxRead = 7;
+    loopback_reset(&config);
+    loopback_queueResponse(200, "OK", expected.data(), expected.size(), 1);
+
+    get("http://example.com/path");
+
+    BOOST_CHECK_EQUAL(result.body, expected);
+    BOOST_CHECK_EQUAL(result.error, http_complete);
+}
+
+BOOST_AUTO_TEST_CASE(RequestLine_SeenByPeer)
+{
+    loopback_reset(&config);
+    loopback_queueResponse(200, "OK", NULL, 0, 0);
+
+    get("http://example.com/some/path");
+
+    size_t size;
+    const char* head = loopback_lastRequest(&size);
+    std::string requestLine("GET /some/path HTTP/1.1\r\n");
+    BOOST_REQUIRE_GE(size, requestLine.size());
+    BOOST_CHECK_EQUAL(std::string(head, requestLine.size()), requestLine);
+}
+
+BOOST_AUTO_TEST_CASE(EmptyScript_NetError)
+{
+    loopback_reset(&config);
+
+    get("http://example.com/path");
+
+    BOOST_CHECK_EQUAL(result.error, http_error);
+}
+
+BOOST_AUTO_TEST_CASE(RefusedConnection_NetError)
+{
+    loopback_reset(&config);
+    loopback_refuseConnections(1);
+    loopback_queueResponse(200, "OK", NULL, 0, 0);
+
+    get("http://example.com/path");
+
+    // reported once, without writing on the connection
+    BOOST_CHECK_EQUAL(result.error, http_error);
+    BOOST_CHECK_EQUAL(result.calls, 1);
+    BOOST_CHECK_EQUAL(loopback_stats().writes, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Timer_FiresOnVirtualClock)
+{
+    loopback_reset(&config);
+    std::vector<uint64_t> fired;
+    NetTimer timer;
+    net_initTimer(&timer, &fired, timerCallback);
+    net_asyncWait(&timer, 500);
+    // waiting again replaces the first wait
+    net_asyncWait(&timer, 300);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(fired.size(), 1u);
+    BOOST_CHECK_EQUAL(fired[0], 300u);
+
+    net_asyncWait(&timer, 100);
+    net_cancelWait(&timer);
+    loopback_run();
+    BOOST_CHECK_EQUAL(fired.size(), 1u);
+
+    // a destroyed timer never fires and can be initialized again
+    net_asyncWait(&timer, 100);
+    net_destroyTimer(&timer);
+    loopback_run();
+    BOOST_CHECK_EQUAL(fired.size(), 1u);
+    net_initTimer(&timer, &fired, timerCallback);
+    net_asyncWait(&timer, 100);
+    loopback_run();
+    BOOST_CHECK_EQUAL(fired.size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(Timer_EventPoolExhausted_Dropped)
+{
+    loopback_reset(&config);
+    std::vector<uint64_t> fired;
+    std::vector<NetTimer> timers(LOOPBACK_MAX_EVENTS + 1);
+    for(size_t i = 0; i < timers.size(); ++i)
+    {
+        net_initTimer(&timers[i], &fired, timerCallback);
+        net_asyncWait(&timers[i], 100);
+    }
+    BOOST_CHECK_EQUAL(loopback_stats().droppedEvents, 1u);
+    loopback_run();
+    BOOST_CHECK_EQUAL(fired.size(), size_t(LOOPBACK_MAX_EVENTS));
+}
+
+BOOST_AUTO_TEST_CASE(Latency_AddsUpOnVirtualClock)
+{
+    config.connectLatency = 1000;
+    config.writeLatency = 10;
+    config.responseLatency = 500;
+    config.readLatency = 1;
+    config.minRead = 4;
+    config.maxRead = 4;
+    loopback_reset(&config);
+    loopback_queueResponse(200, "OK", "abcd", 4, 0);
+
+    get("http://example.com/path");
+
+    // connect, head write, response, then one more microsecond for each of the 10 extra reads of the 42 bytes
+    BOOST_CHECK_EQUAL(loopback_now(), 1000 + 10 + 500 + 10);
+    BOOST_CHECK_EQUAL(net_time(), loopback_now());
+}
+
+BOOST_AUTO_TEST_CASE(SensorCloudUpload_AuthenticatesThenUploads)
+{
+    config.minRead = 1;
+    config.maxRead = 16;
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", 1);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+
+    SensorCloudResult sensorResult = {sensorCloud_netError, 0};
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", &sensorResult);
+    char pointData[16 + 12 * 4];
+    SensorCloudPointBuffer points;
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+    for(int i = 0; i < 4; ++i)
+        sensorCloud_addPoint(&points, i, 1.0f);
+
+    sensorCloud_asyncUploadData(&sensorCloud, "sensor", "channel", &points, sensorCloudCallback);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(sensorResult.calls, 1);
+    BOOST_CHECK_EQUAL(sensorResult.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 2);
+}
+
+BOOST_AUTO_TEST_CASE(SensorCloudUpload_MissingSensorAddedAndRetried)
+{
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_queueResponse(404, "Not Found", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+
+    SensorCloudResult sensorResult = {sensorCloud_netError, 0};
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", &sensorResult);
+    char pointData[16 + 12];
+    SensorCloudPointBuffer points;
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+    sensorCloud_addPoint(&points, 0, 1.0f);
+
+    sensorCloud_asyncUploadData(&sensorCloud, "sensor", "channel", &points, sensorCloudCallback);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(sensorResult.calls, 1);
+    BOOST_CHECK_EQUAL(sensorResult.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,210 @@
+#include <net/resolver_cache.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <thread>
+
+namespace asio = boost::asio;
+
+namespace
+{
+
+struct StubLookup
+{
+    int calls;
+    bool deferred;
+    boost::system::error_code error;
+    ResolverCache::Endpoints endpoints;
+    std::vector<ResolverCache::Handler> pending;
+
+    StubLookup() : calls(0), deferred(false)
+    {
+        endpoints.push_back(asio::ip::tcp::endpoint(asio::ip::address::from_string("127.0.0.1"), 80));
+    }
+
+    void operator()(const std::string&, const std::string&, ResolverCache::Handler handler)
+    {
+        ++calls;
+        if(deferred)
+            pending.push_back(handler);
+        else
+            handler(error, endpoints);
+    }
+
+    void complete()
+    {
+        for(auto& handler : pending)
+            handler(error, endpoints);
+        pending.clear();
+    }
+};
+
+struct Result
+{
+    int calls;
+    boost::system::error_code error;
+    ResolverCache::Endpoints endpoints;
+
+    Result() : calls(0) {}
+
+    void operator()(const boost::system::error_code& e, const ResolverCache::Endpoints& ep)
+    {
+        ++calls;
+        error = e;
+        endpoints = ep;
+    }
+};
+
+ResolverCache::Handler capture(Result& result)
+{
+    return std::ref(result);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(ResolverCacheTest)
+
+BOOST_AUTO_TEST_CASE(SecondLookup_Hit)
+{
+    StubLookup stub;
+    ResolverCache cache(std::ref(stub));
+    Result first;
+    Result second;
+
+    cache.asyncResolve("example.com", "https", capture(first));
+    cache.asyncResolve("example.com", "https", capture(second));
+
+    BOOST_CHECK_EQUAL(stub.calls, 1);
+    BOOST_CHECK_EQUAL(second.calls, 1);
+    BOOST_CHECK(second.endpoints == stub.endpoints);
+    BOOST_CHECK_EQUAL(cache.stats().hits, 1);
+    BOOST_CHECK_EQUAL(cache.stats().misses, 1);
+    BOOST_CHECK_CLOSE(cache.stats().hitRate(), 50.0 / 100.0, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(SecondLookup_HitPosted)
+{
+    StubLookup stub;
+    std::vector<std::function<void()>> posted;
+    ResolverCache cache(std::ref(stub), [&](std::function<void()> handler) { posted.push_back(handler); });
+    Result first;
+    Result second;
+
+    cache.asyncResolve("example.com", "https", capture(first));
+    cache.asyncResolve("example.com", "https", capture(second));
+    // only the cached answer waits to be run
+    BOOST_CHECK_EQUAL(first.calls, 1);
+    BOOST_CHECK_EQUAL(second.calls, 0);
+    BOOST_REQUIRE_EQUAL(posted.size(), 1u);
+    posted[0]();
+    BOOST_CHECK_EQUAL(second.calls, 1);
+    BOOST_CHECK(second.endpoints == stub.endpoints);
+}
+
+BOOST_AUTO_TEST_CASE(DifferentService_Miss)
+{
+    StubLookup stub;
+    ResolverCache cache(std::ref(stub));
+    Result result;
+
+    cache.asyncResolve("example.com", "http", capture(result));
+    cache.asyncResolve("example.com", "https", capture(result));
+
+    BOOST_CHECK_EQUAL(stub.calls, 2);
+}
+
+BOOST_AUTO_TEST_CASE(Failure_NegativelyCached)
+{
+    StubLookup stub;
+    stub.error = asio::error::host_not_found;
+    ResolverCache cache(std::ref(stub));
+    Result result;
+
+    cache.asyncResolve("missing.example.com", "https", capture(result));
+    cache.asyncResolve("missing.example.com", "https", capture(result));
+
+    BOOST_CHECK_EQUAL(stub.calls, 1);
+    BOOST_CHECK_EQUAL(result.calls, 2);
+    BOOST_CHECK(result.error == asio::error::host_not_found);
+    BOOST_CHECK_EQUAL(cache.stats().negativeHits, 1);
+}
+
+BOOST_AUTO_TEST_CASE(Expired_LookedUpAgain)
+{
+    StubLookup stub;
+    ResolverCache cache(std::ref(stub), std::chrono::seconds(0), std::chrono::seconds(0));
+    Result result;
+
+    cache.asyncResolve("example.com", "https", capture(result));
+    cache.asyncResolve("example.com", "https", capture(result));
+
+    BOOST_CHECK_EQUAL(stub.calls, 2);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentLookups_Coalesced)
+{
+    StubLookup stub;
+    stub.deferred = true;
+    ResolverCache cache(std::ref(stub));
+    Result first;
+    Result second;
+
+    cache.asyncResolve("example.com", "https", capture(first));
+    cache.asyncResolve("example.com", "https", capture(second));
+    BOOST_CHECK_EQUAL(first.calls, 0);
+    stub.complete();
+
+    BOOST_CHECK_EQUAL(stub.calls, 1);
+    BOOST_CHECK_EQUAL(first.calls, 1);
+    BOOST_CHECK_EQUAL(second.calls, 1);
+    BOOST_CHECK_EQUAL(cache.stats().coalesced, 1);
+}
+
+BOOST_AUTO_TEST_CASE(Interleave_StartsWithIPv6AndAlternates)
+{
+    ResolverCache::Endpoints endpoints;
+    endpoints.push_back(asio::ip::tcp::endpoint(asio::ip::address::from_string("10.0.0.1"), 443));
+    endpoints.push_back(asio::ip::tcp::endpoint(asio::ip::address::from_string("10.0.0.2"), 443));
+    endpoints.push_back(asio::ip::tcp::endpoint(asio::ip::address::from_string("::1"), 443));
+
+    ResolverCache::Endpoints ordered = interleaveAddressFamilies(endpoints);
+
+    BOOST_REQUIRE_EQUAL(ordered.size(), 3);
+    BOOST_CHECK(ordered[0].address().is_v6());
+    BOOST_CHECK_EQUAL(ordered[1].address().to_string(), "10.0.0.1");
+    BOOST_CHECK_EQUAL(ordered[2].address().to_string(), "10.0.0.2");
+}
+
+BOOST_AUTO_TEST_CASE(HostsFile_LocalhostResolvedOnce)
+{
+    asio::io_service ioService;
+    asio::ip::tcp::resolver resolver(ioService);
+    int lookups = 0;
+    ResolverCache cache([&](const std::string& hostname, const std::string& service, ResolverCache::Handler handler)
+    {
+        ++lookups;
+        resolver.async_resolve(asio::ip::tcp::resolver::query(hostname, service),
+            [handler](const boost::system::error_code& error, asio::ip::tcp::resolver::iterator i)
+            {
+                ResolverCache::Endpoints endpoints;
+                for(; i != asio::ip::tcp::resolver::iterator(); ++i)
+                    endpoints.push_back(i->endpoint());
+                handler(error, endpoints);
+            });
+    });
+    Result first;
+    Result second;
+
+    cache.asyncResolve("localhost", "80", capture(first));
+    ioService.run();
+    cache.asyncResolve("localhost", "80", capture(second));
+
+    BOOST_CHECK_EQUAL(lookups, 1);
+    BOOST_CHECK(!first.error);
+    BOOST_REQUIRE(!first.endpoints.empty());
+    BOOST_CHECK(first.endpoints.front().address().is_loopback());
+    BOOST_CHECK(second.endpoints == first.endpoints);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
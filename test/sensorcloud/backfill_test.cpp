@@ -0,0 +1,126 @@
+#include "fixture.h"
+
+#include <sensorcloud/backfill.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace
+{
+
+const size_t pointCount = 100;
+const size_t slotCount = 4;
+const char garbage[] = "not http\r\n\r\n";
+
+void progressCallback(void* userData, SensorCloudBackfill* backfill)
+{
+    static_cast<std::vector<size_t>*>(userData)->push_back(backfill->running ? backfill->resumePoint : ~size_t(0));
+}
+
+struct Fixture : EngineFixture<slotCount>
+{
+    char pointData[16 + 12 * pointCount];
+    SensorCloudPointBuffer points;
+    SensorCloudBackfillRange ranges[slotCount];
+    SensorCloudBackfill backfill;
+    std::vector<size_t> progress;
+
+    Fixture()
+    {
+        respondCreated();
+        initEngine();
+        sensorCloudEngine_setMaxPoints(&engine, 10);
+
+        SensorCloudSampleRate rate;
+        rate.value = 1;
+        rate.type = sensorCloud_hertz;
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        for(size_t i = 0; i < pointCount; ++i)
+            sensorCloud_addPoint(&points, 1000000000ull * i, float(i));
+
+        sensorCloudBackfill_init(&backfill, &engine, ranges, slotCount, 0, progressCallback, &progress);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudBackfillTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Start_RangesConcurrent)
+{
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, 0), 0);
+    BOOST_CHECK(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, 0) != 0);
+    loopback_run();
+
+    BOOST_CHECK(!backfill.running);
+    BOOST_CHECK_EQUAL(backfill.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(backfill.resumePoint, pointCount);
+    BOOST_CHECK_EQUAL(backfill.rangesUploaded, pointCount / 10);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, pointCount / 10 + 1);
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, slotCount);
+    BOOST_REQUIRE(!progress.empty());
+    BOOST_CHECK_EQUAL(progress.back(), ~size_t(0));
+    for(size_t i = 1; i + 1 < progress.size(); ++i)
+        BOOST_CHECK(progress[i] > progress[i - 1]);
+}
+
+BOOST_AUTO_TEST_CASE(Start_Resume)
+{
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, 65), 0);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(backfill.resumePoint, pointCount);
+    BOOST_CHECK_EQUAL(backfill.rangesUploaded, 4u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 5u);
+}
+
+BOOST_AUTO_TEST_CASE(Start_NothingLeft)
+{
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, pointCount), 0);
+    BOOST_CHECK(!backfill.running);
+    BOOST_REQUIRE_EQUAL(progress.size(), 1u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Range_RetriedAlone)
+{
+    // the second upload is answered with something that isn't HTTP
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueRawResponse(garbage, sizeof(garbage) - 1);
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, 0), 0);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(backfill.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(backfill.resumePoint, pointCount);
+    BOOST_CHECK_EQUAL(backfill.retries, 1u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, pointCount / 10 + 2);
+}
+
+BOOST_AUTO_TEST_CASE(Range_Rejected)
+{
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(400, "Bad Request", NULL, 0, 0);
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, 0), 0);
+    loopback_run();
+
+    // the first two ranges made room for two more before the third was rejected, those running finish and the
+    // resume point stops before the rejected one
+    BOOST_CHECK(!backfill.running);
+    BOOST_CHECK_EQUAL(backfill.error, sensorCloud_badRequest);
+    BOOST_CHECK_EQUAL(backfill.resumePoint, 20u);
+    BOOST_CHECK_EQUAL(backfill.retries, 0u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, slotCount + 2 + 1);
+    BOOST_CHECK_EQUAL(progress.back(), ~size_t(0));
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 0u);
+
+    // a restart picks up at the resume point
+    progress.clear();
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "probe", "temp", &points, backfill.resumePoint), 0);
+    loopback_run();
+    BOOST_CHECK_EQUAL(backfill.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(backfill.resumePoint, pointCount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
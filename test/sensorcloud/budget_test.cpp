@@ -0,0 +1,163 @@
+#include <sensorcloud/budget.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace
+{
+
+const size_t capacity = 4;
+// the headers of two point buffers and a few points
+const size_t cap = 2 * 16 + 6 * 12;
+
+void pressureCallback(void* userData, SensorCloudBudgetPressure pressure)
+{
+    static_cast<std::vector<SensorCloudBudgetPressure>*>(userData)->push_back(pressure);
+}
+
+struct Fixture
+{
+    SensorCloudSampleRate rate;
+    char pointData[2][16 + 12 * capacity];
+    SensorCloudPointBuffer points[2];
+    SensorCloudBudgetChannel channels[2];
+    SensorCloudBudget budget;
+    std::vector<SensorCloudBudgetPressure> pressures;
+
+    Fixture()
+    {
+        rate.value = 1;
+        rate.type = sensorCloud_hertz;
+        for(size_t i = 0; i < 2; ++i)
+            sensorCloud_initPointBuffer(&points[i], pointData[i], sizeof(pointData[i]), rate);
+        sensorCloudBudget_init(&budget, cap, cap - 3 * 12, cap - 6 * 12, pressureCallback, &pressures);
+    }
+
+    std::vector<Timestamp> times(size_t channel)
+    {
+        Timestamp result[capacity];
+        float values[capacity];
+        SensorCloudPointDecoder decoder;
+        sensorCloud_initPointDecoder(&decoder, result, values, capacity);
+        sensorCloud_decodePoints(&decoder, points[channel].data.getPtr + 16, buffer_size(&points[channel].data) - 16);
+        return std::vector<Timestamp>(result, result + decoder.count);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudBudgetTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Pressure_Hysteresis)
+{
+    sensorCloudBudget_addChannel(&budget, &channels[0], &points[0], sensorCloudBudget_dropNewest);
+    sensorCloudBudget_addChannel(&budget, &channels[1], &points[1], sensorCloudBudget_dropNewest);
+    BOOST_CHECK_EQUAL(sensorCloudBudget_used(&budget), 32u);
+
+    sensorCloudBudget_charge(&budget, sensorCloudBudget_inFlight, 3 * 12);
+    BOOST_CHECK_EQUAL(budget.pressure, sensorCloudBudget_high);
+    sensorCloudBudget_charge(&budget, sensorCloudBudget_spooled, 3 * 12);
+    BOOST_CHECK_EQUAL(budget.pressure, sensorCloudBudget_full);
+    sensorCloudBudget_release(&budget, sensorCloudBudget_spooled, 3 * 12);
+    sensorCloudBudget_release(&budget, sensorCloudBudget_inFlight, 2 * 12);
+    // between the watermarks
+    BOOST_CHECK_EQUAL(budget.pressure, sensorCloudBudget_high);
+    sensorCloudBudget_release(&budget, sensorCloudBudget_inFlight, 12);
+    BOOST_CHECK_EQUAL(budget.pressure, sensorCloudBudget_normal);
+
+    BOOST_REQUIRE_EQUAL(pressures.size(), 4u);
+    BOOST_CHECK_EQUAL(pressures[0], sensorCloudBudget_high);
+    BOOST_CHECK_EQUAL(pressures[1], sensorCloudBudget_full);
+    BOOST_CHECK_EQUAL(pressures[2], sensorCloudBudget_high);
+    BOOST_CHECK_EQUAL(pressures[3], sensorCloudBudget_normal);
+    BOOST_CHECK_EQUAL(budget.peak, cap);
+}
+
+BOOST_AUTO_TEST_CASE(DropOldest_KeepsLatest)
+{
+    sensorCloudBudget_addChannel(&budget, &channels[0], &points[0], sensorCloudBudget_dropOldest);
+    for(Timestamp time = 0; time < 6; ++time)
+        BOOST_CHECK_EQUAL(sensorCloudBudget_addPoint(&budget, &channels[0], time, 1.0f), 0);
+
+    // the point buffer filled up before the budget did
+    std::vector<Timestamp> kept = times(0);
+    BOOST_REQUIRE_EQUAL(kept.size(), capacity);
+    BOOST_CHECK_EQUAL(kept[0], 2u);
+    BOOST_CHECK_EQUAL(kept[3], 5u);
+    BOOST_CHECK_EQUAL(channels[0].droppedOldest, 2u);
+    BOOST_CHECK_EQUAL(sensorCloudBudget_used(&budget), 16u + capacity * 12);
+}
+
+BOOST_AUTO_TEST_CASE(DropNewest_UnderCap)
+{
+    sensorCloudBudget_addChannel(&budget, &channels[0], &points[0], sensorCloudBudget_dropNewest);
+    sensorCloudBudget_addChannel(&budget, &channels[1], &points[1], sensorCloudBudget_dropNewest);
+    size_t added = 0;
+    for(Timestamp time = 0; time < 20; ++time)
+    {
+        if(sensorCloudBudget_addPoint(&budget, &channels[time % 2], time, 1.0f) == 0)
+            ++added;
+        BOOST_CHECK(sensorCloudBudget_used(&budget) <= cap);
+    }
+    // up to the high watermark, then nothing more
+    BOOST_CHECK_EQUAL(added, 3u);
+    BOOST_CHECK_EQUAL(channels[0].droppedNewest + channels[1].droppedNewest, 17u);
+}
+
+BOOST_AUTO_TEST_CASE(Decimate_UnderPressure)
+{
+    sensorCloudBudget_addChannel(&budget, &channels[0], &points[0], sensorCloudBudget_decimate);
+    sensorCloudBudget_setDecimation(&channels[0], 3);
+    sensorCloudBudget_charge(&budget, sensorCloudBudget_inFlight, budget.highWatermark - 16);
+    BOOST_REQUIRE_EQUAL(budget.pressure, sensorCloudBudget_high);
+
+    for(Timestamp time = 0; time < 9; ++time)
+        sensorCloudBudget_addPoint(&budget, &channels[0], time, 1.0f);
+    std::vector<Timestamp> kept = times(0);
+    BOOST_REQUIRE_EQUAL(kept.size(), 3u);
+    BOOST_CHECK_EQUAL(kept[0], 0u);
+    BOOST_CHECK_EQUAL(kept[1], 3u);
+    BOOST_CHECK_EQUAL(kept[2], 6u);
+    BOOST_CHECK_EQUAL(channels[0].decimated, 6u);
+}
+
+BOOST_AUTO_TEST_CASE(Rollup_WhileUnderPressure)
+{
+    char outputData[16 + 12 * capacity];
+    SensorCloudPointBuffer output;
+    sensorCloud_initPointBuffer(&output, outputData, sizeof(outputData), rate);
+    SensorCloudPointBuffer* outputs[sensorCloudRollup_statCount] = {NULL, NULL, &output, NULL, NULL};
+    SensorCloudRollup rollup;
+    sensorCloudRollup_init(&rollup, 10, outputs);
+
+    sensorCloudBudget_addChannel(&budget, &channels[0], &points[0], sensorCloudBudget_rollup);
+    sensorCloudBudget_setRollup(&channels[0], &rollup);
+    sensorCloudBudget_charge(&budget, sensorCloudBudget_inFlight, budget.highWatermark - 16);
+    BOOST_REQUIRE_EQUAL(budget.pressure, sensorCloudBudget_high);
+    for(Timestamp time = 0; time < 4; ++time)
+        BOOST_CHECK(sensorCloudBudget_addPoint(&budget, &channels[0], time, float(time)) != 0);
+    BOOST_CHECK_EQUAL(channels[0].rolledUp, 4u);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&points[0]), 0u);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&output), 0u);
+
+    // the summary comes out once the pressure is gone, and points are kept again
+    sensorCloudBudget_release(&budget, sensorCloudBudget_inFlight, budget.highWatermark - 16);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&output), 1u);
+    BOOST_CHECK_EQUAL(sensorCloudBudget_addPoint(&budget, &channels[0], 4, 4.0f), 0);
+}
+
+BOOST_AUTO_TEST_CASE(Sync_AfterUpload)
+{
+    sensorCloudBudget_addChannel(&budget, &channels[0], &points[0], sensorCloudBudget_dropNewest);
+    for(Timestamp time = 0; time < 3; ++time)
+        sensorCloudBudget_addPoint(&budget, &channels[0], time, 1.0f);
+
+    // the buffer goes out as a body and starts over
+    sensorCloudBudget_charge(&budget, sensorCloudBudget_inFlight, buffer_size(&points[0].data));
+    sensorCloud_initPointBuffer(&points[0], pointData[0], sizeof(pointData[0]), rate);
+    sensorCloudBudget_sync(&budget, &channels[0]);
+    BOOST_CHECK_EQUAL(sensorCloudBudget_used(&budget), 16u + 16 + 3 * 12);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
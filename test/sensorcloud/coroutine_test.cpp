@@ -0,0 +1,172 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud/coroutine.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <vector>
+
+#if __cplusplus >= 202002L
+
+namespace
+{
+
+const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+
+// hands out frames from a fixed block and counts them
+struct FramePool
+{
+    alignas(std::max_align_t) char memory[4096];
+    size_t used;
+    int frames;
+    int freed;
+
+    FramePool() : used(0), frames(0), freed(0) {}
+
+    static void* allocate(size_t size, void* userData)
+    {
+        FramePool* pool = static_cast<FramePool*>(userData);
+        size = (size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+        if(pool->used + size > sizeof(pool->memory))
+            return nullptr;
+        void* frame = pool->memory + pool->used;
+        pool->used += size;
+        ++pool->frames;
+        return frame;
+    }
+
+    static void deallocate(void*, size_t, void* userData)
+    {
+        ++static_cast<FramePool*>(userData)->freed;
+    }
+};
+
+struct Result
+{
+    std::vector<SensorCloudError> errors;
+    bool done = false;
+};
+
+SensorCloudTask uploadTwice(SensorCloud* sensorCloud, SensorCloudPointBuffer* points, Result* result)
+{
+    result->errors.push_back(co_await SensorCloudAuthenticate(sensorCloud));
+    result->errors.push_back(co_await SensorCloudUpload(sensorCloud, "sensor", "channel", points));
+    result->errors.push_back(co_await SensorCloudUpload(sensorCloud, "sensor", "channel", points));
+    result->done = true;
+}
+
+SensorCloudTask submit(SensorCloudEngine* engine, SensorCloudPointBuffer* points, const char* channel,
+    Result* result)
+{
+    SensorCloudSubmission submission;
+    sensorCloudEngine_initSubmission(&submission, "sensor", channel, points, nullptr);
+    result->errors.push_back(co_await SensorCloudSubmit(engine, &submission));
+    result->done = true;
+}
+
+SensorCloudTask get(HTTPRequest* request, Buffer* responseBody, Result* result, HTTPError* error)
+{
+    Buffer body;
+    buffer_init(&body, nullptr, 0);
+    *error = co_await HTTPRequestOperation(request, body, responseBody);
+    result->done = true;
+}
+
+struct Fixture
+{
+    LoopbackConfig config;
+    char pointData[16 + 12];
+    SensorCloudPointBuffer points;
+
+    Fixture()
+    {
+        loopback_defaultConfig(&config);
+        config.responseLatency = 1000;
+        loopback_reset(&config);
+        loopback_setDefaultResponse(created, sizeof(created) - 1);
+
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        sensorCloud_addPoint(&points, 1, 1.0f);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudCoroutineTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Upload_Sequential)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", nullptr);
+    FramePool pool;
+    SensorCloudFrameAllocator allocator = {&FramePool::allocate, &FramePool::deallocate, &pool};
+    Result result;
+    sensorCloudFrameAllocator = &allocator;
+    uploadTwice(&sensorCloud, &points, &result);
+    sensorCloudFrameAllocator = nullptr;
+    BOOST_CHECK(!result.done);
+    loopback_run();
+
+    BOOST_REQUIRE(result.done);
+    BOOST_REQUIRE_EQUAL(result.errors.size(), 3u);
+    for(size_t i = 0; i < result.errors.size(); ++i)
+        BOOST_CHECK_EQUAL(result.errors[i], sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 3u);
+    BOOST_CHECK_EQUAL(pool.frames, 1);
+    BOOST_CHECK_EQUAL(pool.freed, 1);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_Concurrent)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", nullptr);
+    SensorCloudEngineSlot slots[4];
+    SensorCloudEngine engine;
+    sensorCloudEngine_init(&engine, &sensorCloud, slots, 4, &SensorCloudSubmit::callback, nullptr);
+
+    const char* channels[] = {"a", "b", "c", "d", "e", "f"};
+    Result results[6];
+    for(size_t i = 0; i < 6; ++i)
+        submit(&engine, &points, channels[i], &results[i]);
+    loopback_run();
+
+    for(size_t i = 0; i < 6; ++i)
+    {
+        BOOST_REQUIRE(results[i].done);
+        BOOST_CHECK_EQUAL(results[i].errors[0], sensorCloud_ok);
+    }
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, 4u);
+}
+
+BOOST_AUTO_TEST_CASE(Request_Body)
+{
+    loopback_queueResponse(200, "OK", "hello", 5, 1);
+    HTTPRequest request;
+    char head[512];
+    Buffer requestHead;
+    buffer_init(&requestHead, head, 256);
+    Buffer responseHead;
+    buffer_init(&responseHead, head + 256, 256);
+    BOOST_REQUIRE_EQUAL(http_initRequest(&request, "GET", "http://example.com/", requestHead, responseHead, nullptr,
+        nullptr), http_ok);
+
+    char bodyData[16];
+    Buffer responseBody;
+    buffer_init(&responseBody, bodyData, sizeof(bodyData));
+    Result result;
+    HTTPError error = http_ok;
+    get(&request, &responseBody, &result, &error);
+    loopback_run();
+
+    BOOST_REQUIRE(result.done);
+    BOOST_CHECK_EQUAL(error, http_complete);
+    BOOST_REQUIRE_EQUAL(buffer_size(&responseBody), 5u);
+    BOOST_CHECK(std::memcmp(responseBody.getPtr, "hello", 5) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif
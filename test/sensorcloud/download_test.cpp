@@ -0,0 +1,160 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud.h>
+#include <xdr/xdr.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+namespace
+{
+
+const size_t pointCount = 100;
+
+struct DownloadResult
+{
+    SensorCloudError error;
+    int calls;
+};
+
+void downloadCallback(void* userData, SensorCloudError error)
+{
+    DownloadResult* result = static_cast<DownloadResult*>(userData);
+    result->error = error;
+    ++result->calls;
+}
+
+struct Fixture
+{
+    char body[12 * pointCount];
+    Timestamp times[pointCount];
+    float values[pointCount];
+    SensorCloudPointDecoder decoder;
+    DownloadResult result;
+    SensorCloud sensorCloud;
+
+    Fixture()
+    {
+        Buffer buffer;
+        buffer_init(&buffer, body, sizeof(body));
+        for(size_t i = 0; i < pointCount; ++i)
+        {
+            xdr_writeUHyper(&buffer, 1000000000000ull + i);
+            xdr_writeFloat(&buffer, float(i) / 4);
+        }
+        sensorCloud_initPointDecoder(&decoder, times, values, pointCount);
+        result.error = sensorCloud_badRequest;
+        result.calls = 0;
+        sensorCloud_init(&sensorCloud, "device", "key", &result);
+    }
+
+    void checkPoints(size_t count)
+    {
+        BOOST_REQUIRE_EQUAL(decoder.count, count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            BOOST_CHECK_EQUAL(times[i], 1000000000000ull + i);
+            BOOST_CHECK_EQUAL(values[i], float(i) / 4);
+        }
+    }
+
+    void download(size_t minRead, size_t maxRead)
+    {
+        LoopbackConfig config;
+        loopback_defaultConfig(&config);
+        config.minRead = minRead;
+        config.maxRead = maxRead;
+        loopback_reset(&config);
+        loopback_queueAuthResponse("token", "upload.example.com", 0);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudDownloadTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Decode_ByteAtATime)
+{
+    size_t decoded = 0;
+    for(size_t i = 0; i < sizeof(body); ++i)
+        decoded += sensorCloud_decodePoints(&decoder, body + i, 1);
+    BOOST_CHECK_EQUAL(decoded, pointCount);
+    BOOST_CHECK_EQUAL(decoder.partialSize, 0u);
+    checkPoints(pointCount);
+}
+
+BOOST_AUTO_TEST_CASE(Decode_UnevenFragments)
+{
+    size_t sizes[] = {5, 12, 31, 100, 1, 251};
+    size_t offset = 0;
+    for(size_t i = 0; offset < sizeof(body); i = (i + 1) % 6)
+    {
+        size_t size = std::min(sizes[i], sizeof(body) - offset);
+        sensorCloud_decodePoints(&decoder, body + offset, size);
+        offset += size;
+    }
+    checkPoints(pointCount);
+}
+
+BOOST_AUTO_TEST_CASE(Decode_Full_Dropped)
+{
+    sensorCloud_initPointDecoder(&decoder, times, values, 10);
+    BOOST_CHECK_EQUAL(sensorCloud_decodePoints(&decoder, body, sizeof(body)), pointCount);
+    checkPoints(10);
+    BOOST_CHECK_EQUAL(decoder.dropped, pointCount - 10);
+}
+
+BOOST_AUTO_TEST_CASE(Download_ChunkedFragmented)
+{
+    download(1, 31);
+    loopback_queueResponse(200, "OK", body, sizeof(body), 1);
+    sensorCloud_asyncDownloadData(&sensorCloud, "sensor", "channel", 1000, 2000, &decoder, downloadCallback);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.calls, 1);
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_ok);
+    checkPoints(pointCount);
+    size_t size;
+    std::string head(loopback_lastRequest(&size));
+    head.resize(size);
+    BOOST_CHECK(head.find("GET /SensorCloud/devices/device/sensors/sensor/channels/channel/streams/timeseries/data/"
+        "?version=1&auth_token=token&starttime=1000&endtime=2000 ") == 0);
+    BOOST_CHECK(head.find("Accept: application/xdr\r\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Download_TooManyPoints)
+{
+    download(1, 64);
+    loopback_queueResponse(200, "OK", body, sizeof(body), 0);
+    sensorCloud_initPointDecoder(&decoder, times, values, 10);
+    sensorCloud_asyncDownloadData(&sensorCloud, "sensor", "channel", 0, 1, &decoder, downloadCallback);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_tooManyPoints);
+    checkPoints(10);
+}
+
+BOOST_AUTO_TEST_CASE(Download_Truncated)
+{
+    download(1, 64);
+    loopback_queueResponse(200, "OK", body, sizeof(body) - 5, 0);
+    sensorCloud_asyncDownloadData(&sensorCloud, "sensor", "channel", 0, 1, &decoder, downloadCallback);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_netError);
+    checkPoints(pointCount - 1);
+}
+
+BOOST_AUTO_TEST_CASE(Download_NotFound_BodyIgnored)
+{
+    download(1, 64);
+    loopback_queueResponse(404, "Not Found", "no such channel", 15, 0);
+    sensorCloud_asyncDownloadData(&sensorCloud, "sensor", "channel", 0, 1, &decoder, downloadCallback);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_notFound);
+    BOOST_CHECK_EQUAL(decoder.count, 0u);
+    BOOST_CHECK_EQUAL(decoder.partialSize, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
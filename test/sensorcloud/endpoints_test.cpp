@@ -0,0 +1,189 @@
+#include "fixture.h"
+
+#include <sensorcloud/endpoints.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+namespace
+{
+
+const size_t pointCount = 4;
+const uint64_t second = 1000000;
+
+struct Fixture : EngineFixture<1>
+{
+    SensorCloudEndpoints endpoints;
+    SensorCloudRetry retry;
+    char pointData[16 + 12 * pointCount];
+    SensorCloudPointBuffer points;
+    SensorCloudSubmission uploads[4];
+    size_t uploadCount;
+
+    // the endpoints are only added by the tests, the engine picks them as it goes
+    Fixture() :
+    uploadCount(0)
+    {
+        sensorCloudEndpoints_init(&endpoints, 1, 10 * second);
+        respondCreated();
+        sensorCloud_setEndpoints(&sensorCloud, &endpoints);
+        initEngine();
+        sensorCloudRetry_init(&retry, 0, second, 1);
+        sensorCloudEngine_setRetry(&engine, &retry);
+
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        for(size_t i = 0; i < pointCount; ++i)
+            sensorCloud_addPoint(&points, i, float(i));
+    }
+
+    void submit()
+    {
+        SensorCloudSubmission* upload = &uploads[uploadCount++];
+        sensorCloudEngine_initSubmission(upload, "sensor", "channel", &points, NULL);
+        sensorCloudEngine_submit(&engine, upload);
+    }
+
+    std::string lastHost()
+    {
+        size_t size;
+        const char* data = loopback_lastRequest(&size);
+        std::string head(data, size);
+        size_t start = head.find("Host: ") + 6;
+        return head.substr(start, head.find("\r\n", start) - start);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudEndpointsTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Select_NoEndpoints)
+{
+    BOOST_CHECK(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload) == NULL);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_auth, "auth.example.com"), 0);
+    BOOST_CHECK(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload) == NULL);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_auth), "auth.example.com");
+}
+
+BOOST_AUTO_TEST_CASE(Select_UnmeasuredFirst_ThenFastest)
+{
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "a");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "b");
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "a");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "a", 0, 1000);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "b");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 0, 500);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "b");
+
+    // b slows down until a is faster
+    for(int i = 0; i < 8; ++i)
+        sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 0, 2000);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "a");
+    BOOST_CHECK_EQUAL(endpoints.failovers, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Select_ErrorRateStretchesRtt)
+{
+    sensorCloudEndpoints_init(&endpoints, 3, second);
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "a");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "b");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "a", 0, 1000);
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 0, 800);
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 1, 0);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "b");
+    // still up, but the retries it takes make it slower than a
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 1, 0);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "a");
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_upload][1].downUntil, 0u);
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_upload][1].errors, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(Failover_DownUntilCooldown)
+{
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "a");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "b");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "a", 0, 100);
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 0, 500);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "a");
+
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "a", 1, 0);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "b");
+    BOOST_CHECK_EQUAL(endpoints.failovers, 1u);
+    loopback_runUntil(10 * second);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "a");
+}
+
+BOOST_AUTO_TEST_CASE(Failover_DeadEndpointNotPreferredAfterCooldown)
+{
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "dead");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "live");
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "dead");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "dead", 1, 0);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "live");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "live", 0, 1000);
+
+    // back up after the cooldown, but never having answered it is still the worst pick
+    loopback_runUntil(10 * second);
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_upload][0].downUntil, 10 * second);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "live");
+    // the only one up, it is tried again
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "live", 1, 0);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "dead");
+}
+
+BOOST_AUTO_TEST_CASE(Failover_AllDown_SoonestBack)
+{
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "a");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "b");
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "a", 1, 0);
+    loopback_runUntil(second);
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "b", 1, 0);
+    BOOST_CHECK_EQUAL(sensorCloudEndpoints_select(&endpoints, sensorCloudEndpoint_upload), "a");
+    // hosts that aren't endpoints don't count
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_upload, "c", 1, 0);
+    sensorCloudEndpoints_record(&endpoints, sensorCloudEndpoint_auth, "a", 0, 100);
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_upload][0].requests, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Engine_RetryFailsOverToHealthyEndpoint)
+{
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_auth, "auth.example.com");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "a.example.com");
+    sensorCloudEndpoints_add(&endpoints, sensorCloudEndpoint_upload, "b.example.com");
+    // each endpoint gets measured before either is preferred
+    submit();
+    loopback_run();
+    BOOST_CHECK_EQUAL(lastHost(), "a.example.com");
+    submit();
+    loopback_run();
+    BOOST_CHECK_EQUAL(lastHost(), "b.example.com");
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_auth][0].requests, 1u);
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_upload][0].rtt,
+        endpoints.endpoints[sensorCloudEndpoint_upload][1].rtt);
+
+    // a stops answering, the retry of the upload goes to b
+    loopback_refuseConnections(1);
+    submit();
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(completions[2]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(lastHost(), "b.example.com");
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_connect], 1u);
+    BOOST_CHECK_EQUAL(endpoints.failovers, 1u);
+    BOOST_CHECK_EQUAL(endpoints.endpoints[sensorCloudEndpoint_upload][0].errors, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Authenticate_NoEndpoints_UsesServerFromToken)
+{
+    sensorCloud_setEndpoints(&sensorCloud, NULL);
+    submit();
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(sensorCloud.server, "upload.example.com");
+    BOOST_CHECK_EQUAL(lastHost(), "upload.example.com");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
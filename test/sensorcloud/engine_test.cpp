@@ -0,0 +1,375 @@
+#include "fixture.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const size_t uploads = 8;
+
+struct Chain
+{
+    SensorCloudEngine* engine;
+    SensorCloudSubmission* next;
+    SensorCloudSubmission* end;
+    size_t completed;
+};
+
+// submits the next submission from the completion of the previous one
+void chainCallback(void* userData, SensorCloudSubmission* submission)
+{
+    Chain* chain = static_cast<Chain*>(userData);
+    ++chain->completed;
+    if(chain->next != chain->end)
+        sensorCloudEngine_submit(chain->engine, chain->next++);
+}
+
+struct Fixture : LoopbackFixture
+{
+    SensorCloud sensorCloud;
+    SensorCloudEngine engine;
+    SensorCloudEngineSlot slots[3];
+    SensorCloudPointBuffer points[uploads];
+    char pointData[uploads][16 + 12 * 10];
+    SensorCloudSubmission submissions[uploads];
+    char channels[uploads][16];
+    int tags[uploads];
+    std::vector<SensorCloudSubmission*> completions;
+
+    Fixture() :
+    LoopbackFixture(500, 1000)
+    {
+        sensorCloud_init(&sensorCloud, "device", "key", NULL);
+        sensorCloudEngine_init(&engine, &sensorCloud, slots, 3, completionCallback, &completions);
+    }
+
+    // each submission goes to a channel of its own unless channel is given
+    void submit(size_t count, const char* channel = NULL, size_t pointCount = 1)
+    {
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        for(size_t i = 0; i < count; ++i)
+        {
+            sensorCloud_initPointBuffer(&points[i], pointData[i], sizeof(pointData[i]), rate);
+            for(size_t j = 0; j < pointCount; ++j)
+                sensorCloud_addPoint(&points[i], i * pointCount + j, float(j));
+            std::snprintf(channels[i], sizeof(channels[i]), "channel%u", unsigned(i));
+            tags[i] = int(i);
+            sensorCloudEngine_initSubmission(&submissions[i], "sensor", channel ? channel : channels[i], &points[i],
+                &tags[i]);
+            sensorCloudEngine_submit(&engine, &submissions[i]);
+        }
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudEngineTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Submit_BoundedConcurrency)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(uploads);
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), uploads);
+
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), uploads);
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 0u);
+    for(size_t i = 0; i < uploads; ++i)
+        BOOST_CHECK_EQUAL(completions[i]->error, sensorCloud_ok);
+    // one connection to authenticate, then the uploads on three at once
+    LoopbackStats stats = loopback_stats();
+    BOOST_CHECK_EQUAL(stats.connections, uploads + 1);
+    BOOST_CHECK_EQUAL(stats.maxOpenConnections, 3u);
+    BOOST_CHECK_EQUAL(stats.openConnections, 0u);
+    // three rounds of uploads instead of eight
+    BOOST_CHECK_EQUAL(loopback_now(), 4 * 1500u);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_UserDataPreserved)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(uploads);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), uploads);
+    std::vector<bool> seen(uploads, false);
+    for(size_t i = 0; i < uploads; ++i)
+    {
+        int tag = *static_cast<int*>(completions[i]->userData);
+        BOOST_CHECK(&submissions[tag] == completions[i]);
+        seen[tag] = true;
+    }
+    for(size_t i = 0; i < uploads; ++i)
+        BOOST_CHECK(seen[i]);
+}
+
+BOOST_AUTO_TEST_CASE(Reap_CompletionQueue)
+{
+    sensorCloudEngine_init(&engine, &sensorCloud, slots, 2, NULL, NULL);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(4);
+    BOOST_CHECK(sensorCloudEngine_reap(&engine) == NULL);
+
+    loopback_run();
+    size_t reaped = 0;
+    while(SensorCloudSubmission* submission = sensorCloudEngine_reap(&engine))
+    {
+        BOOST_CHECK_EQUAL(submission->error, sensorCloud_ok);
+        ++reaped;
+    }
+    BOOST_CHECK_EQUAL(reaped, 4u);
+    BOOST_CHECK(completions.empty());
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Upload_SensorNotFound_AddsSensor)
+{
+    sensorCloudEngine_init(&engine, &sensorCloud, slots, 1, completionCallback, &completions);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_queueResponse(404, "Not Found", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    submit(1);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4u);
+}
+
+BOOST_AUTO_TEST_CASE(Upload_QuotaExceeded)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_queueResponse(401, "Quota", NULL, 0, 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(2);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_quotaExceeded);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+}
+
+BOOST_AUTO_TEST_CASE(Authenticate_Failure_FailsQueued)
+{
+    loopback_queueResponse(401, "Unauthorized", NULL, 0, 0);
+    submit(4);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 4u);
+    for(size_t i = 0; i < 4; ++i)
+        BOOST_CHECK_EQUAL(completions[i]->error, sensorCloud_unauthorized);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_SameChannel_Coalesced)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(uploads, "channel");
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), uploads);
+    for(size_t i = 0; i < uploads; ++i)
+        BOOST_CHECK_EQUAL(completions[i]->error, sensorCloud_ok);
+    // every point in a single upload
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 2u);
+    size_t size;
+    const char* head = loopback_lastRequest(&size);
+    BOOST_CHECK(std::string(head, size).find("Content-Length: 112\r\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_MaxPoints_Split)
+{
+    sensorCloudEngine_setMaxPoints(&engine, 4);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(1, "channel", 10);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    // 4, 4 and 2 points uploaded at once
+    LoopbackStats stats = loopback_stats();
+    BOOST_CHECK_EQUAL(stats.requests, 4u);
+    BOOST_CHECK_EQUAL(stats.maxOpenConnections, 3u);
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_MaxPoints_SplitAndCoalesced)
+{
+    sensorCloudEngine_setMaxPoints(&engine, 4);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(400, "Bad Request", NULL, 0, 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    // 3 points each: 3+1, 2+2, 1+3
+    submit(4, "channel", 3);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 4u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4u);
+    // the second upload failed, taking the submissions it carried part of with it
+    BOOST_CHECK_EQUAL(submissions[0].error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(submissions[1].error, sensorCloud_badRequest);
+    BOOST_CHECK_EQUAL(submissions[2].error, sensorCloud_badRequest);
+    BOOST_CHECK_EQUAL(submissions[3].error, sensorCloud_ok);
+}
+
+BOOST_AUTO_TEST_CASE(Completion_SubmitsMore)
+{
+    Chain chain = {&engine, submissions + 2, submissions + uploads, 0};
+    sensorCloudEngine_init(&engine, &sensorCloud, slots, 2, chainCallback, &chain);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    for(size_t i = 0; i < uploads; ++i)
+    {
+        sensorCloud_initPointBuffer(&points[i], pointData[i], sizeof(pointData[i]), rate);
+        sensorCloud_addPoint(&points[i], i, float(i));
+        std::snprintf(channels[i], sizeof(channels[i]), "channel%u", unsigned(i));
+        sensorCloudEngine_initSubmission(&submissions[i], "sensor", channels[i], &points[i], NULL);
+    }
+    sensorCloudEngine_submit(&engine, &submissions[0]);
+    sensorCloudEngine_submit(&engine, &submissions[1]);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(chain.completed, uploads);
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_NoToken)
+{
+    BOOST_CHECK(sensorCloudEngine_warmUp(&engine) != 0);
+    BOOST_CHECK_EQUAL(loopback_stats().connections, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_UploadSkipsConnect)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(1);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(loopback_stats().connections, 2u);
+
+    BOOST_CHECK_EQUAL(sensorCloudEngine_warmUp(&engine), 0);
+    loopback_run();
+    BOOST_CHECK_EQUAL(loopback_stats().connections, 3u);
+    uint64_t start = loopback_now();
+    submit(1);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+    // only the response latency, the connection was already there
+    BOOST_CHECK_EQUAL(loopback_now() - start, 500u);
+    BOOST_CHECK_EQUAL(loopback_stats().connections, 3u);
+    BOOST_CHECK_EQUAL(engine.warmUps, 1u);
+    BOOST_CHECK_EQUAL(engine.warmUsed, 1u);
+    BOOST_CHECK_EQUAL(engine.warmWasted, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_StillConnecting_UploadWaitsForIt)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(1);
+    loopback_run();
+
+    uint64_t start = loopback_now();
+    BOOST_CHECK_EQUAL(sensorCloudEngine_warmUp(&engine), 0);
+    loopback_runUntil(start + 400);
+    submit(1);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_now() - start, 1500u);
+    BOOST_CHECK_EQUAL(loopback_stats().connections, 3u);
+    BOOST_CHECK_EQUAL(engine.warmUsed, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_ClosedBeforeUse_Wasted)
+{
+    config.idleTimeout = 2000;
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(1);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(sensorCloudEngine_warmUp(&engine), 0);
+    loopback_run();
+    BOOST_CHECK_EQUAL(loopback_stats().openConnections, 0u);
+    // counted as it closes, the slot is no longer warm
+    BOOST_CHECK_EQUAL(engine.warmWasted, 1u);
+    for(size_t i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL(engine.slots[i].warm, 0u);
+    submit(1);
+    loopback_run();
+
+    // the upload connected again on its own
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().connections, 4u);
+    BOOST_CHECK_EQUAL(engine.warmUsed, 0u);
+    BOOST_CHECK_EQUAL(engine.warmWasted, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_ClosedSlotsWarmAgain)
+{
+    config.idleTimeout = 2000;
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(1);
+    loopback_run();
+
+    for(size_t i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL(sensorCloudEngine_warmUp(&engine), 0);
+    loopback_run();
+    BOOST_CHECK_EQUAL(engine.warmWasted, 3u);
+
+    // every slot can be warmed again, without the idle timeout the connections are used
+    config.idleTimeout = 0;
+    loopback_reset(&config);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    for(size_t i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL(sensorCloudEngine_warmUp(&engine), 0);
+    loopback_run();
+    submit(3);
+    loopback_run();
+    BOOST_CHECK_EQUAL(completions.size(), 4u);
+    BOOST_CHECK_EQUAL(engine.warmUps, 6u);
+    BOOST_CHECK_EQUAL(engine.warmUsed, 3u);
+    BOOST_CHECK_EQUAL(engine.warmWasted, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_EveryIdleSlotWarm)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    submit(1);
+    loopback_run();
+
+    for(size_t i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL(sensorCloudEngine_warmUp(&engine), 0);
+    BOOST_CHECK(sensorCloudEngine_warmUp(&engine) != 0);
+    loopback_run();
+    BOOST_CHECK_EQUAL(loopback_stats().openConnections, 3u);
+
+    submit(3);
+    loopback_run();
+    BOOST_CHECK_EQUAL(completions.size(), 4u);
+    BOOST_CHECK_EQUAL(engine.warmUsed, 3u);
+    BOOST_CHECK_EQUAL(loopback_stats().openConnections, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+#ifndef TEST_SENSORCLOUD_FIXTURE
+#define TEST_SENSORCLOUD_FIXTURE
+
+#include <net/loopback_driver.h>
+#include <sensorcloud/engine.h>
+
+#include <vector>
+
+// what the tests of the stages around an engine share, each keeps only the setup of its own stage
+namespace
+{
+
+const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+
+// keeps the submissions in the order they completed
+void completionCallback(void* userData, SensorCloudSubmission* submission)
+{
+    static_cast<std::vector<SensorCloudSubmission*>*>(userData)->push_back(submission);
+}
+
+/**
+ * The loopback driver started over, nothing is scripted yet.
+ */
+struct LoopbackFixture
+{
+    LoopbackConfig config;
+
+    explicit LoopbackFixture(uint64_t responseLatency = 1000, uint64_t connectLatency = 0)
+    {
+        loopback_defaultConfig(&config);
+        config.responseLatency = responseLatency;
+        config.connectLatency = connectLatency;
+        loopback_reset(&config);
+    }
+};
+
+/**
+ * A device whose first request authenticates, and an engine for it once initEngine picks the slots it uses.
+ * Uploads aren't answered until a test scripts responses or calls respondCreated.
+ */
+template<size_t SlotCount>
+struct EngineFixture : LoopbackFixture
+{
+    SensorCloud sensorCloud;
+    SensorCloudEngineSlot slots[SlotCount];
+    SensorCloudEngine engine;
+    std::vector<SensorCloudSubmission*> completions;
+
+    explicit EngineFixture(uint64_t responseLatency = 1000) :
+    LoopbackFixture(responseLatency)
+    {
+        loopback_queueAuthResponse("token", "upload.example.com", 0);
+        sensorCloud_init(&sensorCloud, "device", "key", NULL);
+    }
+
+    void initEngine(size_t slotCount = SlotCount)
+    {
+        sensorCloudEngine_init(&engine, &sensorCloud, slots, slotCount, completionCallback, &completions);
+    }
+
+    void respondCreated()
+    {
+        loopback_setDefaultResponse(created, sizeof(created) - 1);
+    }
+};
+
+}
+
+#endif
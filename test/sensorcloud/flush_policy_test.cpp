@@ -0,0 +1,171 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud/flush_policy.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+
+struct Fixture
+{
+    LoopbackConfig config;
+    SensorCloudPointBuffer points;
+    char pointData[16 + 12 * 10];
+    SensorCloudFlushPolicy policy;
+
+    Fixture()
+    {
+        loopback_defaultConfig(&config);
+        loopback_reset(&config);
+        reset();
+        sensorCloudFlushPolicy_init(&policy, &points, 80, 10000000, 2000000);
+    }
+
+    void reset()
+    {
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+    }
+
+    void advance(uint64_t time)
+    {
+        loopback_runUntil(loopback_now() + time);
+    }
+
+    // an upload of everything collected that takes rtt
+    void upload(uint64_t rtt, SensorCloudError error = sensorCloud_ok)
+    {
+        sensorCloudFlushPolicy_begin(&policy, sensorCloudFlush_batch);
+        advance(rtt);
+        sensorCloudFlushPolicy_end(&policy, error);
+        reset();
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudFlushPolicyTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Check_Empty)
+{
+    advance(20000000);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_none);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_deadline(&policy), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Check_FillRatio)
+{
+    for(int i = 0; i < 7; ++i)
+        sensorCloudFlushPolicy_addPoint(&policy, i, 1.0f);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_none);
+    sensorCloudFlushPolicy_addPoint(&policy, 7, 1.0f);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_full);
+}
+
+BOOST_AUTO_TEST_CASE(Check_NoRoundTrip_HalfTheTarget)
+{
+    advance(1000);
+    sensorCloudFlushPolicy_addPoint(&policy, 0, 1.0f);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_deadline(&policy), 1000u + 1000000u);
+    advance(999999);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_none);
+    advance(1);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_batch);
+}
+
+BOOST_AUTO_TEST_CASE(Check_MaxAge)
+{
+    sensorCloudFlushPolicy_init(&policy, &points, 80, 500000, 2000000);
+    sensorCloudFlushPolicy_addPoint(&policy, 0, 1.0f);
+    advance(500000);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_maxAge);
+}
+
+BOOST_AUTO_TEST_CASE(Check_SlowLink_LatencyTarget)
+{
+    sensorCloudFlushPolicy_addPoint(&policy, 0, 1.0f);
+    upload(1500000);
+    BOOST_CHECK_EQUAL(policy.rtt, 1500000u);
+
+    // only half a second left to collect points before they would arrive late
+    sensorCloudFlushPolicy_addPoint(&policy, 1, 1.0f);
+    advance(499999);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_none);
+    advance(1);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_latency);
+}
+
+BOOST_AUTO_TEST_CASE(Congestion_BiggerBatches)
+{
+    sensorCloudFlushPolicy_init(&policy, &points, 80, 60000000, 10000000);
+    sensorCloudFlushPolicy_addPoint(&policy, 0, 1.0f);
+    upload(100000);
+    // an idle link batches about one round trip
+    BOOST_CHECK_EQUAL(policy.hold, 100000u);
+
+    for(int i = 0; i < 8; ++i)
+    {
+        sensorCloudFlushPolicy_addPoint(&policy, i, 1.0f);
+        upload(400000);
+    }
+    sensorCloudFlushPolicy_addPoint(&policy, 8, 1.0f);
+    sensorCloudFlushPolicy_check(&policy);
+    BOOST_CHECK_GT(policy.rtt, 100000u);
+    BOOST_CHECK_GT(policy.hold, 2 * policy.rtt);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_deadline(&policy), policy.oldest + policy.hold);
+    BOOST_CHECK_EQUAL(policy.uploads, 9u);
+    BOOST_CHECK_EQUAL(policy.flushes[sensorCloudFlush_batch], 9u);
+}
+
+BOOST_AUTO_TEST_CASE(Uploading_OnlyFull)
+{
+    sensorCloudFlushPolicy_addPoint(&policy, 0, 1.0f);
+    advance(1000000);
+    BOOST_REQUIRE_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_batch);
+    sensorCloudFlushPolicy_begin(&policy, sensorCloudFlush_batch);
+    BOOST_CHECK_EQUAL(policy.flushes[sensorCloudFlush_batch], 1u);
+
+    // a second buffer collects while the first is uploaded
+    char otherData[16 + 12 * 10];
+    SensorCloudPointBuffer other;
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&other, otherData, sizeof(otherData), rate);
+    policy.points = &other;
+    sensorCloudFlushPolicy_addPoint(&policy, 1, 1.0f);
+    advance(5000000);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_none);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_deadline(&policy), 0u);
+    for(int i = 0; i < 7; ++i)
+        sensorCloudFlushPolicy_addPoint(&policy, i + 2, 1.0f);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_full);
+
+    // failures don't teach the policy anything about the link
+    sensorCloudFlushPolicy_end(&policy, sensorCloud_netError);
+    BOOST_CHECK_EQUAL(policy.failures, 1u);
+    BOOST_CHECK_EQUAL(policy.rtt, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUp_FillThenLead)
+{
+    sensorCloudFlushPolicy_setWarmUp(&policy, 50, 500000);
+    for(int i = 0; i < 4; ++i)
+        sensorCloudFlushPolicy_addPoint(&policy, i, 1.0f);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_warmUp(&policy), 0);
+    sensorCloudFlushPolicy_addPoint(&policy, 4, 1.0f);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_warmUp(&policy), 1);
+    // once per batch
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_warmUp(&policy), 0);
+    upload(100000);
+
+    // the deadline is half the latency target away with no round trip measured yet
+    sensorCloudFlushPolicy_init(&policy, &points, 80, 10000000, 2000000);
+    sensorCloudFlushPolicy_setWarmUp(&policy, 0, 500000);
+    sensorCloudFlushPolicy_addPoint(&policy, 0, 1.0f);
+    advance(400000);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_warmUp(&policy), 0);
+    advance(100000);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_warmUp(&policy), 1);
+    BOOST_CHECK_EQUAL(sensorCloudFlushPolicy_check(&policy), sensorCloudFlush_none);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
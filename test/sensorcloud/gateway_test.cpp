@@ -0,0 +1,255 @@
+#include "fixture.h"
+
+#include <sensorcloud/gateway.h>
+#include <sensorcloud/sensor_cache.h>
+#include <xdr/xdr.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const size_t deviceCount = 6;
+const size_t tenantCount = 2;
+const size_t slotCount = 2;
+const uint64_t second = 1000000;
+
+// submits the upload again from its completion until left runs out
+struct Resubmit
+{
+    SensorCloudGateway* gateway;
+    size_t left;
+};
+
+void completionCallback(void* userData, SensorCloudGatewayUpload* upload)
+{
+    static_cast<std::vector<SensorCloudGatewayUpload*>*>(userData)->push_back(upload);
+    Resubmit* resubmit = static_cast<Resubmit*>(upload->submission.userData);
+    if(!resubmit || !resubmit->left)
+        return;
+    --resubmit->left;
+    sensorCloudGateway_initUpload(upload, upload->device, "sensor", "channel", upload->submission.points, resubmit);
+    sensorCloudGateway_submit(resubmit->gateway, upload);
+}
+
+struct Fixture : LoopbackFixture
+{
+    SensorCloudTokenEntry entries[deviceCount];
+    SensorCloudTokenStore store;
+    SensorCloudGatewayTenant tenants[tenantCount];
+    SensorCloudEngineSlot slots[slotCount];
+    SensorCloudGateway gateway;
+    char ids[deviceCount][16];
+    SensorCloudGatewayDevice devices[deviceCount];
+    char pointData[16 + 12];
+    SensorCloudPointBuffer points;
+    SensorCloudGatewayUpload uploads[deviceCount * 2];
+    std::vector<SensorCloudGatewayUpload*> completions;
+
+    Fixture()
+    {
+        setDefaultAuthResponse();
+
+        init(deviceCount);
+        for(size_t i = 0; i < deviceCount; ++i)
+        {
+            std::sprintf(ids[i], "device%u", unsigned(i));
+            sensorCloudGateway_initDevice(&devices[i], ids[i], "key");
+        }
+
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        sensorCloud_addPoint(&points, 1, 1.0f);
+    }
+
+    void init(size_t tokens, size_t tenantsUsed = tenantCount)
+    {
+        sensorCloudTokenStore_init(&store, entries, tokens, 3600, NULL);
+        sensorCloudGateway_init(&gateway, &store, tenants, tenantsUsed, slots, slotCount, completionCallback,
+            &completions);
+    }
+
+    // a 200 carrying a token, an upload takes it as success so every request succeeds whatever order they run in
+    void setDefaultAuthResponse()
+    {
+        char body[64];
+        Buffer bodyBuffer;
+        buffer_init(&bodyBuffer, body, sizeof(body));
+        xdr_writeUInt(&bodyBuffer, 5);
+        xdr_writeString(&bodyBuffer, "token", 5);
+        xdr_writeUInt(&bodyBuffer, 18);
+        xdr_writeString(&bodyBuffer, "upload.example.com", 18);
+        xdr_writeUInt(&bodyBuffer, 0);
+
+        char response[256];
+        int headSize = std::sprintf(response, "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n",
+            unsigned(buffer_size(&bodyBuffer)));
+        std::memcpy(response + headSize, body, buffer_size(&bodyBuffer));
+        loopback_setDefaultResponse(response, headSize + buffer_size(&bodyBuffer));
+    }
+
+    void submit(size_t upload, size_t device, Resubmit* resubmit = NULL)
+    {
+        sensorCloudGateway_initUpload(&uploads[upload], &devices[device], "sensor", "channel", &points, resubmit);
+        sensorCloudGateway_submit(&gateway, &uploads[upload]);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudGatewayTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Device_Small)
+{
+    BOOST_CHECK(sizeof(SensorCloudGatewayDevice) <= 8 * sizeof(void*));
+}
+
+BOOST_AUTO_TEST_CASE(Submit_DevicesShareTenants)
+{
+    for(size_t i = 0; i < deviceCount; ++i)
+        submit(i, i);
+    BOOST_CHECK_EQUAL(sensorCloudGateway_pending(&gateway), deviceCount);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), deviceCount);
+    for(size_t i = 0; i < deviceCount; ++i)
+        BOOST_CHECK_EQUAL(completions[i]->submission.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(sensorCloudGateway_pending(&gateway), 0u);
+    BOOST_CHECK_EQUAL(gateway.binds, deviceCount);
+    BOOST_CHECK_EQUAL(store.authentications, deviceCount);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 2 * deviceCount);
+    // the slots and the authentication of each tenant
+    BOOST_CHECK(loopback_stats().maxOpenConnections <= slotCount + tenantCount);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_TokenReused)
+{
+    submit(0, 0);
+    submit(1, 0);
+    loopback_run();
+    submit(2, 0);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(store.authentications, 1u);
+    // the device kept its tenant, the two uploads waiting for the token went out as one
+    BOOST_CHECK_EQUAL(gateway.binds, 1u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_IdleTenantHandedOver)
+{
+    submit(0, 0);
+    submit(1, 1);
+    loopback_run();
+    BOOST_CHECK(tenants[0].device == &devices[0]);
+    BOOST_CHECK(tenants[1].device == &devices[1]);
+
+    // both tenants are idle, the one of device 0 goes to device 2
+    submit(2, 2);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(uploads[2].submission.error, sensorCloud_ok);
+    BOOST_CHECK(tenants[0].device == &devices[2]);
+    BOOST_CHECK(devices[0].tenant == NULL);
+    BOOST_CHECK_EQUAL(gateway.binds, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_BusyDeviceLetsWaitingDeviceIn)
+{
+    // one tenant, device 0 submits again every time an upload completes
+    init(deviceCount, 1);
+    Resubmit resubmit = {&gateway, 10};
+    submit(0, 0, &resubmit);
+    loopback_runUntil(3000);
+    BOOST_CHECK(tenants[0].device == &devices[0]);
+    submit(1, 1);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 12u);
+    BOOST_CHECK_EQUAL(uploads[1].submission.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(resubmit.left, 0u);
+    // device 1 got the tenant as soon as it went idle, device 0 had its turn again after it
+    size_t index = std::find(completions.begin(), completions.end(), &uploads[1]) - completions.begin();
+    BOOST_CHECK(index < 4u);
+    BOOST_CHECK_EQUAL(gateway.binds, 3u);
+    BOOST_CHECK(tenants[0].device == &devices[0]);
+    BOOST_CHECK_EQUAL(sensorCloudGateway_pending(&gateway), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_TokenDropped)
+{
+    // only the token of the last active device is kept
+    init(1);
+    submit(0, 0);
+    loopback_run();
+    submit(1, 1);
+    loopback_run();
+    submit(2, 0);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(completions[2]->submission.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(store.authentications, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(Authenticate_Fails)
+{
+    loopback_queueResponse(401, "Unauthorized", NULL, 0, 0);
+    submit(0, 0);
+    submit(1, 0);
+    submit(2, 1);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(uploads[0].submission.error, sensorCloud_unauthorized);
+    BOOST_CHECK_EQUAL(uploads[1].submission.error, sensorCloud_unauthorized);
+    BOOST_CHECK_EQUAL(uploads[2].submission.error, sensorCloud_ok);
+}
+
+BOOST_AUTO_TEST_CASE(Upload_Unauthorized_NextUploadReauthenticates)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_queueResponse(401, "Unauthorized", NULL, 0, 0);
+    submit(0, 0);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(uploads[0].submission.error, sensorCloud_unauthorized);
+
+    submit(1, 0);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(uploads[1].submission.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(store.authentications, 2u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4u);
+}
+
+BOOST_AUTO_TEST_CASE(Upload_UsesEngineRetryAndSensorCache)
+{
+    SensorCloudRetry retry;
+    sensorCloudRetry_init(&retry, 0, second, 1);
+    sensorCloudGateway_setRetry(&gateway, &retry);
+    SensorCloudKnownName names[2];
+    SensorCloudSensorCache cache;
+    sensorCloudSensorCache_init(&cache, names, 2);
+    sensorCloudGateway_setSensorCache(&devices[0], &cache);
+
+    submit(0, 0);
+    loopback_run();
+    BOOST_CHECK(sensorCloudSensorCache_contains(&cache, "sensor"));
+
+    // the connection is refused once, the engine sends the upload again
+    loopback_refuseConnections(1);
+    submit(1, 0);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(uploads[1].submission.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_connect], 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
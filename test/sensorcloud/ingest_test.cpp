@@ -0,0 +1,150 @@
+#include <sensorcloud/ingest.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const size_t channelCount = 4;
+const size_t pointsPerChannel = 4096;
+
+struct Fixture
+{
+    SensorCloudIngestQueue queue;
+    std::vector<char> pointData;
+    SensorCloudPointBuffer points[channelCount];
+    SensorCloudPointBuffer* channels[channelCount];
+
+    Fixture() :
+    pointData(channelCount * (16 + 12 * pointsPerChannel))
+    {
+        sensorCloudIngest_init(&queue);
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        for(size_t i = 0; i < channelCount; ++i)
+        {
+            sensorCloud_initPointBuffer(&points[i], &pointData[i * (16 + 12 * pointsPerChannel)],
+                16 + 12 * pointsPerChannel, rate);
+            channels[i] = &points[i];
+        }
+    }
+
+    std::vector<Timestamp> times(size_t channel)
+    {
+        std::vector<Timestamp> result(pointsPerChannel);
+        std::vector<float> values(pointsPerChannel);
+        SensorCloudPointDecoder decoder;
+        sensorCloud_initPointDecoder(&decoder, &result[0], &values[0], pointsPerChannel);
+        sensorCloud_decodePoints(&decoder, points[channel].data.getPtr + 16, buffer_size(&points[channel].data) - 16);
+        result.resize(decoder.count);
+        return result;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudIngestTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Put_PublishedOnceFull)
+{
+    SensorCloudIngestBatch batches[2];
+    SensorCloudIngestProducer producer;
+    sensorCloudIngest_initProducer(&producer, &queue, batches, 2);
+
+    for(size_t i = 0; i < SENSORCLOUD_INGEST_BATCH - 1; ++i)
+        BOOST_REQUIRE_EQUAL(sensorCloudIngest_put(&producer, 0, i, 1.0f), 0);
+    BOOST_CHECK_EQUAL(sensorCloudIngest_drain(&queue, channels, channelCount), 0u);
+
+    BOOST_REQUIRE_EQUAL(sensorCloudIngest_put(&producer, 1, 100, 2.0f), 0);
+    BOOST_CHECK_EQUAL(sensorCloudIngest_drain(&queue, channels, channelCount), SENSORCLOUD_INGEST_BATCH);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&points[0]), SENSORCLOUD_INGEST_BATCH - 1);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&points[1]), 1u);
+
+    sensorCloudIngest_put(&producer, 2, 200, 3.0f);
+    sensorCloudIngest_publish(&producer);
+    BOOST_CHECK_EQUAL(sensorCloudIngest_drain(&queue, channels, channelCount), 1u);
+    BOOST_CHECK_EQUAL(queue.drained, SENSORCLOUD_INGEST_BATCH + 1);
+}
+
+BOOST_AUTO_TEST_CASE(Put_RefusedUntilDrained)
+{
+    SensorCloudIngestBatch batches[2];
+    SensorCloudIngestProducer producer;
+    sensorCloudIngest_initProducer(&producer, &queue, batches, 2);
+
+    for(size_t i = 0; i < 2 * SENSORCLOUD_INGEST_BATCH; ++i)
+        BOOST_REQUIRE_EQUAL(sensorCloudIngest_put(&producer, 0, i, 1.0f), 0);
+    BOOST_CHECK(sensorCloudIngest_put(&producer, 0, 0, 1.0f) != 0);
+    BOOST_CHECK_EQUAL(producer.refused, 1u);
+
+    sensorCloudIngest_drain(&queue, channels, channelCount);
+    BOOST_CHECK_EQUAL(sensorCloudIngest_put(&producer, 0, 0, 1.0f), 0);
+}
+
+BOOST_AUTO_TEST_CASE(Drain_DropsUnknownAndFull)
+{
+    SensorCloudIngestBatch batches[1];
+    SensorCloudIngestProducer producer;
+    sensorCloudIngest_initProducer(&producer, &queue, batches, 1);
+
+    char smallData[16 + 12];
+    SensorCloudPointBuffer small;
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&small, smallData, sizeof(smallData), rate);
+    SensorCloudPointBuffer* smallChannels[] = {&small, NULL};
+
+    sensorCloudIngest_put(&producer, 0, 1, 1.0f);
+    sensorCloudIngest_put(&producer, 0, 2, 1.0f);
+    sensorCloudIngest_put(&producer, 1, 3, 1.0f);
+    sensorCloudIngest_put(&producer, 7, 4, 1.0f);
+    sensorCloudIngest_publish(&producer);
+
+    BOOST_CHECK_EQUAL(sensorCloudIngest_drain(&queue, smallChannels, 2), 1u);
+    BOOST_CHECK_EQUAL(queue.dropped, 3u);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&small), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Producers_Concurrent)
+{
+    // one producer per channel, the consumer drains while they run
+    const size_t batchCount = 4;
+    std::vector<SensorCloudIngestBatch> batches(channelCount * batchCount);
+    SensorCloudIngestProducer producers[channelCount];
+    for(size_t i = 0; i < channelCount; ++i)
+        sensorCloudIngest_initProducer(&producers[i], &queue, &batches[i * batchCount], batchCount);
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < channelCount; ++i)
+    {
+        threads.push_back(std::thread([&producers, i]
+        {
+            for(size_t time = 0; time < pointsPerChannel;)
+            {
+                if(sensorCloudIngest_put(&producers[i], i, time, float(i)) == 0)
+                    ++time;
+                else
+                    std::this_thread::yield();
+            }
+            sensorCloudIngest_publish(&producers[i]);
+        }));
+    }
+
+    while(queue.drained < channelCount * pointsPerChannel)
+        sensorCloudIngest_drain(&queue, channels, channelCount);
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    BOOST_CHECK_EQUAL(queue.dropped, 0u);
+    for(size_t i = 0; i < channelCount; ++i)
+    {
+        std::vector<Timestamp> channelTimes = times(i);
+        BOOST_REQUIRE_EQUAL(channelTimes.size(), pointsPerChannel);
+        // the points of a producer arrive in the order it put them
+        for(size_t j = 0; j < pointsPerChannel; ++j)
+            BOOST_CHECK_EQUAL(channelTimes[j], Timestamp(j));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+#include "fixture.h"
+
+#include <sensorcloud/multi_buffer.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const size_t channelCount = 3;
+const size_t capacity = 4;
+
+struct Fixture
+{
+    SensorCloudSampleRate rate;
+    Timestamp times[capacity];
+    float values[channelCount * capacity];
+    SensorCloudMultiBuffer buffer;
+    char pointData[channelCount][16 + 12 * capacity];
+    SensorCloudPointBuffer points[channelCount];
+
+    Fixture()
+    {
+        rate.value = 100;
+        rate.type = sensorCloud_hertz;
+        sensorCloudMultiBuffer_init(&buffer, rate, channelCount, times, values, capacity);
+        for(size_t c = 0; c < channelCount; ++c)
+            sensorCloud_initPointBuffer(&points[c], pointData[c], sizeof(pointData[c]), rate);
+    }
+
+    void fill(size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            float sample[channelCount] = {float(i), float(i) * 10, float(i) * 100};
+            BOOST_REQUIRE_EQUAL(sensorCloudMultiBuffer_append(&buffer, 1000000 + i, sample), 0);
+        }
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudMultiBufferTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Append_Full)
+{
+    fill(capacity);
+    float sample[channelCount] = {};
+    BOOST_CHECK(sensorCloudMultiBuffer_append(&buffer, 0, sample) != 0);
+    sensorCloudMultiBuffer_clear(&buffer);
+    BOOST_CHECK_EQUAL(sensorCloudMultiBuffer_append(&buffer, 0, sample), 0);
+}
+
+BOOST_AUTO_TEST_CASE(Encode_MatchesPointBuffers)
+{
+    fill(3);
+    BOOST_REQUIRE_EQUAL(sensorCloudMultiBuffer_encode(&buffer, points), 0);
+
+    // the same points added one channel at a time
+    for(size_t c = 0; c < channelCount; ++c)
+    {
+        char expectedData[16 + 12 * capacity];
+        SensorCloudPointBuffer expected;
+        sensorCloud_initPointBuffer(&expected, expectedData, sizeof(expectedData), rate);
+        for(size_t i = 0; i < 3; ++i)
+            sensorCloud_addPoint(&expected, 1000000 + i, values[c * capacity + i]);
+        sensorCloud_finishPointBuffer(&expected);
+
+        BOOST_CHECK_EQUAL(sensorCloud_pointCount(&points[c]), 3u);
+        BOOST_REQUIRE_EQUAL(buffer_size(&points[c].data), buffer_size(&expected.data));
+        BOOST_CHECK(std::memcmp(points[c].data.data, expected.data.data, buffer_size(&expected.data)) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Encode_DoesNotFit)
+{
+    fill(capacity);
+    sensorCloud_initPointBuffer(&points[1], pointData[1], 16 + 12 * (capacity - 1), rate);
+    BOOST_CHECK(sensorCloudMultiBuffer_encode(&buffer, points) != 0);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_ChannelsTogether)
+{
+    EngineFixture<channelCount> upload;
+    upload.respondCreated();
+    upload.initEngine();
+    const std::vector<SensorCloudSubmission*>& completions = upload.completions;
+
+    fill(2);
+    const char* channels[channelCount] = {"x", "y", "z"};
+    SensorCloudSubmission submissions[channelCount];
+    BOOST_REQUIRE_EQUAL(sensorCloudMultiBuffer_submit(&buffer, &upload.engine, "imu", channels, points, submissions, NULL),
+        0);
+    sensorCloudMultiBuffer_clear(&buffer);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), channelCount);
+    for(size_t c = 0; c < channelCount; ++c)
+        BOOST_CHECK_EQUAL(completions[c]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, channelCount + 1);
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, channelCount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
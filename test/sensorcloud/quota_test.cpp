@@ -0,0 +1,186 @@
+#include "fixture.h"
+
+#include <sensorcloud/quota.h>
+#include <sensorcloud/scheduler.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+
+const size_t pointCount = 4;
+const uint64_t second = 1000000;
+
+struct Fixture : EngineFixture<2>
+{
+    SensorCloudQuota quota;
+    char pointData[16 + 12 * pointCount];
+    SensorCloudPointBuffer points;
+    SensorCloudSubmission uploads[8];
+    size_t uploadCount;
+
+    Fixture() :
+    uploadCount(0)
+    {
+        initEngine();
+        sensorCloudQuota_init(&quota, &engine, 2 * second);
+
+        SensorCloudSampleRate rate;
+        rate.value = 1;
+        rate.type = sensorCloud_hertz;
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        for(size_t i = 0; i < pointCount; ++i)
+            sensorCloud_addPoint(&points, i, float(i));
+    }
+
+    SensorCloudQuotaDecision submit()
+    {
+        SensorCloudSubmission* upload = &uploads[uploadCount++];
+        sensorCloudEngine_initSubmission(upload, "sensor", "channel", &points, NULL);
+        return sensorCloudQuota_submit(&quota, upload);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudQuotaTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Unlimited_SendsEverything)
+{
+    respondCreated();
+    for(size_t i = 0; i < 4; ++i)
+        BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    loopback_run();
+    BOOST_CHECK_EQUAL(completions.size(), 4u);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_headroom(&quota, sensorCloudQuota_points), UINT64_MAX);
+}
+
+BOOST_AUTO_TEST_CASE(Burst_ThenDeferred)
+{
+    respondCreated();
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, 2 * pointCount, pointCount);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_deferred);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_headroom(&quota, sensorCloudQuota_points), 0u);
+    loopback_run();
+    BOOST_CHECK_EQUAL(completions.size(), 2u);
+
+    // a second of the rate makes room for it
+    uint64_t deadline = sensorCloudQuota_deadline(&quota);
+    BOOST_CHECK_EQUAL(deadline, second);
+    loopback_runUntil(deadline - 1);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_poll(&quota), 0u);
+    loopback_runUntil(deadline);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_poll(&quota), 1u);
+    loopback_run();
+    BOOST_CHECK_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(quota.deferrals, 1u);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_deadline(&quota), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Refused_WhenWaitTooLong)
+{
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, pointCount, pointCount / 2);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_deferred);
+    // would wait four seconds, behind the one deferred already
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_refused);
+    BOOST_CHECK_EQUAL(quota.refusals, 1u);
+
+    // never fits at all
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, pointCount - 1, pointCount);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_refused);
+}
+
+BOOST_AUTO_TEST_CASE(Bytes_Headroom)
+{
+    respondCreated();
+    // no refill, what's left is all there is
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_bytes, 100, 0);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_headroom(&quota, sensorCloudQuota_bytes), 100u - 16 - 12 * pointCount);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_refused);
+    loopback_run();
+    BOOST_CHECK_EQUAL(completions.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Rejection_Resyncs)
+{
+    loopback_queueResponse(401, "Quota", NULL, 0, 0);
+    respondCreated();
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, 2 * pointCount, 8);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_quotaExceeded);
+    BOOST_CHECK_EQUAL(quota.rejections, 1u);
+    // the server says the bucket is empty and fills slower than configured
+    BOOST_CHECK_EQUAL(sensorCloudQuota_headroom(&quota, sensorCloudQuota_points), 0u);
+    BOOST_CHECK_EQUAL(quota.buckets[sensorCloudQuota_points].estimate, 6u);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_deferred);
+
+    loopback_runUntil(sensorCloudQuota_deadline(&quota));
+    BOOST_CHECK_EQUAL(sensorCloudQuota_poll(&quota), 1u);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+    // successes work back towards the configured rate
+    BOOST_CHECK_EQUAL(quota.buckets[sensorCloudQuota_points].estimate, 7u);
+}
+
+BOOST_AUTO_TEST_CASE(Failure_Refunded)
+{
+    // no default response, the peer disconnects
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, pointCount, 0);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK(completions[0]->error != sensorCloud_ok);
+    BOOST_CHECK_EQUAL(sensorCloudQuota_headroom(&quota, sensorCloudQuota_points), pointCount);
+}
+
+BOOST_AUTO_TEST_CASE(Stage_StacksWithScheduler)
+{
+    // the quota decides when uploads may go out, the scheduler which slot they wait for
+    SensorCloudScheduler scheduler;
+    sensorCloudScheduler_init(&scheduler, &engine, 1);
+    SensorCloudSchedulerFlow flow;
+    sensorCloudScheduler_initFlow(&flow, &scheduler, sensorCloudPriority_normal, pointCount);
+    SensorCloudStage stage;
+    sensorCloudScheduler_initStage(&stage, &flow);
+    sensorCloudQuota_setStage(&quota, &stage);
+    loopback_queueResponse(401, "Quota", NULL, 0, 0);
+    respondCreated();
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, 2 * pointCount, 8);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    BOOST_CHECK_EQUAL(submit(), sensorCloudQuota_sent);
+    // only one slot isn't reserved, the second upload waits for it in the scheduler
+    BOOST_CHECK_EQUAL(scheduler.busy, 1u);
+    BOOST_CHECK_EQUAL(sensorCloudScheduler_queued(&scheduler, sensorCloudPriority_normal), 1u);
+    loopback_run();
+
+    // the scheduler gave the slot back and the quota saw the rejection before the callback of the engine ran
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_quotaExceeded);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(quota.rejections, 1u);
+    BOOST_CHECK_EQUAL(scheduler.busy, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Stage_RefusedCompletes)
+{
+    SensorCloudStage stage;
+    sensorCloudQuota_initStage(&stage, &quota);
+    sensorCloudQuota_setLimit(&quota, sensorCloudQuota_points, pointCount - 1, pointCount);
+    sensorCloudEngine_initSubmission(&uploads[0], "sensor", "channel", &points, NULL);
+    sensorCloudStage_submit(&stage, &uploads[0]);
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_quotaExceeded);
+    BOOST_CHECK_EQUAL(quota.refusals, 1u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,144 @@
+#include <sensorcloud/reorder.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace
+{
+
+const size_t heapSize = 4;
+const size_t pointCapacity = 16;
+
+struct Fixture
+{
+    char pointData[16 + 12 * pointCapacity];
+    SensorCloudPointBuffer points;
+    SensorCloudReorderPoint heap[heapSize];
+    SensorCloudReorderBuffer reorder;
+
+    Fixture()
+    {
+        SensorCloudSampleRate rate;
+        rate.value = 10;
+        rate.type = sensorCloud_hertz;
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        sensorCloudReorder_init(&reorder, &points, heap, heapSize, 10);
+    }
+
+    // timestamps released to the point buffer, the value of each point is its timestamp
+    std::vector<Timestamp> released()
+    {
+        Timestamp times[pointCapacity];
+        float values[pointCapacity];
+        SensorCloudPointDecoder decoder;
+        sensorCloud_initPointDecoder(&decoder, times, values, pointCapacity);
+        sensorCloud_decodePoints(&decoder, points.data.getPtr + 16, buffer_size(&points.data) - 16);
+        for(size_t i = 0; i < decoder.count; ++i)
+            BOOST_CHECK_EQUAL(values[i], float(times[i]));
+        return std::vector<Timestamp>(times, times + decoder.count);
+    }
+
+    int add(Timestamp time)
+    {
+        return sensorCloudReorder_addPoint(&reorder, time, float(time));
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudReorderTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(AddPoint_ReleasedPastWatermark)
+{
+    BOOST_CHECK_EQUAL(add(100), 0);
+    BOOST_CHECK_EQUAL(add(104), 0);
+    BOOST_CHECK_EQUAL(add(102), 0);
+    BOOST_CHECK(released().empty());
+
+    // 112 moves the watermark to 102
+    BOOST_CHECK_EQUAL(add(112), 0);
+    std::vector<Timestamp> times = released();
+    BOOST_REQUIRE_EQUAL(times.size(), 2u);
+    BOOST_CHECK_EQUAL(times[0], 100u);
+    BOOST_CHECK_EQUAL(times[1], 102u);
+    BOOST_CHECK_EQUAL(sensorCloudReorder_pending(&reorder), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(AddPoint_Late)
+{
+    add(100);
+    add(120);
+    BOOST_REQUIRE_EQUAL(released().size(), 1u);
+    BOOST_CHECK(add(99) != 0);
+    BOOST_CHECK_EQUAL(reorder.late, 1u);
+
+    // behind the watermark but nothing newer was released, still in order
+    BOOST_CHECK_EQUAL(add(105), 0);
+    BOOST_CHECK_EQUAL(sensorCloudReorder_flush(&reorder), 0);
+    std::vector<Timestamp> times = released();
+    BOOST_REQUIRE_EQUAL(times.size(), 3u);
+    BOOST_CHECK_EQUAL(times[1], 105u);
+    BOOST_CHECK_EQUAL(times[2], 120u);
+}
+
+BOOST_AUTO_TEST_CASE(Flush_Sorted)
+{
+    const Timestamp arrivals[] = {5, 3, 9, 1};
+    for(size_t i = 0; i < 4; ++i)
+        BOOST_CHECK_EQUAL(add(arrivals[i]), 0);
+    BOOST_CHECK(released().empty());
+
+    BOOST_CHECK_EQUAL(sensorCloudReorder_flush(&reorder), 0);
+    std::vector<Timestamp> times = released();
+    BOOST_REQUIRE_EQUAL(times.size(), 4u);
+    BOOST_CHECK_EQUAL(times[0], 1u);
+    BOOST_CHECK_EQUAL(times[1], 3u);
+    BOOST_CHECK_EQUAL(times[2], 5u);
+    BOOST_CHECK_EQUAL(times[3], 9u);
+    BOOST_CHECK_EQUAL(sensorCloudReorder_pending(&reorder), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(AddPoint_HeapFull)
+{
+    add(8);
+    add(6);
+    add(7);
+    add(9);
+    BOOST_CHECK_EQUAL(add(10), 0);
+    BOOST_CHECK_EQUAL(reorder.forced, 1u);
+    BOOST_REQUIRE_EQUAL(released().size(), 1u);
+    BOOST_CHECK_EQUAL(released()[0], 6u);
+
+    // older than everything waiting, it goes out straight away
+    BOOST_CHECK_EQUAL(add(6), 0);
+    BOOST_CHECK_EQUAL(reorder.forced, 2u);
+    BOOST_REQUIRE_EQUAL(released().size(), 2u);
+    BOOST_CHECK_EQUAL(released()[1], 6u);
+    BOOST_CHECK_EQUAL(sensorCloudReorder_pending(&reorder), heapSize);
+}
+
+BOOST_AUTO_TEST_CASE(Flush_PointBufferFull)
+{
+    sensorCloud_initPointBuffer(&points, pointData, 16 + 12 * 2, points.sampleRate);
+    add(3);
+    add(1);
+    add(2);
+    BOOST_CHECK(sensorCloudReorder_flush(&reorder) != 0);
+    BOOST_CHECK_EQUAL(released().size(), 2u);
+    BOOST_CHECK_EQUAL(sensorCloudReorder_pending(&reorder), 1u);
+
+    add(4);
+    add(5);
+    add(6);
+    BOOST_CHECK(add(7) != 0);
+    BOOST_CHECK_EQUAL(reorder.overflow, 1u);
+
+    // uploaded, the rest follows into the empty buffer
+    sensorCloud_initPointBuffer(&points, pointData, 16 + 12 * 2, points.sampleRate);
+    BOOST_CHECK(sensorCloudReorder_flush(&reorder) != 0);
+    BOOST_CHECK_EQUAL(released()[0], 3u);
+    BOOST_CHECK_EQUAL(released()[1], 4u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+#include "fixture.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+namespace
+{
+
+const size_t pointCount = 4;
+const uint64_t second = 1000000;
+const char server[] = "upload.example.com";
+
+struct Fixture : EngineFixture<1>
+{
+    SensorCloudRetry retry;
+    char pointData[16 + 12 * pointCount];
+    SensorCloudPointBuffer points;
+    SensorCloudSubmission uploads[4];
+    size_t uploadCount;
+
+    Fixture() :
+    uploadCount(0)
+    {
+        initEngine();
+        sensorCloudRetry_init(&retry, 0, second, 1);
+        sensorCloudEngine_setRetry(&engine, &retry);
+
+        SensorCloudSampleRate rate;
+        rate.value = 1;
+        rate.type = sensorCloud_hertz;
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        for(size_t i = 0; i < pointCount; ++i)
+            sensorCloud_addPoint(&points, i, float(i));
+    }
+
+    // the first submit authenticates, connections refused right after it only hit the uploads
+    void submit(const char* channel = "channel")
+    {
+        SensorCloudSubmission* upload = &uploads[uploadCount++];
+        sensorCloudEngine_initSubmission(upload, "sensor", channel, &points, NULL);
+        sensorCloudEngine_submit(&engine, upload);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudRetryTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Backoff_JitteredAndCapped)
+{
+    sensorCloudRetry_setPolicy(&retry, sensorCloudRetry_connect, 6, 100, 1000);
+    for(uint8_t retries = 0; retries < 6; ++retries)
+    {
+        uint64_t ceiling = std::min<uint64_t>(100u << retries, 1000);
+        uint64_t delay = sensorCloudRetry_failed(&retry, server, sensorCloudRetry_connect, retries);
+        BOOST_CHECK_GE(delay, ceiling / 2);
+        BOOST_CHECK_LE(delay, ceiling);
+    }
+    BOOST_CHECK_EQUAL(sensorCloudRetry_failed(&retry, server, sensorCloudRetry_connect, 6), UINT64_MAX);
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_connect], 6u);
+    BOOST_CHECK_EQUAL(retry.exhausted, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Connect_Retried)
+{
+    respondCreated();
+    submit();
+    loopback_refuseConnections(2);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_connect], 2u);
+    // nothing was sent on the refused connections
+    BOOST_CHECK_EQUAL(loopback_stats().connections, 4u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(Reset_ResendsBody)
+{
+    loopback_queueHangup();
+    respondCreated();
+    submit();
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_reset], 1u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 3u);
+    size_t size;
+    const char* head = loopback_lastRequest(&size);
+    BOOST_CHECK(std::string(head, size).find("Content-Length: 64\r\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(ServerError_Retried)
+{
+    loopback_queueResponse(503, "Service Unavailable", NULL, 0, 0);
+    respondCreated();
+    submit();
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_serverError], 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Policy_GivesUp)
+{
+    sensorCloudRetry_setPolicy(&retry, sensorCloudRetry_serverError, 0, 1, 1);
+    sensorCloudRetry_setPolicy(&retry, sensorCloudRetry_connect, 2, 1000, 1000);
+    loopback_queueResponse(503, "Service Unavailable", NULL, 0, 0);
+    submit();
+    loopback_run();
+    respondCreated();
+    loopback_refuseConnections(10);
+    submit();
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_badRequest);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_netError);
+    BOOST_CHECK_EQUAL(retry.retries[sensorCloudRetry_connect], 2u);
+    BOOST_CHECK_EQUAL(retry.exhausted, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(Breaker_FailsFast)
+{
+    sensorCloudRetry_init(&retry, 2, second, 1);
+    sensorCloudRetry_setPolicy(&retry, sensorCloudRetry_connect, 0, 1, 1);
+    respondCreated();
+    // different channels so they aren't merged into one upload
+    submit("a");
+    submit("b");
+    loopback_refuseConnections(2);
+    loopback_run();
+    BOOST_CHECK_EQUAL(sensorCloudRetry_state(&retry, sensorCloud.server), sensorCloudBreaker_open);
+    BOOST_CHECK_EQUAL(retry.opened, 1u);
+
+    // doesn't even connect
+    uint32_t connections = loopback_stats().connections;
+    submit();
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(completions[2]->error, sensorCloud_netError);
+    BOOST_CHECK_EQUAL(loopback_stats().connections, connections);
+
+    // after the cooldown an upload finds out the server is back
+    loopback_runUntil(loopback_now() + second);
+    submit();
+    BOOST_CHECK_EQUAL(sensorCloudRetry_state(&retry, sensorCloud.server), sensorCloudBreaker_halfOpen);
+    loopback_run();
+    BOOST_REQUIRE_EQUAL(completions.size(), 4u);
+    BOOST_CHECK_EQUAL(completions[3]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(sensorCloudRetry_state(&retry, sensorCloud.server), sensorCloudBreaker_closed);
+}
+
+BOOST_AUTO_TEST_CASE(Breaker_DelaysRetry)
+{
+    sensorCloudRetry_init(&retry, 1, second, 1);
+    sensorCloudRetry_setPolicy(&retry, sensorCloudRetry_connect, 1, 1000, 1000);
+    respondCreated();
+    submit();
+    loopback_refuseConnections(1);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    // the retry waited out the cooldown of the breaker its failure opened instead of its own backoff
+    BOOST_CHECK_GE(loopback_now(), second);
+    BOOST_CHECK_EQUAL(sensorCloudRetry_state(&retry, sensorCloud.server), sensorCloudBreaker_closed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,163 @@
+#include "fixture.h"
+
+#include <sensorcloud/rollup.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const Timestamp second = 1000000000ull;
+const Timestamp window = 60 * second;
+const size_t capacity = 8;
+
+struct Fixture
+{
+    SensorCloudSampleRate rate;
+    char outputData[sensorCloudRollup_statCount][16 + 12 * capacity];
+    SensorCloudPointBuffer outputs[sensorCloudRollup_statCount];
+    SensorCloudRollup rollup;
+
+    Fixture()
+    {
+        rate.value = 60;
+        rate.type = sensorCloud_seconds;
+        SensorCloudPointBuffer* kept[sensorCloudRollup_statCount];
+        for(size_t s = 0; s < sensorCloudRollup_statCount; ++s)
+        {
+            sensorCloud_initPointBuffer(&outputs[s], outputData[s], sizeof(outputData[s]), rate);
+            kept[s] = &outputs[s];
+        }
+        sensorCloudRollup_init(&rollup, window, kept);
+    }
+
+    // the summary points of a statistic
+    std::vector<std::pair<Timestamp, float> > points(SensorCloudRollupStat stat)
+    {
+        Timestamp times[capacity];
+        float values[capacity];
+        SensorCloudPointDecoder decoder;
+        sensorCloud_initPointDecoder(&decoder, times, values, capacity);
+        sensorCloud_decodePoints(&decoder, outputs[stat].data.getPtr + 16, buffer_size(&outputs[stat].data) - 16);
+        std::vector<std::pair<Timestamp, float> > result;
+        for(size_t i = 0; i < decoder.count; ++i)
+            result.push_back(std::make_pair(times[i], values[i]));
+        return result;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudRollupTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(AddPoint_WindowStats)
+{
+    sensorCloudRollup_addPoint(&rollup, 125 * second, 4);
+    sensorCloudRollup_addPoint(&rollup, 130 * second, -2);
+    sensorCloudRollup_addPoint(&rollup, 179 * second, 7);
+    BOOST_CHECK_EQUAL(rollup.windows, 0u);
+
+    sensorCloudRollup_addPoint(&rollup, 180 * second, 1);
+    BOOST_REQUIRE_EQUAL(rollup.windows, 1u);
+    BOOST_REQUIRE_EQUAL(points(sensorCloudRollup_min).size(), 1u);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_min)[0].first, 120 * second);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_min)[0].second, -2);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_max)[0].second, 7);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_mean)[0].second, 3);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_count)[0].second, 3);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_last)[0].second, 7);
+
+    sensorCloudRollup_flush(&rollup);
+    BOOST_REQUIRE_EQUAL(points(sensorCloudRollup_last).size(), 2u);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_last)[1].first, 180 * second);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_count)[1].second, 1);
+}
+
+BOOST_AUTO_TEST_CASE(AddPoint_SkipsEmptyWindows)
+{
+    sensorCloudRollup_addPoint(&rollup, 0, 1);
+    sensorCloudRollup_addPoint(&rollup, 10 * window + 5, 2);
+    sensorCloudRollup_flush(&rollup);
+    sensorCloudRollup_flush(&rollup);
+    BOOST_CHECK_EQUAL(rollup.windows, 2u);
+    BOOST_REQUIRE_EQUAL(points(sensorCloudRollup_mean).size(), 2u);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_mean)[1].first, 10 * window);
+}
+
+BOOST_AUTO_TEST_CASE(AddPoints_MatchesAddPoint)
+{
+    char rawData[16 + 12 * 64];
+    SensorCloudPointBuffer raw;
+    SensorCloudSampleRate rawRate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&raw, rawData, sizeof(rawData), rawRate);
+    for(size_t i = 0; i < 64; ++i)
+        sensorCloud_addPoint(&raw, 1000 * second + i * 7 * second, float((i * 37) % 23) - 11);
+
+    sensorCloudRollup_addPoints(&rollup, &raw);
+    sensorCloudRollup_flush(&rollup);
+
+    char expectedData[sensorCloudRollup_statCount][16 + 12 * capacity];
+    SensorCloudPointBuffer expected[sensorCloudRollup_statCount];
+    SensorCloudPointBuffer* kept[sensorCloudRollup_statCount];
+    for(size_t s = 0; s < sensorCloudRollup_statCount; ++s)
+    {
+        sensorCloud_initPointBuffer(&expected[s], expectedData[s], sizeof(expectedData[s]), rate);
+        kept[s] = &expected[s];
+    }
+    SensorCloudRollup oneByOne;
+    sensorCloudRollup_init(&oneByOne, window, kept);
+    for(size_t i = 0; i < 64; ++i)
+        sensorCloudRollup_addPoint(&oneByOne, 1000 * second + i * 7 * second, float((i * 37) % 23) - 11);
+    sensorCloudRollup_flush(&oneByOne);
+
+    BOOST_CHECK_EQUAL(rollup.windows, oneByOne.windows);
+    for(size_t s = 0; s < sensorCloudRollup_statCount; ++s)
+    {
+        BOOST_REQUIRE_EQUAL(buffer_size(&outputs[s].data), buffer_size(&expected[s].data));
+        BOOST_CHECK(std::memcmp(outputs[s].data.getPtr, expected[s].data.getPtr, buffer_size(&expected[s].data)) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Flush_OutputFull)
+{
+    for(size_t i = 0; i < capacity + 2; ++i)
+        sensorCloudRollup_addPoint(&rollup, i * window, 1);
+    sensorCloudRollup_flush(&rollup);
+    BOOST_CHECK_EQUAL(rollup.windows, capacity + 2);
+    BOOST_CHECK_EQUAL(rollup.dropped, 2 * sensorCloudRollup_statCount);
+    BOOST_CHECK_EQUAL(points(sensorCloudRollup_max).size(), capacity);
+}
+
+BOOST_AUTO_TEST_CASE(Submit_KeptStats)
+{
+    EngineFixture<2> upload;
+    upload.respondCreated();
+    upload.initEngine();
+    const std::vector<SensorCloudSubmission*>& completions = upload.completions;
+
+    // only the mean and the max are uploaded
+    SensorCloudPointBuffer* kept[sensorCloudRollup_statCount] = {};
+    kept[sensorCloudRollup_max] = &outputs[sensorCloudRollup_max];
+    kept[sensorCloudRollup_mean] = &outputs[sensorCloudRollup_mean];
+    sensorCloudRollup_init(&rollup, window, kept);
+    sensorCloudRollup_addPoint(&rollup, 0, 1);
+    sensorCloudRollup_addPoint(&rollup, window, 2);
+    sensorCloudRollup_flush(&rollup);
+
+    const char* channels[sensorCloudRollup_statCount] = {"temp.min", "temp.max", "temp.mean", "temp.count",
+        "temp.last"};
+    SensorCloudSubmission submissions[sensorCloudRollup_statCount];
+    BOOST_CHECK_EQUAL(sensorCloudRollup_submit(&rollup, &upload.engine, "probe", channels, submissions, NULL), 2u);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(completions[1]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&outputs[sensorCloudRollup_max]), 2u);
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&outputs[sensorCloudRollup_min]), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
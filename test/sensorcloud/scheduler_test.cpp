@@ -0,0 +1,220 @@
+#include "fixture.h"
+
+#include <sensorcloud/backfill.h>
+#include <sensorcloud/scheduler.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const size_t maxSlots = 4;
+const size_t pointCount = 4;
+
+// the end of a backfill shows up among the completions as NULL
+void backfillCallback(void* userData, SensorCloudBackfill* backfill)
+{
+    if(!backfill->running)
+        static_cast<std::vector<SensorCloudSubmission*>*>(userData)->push_back(NULL);
+}
+
+struct Fixture : EngineFixture<maxSlots>
+{
+    SensorCloudScheduler scheduler;
+    SensorCloudSchedulerStats stats[sensorCloudPriority_classCount];
+    char pointData[16 + 12 * pointCount];
+    SensorCloudPointBuffer points;
+    std::vector<std::string> channels;
+    SensorCloudSubmission uploads[16];
+    size_t uploadCount;
+
+    Fixture() :
+    uploadCount(0)
+    {
+        respondCreated();
+
+        SensorCloudSampleRate rate;
+        rate.value = 1;
+        rate.type = sensorCloud_hertz;
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        for(size_t i = 0; i < pointCount; ++i)
+            sensorCloud_addPoint(&points, i, float(i));
+        channels.reserve(16);
+    }
+
+    void init(size_t slotCount, size_t reserved)
+    {
+        initEngine(slotCount);
+        sensorCloudScheduler_init(&scheduler, &engine, reserved);
+        sensorCloudScheduler_setStats(&scheduler, stats);
+    }
+
+    // the channel names the upload so the completions show the order
+    void submit(SensorCloudSchedulerFlow* flow, const char* channel)
+    {
+        channels.push_back(channel);
+        SensorCloudSubmission* upload = &uploads[uploadCount++];
+        sensorCloudEngine_initSubmission(upload, "sensor", channels.back().c_str(), &points, NULL);
+        sensorCloudScheduler_submit(flow, upload);
+    }
+
+    std::string completed(size_t i) const
+    {
+        return completions[i]->channel;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudSchedulerTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Critical_TakesReservedSlot)
+{
+    init(2, 1);
+    SensorCloudSchedulerFlow backfill;
+    sensorCloudScheduler_initFlow(&backfill, &scheduler, sensorCloudPriority_bulk, pointCount);
+    SensorCloudSchedulerFlow alarm;
+    sensorCloudScheduler_initFlow(&alarm, &scheduler, sensorCloudPriority_critical, pointCount);
+
+    submit(&backfill, "b1");
+    submit(&backfill, "b2");
+    submit(&backfill, "b3");
+    BOOST_CHECK_EQUAL(sensorCloudScheduler_queued(&scheduler, sensorCloudPriority_bulk), 2u);
+    submit(&alarm, "alarm");
+    BOOST_CHECK_EQUAL(sensorCloudScheduler_queued(&scheduler, sensorCloudPriority_critical), 0u);
+    BOOST_CHECK_EQUAL(scheduler.busy, 2u);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 4u);
+    // the alarm ran alongside the first backfill upload instead of after the last
+    BOOST_CHECK(completed(0) == "b1" || completed(0) == "alarm");
+    BOOST_CHECK(completed(1) == "b1" || completed(1) == "alarm");
+    BOOST_CHECK_EQUAL(completed(3), "b3");
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, 2u);
+    BOOST_CHECK_EQUAL(scheduler.busy, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Classes_InPriorityOrder)
+{
+    init(1, 0);
+    SensorCloudSchedulerFlow bulk;
+    sensorCloudScheduler_initFlow(&bulk, &scheduler, sensorCloudPriority_bulk, pointCount);
+    SensorCloudSchedulerFlow normal;
+    sensorCloudScheduler_initFlow(&normal, &scheduler, sensorCloudPriority_normal, pointCount);
+
+    submit(&bulk, "b1");
+    submit(&bulk, "b2");
+    submit(&normal, "n1");
+    submit(&normal, "n2");
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 4u);
+    BOOST_CHECK_EQUAL(completed(0), "b1");
+    BOOST_CHECK_EQUAL(completed(1), "n1");
+    BOOST_CHECK_EQUAL(completed(2), "n2");
+    BOOST_CHECK_EQUAL(completed(3), "b2");
+}
+
+BOOST_AUTO_TEST_CASE(Flows_TakeTurns)
+{
+    init(1, 0);
+    SensorCloudSchedulerFlow noisy;
+    sensorCloudScheduler_initFlow(&noisy, &scheduler, sensorCloudPriority_normal, pointCount);
+    SensorCloudSchedulerFlow quiet;
+    sensorCloudScheduler_initFlow(&quiet, &scheduler, sensorCloudPriority_normal, pointCount);
+
+    const char* noisyChannels[] = {"a1", "a2", "a3", "a4", "a5", "a6"};
+    for(size_t i = 0; i < 6; ++i)
+        submit(&noisy, noisyChannels[i]);
+    submit(&quiet, "q1");
+    submit(&quiet, "q2");
+    BOOST_CHECK_EQUAL(sensorCloudScheduler_queued(&scheduler, sensorCloudPriority_normal), 7u);
+    loopback_run();
+
+    // the noisy flow joined the round first, after that they alternate until the quiet one runs out
+    const char* expected[] = {"a1", "a2", "q1", "a3", "q2", "a4", "a5", "a6"};
+    BOOST_REQUIRE_EQUAL(completions.size(), 8u);
+    for(size_t i = 0; i < 8; ++i)
+        BOOST_CHECK_EQUAL(completed(i), expected[i]);
+}
+
+BOOST_AUTO_TEST_CASE(Flows_WeightedByQuantum)
+{
+    init(1, 0);
+    SensorCloudSchedulerFlow heavy;
+    sensorCloudScheduler_initFlow(&heavy, &scheduler, sensorCloudPriority_normal, 2 * pointCount);
+    SensorCloudSchedulerFlow light;
+    sensorCloudScheduler_initFlow(&light, &scheduler, sensorCloudPriority_normal, pointCount);
+
+    submit(&light, "l0");
+    const char* heavyChannels[] = {"h1", "h2", "h3", "h4"};
+    for(size_t i = 0; i < 4; ++i)
+        submit(&heavy, heavyChannels[i]);
+    submit(&light, "l1");
+    submit(&light, "l2");
+    loopback_run();
+
+    // two heavy uploads for each light one
+    const char* expected[] = {"l0", "h1", "h2", "l1", "h3", "h4", "l2"};
+    BOOST_REQUIRE_EQUAL(completions.size(), 7u);
+    for(size_t i = 0; i < 7; ++i)
+        BOOST_CHECK_EQUAL(completed(i), expected[i]);
+}
+
+BOOST_AUTO_TEST_CASE(Stats_PerClass)
+{
+    init(1, 0);
+    SensorCloudSchedulerFlow flow;
+    sensorCloudScheduler_initFlow(&flow, &scheduler, sensorCloudPriority_normal, pointCount);
+    submit(&flow, "n1");
+    submit(&flow, "n2");
+    submit(&flow, "n3");
+    loopback_run();
+
+    const SensorCloudSchedulerStats& normal = stats[sensorCloudPriority_normal];
+    BOOST_CHECK_EQUAL(normal.dispatched, 3u);
+    BOOST_CHECK_EQUAL(normal.maxQueued, 2u);
+    BOOST_CHECK_EQUAL(normal.wait.count, 3u);
+    // the last one waited for the two before it
+    BOOST_CHECK(normal.wait.max > normal.wait.min);
+    BOOST_CHECK_EQUAL(stats[sensorCloudPriority_bulk].dispatched, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(Stage_BackfillBehindCritical)
+{
+    init(2, 1);
+    SensorCloudSchedulerFlow bulk;
+    sensorCloudScheduler_initFlow(&bulk, &scheduler, sensorCloudPriority_bulk, pointCount);
+    SensorCloudSchedulerFlow alarm;
+    sensorCloudScheduler_initFlow(&alarm, &scheduler, sensorCloudPriority_critical, pointCount);
+    SensorCloudStage stage;
+    sensorCloudScheduler_initStage(&stage, &bulk);
+    SensorCloudBackfillRange ranges[2];
+    SensorCloudBackfill backfill;
+    sensorCloudBackfill_init(&backfill, &engine, ranges, 2, 1, backfillCallback, &completions);
+    sensorCloudBackfill_setStage(&backfill, &stage);
+
+    // a range a point, the backfill only gets the slot that isn't reserved
+    BOOST_REQUIRE_EQUAL(sensorCloudBackfill_start(&backfill, "sensor", "backfill", &points, 0), 0);
+    BOOST_CHECK_EQUAL(scheduler.busy, 1u);
+    BOOST_CHECK_EQUAL(sensorCloudScheduler_queued(&scheduler, sensorCloudPriority_bulk), 1u);
+    submit(&alarm, "alarm");
+    BOOST_CHECK_EQUAL(scheduler.busy, 2u);
+    loopback_run();
+
+    // the ranges completed to the backfill, the alarm to the callback of the engine long before the backfill ended
+    BOOST_REQUIRE_EQUAL(completions.size(), 2u);
+    BOOST_CHECK_EQUAL(completed(0), "alarm");
+    BOOST_CHECK(completions[1] == NULL);
+    BOOST_CHECK_EQUAL(backfill.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(backfill.resumePoint, pointCount);
+    BOOST_CHECK_EQUAL(backfill.rangesUploaded, pointCount);
+    BOOST_CHECK_EQUAL(stats[sensorCloudPriority_bulk].dispatched, pointCount);
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, 2u);
+    BOOST_CHECK_EQUAL(scheduler.busy, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
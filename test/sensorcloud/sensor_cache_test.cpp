@@ -0,0 +1,155 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud/engine.h>
+#include <sensorcloud/sensor_cache.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+
+const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+
+void completionCallback(void* userData, SensorCloudSubmission* submission)
+{
+    static_cast<std::vector<SensorCloudSubmission*>*>(userData)->push_back(submission);
+}
+
+struct Fixture
+{
+    SensorCloudKnownName names[8];
+    SensorCloudSensorCache cache;
+
+    Fixture()
+    {
+        sensorCloudSensorCache_init(&cache, names, 8);
+    }
+};
+
+struct EngineFixture : Fixture
+{
+    LoopbackConfig config;
+    SensorCloud sensorCloud;
+    SensorCloudEngine engine;
+    SensorCloudEngineSlot slots[3];
+    std::vector<SensorCloudSubmission*> completions;
+
+    EngineFixture()
+    {
+        loopback_defaultConfig(&config);
+        loopback_reset(&config);
+        sensorCloud_init(&sensorCloud, "device", "key", NULL);
+        sensorCloud_setSensorCache(&sensorCloud, &cache);
+        sensorCloudEngine_init(&engine, &sensorCloud, slots, 3, completionCallback, &completions);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCacheTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Add_Contains)
+{
+    BOOST_CHECK(!sensorCloudSensorCache_contains(&cache, "sensor"));
+    sensorCloudSensorCache_add(&cache, "sensor");
+    BOOST_CHECK(sensorCloudSensorCache_contains(&cache, "sensor"));
+    BOOST_CHECK(!sensorCloudSensorCache_contains(&cache, "sensorchannel"));
+    BOOST_CHECK_EQUAL(cache.hits, 1u);
+    BOOST_CHECK_EQUAL(cache.misses, 2u);
+
+    // adding again doesn't duplicate
+    sensorCloudSensorCache_add(&cache, "sensor");
+    BOOST_CHECK_EQUAL(cache.used, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Remove)
+{
+    sensorCloudSensorCache_add(&cache, "sensor");
+    sensorCloudSensorCache_add(&cache, "other");
+    sensorCloudSensorCache_remove(&cache, "sensor");
+    BOOST_CHECK(!sensorCloudSensorCache_contains(&cache, "sensor"));
+    BOOST_CHECK(sensorCloudSensorCache_contains(&cache, "other"));
+    BOOST_CHECK_EQUAL(cache.used, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Add_Full_ReplacesInTurn)
+{
+    const char* sensors[] = {"0", "1", "2", "3", "4", "5", "6", "7", "8"};
+    for(int i = 0; i < 9; ++i)
+        sensorCloudSensorCache_add(&cache, sensors[i]);
+    BOOST_CHECK_EQUAL(cache.used, 8u);
+    BOOST_CHECK(!sensorCloudSensorCache_contains(&cache, "0"));
+    BOOST_CHECK(sensorCloudSensorCache_contains(&cache, "8"));
+}
+
+BOOST_AUTO_TEST_CASE(Save_Load)
+{
+    const char* path = "/tmp/sensorcloud_sensor_cache_test";
+    std::remove(path);
+    BOOST_REQUIRE_EQUAL(sensorCloudSensorCache_load(&cache, path), 0);
+    sensorCloudSensorCache_add(&cache, "sensor");
+    sensorCloudSensorCache_add(&cache, "other");
+
+    SensorCloudKnownName loadedNames[8];
+    SensorCloudSensorCache loaded;
+    sensorCloudSensorCache_init(&loaded, loadedNames, 8);
+    BOOST_REQUIRE_EQUAL(sensorCloudSensorCache_load(&loaded, path), 0);
+    BOOST_CHECK_EQUAL(loaded.used, 2u);
+    BOOST_CHECK(sensorCloudSensorCache_contains(&loaded, "sensor"));
+    BOOST_CHECK(sensorCloudSensorCache_contains(&loaded, "other"));
+    std::remove(path);
+}
+
+BOOST_FIXTURE_TEST_CASE(Provision_Concurrent, EngineFixture)
+{
+    const char* sensors[] = {"a", "b", "c"};
+    SensorCloudSubmission submissions[3];
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    sensorCloudEngine_provision(&engine, submissions, sensors, 3, NULL);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 3u);
+    for(size_t i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL(completions[i]->error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4u);
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, 3u);
+    for(size_t i = 0; i < 3; ++i)
+        BOOST_CHECK(sensorCloudSensorCache_contains(&cache, sensors[i]));
+
+    // known sensors complete without a request
+    completions.clear();
+    sensorCloudEngine_provision(&engine, submissions, sensors, 3, NULL);
+    BOOST_CHECK_EQUAL(completions.size(), 3u);
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 0u);
+    BOOST_CHECK_EQUAL(loopback_run(), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(Upload_NotFound_UpdatesCache, EngineFixture)
+{
+    sensorCloudSensorCache_add(&cache, "sensor");
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_queueResponse(404, "Not Found", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+    loopback_queueResponse(201, "Created", NULL, 0, 0);
+
+    SensorCloudPointBuffer points;
+    char pointData[16 + 12];
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+    sensorCloud_addPoint(&points, 1, 1.0f);
+    SensorCloudSubmission submission;
+    sensorCloudEngine_initSubmission(&submission, "sensor", "other", &points, NULL);
+    sensorCloudEngine_submit(&engine, &submission);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0]->error, sensorCloud_ok);
+    // forgotten on the 404, known again once it was created
+    BOOST_CHECK(sensorCloudSensorCache_contains(&cache, "sensor"));
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
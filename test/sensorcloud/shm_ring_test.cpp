@@ -0,0 +1,233 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud/shm_ring.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+
+void uploadCallback(void* userData, SensorCloudError error)
+{
+    *static_cast<SensorCloudError*>(userData) = error;
+}
+
+// a writer and a reader view of the same named ring, as two processes would have
+struct Fixture
+{
+    char name[64];
+    SensorCloudShmRing writer;
+    SensorCloudShmRing reader;
+    SensorCloudShmChannel channels[4];
+
+    Fixture()
+    {
+        std::sprintf(name, "/sensorcloud-test-%d", int(getpid()));
+        open(256);
+    }
+
+    ~Fixture()
+    {
+        close();
+    }
+
+    void open(uint32_t size)
+    {
+        BOOST_REQUIRE_EQUAL(sensorCloudShmRing_create(&writer, name, size), 0);
+        BOOST_REQUIRE_EQUAL(sensorCloudShmRing_open(&reader, name), 0);
+        sensorCloudShmRing_initReader(&reader, channels, 4);
+    }
+
+    void close()
+    {
+        sensorCloudShmRing_close(&writer);
+        sensorCloudShmRing_close(&reader);
+        shm_unlink(name);
+    }
+
+    int write(uint32_t channelId, Timestamp first, size_t count)
+    {
+        SensorCloudPointBuffer points;
+        if(sensorCloudShmRing_reserve(&writer, channelId, count, &points) != 0)
+            return 1;
+        for(size_t i = 0; i < count; ++i)
+            sensorCloud_addPoint(&points, first + i, float(first + i));
+        sensorCloudShmRing_commit(&writer, &points);
+        return 0;
+    }
+
+    std::vector<Timestamp> times(const SensorCloudShmRecord& record)
+    {
+        std::vector<Timestamp> result(64);
+        std::vector<float> values(64);
+        SensorCloudPointDecoder decoder;
+        sensorCloud_initPointDecoder(&decoder, &result[0], &values[0], 64);
+        sensorCloud_decodePoints(&decoder, record.points.data.getPtr + 16, buffer_size(&record.points.data) - 16);
+        result.resize(decoder.count);
+        for(size_t i = 0; i < decoder.count; ++i)
+            BOOST_CHECK_EQUAL(values[i], float(result[i]));
+        return result;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudShmRingTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Read_Registered)
+{
+    SensorCloudSampleRate rate = {10, sensorCloud_hertz};
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_register(&writer, 2, "sensor", "channel", rate), 0);
+    BOOST_REQUIRE_EQUAL(write(2, 100, 3), 0);
+    // not registered
+    BOOST_REQUIRE_EQUAL(write(1, 200, 1), 0);
+
+    SensorCloudShmRecord record;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_read(&reader, &record), 0);
+    BOOST_CHECK_EQUAL(record.channelId, 2u);
+    BOOST_CHECK_EQUAL(record.channel->sensor, "sensor");
+    BOOST_CHECK_EQUAL(record.channel->channel, "channel");
+    BOOST_CHECK_EQUAL(sensorCloud_pointCount(&record.points), 3u);
+    std::vector<Timestamp> recordTimes = times(record);
+    BOOST_REQUIRE_EQUAL(recordTimes.size(), 3u);
+    BOOST_CHECK_EQUAL(recordTimes[0], 100u);
+    BOOST_CHECK_EQUAL(recordTimes[2], 102u);
+    // the sample rate words of the point buffer header
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(record.points.data.getPtr);
+    BOOST_CHECK_EQUAL(header[7], unsigned(sensorCloud_hertz));
+    BOOST_CHECK_EQUAL(header[11], 10u);
+
+    BOOST_CHECK(sensorCloudShmRing_read(&reader, &record) != 0);
+    BOOST_CHECK_EQUAL(reader.unregistered, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Reserve_FullUntilReleased)
+{
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloudShmRing_register(&writer, 0, "s", "c", rate);
+    size_t written = 0;
+    while(write(0, written, 4) == 0)
+        ++written;
+    BOOST_REQUIRE(written > 0);
+
+    SensorCloudShmRecord first;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_read(&reader, &first), 0);
+    SensorCloudShmRecord second;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_read(&reader, &second), 0);
+    BOOST_CHECK(write(0, 0, 4) != 0);
+
+    // the room is given back once the first record is released, along with the registration before it
+    sensorCloudShmRing_release(&reader, &first);
+    BOOST_CHECK_EQUAL(write(0, 0, 4), 0);
+    sensorCloudShmRing_release(&reader, &second);
+}
+
+BOOST_AUTO_TEST_CASE(Write_WrapsAround)
+{
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloudShmRing_register(&writer, 3, "s", "c", rate);
+    // records of 8 + 4 + 16 + 12 * 5 bytes don't divide the ring, so the end of the ring gets padded
+    Timestamp next = 0;
+    for(size_t i = 0; i < 20; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(write(3, i * 5, 5), 0);
+        SensorCloudShmRecord record;
+        BOOST_REQUIRE_EQUAL(sensorCloudShmRing_read(&reader, &record), 0);
+        std::vector<Timestamp> recordTimes = times(record);
+        BOOST_REQUIRE_EQUAL(recordTimes.size(), 5u);
+        for(size_t j = 0; j < 5; ++j)
+            BOOST_CHECK_EQUAL(recordTimes[j], next++);
+        sensorCloudShmRing_release(&reader, &record);
+    }
+    BOOST_CHECK_EQUAL(reader.records, 20u);
+}
+
+BOOST_AUTO_TEST_CASE(Upload_FromRing)
+{
+    LoopbackConfig config;
+    loopback_defaultConfig(&config);
+    loopback_reset(&config);
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    sensorCloudShmRing_register(&writer, 0, "sensor", "channel", rate);
+    write(0, 1, 2);
+    SensorCloudShmRecord record;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_read(&reader, &record), 0);
+
+    SensorCloudError error = sensorCloud_badRequest;
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", &error);
+    sensorCloud_asyncUploadData(&sensorCloud, record.channel->sensor, record.channel->channel, &record.points,
+        uploadCallback);
+    loopback_run();
+    BOOST_CHECK_EQUAL(error, sensorCloud_ok);
+
+    // the body went out of the ring, the upload filled in the point count where it lies
+    size_t headSize;
+    const char* head = loopback_lastRequest(&headSize);
+    char contentLength[32];
+    std::sprintf(contentLength, "Content-Length: %u", unsigned(buffer_size(&record.points.data)));
+    BOOST_CHECK(std::string(head, headSize).find(contentLength) != std::string::npos);
+    BOOST_CHECK_EQUAL(static_cast<unsigned char>(record.points.data.getPtr[15]), 2u);
+    sensorCloudShmRing_release(&reader, &record);
+}
+
+BOOST_AUTO_TEST_CASE(Wait_WokenOnlyFromEmpty)
+{
+    BOOST_CHECK(sensorCloudShmRing_wait(&reader, 10) != 0);
+
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    std::thread producer([this, rate]
+    {
+        usleep(20000);
+        sensorCloudShmRing_register(&writer, 0, "s", "c", rate);
+        write(0, 0, 1);
+    });
+    BOOST_CHECK_EQUAL(sensorCloudShmRing_wait(&reader, 5000), 0);
+    producer.join();
+    BOOST_CHECK_EQUAL(writer.wakeups, 1u);
+
+    // nobody waiting, no system call
+    write(0, 1, 1);
+    BOOST_CHECK_EQUAL(writer.wakeups, 1u);
+    SensorCloudShmRecord record;
+    BOOST_CHECK_EQUAL(sensorCloudShmRing_read(&reader, &record), 0);
+}
+
+BOOST_AUTO_TEST_CASE(Attach_Memfd)
+{
+    SensorCloudShmRing anonymous;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_create(&anonymous, NULL, 128), 0);
+    SensorCloudShmRing other;
+    // as received over a Unix socket
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_attach(&other, dup(anonymous.fd)), 0);
+    sensorCloudShmRing_initReader(&other, channels, 4);
+
+    SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_register(&anonymous, 0, "s", "c", rate), 0);
+    SensorCloudPointBuffer points;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_reserve(&anonymous, 0, 1, &points), 0);
+    sensorCloud_addPoint(&points, 7, 7.0f);
+    sensorCloudShmRing_commit(&anonymous, &points);
+
+    SensorCloudShmRecord record;
+    BOOST_REQUIRE_EQUAL(sensorCloudShmRing_read(&other, &record), 0);
+    BOOST_CHECK_EQUAL(times(record)[0], 7u);
+    BOOST_CHECK(sensorCloudShmRing_create(&other, NULL, 100) != 0);
+    sensorCloudShmRing_close(&other);
+    sensorCloudShmRing_close(&anonymous);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
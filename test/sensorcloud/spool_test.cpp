@@ -0,0 +1,172 @@
+#include "fixture.h"
+
+#include <sensorcloud/spool.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char directory[] = "/tmp/sensorcloud_spool_test";
+
+size_t segmentFiles()
+{
+    size_t count = 0;
+    DIR* dir = opendir(directory);
+    while(struct dirent* entry = readdir(dir))
+        count += std::string(entry->d_name).compare(0, 6, "spool-") == 0;
+    closedir(dir);
+    return count;
+}
+
+struct Fixture
+{
+    SensorCloudSpoolSegment segments[4];
+    SensorCloudSpool spool;
+    SensorCloudPointBuffer points;
+    char pointData[16 + 12 * 10];
+
+    Fixture()
+    {
+        mkdir(directory, 0755);
+        clear();
+        BOOST_REQUIRE_EQUAL(sensorCloudSpool_open(&spool, segments, 4, directory, 4096), 0);
+    }
+
+    ~Fixture()
+    {
+        sensorCloudSpool_close(&spool);
+        clear();
+    }
+
+    void clear()
+    {
+        DIR* dir = opendir(directory);
+        while(struct dirent* entry = readdir(dir))
+            unlink((std::string(directory) + "/" + entry->d_name).c_str());
+        closedir(dir);
+    }
+
+    void reopen(size_t segmentSize = 4096)
+    {
+        sensorCloudSpool_close(&spool);
+        BOOST_REQUIRE_EQUAL(sensorCloudSpool_open(&spool, segments, 4, directory, segmentSize), 0);
+    }
+
+    int append(const char* channel, size_t pointCount)
+    {
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        for(size_t i = 0; i < pointCount; ++i)
+            sensorCloud_addPoint(&points, i, float(i));
+        return sensorCloudSpool_append(&spool, "sensor", channel, &points);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(SensorCloudSpoolTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Append_Reopen_ReadsBack)
+{
+    BOOST_REQUIRE_EQUAL(append("a", 1), 0);
+    BOOST_REQUIRE_EQUAL(append("b", 2), 0);
+    BOOST_REQUIRE_EQUAL(append("c", 3), 0);
+    reopen();
+    BOOST_CHECK_EQUAL(spool.pending, 3u);
+    BOOST_CHECK_EQUAL(spool.corrupt, 0u);
+
+    SensorCloudSpoolCursor cursor;
+    sensorCloudSpool_rewind(&spool, &cursor);
+    SensorCloudSpoolRecord record;
+    const char* channels[] = {"a", "b", "c"};
+    for(size_t i = 0; i < 3; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(sensorCloudSpool_read(&spool, &cursor, &record), 0);
+        BOOST_CHECK_EQUAL(record.sensor, "sensor");
+        BOOST_CHECK_EQUAL(record.channel, channels[i]);
+        BOOST_CHECK_EQUAL(record.bodySize, 16 + 12 * (i + 1));
+        // the point count in the header was filled in
+        BOOST_CHECK_EQUAL(record.body[15], char(i + 1));
+    }
+    BOOST_CHECK(sensorCloudSpool_read(&spool, &cursor, &record) != 0);
+}
+
+BOOST_AUTO_TEST_CASE(Append_Rotates_UntilFull)
+{
+    // a record of 10 points takes 168 bytes, 2 of them fit in a segment
+    reopen(16 + 2 * 168);
+    for(size_t i = 0; i < 8; ++i)
+        BOOST_REQUIRE_EQUAL(append("a", 10), 0);
+    BOOST_CHECK_EQUAL(spool.segmentCount, 4u);
+    BOOST_CHECK_EQUAL(segmentFiles(), 4u);
+    BOOST_CHECK(append("a", 10) != 0);
+    BOOST_CHECK_EQUAL(spool.pending, 8u);
+}
+
+BOOST_AUTO_TEST_CASE(Open_TornRecord_Dropped)
+{
+    BOOST_REQUIRE_EQUAL(append("a", 1), 0);
+    BOOST_REQUIRE_EQUAL(append("b", 1), 0);
+    // damage a point of the second record
+    segments[0].data[segments[0].end - 4] ^= 0x55;
+    reopen();
+    BOOST_CHECK_EQUAL(spool.pending, 1u);
+    BOOST_CHECK_EQUAL(spool.corrupt, 1u);
+
+    BOOST_REQUIRE_EQUAL(append("c", 1), 0);
+    SensorCloudSpoolCursor cursor;
+    sensorCloudSpool_rewind(&spool, &cursor);
+    SensorCloudSpoolRecord record;
+    BOOST_REQUIRE_EQUAL(sensorCloudSpool_read(&spool, &cursor, &record), 0);
+    BOOST_CHECK_EQUAL(record.channel, "a");
+    BOOST_REQUIRE_EQUAL(sensorCloudSpool_read(&spool, &cursor, &record), 0);
+    BOOST_CHECK_EQUAL(record.channel, "c");
+}
+
+BOOST_AUTO_TEST_CASE(Drain_UploadsAndTruncates)
+{
+    EngineFixture<2> upload;
+    upload.initEngine();
+    SensorCloudSpoolDrain drains[3];
+    SensorCloudSpoolDrainer drainer;
+    sensorCloudSpoolDrainer_init(&drainer, &spool, &upload.engine, drains, 3);
+
+    reopen(16 + 2 * 168);
+    const char* channels[] = {"a", "b", "c", "d", "e", "f", "g"};
+    for(size_t i = 0; i < 7; ++i)
+        BOOST_REQUIRE_EQUAL(append(channels[i], 10), 0);
+    BOOST_REQUIRE_EQUAL(spool.segmentCount, 4u);
+
+    // the network is down
+    loopback_refuseConnections(1);
+    sensorCloudSpoolDrainer_start(&drainer);
+    loopback_run();
+    BOOST_CHECK(!drainer.running);
+    BOOST_CHECK_EQUAL(drainer.lastError, sensorCloud_netError);
+    BOOST_CHECK_EQUAL(spool.pending, 7u);
+
+    // and back
+    upload.respondCreated();
+    sensorCloudSpoolDrainer_start(&drainer);
+    loopback_run();
+    BOOST_CHECK(!drainer.running);
+    BOOST_CHECK_EQUAL(drainer.uploaded, 7u);
+    BOOST_CHECK_EQUAL(spool.pending, 0u);
+    BOOST_CHECK_EQUAL(loopback_stats().maxOpenConnections, 2u);
+    // only the segment being appended to is left
+    BOOST_CHECK_EQUAL(segmentFiles(), 1u);
+
+    reopen(16 + 2 * 168);
+    BOOST_CHECK_EQUAL(spool.pending, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,324 @@
+#include <net/loopback_driver.h>
+#include <sensorcloud/engine.h>
+#include <sensorcloud/token_store.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+uint64_t now;
+
+uint64_t fakeClock()
+{
+    return now;
+}
+
+struct UploadResult
+{
+    SensorCloudError error;
+    int calls;
+
+    UploadResult() : error(sensorCloud_badRequest), calls(0) {}
+};
+
+void uploadCallback(void* userData, SensorCloudError error)
+{
+    UploadResult* result = static_cast<UploadResult*>(userData);
+    result->error = error;
+    ++result->calls;
+}
+
+void completionCallback(void* userData, SensorCloudSubmission* submission)
+{
+    static_cast<std::vector<SensorCloudError>*>(userData)->push_back(submission->error);
+}
+
+struct Fixture
+{
+    LoopbackConfig config;
+    SensorCloudTokenEntry entries[4];
+    SensorCloudTokenStore store;
+    SensorCloudPointBuffer points;
+    char pointData[16 + 12];
+
+    Fixture()
+    {
+        now = 1000;
+        loopback_defaultConfig(&config);
+        config.writeLatency = 10;
+        loopback_reset(&config);
+        loopback_setDefaultResponse(created, sizeof(created) - 1);
+        sensorCloudTokenStore_init(&store, entries, 4, 100, fakeClock);
+
+        SensorCloudSampleRate rate = {1, sensorCloud_hertz};
+        sensorCloud_initPointBuffer(&points, pointData, sizeof(pointData), rate);
+        sensorCloud_addPoint(&points, 1, 1.0f);
+    }
+
+    void upload(SensorCloud* sensorCloud, UploadResult* result)
+    {
+        sensorCloud_init(sensorCloud, "device", "key", result);
+        sensorCloud_setTokenStore(sensorCloud, &store);
+        sensorCloud_asyncUploadData(sensorCloud, "sensor", "channel", &points, uploadCallback);
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(TokenStoreTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(Put_State)
+{
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, sensorCloudTokenStore_find(&store, "device")),
+        sensorCloudToken_missing);
+    BOOST_REQUIRE_EQUAL(sensorCloudTokenStore_put(&store, "device", "token", 5, "server", 6), 0);
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(&store, "device");
+    BOOST_REQUIRE(entry);
+    BOOST_CHECK_EQUAL(entry->token, "token");
+    BOOST_CHECK_EQUAL(entry->server, "server");
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, entry), sensorCloudToken_fresh);
+    now += 80;
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, entry), sensorCloudToken_refresh);
+    now += 20;
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, entry), sensorCloudToken_expired);
+    sensorCloudTokenStore_invalidate(&store, "device");
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, entry), sensorCloudToken_missing);
+}
+
+BOOST_AUTO_TEST_CASE(Put_Full_ReplacesOldest)
+{
+    const char* devices[] = {"a", "b", "c", "d"};
+    for(int i = 0; i < 4; ++i)
+    {
+        sensorCloudTokenStore_put(&store, devices[i], "token", 5, "server", 6);
+        ++now;
+    }
+    sensorCloudTokenStore_put(&store, "e", "token", 5, "server", 6);
+    BOOST_CHECK(sensorCloudTokenStore_find(&store, "a") == NULL);
+    BOOST_CHECK(sensorCloudTokenStore_find(&store, "b"));
+    BOOST_CHECK(sensorCloudTokenStore_find(&store, "e"));
+}
+
+BOOST_AUTO_TEST_CASE(Serialize_RoundTrip)
+{
+    sensorCloudTokenStore_put(&store, "device", "token", 5, "server", 6);
+    sensorCloudTokenStore_put(&store, "other", "token2", 6, "server2", 7);
+    sensorCloudTokenStore_invalidate(&store, "other");
+    char data[1024];
+    Buffer buffer;
+    buffer_init(&buffer, data, sizeof(data));
+    BOOST_REQUIRE_EQUAL(sensorCloudTokenStore_serialize(&store, &buffer), 0);
+
+    SensorCloudTokenEntry loadedEntries[4];
+    SensorCloudTokenStore loaded;
+    sensorCloudTokenStore_init(&loaded, loadedEntries, 4, 100, fakeClock);
+    BOOST_REQUIRE_EQUAL(sensorCloudTokenStore_deserialize(&loaded, &buffer), 0);
+    BOOST_CHECK_EQUAL(loaded.used, 1u);
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(&loaded, "device");
+    BOOST_REQUIRE(entry);
+    BOOST_CHECK_EQUAL(entry->token, "token");
+    BOOST_CHECK_EQUAL(entry->server, "server");
+    BOOST_CHECK_EQUAL(entry->obtained, 1000u);
+
+    // truncated data is rejected
+    buffer_init(&buffer, data, sizeof(data));
+    sensorCloudTokenStore_serialize(&store, &buffer);
+    buffer.putPtr -= 4;
+    BOOST_CHECK(sensorCloudTokenStore_deserialize(&loaded, &buffer) != 0);
+}
+
+BOOST_AUTO_TEST_CASE(Load_FirstUploadSkipsAuthenticate)
+{
+    std::string path = "/tmp/sensorcloud_token_store_test";
+    std::remove(path.c_str());
+    // times from net_time don't carry over to the next boot
+    SensorCloudTokenEntry bootEntries[4];
+    SensorCloudTokenStore boot;
+    sensorCloudTokenStore_init(&boot, bootEntries, 4, 100, NULL);
+    BOOST_CHECK(sensorCloudTokenStore_load(&boot, path.c_str()) != 0);
+    BOOST_CHECK(boot.path == NULL);
+    BOOST_REQUIRE_EQUAL(sensorCloudTokenStore_load(&store, path.c_str()), 0);
+
+    // the first process authenticates, the token is saved once it asks for it
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    SensorCloud first;
+    UploadResult firstResult;
+    upload(&first, &firstResult);
+    loopback_run();
+    BOOST_CHECK_EQUAL(firstResult.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 2u);
+    BOOST_CHECK_EQUAL(store.dirty, 1u);
+    BOOST_CHECK(std::ifstream(path.c_str()).fail());
+    BOOST_REQUIRE_EQUAL(sensorCloudTokenStore_save(&store), 0);
+    BOOST_CHECK_EQUAL(store.dirty, 0u);
+    BOOST_CHECK(!std::ifstream(path.c_str()).fail());
+
+    // the next one starts with it
+    loopback_reset(&config);
+    loopback_setDefaultResponse(created, sizeof(created) - 1);
+    SensorCloudTokenEntry loadedEntries[4];
+    SensorCloudTokenStore loaded;
+    sensorCloudTokenStore_init(&loaded, loadedEntries, 4, 100, fakeClock);
+    BOOST_REQUIRE_EQUAL(sensorCloudTokenStore_load(&loaded, path.c_str()), 0);
+    SensorCloud second;
+    UploadResult secondResult;
+    sensorCloud_init(&second, "device", "key", &secondResult);
+    sensorCloud_setTokenStore(&second, &loaded);
+    sensorCloud_asyncUploadData(&second, "sensor", "channel", &points, uploadCallback);
+    loopback_run();
+    BOOST_CHECK_EQUAL(secondResult.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 1u);
+    BOOST_CHECK_EQUAL(loaded.authentications, 0u);
+    size_t headSize;
+    const char* data = loopback_lastRequest(&headSize);
+    std::string head(data, headSize);
+    BOOST_CHECK(head.find("auth_token=token") != std::string::npos);
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Authenticate_SingleFlight)
+{
+    loopback_queueAuthResponse("token", "upload.example.com", 0);
+    SensorCloud contexts[3];
+    UploadResult results[3];
+    for(int i = 0; i < 3; ++i)
+        upload(&contexts[i], &results[i]);
+    loopback_run();
+
+    for(int i = 0; i < 3; ++i)
+    {
+        BOOST_CHECK_EQUAL(results[i].calls, 1);
+        BOOST_CHECK_EQUAL(results[i].error, sensorCloud_ok);
+    }
+    BOOST_CHECK_EQUAL(store.authentications, 1u);
+    BOOST_CHECK_EQUAL(store.coalesced, 2u);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 4u);
+}
+
+BOOST_AUTO_TEST_CASE(Authenticate_SingleFlight_FailureFansOut)
+{
+    loopback_queueResponse(401, "Unauthorized", NULL, 0, 0);
+    SensorCloud contexts[2];
+    UploadResult results[2];
+    for(int i = 0; i < 2; ++i)
+        upload(&contexts[i], &results[i]);
+    loopback_run();
+
+    for(int i = 0; i < 2; ++i)
+        BOOST_CHECK_EQUAL(results[i].error, sensorCloud_unauthorized);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Refresh_ServerError_KeepsToken)
+{
+    sensorCloudTokenStore_put(&store, "device", "old", 3, "upload.example.com", 18);
+    now += 85;
+    loopback_queueResponse(503, "Service Unavailable", NULL, 0, 0);
+    SensorCloud sensorCloud;
+    UploadResult result;
+    upload(&sensorCloud, &result);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_ok);
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, sensorCloudTokenStore_find(&store, "device")),
+        sensorCloudToken_refresh);
+    size_t headSize;
+    const char* data = loopback_lastRequest(&headSize);
+    std::string head(data, headSize);
+    BOOST_CHECK(head.find("auth_token=old") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Refresh_Unauthorized_Invalidates)
+{
+    sensorCloudTokenStore_put(&store, "device", "old", 3, "upload.example.com", 18);
+    now += 85;
+    loopback_queueResponse(401, "Unauthorized", NULL, 0, 0);
+    SensorCloud sensorCloud;
+    UploadResult result;
+    upload(&sensorCloud, &result);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_unauthorized);
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, sensorCloudTokenStore_find(&store, "device")),
+        sensorCloudToken_missing);
+    BOOST_CHECK_EQUAL(loopback_stats().requests, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(Engine_RefreshesAlongsideUploads)
+{
+    sensorCloudTokenStore_put(&store, "device", "old", 3, "upload.example.com", 18);
+    now += 85;
+    loopback_queueAuthResponse("new", "upload.example.com", 0);
+
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", NULL);
+    sensorCloud_setTokenStore(&sensorCloud, &store);
+    SensorCloudEngineSlot slots[2];
+    SensorCloudEngine engine;
+    std::vector<SensorCloudError> completions;
+    sensorCloudEngine_init(&engine, &sensorCloud, slots, 2, completionCallback, &completions);
+    SensorCloudSubmission submission;
+    sensorCloudEngine_initSubmission(&submission, "sensor", "channel", &points, NULL);
+    sensorCloudEngine_submit(&engine, &submission);
+    // the upload didn't wait for the refresh
+    BOOST_CHECK_EQUAL(sensorCloudEngine_pending(&engine), 1u);
+    BOOST_CHECK_EQUAL(engine.active, 1u);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0], sensorCloud_ok);
+    SensorCloudTokenEntry* entry = sensorCloudTokenStore_find(&store, "device");
+    BOOST_CHECK_EQUAL(entry->token, "new");
+    BOOST_CHECK_EQUAL(entry->obtained, 1085u);
+    BOOST_CHECK_EQUAL(sensorCloud_tokenState(&sensorCloud), sensorCloudToken_fresh);
+}
+
+BOOST_AUTO_TEST_CASE(Engine_ExpiredWaitsForAuthenticate)
+{
+    sensorCloudTokenStore_put(&store, "device", "old", 3, "upload.example.com", 18);
+    now += 100;
+    loopback_queueAuthResponse("new", "upload.example.com", 0);
+
+    SensorCloud sensorCloud;
+    sensorCloud_init(&sensorCloud, "device", "key", NULL);
+    sensorCloud_setTokenStore(&sensorCloud, &store);
+    SensorCloudEngineSlot slots[2];
+    SensorCloudEngine engine;
+    std::vector<SensorCloudError> completions;
+    sensorCloudEngine_init(&engine, &sensorCloud, slots, 2, completionCallback, &completions);
+    SensorCloudSubmission submission;
+    sensorCloudEngine_initSubmission(&submission, "sensor", "channel", &points, NULL);
+    sensorCloudEngine_submit(&engine, &submission);
+    BOOST_CHECK_EQUAL(engine.active, 0u);
+    loopback_run();
+
+    BOOST_REQUIRE_EQUAL(completions.size(), 1u);
+    BOOST_CHECK_EQUAL(completions[0], sensorCloud_ok);
+    size_t headSize;
+    const char* data = loopback_lastRequest(&headSize);
+    std::string head(data, headSize);
+    BOOST_CHECK(head.find("auth_token=new") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Upload_Unauthorized_Invalidates)
+{
+    sensorCloudTokenStore_put(&store, "device", "old", 3, "upload.example.com", 18);
+    loopback_queueResponse(401, "Unauthorized", NULL, 0, 0);
+    SensorCloud sensorCloud;
+    UploadResult result;
+    upload(&sensorCloud, &result);
+    loopback_run();
+
+    BOOST_CHECK_EQUAL(result.error, sensorCloud_unauthorized);
+    BOOST_CHECK_EQUAL(sensorCloudTokenStore_state(&store, sensorCloudTokenStore_find(&store, "device")),
+        sensorCloudToken_missing);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
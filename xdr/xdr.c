@@ -190,3 +190,28 @@ BufferError ICACHE_FLASH_ATTR xdr_writeString(Buffer* buffer, const char* value,
     memcpy(buffer->putPtr, value, size);
     return buffer_commit(buffer, lineSize);
 }
+
+BufferError ICACHE_FLASH_ATTR xdr_readCString(char* value, size_t size, Buffer* buffer)
+{
+    uint32_t stringSize;
+    if(buffer_size(buffer) < 4)
+        return buffer_overrun;
+    const char* start = buffer->getPtr;
+    xdr_readUInt(&stringSize, buffer);
+    if(stringSize >= size || xdr_readString(value, stringSize, buffer) != buffer_ok)
+    { // leave the buffer as it was
+        buffer->getPtr = start;
+        return buffer_overrun;
+    }
+    value[stringSize] = '\0';
+    return buffer_ok;
+}
+
+BufferError ICACHE_FLASH_ATTR xdr_writeCString(Buffer* buffer, const char* value)
+{
+    size_t size = strlen(value);
+    if(buffer_bytesAvailable(buffer) < 4 + xdr_lineSize(size))
+        return buffer_overrun;
+    xdr_writeUInt(buffer, size);
+    return xdr_writeString(buffer, value, size);
+}
@@ -5,6 +5,17 @@
 
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Convert between host and XDR byte order.
+uint32_t xdr_endianUint(uint32_t v);
+uint64_t xdr_endianUhyper(uint64_t v);
+
+// Number of bytes size bytes of opaque data or string take up once padded.
+size_t xdr_lineSize(size_t size);
+
 BufferError xdr_readUInt(uint32_t* value, Buffer* buffer);
 
 BufferError xdr_readInt(int32_t* value, Buffer* buffer);
@@ -19,6 +30,9 @@ BufferError xdr_readDouble(double* value, Buffer* buffer);
 
 BufferError xdr_readString(char* value, size_t size, Buffer* buffer);
 
+// Read a length prefixed string into a null terminated one holding at most size - 1 characters.
+BufferError xdr_readCString(char* value, size_t size, Buffer* buffer);
+
 BufferError xdr_writeInt(Buffer* buffer, int32_t value);
 
 BufferError xdr_writeUInt(Buffer* buffer, uint32_t value);
@@ -33,4 +47,11 @@ BufferError xdr_writeDouble(Buffer* buffer, double value);
 
 BufferError xdr_writeString(Buffer* buffer, const char* value, size_t size);
 
+// Write a null terminated string with its length prefixed.
+BufferError xdr_writeCString(Buffer* buffer, const char* value);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif